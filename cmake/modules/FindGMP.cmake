@@ -34,7 +34,7 @@
 #ENDIF(GMP_INCLUDE_DIR AND GMP_LIBRARIES)
 
 FIND_PATH(GMP_INCLUDE_DIR NAMES gmpxx.h)
-FIND_LIBRARY(GMP_LIBRARIES NAMES libgmpxx)
+FIND_LIBRARY(GMP_LIBRARIES NAMES gmpxx libgmpxx)
 
 INCLUDE(FindPackageHandleStandardArgs)
 
@@ -68,6 +68,15 @@ int main(int argc, char* argv[]) {
     // (The first 500 generations of Edna get processed in under a second though)
     QuadTreeTests::RunRLEPatternTest("../patterns/edna.rle", 500, INT64_MIN, INT64_MIN, false);
 
+    // Edna again, but jumping to the end of its lifespan with HashLife power of 2 steps
+    QuadTreeTests::RunRLEPatternJumpTest("../patterns/edna.rle", 31192, INT64_MIN, INT64_MIN, false);
+
+    // Glider jumping 2^40 generations, which only takes a few nodes per level because it repeats
+    QuadTreeTests::RunRLEPatternJumpTest("../patterns/glider.rle", UINT64_C(1) << 40, 0, 0, true);
+
+    // Puffer in trees that share a node store and in trees with their own stores on separate threads
+    QuadTreeTests::RunNodeStoreTest("../patterns/puffer1.rle", 2000);
+
     // STRESS TEST: Generate cells in a signed 64 bit range with boundaries and generations clamped
     QuadTreeTests::RunMegaRandomMaxBoundariesTest(1000, 100, MinPowerOf2(6), MaxPowerOf2(6), MinPowerOf2(6), MaxPowerOf2(6), false);
 
@@ -79,6 +88,68 @@ int main(int argc, char* argv[]) {
     // This is commented out because it's slow
     //QuadTreeTests::RunMegaRandomMaxBoundariesTest(MaxPowerOf2(12) * MaxPowerOf2(12), 1, MinPowerOf2(12), MaxPowerOf2(12), MinPowerOf2(12), MaxPowerOf2(12), false);
 
+    // BENCHMARK: Compare our canonical node table with the old std::unordered_map, using a 2048x2048 soup that
+    // evolves to a couple million nodes
+    QuadTreeTests::RunNodeTableBenchmark(MaxPowerOf2(11) * MaxPowerOf2(11), 10, MinPowerOf2(11), MaxPowerOf2(11), MinPowerOf2(11), MaxPowerOf2(11));
+
+    // BENCHMARK: Build a 2048x2048 soup with the bulk loader and one cell at a time
+    QuadTreeTests::RunBulkLoadBenchmark(MaxPowerOf2(11) * MaxPowerOf2(11), MinPowerOf2(11), MaxPowerOf2(11), MinPowerOf2(11), MaxPowerOf2(11));
+
+    // BENCHMARK: Evolve a 2048x2048 soup with more and more threads, and make sure we always get the serial result
+    QuadTreeTests::RunThreadScalingBenchmark(MaxPowerOf2(11) * MaxPowerOf2(11), 20, MinPowerOf2(11), MaxPowerOf2(11), MinPowerOf2(11), MaxPowerOf2(11));
+
+    // STRESS TEST: Fill a 16384x16384 square with about 100 million random cells straight into the tree. Evolving it
+    // takes gigabytes, so we only build it
+    QuadTreeTests::RunRandomSoupTest(MinPowerOf2(14), MaxPowerOf2(14), MinPowerOf2(14), MaxPowerOf2(14), 0.375, 1, 0);
+
+    // BENCHMARK: Evolve a 1024x1024 soup through a few garbage collections, stopping the world, incrementally and
+    // with a concurrent sweep, and compare the slowest steps
+    QuadTreeTests::RunCollectionLatencyTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 3000);
+
+    // STRESS TEST: Jump a 1024x1024 soup 4096 generations in a single step, with and without a limit of 400k nodes,
+    // which the store keeps to by collecting garbage in the middle of the step
+    QuadTreeTests::RunMemoryPressureTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 12, 400000);
+
+    // BENCHMARK: Run the Gosper glider gun for 2^20 generations, 1024 at a time, with and without a 1MB memo budget. The
+    // budget keeps the gun's results from one step to the next, where a plain collection throws them away
+    QuadTreeTests::RunMemoBudgetTest("../patterns/gosperglidergun.rle", UINT64_C(1) << 20, 10, 1 << 20);
+
+    // BENCHMARK: Evolve a 512x512 soup for 3000 generations with and without compacting after every collection, which
+    // puts the nodes that are left next to each other and gives the rest of the arenas back
+    QuadTreeTests::RunCompactionTest(MinPowerOf2(9), MaxPowerOf2(9), MinPowerOf2(9), MaxPowerOf2(9), 0.375, 1, 3000);
+
+    // BENCHMARK: Export the alive cells of a 2048x2048 soup into flat arrays a chunk at a time, against building a
+    // display list, and read blocks 2^63 apart back out of a tree taller than 64 bit offsets
+    QuadTreeTests::RunCellIteratorTest(MinPowerOf2(11), MaxPowerOf2(11), MinPowerOf2(11), MaxPowerOf2(11), 0.25, 1, 0);
+
+    // Query 2000 random rectangles of a 1024x1024 soup as cells and as bitmaps, and look at a small viewport
+    // into a tree about 2^64 wide without building its display list
+    QuadTreeTests::RunRectQueryTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 100, 2000);
+
+    // Render 100 random viewports of a 1024x1024 soup at each zoom from 0 to 7 and count their cells to check them, then
+    // render a tree about 2^64 wide whole
+    QuadTreeTests::RunRenderTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 100, 100);
+
+    // Write a 1024x1024 soup as PGM, PPM and PNG frames every 10 generations for 100 generations and read them back
+    // to check them, then see what writing frames costs the steps
+    QuadTreeTests::RunFrameWriterTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 100, 10);
+
+    // Diff a 1024x1024 soup against the generation before for 100 generations, whole and in 2000 random rectangles,
+    // and check the cells born and died against comparing the cells before and after
+    QuadTreeTests::RunDiffTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 100, 2000);
+
+    // Find the bounding box of a 1024x1024 soup from the edges of the tree for 100 generations, and check it and every
+    // node's quadrants against the cells
+    QuadTreeTests::RunBoundingBoxTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 100);
+
+    // Checkpoint a 1024x1024 soup every 64 generations for 500 generations, resume a second tree from the last
+    // checkpoint and check that both end up the same, then time saving and loading over a million nodes
+    QuadTreeTests::RunSnapshotTest(MinPowerOf2(10), MaxPowerOf2(10), MinPowerOf2(10), MaxPowerOf2(10), 0.375, 1, 500, 64);
+
+    // BENCHMARK: Run the Gosper glider gun for 2100 generations one at a time and 7 at a time, which evolves nodes by
+    // 4, 2 and 1 generations every step, and check that the memo keeps up
+    QuadTreeTests::RunExactStepTest("../patterns/gosperglidergun.rle", 2100, 7);
+
     return 0;
 }
 
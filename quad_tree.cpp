@@ -2,47 +2,111 @@
 // Created by Jenny Spurlock on 5/4/17.
 //
 
+#include <algorithm>
 #include <vector>
 #include <fstream>
 #include "quad_tree.h"
 
 /**
- * Constructs a new quad tree with a base level
+ * Constructs a new quad tree with a base level, with a store of its own
  */
-QuadTree::QuadTree() {
-    // Initialize the quad tree node structure
-    QuadTreeNode::Initialize();
-    // create a new root node at level 3
-    root = QuadTreeNode::EmptyQuadTree(kStartLevels);
+QuadTree::QuadTree() : owned_store(new QuadTreeNodeStore()), store(*owned_store) {
+    Initialize();
+}
+
+/**
+ * Constructs a new quad tree with a base level, whose nodes live in a store it can share with other trees
+ * @param store store to create nodes in, which has to outlive this tree
+ */
+QuadTree::QuadTree(QuadTreeNodeStore& store) : owned_store(0), store(store) {
+    Initialize();
+}
+
+/**
+ * Shared part of the constructors
+ */
+void QuadTree::Initialize() {
+    // create a new root node at our starting level, and keep it alive when the store collects garbage
+    root = store.EmptyQuadTree(kStartLevels);
+    store.AddRoot(&root);
+    // nothing is marked until MarkGeneration()
+    marked_root = 0;
+    store.AddRoot(&marked_root);
     // init generation count;
     num_generations = 0;
+ #if (GARBAGE_COLLECTION_MODE_GENERATIONS)
+    generations_since_collection = 0;
+ #endif
+    frame_writer = 0;
+    checkpoint_interval = 1;
+    next_checkpoint = 0;
+    num_checkpoints = 0;
+    num_checkpoints_failed = 0;
+    // init hash table stats
+    num_steps = 0;
+    step_lookups = 0;
+    step_probes = 0;
     // Set our display origin to zero for now
     origin_x = 0;
     origin_y = 0;
+    marked_origin_x = 0;
+    marked_origin_y = 0;
 }
 
 /**
  * Destructor
  */
 QuadTree::~QuadTree() {
-    // Shutdown the quad tree nodes, freeing all node memory
-    QuadTreeNode::Shutdown();
+    // the writer keeps roots alive in our store, which may be about to go
+    if (frame_writer != 0) {
+        frame_writer->Detach();
+    }
+    store.RemoveRoot(&root);
+    store.RemoveRoot(&marked_root);
+    // if the store is ours, this frees all node memory
+    delete owned_store;
 }
 
 /**
  * Initialize this quad tree before it's actually been run
  * @param input in the form of {x, y}
- * @param num_rows the number of input pairs
  */
-void QuadTree::SetCellsAlive(std::vector<std::pair<int64_t, int64_t>> input) {
+void QuadTree::SetCellsAlive(const std::vector<std::pair<int64_t, int64_t>>& input) {
+    SetCellsAlive(input.data(), input.size());
+}
+
+/**
+ * Initialize this quad tree before it's actually been run. If the tree is empty, which it is until cells are set,
+ * the whole tree is built in one go by QuadTreeBulkLoader. Otherwise we set the cells one at a time
+ * @param input in the form of {x, y}, which isn't copied
+ * @param num_cells the number of input pairs
+ */
+void QuadTree::SetCellsAlive(const std::pair<int64_t, int64_t>* input, size_t num_cells) {
+    if (!root->empty) {
+        // we already have cells, so our origin is picked, and we add the new ones around it
+#if (ENABLE_BIG_INT)
+        int64_t current_origin_x = origin_x.get_si();
+        int64_t current_origin_y = origin_y.get_si();
+#else
+        int64_t current_origin_x = origin_x;
+        int64_t current_origin_y = origin_y;
+#endif
+        for (size_t i = 0; i < num_cells; ++i) {
+            SetCellAlive(input[i].first - current_origin_x, input[i].second - current_origin_y);
+        }
+        return;
+    }
+    int64_t new_origin_x = 0;
+    int64_t new_origin_y = 0;
 #if (ENABLE_QUADTREE_CENTER_ALIGN)
-     CenterQuadTreeInput(input);
+    CenterQuadTreeInput(input, num_cells, new_origin_x, new_origin_y);
+#endif
+#if (ENABLE_INFINITE_LEVELS)
+    int level = root->level.get_si();
 #else
-     // Set the input list cells alive!
-     for (std::pair<int64_t, int64_t> pair : input) {
-         SetCellAlive(pair.first, pair.second);
-     }
+    int level = root->level;
 #endif
+    root = QuadTreeBulkLoader::Build(store, input, num_cells, new_origin_x, new_origin_y, level);
 }
 
 /**
@@ -57,6 +121,59 @@ void QuadTree::SetCellsAlive(int64_t input[][2], size_t num_rows) {
     }
 }
 
+/**
+ * Fill a rectangle with random cells, straight into canonical leaves. The same arguments always give the same cells,
+ * see QuadTreeBulkLoader::BuildSoup(). Cells that are already alive stay alive
+ * @param min_x smallest x coordinate of the rectangle
+ * @param max_x biggest x coordinate of the rectangle, inclusive
+ * @param min_y smallest y coordinate of the rectangle
+ * @param max_y biggest y coordinate of the rectangle, inclusive
+ * @param density chance of each cell in the rectangle being alive, [0, 1]
+ * @param seed random seed
+ */
+void QuadTree::SetRandomCellsAlive(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed) {
+#if (ENABLE_INFINITE_LEVELS)
+    int level = root->level.get_si();
+#else
+    int level = root->level;
+#endif
+    int64_t current_origin_x = 0;
+    int64_t current_origin_y = 0;
+    if (root->empty) {
+#if (ENABLE_QUADTREE_CENTER_ALIGN)
+        // same midpoint as CenterQuadTreeInput()
+        current_origin_x = (min_x / 2) + (max_x / 2) + (min_x & max_x & 1);
+        current_origin_y = (min_y / 2) + (max_y / 2) + (min_y & max_y & 1);
+        SetOrigin(current_origin_x, current_origin_y);
+#endif
+    } else {
+        // we already have cells, so our origin is picked, and we add the new ones around it
+#if (ENABLE_BIG_INT)
+        current_origin_x = origin_x.get_si();
+        current_origin_y = origin_y.get_si();
+#else
+        current_origin_x = origin_x;
+        current_origin_y = origin_y;
+#endif
+    }
+    QuadTreeNode* soup = QuadTreeBulkLoader::BuildSoup(store,
+        (int64_t) ((uint64_t) min_x - (uint64_t) current_origin_x), (int64_t) ((uint64_t) max_x - (uint64_t) current_origin_x),
+        (int64_t) ((uint64_t) min_y - (uint64_t) current_origin_y), (int64_t) ((uint64_t) max_y - (uint64_t) current_origin_y),
+        density, seed, level);
+    if (root->empty) {
+        root = soup;
+        return;
+    }
+    // both trees are centered on the origin, so we only have to grow the smaller one before we combine them
+    while (root->level < soup->level) {
+        root = root->Expand(store);
+    }
+    while (soup->level < root->level) {
+        soup = soup->Expand(store);
+    }
+    root = QuadTreeBulkLoader::Union(store, root, soup);
+}
+
 /**
  * Step this quad tree one generation forward using Conway's Game of Life Rules
  * and a hashed tree node algorithm
@@ -65,49 +182,121 @@ void QuadTree::SetCellsAlive(int64_t input[][2], size_t num_rows) {
  * https://en.wikipedia.org/wiki/Hashlife
  */
 void QuadTree::Step() {
-    // does the root exist and have a population greater than zero?
+    StepPow2(0);
+}
+
+/**
+ * Step this quad tree an exact number of generations forward, by breaking it up into power of 2 jumps
+ * @param generations number of generations to step
+ */
+void QuadTree::Step(uint64_t generations) {
+    for (int exponent = 0; exponent < 64; ++exponent) {
+        if ((generations >> exponent) & 1) {
+            StepPow2(exponent);
+        }
+    }
+}
+
 #if (ENABLE_BIG_INT)
-    if (root == 0 || mpz_cmp_si(root->population, 0) == 0) {
-#else
-        if (root == 0 || root->population == 0) {
+/**
+ * Step this quad tree an exact number of generations forward, by breaking it up into power of 2 jumps
+ * @param generations number of generations to step, which can't be negative
+ */
+void QuadTree::Step(const mpz_class& generations) {
+    size_t num_bits = mpz_sizeinbase(generations.get_mpz_t(), 2);
+    for (size_t exponent = 0; exponent < num_bits; ++exponent) {
+        if (mpz_tstbit(generations.get_mpz_t(), exponent)) {
+            StepPow2((int) exponent);
+        }
+    }
+}
 #endif
+
+/**
+ * Step this quad tree 2^exponent generations forward in a single HashLife jump
+ * @param exponent power of 2 of the number of generations to step
+ */
+void QuadTree::StepPow2(int exponent) {
+    // does the root exist and have a population greater than zero?
+    if (root == 0 || root->empty) {
         return;
     }
-    // if we're under level 3 or our population one level below doesn't match 2 levels below itself,
-    // we expand to ensure that there is a border along the edge to calculate the next generation
+    uint64_t lookups = store.node_table.NumLookups();
+    uint64_t probes = store.node_table.NumProbes();
+    // if we're too small to look 3 levels down past the leaves or we have cells outside our center square, we expand
+    // to ensure that there is a border along the edge to calculate the next generation.
+    // Nothing moves faster than one cell a generation, so the border is wide enough for a 2^(level-3) generation jump
     while (
-            root->level < 3
-#if (ENABLE_BIG_INT)
-            || mpz_cmp(root->nw->population, root->nw->se->se->population) != 0
-            || mpz_cmp(root->ne->population, root->ne->sw->sw->population) != 0
-            || mpz_cmp(root->sw->population, root->sw->ne->ne->population) != 0
-            || mpz_cmp(root->se->population, root->se->nw->nw->population) != 0
-#else
-            || root->nw->population != root->nw->se->se->population
-            || root->ne->population != root->ne->sw->sw->population
-            || root->sw->population != root->sw->ne->ne->population
-            || root->se->population != root->se->nw->nw->population
-#endif
+            root->level < QuadTreeNode::kLeafLevel + 3
+            || root->level < exponent + 3
+            || !root->HasEmptyBorder()
     ) {
 #if (!ENABLE_INFINITE_LEVELS)
-        QuadTreeNode* new_root = root->Expand();
+        QuadTreeNode* new_root = root->Expand(store);
         if (new_root == root) {
             std::cout << "Unable to evolve tree, maximum level count has been reached." << std::endl;
             return;
         }
         root = new_root;
 #else
-        root = root->Expand();
+        root = root->Expand(store);
 #endif;
     }
-    // evolve a generation forward
-    root = root->Evolve();
+    // evolve 2^exponent generations forward
+    store.BeginEvolve();
+ #if (ENABLE_GARBAGE_COLLECTION)
+    uint64_t collections_in_step = store.AllCollections().num_in_step;
+ #endif
+    root = root->Evolve(store, exponent);
+    store.EndEvolve();
+ #if (GARBAGE_COLLECTION_REPORT)
+    if (store.AllCollections().num_in_step != collections_in_step) {
+        const QuadTreeNodeStore::CollectionStats& stats = store.LastCollection();
+        std::cout << "\tCollected garbage " << store.AllCollections().num_in_step - collections_in_step << " times during generation "
+                  << num_generations << " under memory pressure, the last one paused " << stats.pause_us << " us and freed "
+                  << stats.nodes_freed << " nodes, " << store.NumNodes() << " nodes left" << std::endl;
+    }
+ #endif
+    // no other threads are looking at the node table now, so it can free the slot arrays it has grown out of
+    store.node_table.Reclaim();
     // can we prune this level above and shrink our structure?
-    root = root->Compact();
+    root = root->Compact(store);
     // increment the current generation
-    ++num_generations;
+#if (ENABLE_BIG_INT)
+    mpz_class generations = 1;
+    mpz_mul_2exp(generations.get_mpz_t(), generations.get_mpz_t(), exponent);
+    num_generations += generations;
+#else
+    num_generations += INT64_C(1) << exponent;
+#endif
+ #if (GARBAGE_COLLECTION_MODE_GENERATIONS)
+    if (exponent >= 64 || generations_since_collection > UINT64_MAX - (UINT64_C(1) << exponent)) {
+        generations_since_collection = UINT64_MAX;
+    } else {
+        generations_since_collection += UINT64_C(1) << exponent;
+    }
+ #endif
     // collect garbage
+ #if (ENABLE_GARBAGE_COLLECTION)
     CollectGarbage();
+ #endif
+    // write a frame if one is due, before anything can change the tree again
+    if (frame_writer != 0) {
+        frame_writer->Stepped(root, origin_x, origin_y, num_generations);
+    }
+    // and save a checkpoint if one is due
+    if (!checkpoint_path.empty() && num_generations >= next_checkpoint) {
+        if (SaveSnapshot(checkpoint_path)) {
+            ++num_checkpoints;
+        } else {
+            ++num_checkpoints_failed;
+        }
+        next_checkpoint = (num_generations / checkpoint_interval + 1) * checkpoint_interval;
+    }
+    // keep track of how hard we're hitting the hash table
+    step_lookups += store.node_table.NumLookups() - lookups;
+    step_probes += store.node_table.NumProbes() - probes;
+    ++num_steps;
 }
 
 /**
@@ -127,16 +316,322 @@ void QuadTree::PrintVerbose() {
  * Print run stats, including memory usage and memory
  */
 void QuadTree::PrintStats() {
-    size_t total_mem = (sizeof(QuadTreeNode) * QuadTreeNode::node_map.size())/1024;  // convert to kilobytes
+    size_t total_mem = store.MemoryUsage()/1024;  // convert to kilobytes
     std::cout << "Generating stats..\n";
-    std::cout << "\tOverview: Generation (" << num_generations << ") Population (" << root->population << ")" << " Tree Level (" << root->level << ")" << std::endl;
-    std::cout << "\t\tCurrent # nodes: " << QuadTreeNode::node_map.size() << std::endl;
+    std::cout << "\tOverview: Generation (" << num_generations << ") Population (" << root->ExactPopulation() << ")" << " Tree Level (" << (level_type) root->level << ")" << std::endl;
+    std::cout << "\t\tCurrent # nodes: " << store.NumNodes() << std::endl;
     std::cout << "\t\tCurrent Heap memory usage: " << total_mem << " KB" << std::endl;
-    std::cout << "\t\tAll Time # nodes: " << QuadTreeNode::num_nodes_created << std::endl;
-    std::cout << "\t\tNW Population: " << root->nw->population << std::endl;
-    std::cout << "\t\tNE Population: " << root->ne->population << std::endl;
-    std::cout << "\t\tSW Population: " << root->sw->population << std::endl;
-    std::cout << "\t\tSE Population: " << root->se->population << std::endl;
+    std::cout << "\t\tAll Time # nodes: " << store.NumNodesCreated() << std::endl;
+    if (num_steps > 0) {
+        std::cout << "\t\tHash lookups per step: " << step_lookups / num_steps << " (" << step_probes / num_steps << " slots probed)" << std::endl;
+    }
+#if (ENABLE_GARBAGE_COLLECTION)
+    const QuadTreeNodeStore::CollectionStats& collections = store.AllCollections();
+    if (collections.num_collections > 0) {
+        std::cout << "\t\tGarbage collections: " << collections.num_collections << ", paused " << collections.pause_us / 1000
+                  << " ms in " << collections.num_pauses << " pauses (longest " << collections.max_pause_us / 1000 << " ms), freed " << collections.nodes_freed
+                  << " nodes (" << collections.bytes_freed / 1024 << " KB), released " << collections.bytes_released / 1024 << " KB, "
+                  << collections.num_in_step << " during steps" << std::endl;
+        if (collections.num_compactions != 0) {
+            std::cout << "\t\tCompactions: " << collections.num_compactions << ", moved " << collections.nodes_moved << " nodes in "
+                      << collections.compact_us / 1000 << " ms" << std::endl;
+        }
+        if (store.MemoBudget() != 0) {
+            std::cout << "\t\tMemo budget: " << store.MemoBudget() / 1024 << " KB, dropped " << collections.memos_dropped
+                      << " memos, kept " << collections.hot_nodes_kept << " unreachable nodes" << std::endl;
+        }
+    }
+#endif
+    if (frame_writer != 0) {
+        QuadTreeFrameWriter::Stats frames = frame_writer->GetStats();
+        std::cout << "\t\tFrames: " << frames.frames_written << " written (" << frames.bytes_written / 1024 << " KB), "
+                  << frames.frames_dropped << " dropped, " << frames.frames_failed << " failed, " << frames.frames_per_second
+                  << " fps, rendering took " << frames.render_us / 1000 << " ms and encoding " << frames.encode_us / 1000 << " ms" << std::endl;
+    }
+    if (!checkpoint_path.empty()) {
+        std::cout << "\t\tCheckpoints: " << num_checkpoints << " saved to " << checkpoint_path << ", " << num_checkpoints_failed << " failed" << std::endl;
+    }
+    std::cout << "\t\tNW Population: " << root->nw->ExactPopulation() << std::endl;
+    std::cout << "\t\tNE Population: " << root->ne->ExactPopulation() << std::endl;
+    std::cout << "\t\tSW Population: " << root->sw->ExactPopulation() << std::endl;
+    std::cout << "\t\tSE Population: " << root->se->ExactPopulation() << std::endl;
+}
+
+/**
+ * Walk our alive cells a chunk at a time, as 64 bit offsets from a display coordinate, without building a display
+ * list. See QuadTreeCellIterator
+ * @return an iterator over our cells, which is only good until we step
+ */
+QuadTreeCellIterator QuadTree::Cells() const {
+    return QuadTreeCellIterator(root, origin_x, origin_y);
+}
+
+/**
+ * Walk our alive cells inside a rectangle a chunk at a time, skipping the parts of the tree outside of it.
+ * See QuadTreeCellIterator
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ * @return an iterator over the cells, which is only good until we step
+ */
+QuadTreeCellIterator QuadTree::Cells(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const {
+    return QuadTreeCellIterator(root, origin_x, origin_y, x0, y0, x1, y1);
+}
+
+/**
+ * Get our alive cells inside a rectangle. Subtrees outside of it or without cells are skipped, so this costs
+ * about as much as the cells we find, however big the tree is. The rectangle has to be less than 2^62 cells across
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ * @param cells set to the cells' offsets from (x0, y0), in the same order as Cells()
+ * @return number of cells
+ */
+size_t QuadTree::QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                           std::vector<std::pair<int64_t, int64_t>>& cells) const {
+    cells.clear();
+    return QueryRect(x0, y0, x1, y1, [&cells](int64_t x, int64_t y) {
+        cells.emplace_back(x, y);
+    });
+}
+
+/**
+ * Get our alive cells inside a rectangle as a bitmap, skipping subtrees outside of it or without cells
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ * @param bitmap y1 - y0 + 1 rows of BitmapWords(x0, x1) words each, north to south, which we clear first. Cell
+ * (x0 + i, y0 + j) is bit i % 64 of word i / 64 of row j
+ * @return number of cells
+ */
+size_t QuadTree::QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                           uint64_t* bitmap) const {
+    if (x1 < x0 || y1 < y0) {
+        return 0;
+    }
+    size_t row_words = BitmapWords(x0, x1);
+#if (ENABLE_BIG_INT)
+    size_t num_rows = (size_t) mpz_class(y1 - y0 + 1).get_ui();
+#else
+    size_t num_rows = (size_t) (y1 - y0 + 1);
+#endif
+    std::fill(bitmap, bitmap + row_words * num_rows, UINT64_C(0));
+    return QueryRect(x0, y0, x1, y1, [bitmap, row_words](int64_t x, int64_t y) {
+        bitmap[(size_t) y * row_words + (size_t) x / 64] |= UINT64_C(1) << (x % 64);
+    });
+}
+
+/**
+ * @param x0 display coordinate of a rectangle's west edge
+ * @param x1 display coordinate of a rectangle's east edge, inclusive
+ * @return number of words in each row of the rectangle's bitmap
+ */
+size_t QuadTree::BitmapWords(const coordinate_type& x0, const coordinate_type& x1) {
+    if (x1 < x0) {
+        return 0;
+    }
+#if (ENABLE_BIG_INT)
+    return (size_t) mpz_class((x1 - x0 + 64) / 64).get_ui();
+#else
+    return (size_t) ((x1 - x0) / 64 + 1);
+#endif
+}
+
+/**
+ * Find the smallest rectangle that holds all of our alive cells, walking down each edge of the tree
+ * @param x0 set to the display coordinate of the westmost alive cell
+ * @param y0 set to the display coordinate of the northmost alive cell
+ * @param x1 set to the display coordinate of the eastmost alive cell
+ * @param y1 set to the display coordinate of the southmost alive cell
+ * @return false if we have no alive cells, and the rectangle is left alone
+ */
+bool QuadTree::BoundingBox(coordinate_type& x0, coordinate_type& y0, coordinate_type& x1, coordinate_type& y1) const {
+    if (root == 0 || root->empty) {
+        return false;
+    }
+    // the root covers [origin - half, origin + half - 1], and a cell can't be further in from an edge than half + half - 1
+#if (ENABLE_BIG_INT)
+    mpz_class half = 0;
+ #if (ENABLE_INFINITE_LEVELS)
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) root->level.get_ui() - 1);
+ #else
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) root->level - 1);
+ #endif
+#else
+    int64_t half = INT64_C(1) << (root->level - 1);
+#endif
+    coordinate_type limit = half + (half - 1);
+    x0 = origin_x - half + root->EdgeInset(QuadTreeNode::kWestEdge, limit);
+    y0 = origin_y - half + root->EdgeInset(QuadTreeNode::kNorthEdge, limit);
+    x1 = origin_x + (half - 1) - root->EdgeInset(QuadTreeNode::kEastEdge, limit);
+    y1 = origin_y + (half - 1) - root->EdgeInset(QuadTreeNode::kSouthEdge, limit);
+    return true;
+}
+
+/**
+ * Remember our cells as they are now, for Diff() to compare with later. The nodes are kept alive until the next
+ * time we mark, which costs the nodes that change in between
+ */
+void QuadTree::MarkGeneration() {
+    marked_root = root;
+    marked_origin_x = origin_x;
+    marked_origin_y = origin_y;
+}
+
+/**
+ * Get the cells inside a rectangle that were born and that died since MarkGeneration(), or since we had no cells
+ * if we never marked. See QuadTreeDiff
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ * @param born set to the offsets from (x0, y0) of the cells alive now that weren't
+ * @param died set to the offsets from (x0, y0) of the cells that were alive and aren't now
+ * @return number of cells that changed
+ */
+size_t QuadTree::Diff(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                      std::vector<std::pair<int64_t, int64_t>>& born, std::vector<std::pair<int64_t, int64_t>>& died) {
+    born.clear();
+    died.clear();
+    QuadTreeNode* old_root = marked_root != 0 ? marked_root : store.EmptyQuadTree(root->level);
+    QuadTreeNode* new_root = root;
+    if (!old_root->empty && !new_root->empty && (marked_origin_x != origin_x || marked_origin_y != origin_y)) {
+        // we died out and were set up again around another origin, so the roots don't line up
+        QuadTreeDiff(old_root, store.EmptyQuadTree(old_root->level), marked_origin_x, marked_origin_y).Diff(x0, y0, x1, y1, born, died);
+        QuadTreeDiff(store.EmptyQuadTree(new_root->level), new_root, origin_x, origin_y).Diff(x0, y0, x1, y1, born, died);
+        return born.size() + died.size();
+    }
+    // steps expand and compact the root around the same center, so the smaller root only needs empty space around it
+    while (old_root->level < new_root->level) {
+        old_root = old_root->Expand(store);
+    }
+    while (new_root->level < old_root->level) {
+        new_root = new_root->Expand(store);
+    }
+    // an empty root's origin doesn't matter
+    if (new_root->empty) {
+        return QuadTreeDiff(old_root, new_root, marked_origin_x, marked_origin_y).Diff(x0, y0, x1, y1, born, died);
+    }
+    return QuadTreeDiff(old_root, new_root, origin_x, origin_y).Diff(x0, y0, x1, y1, born, died);
+}
+
+/**
+ * Render the share of alive cells in every pixel of a viewport, at any zoom, in about one node per pixel.
+ * See QuadTreeRenderer
+ * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+ * @param width pixels across
+ * @param height pixels down
+ * @param density width * height bytes, row by row north to south. Each is the share of the pixel's cells that
+ * are alive in 255ths, and only 0 if none are
+ */
+void QuadTree::RenderDensity(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint8_t* density) const {
+    QuadTreeRenderer(root, origin_x, origin_y).RenderDensity(x0, y0, zoom, width, height, density);
+}
+
+/**
+ * Render which pixels of a viewport have any alive cells, at any zoom, in about one node per pixel.
+ * See QuadTreeRenderer
+ * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+ * @param width pixels across
+ * @param height pixels down
+ * @param bitmap height rows of QuadTreeRenderer::OccupancyWords(width) words each, north to south. Pixel (i, j)
+ * is bit i % 64 of word i / 64 of row j
+ */
+void QuadTree::RenderOccupancy(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint64_t* bitmap) const {
+    QuadTreeRenderer(root, origin_x, origin_y).RenderOccupancy(x0, y0, zoom, width, height, bitmap);
+}
+
+/**
+ * Write a viewport to an image file every so many generations while we step, see QuadTreeFrameWriter. A frame is
+ * captured right away, and then after every step that reaches or passes the next multiple of the writer's interval.
+ * The writer keeps the roots of frames it hasn't rendered yet alive in our store, and holds off compacting it
+ * @param writer writer to feed, which has to outlive us or be detached, or 0 to detach it
+ */
+void QuadTree::SetFrameWriter(QuadTreeFrameWriter* writer) {
+    if (frame_writer != 0) {
+        frame_writer->Detach();
+    }
+    frame_writer = writer;
+    if (frame_writer != 0) {
+        frame_writer->Attach(store);
+        frame_writer->Capture(root, origin_x, origin_y, num_generations);
+    }
+}
+
+/**
+ * Write our cells, origin and generation to a snapshot file, see QuadTreeSnapshot
+ * @param path file to write, which is only replaced once the new one has been written whole
+ * @return false if the file couldn't be written
+ */
+bool QuadTree::SaveSnapshot(const std::string& path) const {
+    return QuadTreeSnapshot::Save(path, root, origin_x, origin_y, num_generations);
+}
+
+/**
+ * Replace our cells, origin and generation with a snapshot's, so a run can pick up where it left off
+ * @param path file to read
+ * @return false if the file couldn't be read or isn't a snapshot, in which case we're left as we were
+ */
+bool QuadTree::LoadSnapshot(const std::string& path) {
+    QuadTreeNode* new_root = QuadTreeSnapshot::Load(path, store, origin_x, origin_y, num_generations);
+    if (new_root == 0) {
+        return false;
+    }
+    root = new_root;
+    if (!checkpoint_path.empty()) {
+        next_checkpoint = (num_generations / checkpoint_interval + 1) * checkpoint_interval;
+    }
+    return true;
+}
+
+/**
+ * Save a snapshot after the steps that reach every so many generations, so long runs survive restarts
+ * @param path file to keep the latest checkpoint in, or "" to stop checkpointing
+ * @param interval generations between checkpoints, at least 1
+ */
+void QuadTree::SetCheckpoint(const std::string& path, uint64_t interval) {
+    checkpoint_path = path;
+    checkpoint_interval = interval < 1 ? 1 : interval;
+    next_checkpoint = (num_generations / checkpoint_interval + 1) * checkpoint_interval;
+}
+
+/**
+ * Shared part of both QueryRect() calls
+ * @param output void(int64_t x, int64_t y), gets each cell's offsets from (x0, y0)
+ * @return number of cells
+ */
+template <class Output>
+size_t QuadTree::QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                           Output output) const {
+    if (x1 < x0 || y1 < y0) {
+        return 0;
+    }
+    QuadTreeCellIterator cells = Cells(x0, y0, x1, y1);
+    QuadTreeCellIterator::Cell chunk[QuadTreeNode::kDisplayListChunkCells];
+    size_t num_cells = 0;
+    size_t num_chunk;
+    while ((num_chunk = cells.Next(chunk, QuadTreeNode::kDisplayListChunkCells)) != 0) {
+        // the chunk's origin is the center of a node that overlaps the rectangle, so it's within 2^62 of it
+#if (ENABLE_BIG_INT)
+        int64_t dx = mpz_class(cells.OriginX() - x0).get_si();
+        int64_t dy = mpz_class(cells.OriginY() - y0).get_si();
+#else
+        int64_t dx = cells.OriginX() - x0;
+        int64_t dy = cells.OriginY() - y0;
+#endif
+        for (size_t i = 0; i < num_chunk; ++i) {
+            output(chunk[i].x + dx, chunk[i].y + dy);
+        }
+        num_cells += num_chunk;
+    }
+    return num_cells;
 }
 
 /**
@@ -145,84 +640,37 @@ void QuadTree::PrintStats() {
 void QuadTree::PrintDisplayCoordinates() {
 
 #if (ENABLE_BIG_INT)
-    std::cout << "Generating Display List..\n";
-    // Create our display list in full, multiprecision coordinates, starting from our origin
-    std::vector<std::pair<mpz_class, mpz_class>> display_list;
-    root->BuildDisplayList(origin_x, origin_y, display_list);
-
-    // Setup our display coordinate map to store alive cells
-    std::unordered_map<std::pair<mpz_class, mpz_class>, bool, MpzClassHash> display_map;
-    bool min_max_set = false;
     mpz_class min_x = 0;
     mpz_class min_y = 0;
     mpz_class max_x = 0;
     mpz_class max_y = 0;
 
-    // Let's go through our display list, record min and max coordinates, and add to our map for fast access
-    for(std::pair<mpz_class, mpz_class> pair : display_list) {
-        if (!min_max_set) {
-            min_x = pair.first;
-            max_x = pair.first;
-            min_y = pair.second;
-            max_y = pair.second;
-            min_max_set = true;
-        } else {
-            if (pair.first < min_x) {
-                min_x = pair.first;
-            } else if (pair.first > max_x) {
-                max_x = pair.first;
-            }
-            if (pair.second < min_y) {
-                min_y = pair.second;
-            } else if (pair.second > max_y) {
-                max_y = pair.second;
-            }
-        }
-        display_map[pair] = true;
-    }
+    // Our min and max coordinates come from the edges of the tree, without looking at every cell
+    BoundingBox(min_x, min_y, max_x, max_y);
     // Print out a small render of the board, or if its too large, print out display coordinates so we can verify
     std::cout << "Drawing Boundaries min(" << min_x << ", " << min_y  << ") max(" << max_x << ", " << max_y << ").." << std::endl;
-    int display_list_index = 0;
     // Are we small enough to render out to the console?
     if ((max_x - min_x < DEBUG_RENDER_SIZE_MAX) && (max_y - min_y < DEBUG_RENDER_SIZE_MAX)) {
-        for (mpz_class y = min_y; y <= max_y; ++y) {
-            mpz_class x;
-            for (x = min_x; x <= max_x; ++x) {
-                if (display_map[std::make_pair(x, y)]) {
-                    std::cout << "*";
-                    ++display_list_index;
-                } else {
-
-                    std::cout << "_";
-                }
-            }
-            std::cout << std::endl;
-        }
+        DrawRect(std::cout, min_x, min_y, max_x, max_y);
     } else {
 #if (DEBUG_PRINT_TO_FILE)
         std::ofstream myfile("test.txt");
 
         if (myfile.is_open())
         {
-            for (mpz_class y = min_y; y <= max_y; ++y) {
-                mpz_class x;
-                for (x = min_x; x <= max_x; ++x) {
-                    if (display_map[std::make_pair(x, y)]) {
-                        myfile << "*";
-                        ++display_list_index;
-                    } else {
-
-                        myfile << "_";
-                    }
-                }
-                myfile << std::endl;
-            }
+            DrawRect(myfile, min_x, min_y, max_x, max_y);
             myfile.close();
         }
 #endif
 
-        // Render size would be too large, so lets just display a list of coordinates
-        // Let's go through our display list, record min and max coordinates, and add to our map for fast access
+        // Too big to draw a cell per character, so draw it zoomed out until it fits
+        DrawZoomed(std::cout, min_x, min_y, max_x, max_y);
+
+        // Then display a list of coordinates
+        std::cout << "Generating Display List..\n";
+        // Create our display list in full, multiprecision coordinates, starting from our origin
+        std::vector<std::pair<mpz_class, mpz_class>> display_list;
+        root->BuildDisplayList(origin_x, origin_y, display_list);
         int64_t max = 0;
         for(std::pair<mpz_class, mpz_class> pair : display_list) {
             if (max > DEBUG_PRINT_NODES_MAX) {
@@ -235,52 +683,25 @@ void QuadTree::PrintDisplayCoordinates() {
         std::cout << std::endl;
     }
 #else
-    // Create our display list, starting from our origin coordinates
-    std::vector<std::pair<int64_t, int64_t>> display_list;
-    root->BuildDisplayList(INT64_C(0), INT64_C(0), display_list);
-    std::unordered_map<std::pair<int64_t, int64_t>, bool, PairHash> display_map;
-
-    // Setup our display coordinate map to store alive cells
     int64_t min_x = INT64_MAX;
     int64_t min_y = INT64_MAX;
     int64_t max_x = INT64_MIN;
     int64_t max_y = INT64_MIN;
 
-    // Let's go through our display list, record min and max coordinates, and add to our map for fast access
-    for(std::pair<int64_t, int64_t> pair : display_list) {
-        if (pair.first < min_x) {
-            min_x = pair.first;
-        } else if (pair.first > max_x) {
-            max_x = pair.first;
-        }
-        if (pair.second < min_y) {
-            min_y = pair.second;
-        } else if (pair.second > max_y) {
-            max_y = pair.second;
-        }
-        display_map[pair] = true;
-    }
-    int display_list_index = 0;
+    // Our min and max coordinates come from the edges of the tree, without looking at every cell
+    BoundingBox(min_x, min_y, max_x, max_y);
     std::cout << "============================================================\n";
     std::cout << "== Drawing min(" << min_x << ", " << min_y  << ") max(" << max_x << ", " << max_y << ")" << std::endl;
     // Are we small enough to render out to the console?
     if ((max_x - min_x < DEBUG_RENDER_SIZE_MAX) && (max_y - min_y < DEBUG_RENDER_SIZE_MAX)) {
-        for (int64_t y = min_y; y <= max_y; ++y) {
-            int64_t x;
-            for (x = min_x; x <= max_x; ++x) {
-                if (display_map[std::make_pair(x, y)]) {
-                    std::cout << "*";
-                    ++display_list_index;
-                } else {
-
-                    std::cout << "_";
-                }
-            }
-            std::cout << std::endl;
-        }
+        DrawRect(std::cout, min_x, min_y, max_x, max_y);
     } else {
-        // Render size would be too large, so lets just display a list of coordinates
-        // Let's go through our display list, record min and max coordinates, and add to our map for fast access
+        // Too big to draw a cell per character, so draw it zoomed out until it fits
+        DrawZoomed(std::cout, min_x, min_y, max_x, max_y);
+
+        // Then display a list of coordinates, starting from our origin coordinates
+        std::vector<std::pair<int64_t, int64_t>> display_list;
+        root->BuildDisplayList(origin_x, origin_y, display_list);
         for(std::pair<int64_t, int64_t> pair : display_list) {
             std::cout << "(" << pair.first << ", " << pair.second << ") ";
         }
@@ -289,19 +710,83 @@ void QuadTree::PrintDisplayCoordinates() {
 #endif
 }
 
+/**
+ * Draw the cells inside a rectangle a row at a time, with alive cells as "*" and empty cells as "_"
+ * @param out stream to draw to
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ */
+void QuadTree::DrawRect(std::ostream& out, const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const {
+#if (ENABLE_BIG_INT)
+    size_t width = (size_t) mpz_class(x1 - x0 + 1).get_ui();
+#else
+    size_t width = (size_t) (x1 - x0 + 1);
+#endif
+    std::vector<uint64_t> row(BitmapWords(x0, x1));
+    std::string line(width, '_');
+    for (coordinate_type y = y0; y <= y1; ++y) {
+        QueryRect(x0, y, x1, y, row.data());
+        for (size_t x = 0; x < width; ++x) {
+            line[x] = ((row[x / 64] >> (x % 64)) & 1) != 0 ? '*' : '_';
+        }
+        out << line << std::endl;
+    }
+}
+
+/**
+ * Draw a rectangle zoomed out by the smallest power of 2 that makes it fit in DEBUG_RENDER_SIZE_MAX characters,
+ * with empty pixels as "_" and the rest darker the more of their cells are alive
+ * @param out stream to draw to
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ */
+void QuadTree::DrawZoomed(std::ostream& out, const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const {
+    static const char kShades[] = "_.:-=+*#%@";
+    coordinate_type span = x1 - x0 > y1 - y0 ? x1 - x0 : y1 - y0;
+    // pixels are aligned to the tree, so the rectangle can start partway into one and take an extra pixel
+    int zoom = 0;
+#if (ENABLE_BIG_INT)
+    while (mpz_class(span >> zoom) + 2 > DEBUG_RENDER_SIZE_MAX) {
+        ++zoom;
+    }
+    size_t width = (size_t) mpz_class(((x1 - x0) >> zoom) + 2).get_ui();
+    size_t height = (size_t) mpz_class(((y1 - y0) >> zoom) + 2).get_ui();
+#else
+    while ((span >> zoom) + 2 > DEBUG_RENDER_SIZE_MAX) {
+        ++zoom;
+    }
+    size_t width = (size_t) (((x1 - x0) >> zoom) + 2);
+    size_t height = (size_t) (((y1 - y0) >> zoom) + 2);
+#endif
+    std::vector<uint8_t> density(width * height);
+    RenderDensity(x0, y0, zoom, width, height, density.data());
+    out << "Drawing zoomed out, each character is 2^" << zoom << " x 2^" << zoom << " cells.." << std::endl;
+    std::string line(width, '_');
+    for (size_t y = 0; y < height; ++y) {
+        for (size_t x = 0; x < width; ++x) {
+            uint8_t pixel = density[y * width + x];
+            line[x] = kShades[pixel == 0 ? 0 : 1 + (pixel - 1) * 9 / 255];
+        }
+        out << line << std::endl;
+    }
+}
+
 /**
  * Print out the current hashtable, mainly for debugging
  */
 void QuadTree::PrintHashTable() {
-    for(std::pair<QuadTreeNode*, QuadTreeNode*> pair : QuadTreeNode::node_map) {
-        QuadTreeNode* node = pair.first;
-        if (node->level != 0) {
-            std::cout << "Node " << node->level << " " << node->nw->population << " " << node->ne->population;
-            std::cout << " " << node->sw->population << " " << node->se->population << " " << node->population << std::endl;
-        } else {
-            std::cout << "Node " << node->level << " " << node->population << std::endl;
+    store.node_table.ForEach([](QuadTreeNode* node) {
+        if (node->level == QuadTreeNode::kLeafLevel) {
+            std::cout << "Leaf " << std::hex << node->bits << std::dec << " " << QuadTreeLeafKernel::PopCount(node->bits) << std::endl;
+            return;
         }
-    }
+        std::cout << "Node " << (level_type) node->level << " " << node->nw->empty << " " << node->ne->empty;
+        std::cout << " " << node->sw->empty << " " << node->se->empty << " " << node->empty << std::endl;
+    });
 }
 
 #if (ENABLE_GARBAGE_COLLECTION)
@@ -310,55 +795,42 @@ void QuadTree::PrintHashTable() {
  * @return if garbage collection was performed
  */
 bool QuadTree::CollectGarbage() {
-
+    bool collected = false;
+    if (store.IsCollecting()) {
+        // an incremental collection is under way, which we or a tree we share the store with started
+        collected = store.ContinueCollection();
  #if (GARBAGE_COLLECTION_MODE_GENERATIONS)
-    if (num_generations % GARBAGE_COLLECTION_GENERATIONS_COUNT == 0) {
+    } else if (generations_since_collection >= GARBAGE_COLLECTION_GENERATIONS_COUNT || store.OverMemoBudget()) {
+        generations_since_collection = 0;
  #else //(GARBAGE_COLLECTON_MODE_NODES)
-    if (QuadTreeNode::node_map.size() > GARBAGE_COLLECTION_NODES_COUNT) {
+    } else if (store.NumNodes() > GARBAGE_COLLECTION_NODES_COUNT || store.OverMemoBudget()) {
  #endif
-        // this map stores nodes that are currently used
-        std::unordered_map<QuadTreeNode*, QuadTreeNode*> nodesInUse;
-
-        // recurse to figure out which nodes are in use
-        CollectGarbageHelper(nodesInUse, root);
-        int64_t numNodes = 0;
-        for (auto it = QuadTreeNode::node_map.begin(); it != QuadTreeNode::node_map.end();) {
-            if(nodesInUse.find(it->first) == nodesInUse.end()) {
-                QuadTreeNode* node = it->first;
-                // delete the node first
-                delete node;
-                // erase the node from the map, AFTER deleting
-                it = QuadTreeNode::node_map.erase(it);
-                ++numNodes;
-            } else {
-                it++;
-            }
-        }
-        // remove nodes if they are not in the in use map
-        return true;
+        // the store keeps everything reachable from our root, and from the roots of any trees we share it with.
+        // Stopping the world collects right here, otherwise we get a first slice of the work in
+        store.StartCollection();
+        collected = !store.IsCollecting() || store.ContinueCollection();
     }
-    return false;
-}
-
-/**
- * Helper for garbage collection, called recursively to iterate
- * Through a quad tree node structure
- * @param nodesInUse
- * @param curr
- */
-void QuadTree::CollectGarbageHelper(std::unordered_map<QuadTreeNode *, QuadTreeNode *> &nodesInUse, QuadTreeNode *curr) {
-    if (curr == 0) {
-        return;
+    if (collected && store.CompactionDue()) {
+        // the collection left holes all over the arenas, so move what's left next to each other
+        store.Compact();
     }
-    if (nodesInUse.find(curr) == nodesInUse.end()) {
-        nodesInUse.insert(std::make_pair(curr, curr));
-
-        CollectGarbageHelper(nodesInUse, curr->calc);
-        CollectGarbageHelper(nodesInUse, curr->nw);
-        CollectGarbageHelper(nodesInUse, curr->ne);
-        CollectGarbageHelper(nodesInUse, curr->sw);
-        CollectGarbageHelper(nodesInUse, curr->se);
+ #if (GARBAGE_COLLECTION_REPORT)
+    if (collected) {
+        const QuadTreeNodeStore::CollectionStats& stats = store.LastCollection();
+        std::cout << "\tCollected garbage at generation " << num_generations << ": paused " << stats.pause_us << " us in "
+                  << stats.num_pauses << " pauses (longest " << stats.max_pause_us << " us), freed " << stats.nodes_freed
+                  << " nodes (" << stats.bytes_freed / 1024 << " KB), released " << stats.bytes_released / 1024 << " KB, "
+                  << store.NumNodes() << " nodes left";
+        if (store.MemoBudget() != 0) {
+            std::cout << ", dropped " << stats.memos_dropped << " memos, kept " << stats.hot_nodes_kept << " unreachable nodes";
+        }
+        if (stats.num_compactions != 0) {
+            std::cout << ", moved " << stats.nodes_moved << " nodes in " << stats.compact_us << " us";
+        }
+        std::cout << std::endl;
     }
+ #endif
+    return collected;
 }
 #endif
 
@@ -377,19 +849,19 @@ void QuadTree::SetCellAlive(int64_t x, int64_t y) {
 #else
         int shift = root->level - 1;
 #endif
-        int64_t min = (root->level == 0) ? 0 : -(INT64_C(1) << shift);
-        int64_t max = (root->level == 0) ? 0 : (INT64_C(1) << shift) - 1;
+        int64_t min = -(INT64_C(1) << shift);
+        int64_t max = (INT64_C(1) << shift) - 1;
 
         // if we're in bounds, we're cool.
         // if not, expand the root node one level higher (power of 2 higher in size)
         if ((x >= min && x <= max && y >= min && y <= max)) {
             break;
         } else {
-            root = root->Expand();
+            root = root->Expand(store);
         }
     }
 
-    root = root->SetCellAlive(x, y);
+    root = root->SetCellAlive(store, x, y);
 }
 
 #if (ENABLE_QUADTREE_CENTER_ALIGN)
@@ -398,14 +870,18 @@ void QuadTree::SetCellAlive(int64_t x, int64_t y) {
  * This is an optimization if input is clustered away from the origin, say at our 64 bit signed integer
  * boundaries or otherwise so that we save memory by creating a smaller tree
  * @param input
+ * @param num_cells the number of input pairs
+ * @param new_origin_x the origin we picked, which is also stored in origin_x
+ * @param new_origin_y the origin we picked, which is also stored in origin_y
  */
-void QuadTree::CenterQuadTreeInput(std::vector<std::pair<int64_t, int64_t>> input) {
+void QuadTree::CenterQuadTreeInput(const std::pair<int64_t, int64_t>* input, size_t num_cells, int64_t& new_origin_x, int64_t& new_origin_y) {
     int64_t min_x = INT64_MAX;
     int64_t max_x = INT64_MIN;
     int64_t min_y = INT64_MAX;
     int64_t max_y = INT64_MIN;
     // Go through once and figure out our min and max coordinates
-    for (std::pair<int64_t, int64_t> pair : input) {
+    for (size_t i = 0; i < num_cells; ++i) {
+        const std::pair<int64_t, int64_t>& pair = input[i];
         if (pair.first < min_x) {
             min_x = pair.first;
         } else if (pair.first > max_x) {
@@ -421,20 +897,21 @@ void QuadTree::CenterQuadTreeInput(std::vector<std::pair<int64_t, int64_t>> inpu
     // use big integers to calculate the midpoint
     // apparently this is patented by samsung -> https://www.google.com/patents/US6007232?dq=
     // "Calculating the average of two integer numbers rounded towards zero in a single instruction cycle "
-    int64_t new_origin_x = (min_x / 2) + (max_x / 2) + (min_x & max_x & 1);
-    int64_t new_origin_y = (min_y / 2) + (max_y / 2) + (min_y & max_y & 1);
+    new_origin_x = (min_x / 2) + (max_x / 2) + (min_x & max_x & 1);
+    new_origin_y = (min_y / 2) + (max_y / 2) + (min_y & max_y & 1);
 
-    // re-process input to take into account new origin
-    for (std::pair<int64_t, int64_t> pair : input) {
-        pair.first -= new_origin_x;
-        pair.second -= new_origin_y;
-        // Set this cell to be alive
-        // We do it here because this is an iterator, so its stored by value not by pointer
-        SetCellAlive(pair.first, pair.second);
-    }
+    SetOrigin(new_origin_x, new_origin_y);
+}
+#endif
 
+/**
+ * Set the display coordinates of the tree's center
+ * @param new_origin_x
+ * @param new_origin_y
+ */
+void QuadTree::SetOrigin(int64_t new_origin_x, int64_t new_origin_y) {
 #if (ENABLE_BIG_INT)
-    // finally, process our origin coordinates to be multiprecision, taking
+    // process our origin coordinates to be multiprecision, taking
     // special care with negative values because of the mpz_import function
     if (new_origin_x > 0) {
         mpz_import(origin_x.get_mpz_t(), 1, 1, sizeof(int64_t), 0, 0, &new_origin_x);
@@ -459,4 +936,3 @@ void QuadTree::CenterQuadTreeInput(std::vector<std::pair<int64_t, int64_t>> inpu
     origin_y = new_origin_y;
 #endif
 }
-#endif
\ No newline at end of file
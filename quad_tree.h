@@ -9,8 +9,15 @@
 #include <cstdio>
 #include <cstdint>
 #include <iostream>
-#include <unordered_map>
+#include <string>
+#include "quad_tree_bulk_loader.h"
+#include "quad_tree_cell_iterator.h"
+#include "quad_tree_diff.h"
+#include "quad_tree_frame_writer.h"
 #include "quad_tree_node.h"
+#include "quad_tree_node_store.h"
+#include "quad_tree_renderer.h"
+#include "quad_tree_snapshot.h"
 #include "quad_tree_config.h"
 
 #if (ENABLE_BIG_INT)
@@ -27,16 +34,26 @@
  * http://www.drdobbs.com/jvm/an-algorithm-for-compressing-space-and-t/184406478
  * http://golly.sourceforge.net/
  * http://conwaylife.com/
+ *
+ * Nodes live in a QuadTreeNodeStore. A tree either makes its own store, or shares one that it's given with other trees
  */
 class QuadTree {
 
+    friend class QuadTreeTests;
+
     public:
 
         /**
-         * Constructs a new quad tree with a base level
+         * Constructs a new quad tree with a base level, with a store of its own
          */
         QuadTree();
 
+        /**
+         * Constructs a new quad tree with a base level, whose nodes live in a store it can share with other trees
+         * @param store store to create nodes in, which has to outlive this tree
+         */
+        explicit QuadTree(QuadTreeNodeStore& store);
+
         /**
          * Destructor
          */
@@ -45,9 +62,16 @@ class QuadTree {
         /**
          * Initialize this quad tree before it's actually been run
          * @param input in the form of {x, y}
-         * @param num_rows the number of input pairs
         */
-        void SetCellsAlive(std::vector<std::pair<int64_t, int64_t>> input);
+        void SetCellsAlive(const std::vector<std::pair<int64_t, int64_t>>& input);
+
+        /**
+         * Initialize this quad tree before it's actually been run. If the tree is empty, which it is until cells are set,
+         * the whole tree is built in one go by QuadTreeBulkLoader. Otherwise we set the cells one at a time
+         * @param input in the form of {x, y}, which isn't copied
+         * @param num_cells the number of input pairs
+         */
+        void SetCellsAlive(const std::pair<int64_t, int64_t>* input, size_t num_cells);
 
         /**
          * Initialize this quad tree before it's actually been run
@@ -56,6 +80,18 @@ class QuadTree {
          */
         void SetCellsAlive(int64_t input[][2], size_t num_rows);
 
+        /**
+         * Fill a rectangle with random cells, straight into canonical leaves. The same arguments always give the same cells,
+         * see QuadTreeBulkLoader::BuildSoup(). Cells that are already alive stay alive
+         * @param min_x smallest x coordinate of the rectangle
+         * @param max_x biggest x coordinate of the rectangle, inclusive
+         * @param min_y smallest y coordinate of the rectangle
+         * @param max_y biggest y coordinate of the rectangle, inclusive
+         * @param density chance of each cell in the rectangle being alive, [0, 1]
+         * @param seed random seed
+         */
+        void SetRandomCellsAlive(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed);
+
         /**
          * Step this quad tree one generation forward using Conway's Game of Life Rules
          * and a hashed tree node algorithm
@@ -65,6 +101,167 @@ class QuadTree {
          */
         void Step();
 
+        /**
+         * Step this quad tree an exact number of generations forward, by breaking it up into power of 2 jumps
+         * @param generations number of generations to step
+         */
+        void Step(uint64_t generations);
+
+#if (ENABLE_BIG_INT)
+        /**
+         * Step this quad tree an exact number of generations forward, by breaking it up into power of 2 jumps
+         * @param generations number of generations to step, which can't be negative
+         */
+        void Step(const mpz_class& generations);
+#endif
+
+        /**
+         * Step this quad tree 2^exponent generations forward in a single HashLife jump. Patterns that repeat or move
+         * away from each other get memoized, so big jumps on them only cost a handful of new nodes per level
+         * @param exponent power of 2 of the number of generations to step
+         */
+        void StepPow2(int exponent);
+
+        /**
+         * Walk our alive cells a chunk at a time, as 64 bit offsets from a display coordinate, without building a display
+         * list. See QuadTreeCellIterator
+         * @return an iterator over our cells, which is only good until we step
+         */
+        QuadTreeCellIterator Cells() const;
+
+        /**
+         * Walk our alive cells inside a rectangle a chunk at a time, skipping the parts of the tree outside of it.
+         * See QuadTreeCellIterator
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         * @return an iterator over the cells, which is only good until we step
+         */
+        QuadTreeCellIterator Cells(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const;
+
+        /**
+         * Get our alive cells inside a rectangle. Subtrees outside of it or without cells are skipped, so this costs
+         * about as much as the cells we find, however big the tree is. The rectangle has to be less than 2^62 cells across
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         * @param cells set to the cells' offsets from (x0, y0), in the same order as Cells()
+         * @return number of cells
+         */
+        size_t QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                         std::vector<std::pair<int64_t, int64_t>>& cells) const;
+
+        /**
+         * Get our alive cells inside a rectangle as a bitmap, skipping subtrees outside of it or without cells
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         * @param bitmap y1 - y0 + 1 rows of BitmapWords(x0, x1) words each, north to south, which we clear first. Cell
+         * (x0 + i, y0 + j) is bit i % 64 of word i / 64 of row j
+         * @return number of cells
+         */
+        size_t QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                         uint64_t* bitmap) const;
+
+        /**
+         * @param x0 display coordinate of a rectangle's west edge
+         * @param x1 display coordinate of a rectangle's east edge, inclusive
+         * @return number of words in each row of the rectangle's bitmap
+         */
+        static size_t BitmapWords(const coordinate_type& x0, const coordinate_type& x1);
+
+        /**
+         * Find the smallest rectangle that holds all of our alive cells. Every node knows which of its quadrants have
+         * cells, so this walks down each edge of the tree, which is about a node a level, instead of visiting the cells
+         * @param x0 set to the display coordinate of the westmost alive cell
+         * @param y0 set to the display coordinate of the northmost alive cell
+         * @param x1 set to the display coordinate of the eastmost alive cell
+         * @param y1 set to the display coordinate of the southmost alive cell
+         * @return false if we have no alive cells, and the rectangle is left alone
+         */
+        bool BoundingBox(coordinate_type& x0, coordinate_type& y0, coordinate_type& x1, coordinate_type& y1) const;
+
+        /**
+         * Remember our cells as they are now, for Diff() to compare with later. The nodes are kept alive until the next
+         * time we mark, which costs the nodes that change in between
+         */
+        void MarkGeneration();
+
+        /**
+         * Get the cells inside a rectangle that were born and that died since MarkGeneration(), or since we had no cells
+         * if we never marked. Subtrees that didn't change are skipped, so this costs about as much as the activity in
+         * the rectangle, whatever the population. See QuadTreeDiff. The rectangle has to be less than 2^62 cells across
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         * @param born set to the offsets from (x0, y0) of the cells alive now that weren't
+         * @param died set to the offsets from (x0, y0) of the cells that were alive and aren't now
+         * @return number of cells that changed
+         */
+        size_t Diff(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                    std::vector<std::pair<int64_t, int64_t>>& born, std::vector<std::pair<int64_t, int64_t>>& died);
+
+        /**
+         * Render the share of alive cells in every pixel of a viewport, at any zoom, in about one node per pixel.
+         * See QuadTreeRenderer
+         * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+         * @param width pixels across
+         * @param height pixels down
+         * @param density width * height bytes, row by row north to south. Each is the share of the pixel's cells that
+         * are alive in 255ths, and only 0 if none are
+         */
+        void RenderDensity(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint8_t* density) const;
+
+        /**
+         * Render which pixels of a viewport have any alive cells, at any zoom, in about one node per pixel.
+         * See QuadTreeRenderer
+         * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+         * @param width pixels across
+         * @param height pixels down
+         * @param bitmap height rows of QuadTreeRenderer::OccupancyWords(width) words each, north to south. Pixel (i, j)
+         * is bit i % 64 of word i / 64 of row j
+         */
+        void RenderOccupancy(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint64_t* bitmap) const;
+
+        /**
+         * Write a viewport to an image file every so many generations while we step, see QuadTreeFrameWriter. A frame is
+         * captured right away, and then after every step that reaches or passes the next multiple of the writer's interval.
+         * The writer keeps the roots of frames it hasn't rendered yet alive in our store, and holds off compacting it
+         * @param writer writer to feed, which has to outlive us or be detached, or 0 to detach it
+         */
+        void SetFrameWriter(QuadTreeFrameWriter* writer);
+
+        /**
+         * Write our cells, origin and generation to a snapshot file, see QuadTreeSnapshot
+         * @param path file to write, which is only replaced once the new one has been written whole
+         * @return false if the file couldn't be written
+         */
+        bool SaveSnapshot(const std::string& path) const;
+
+        /**
+         * Replace our cells, origin and generation with a snapshot's, so a run can pick up where it left off.
+         * See QuadTreeSnapshot
+         * @param path file to read
+         * @return false if the file couldn't be read or isn't a snapshot, in which case we're left as we were
+         */
+        bool LoadSnapshot(const std::string& path);
+
+        /**
+         * Save a snapshot after the steps that reach every so many generations, so long runs survive restarts. The
+         * first one is due at the next multiple of the interval after our generation
+         * @param path file to keep the latest checkpoint in, or "" to stop checkpointing
+         * @param interval generations between checkpoints, at least 1
+         */
+        void SetCheckpoint(const std::string& path, uint64_t interval);
+
         /**
          * Print some debug information, and if the board is small enough we print
          * it out to the console with empty cells as "_", and alive cells as "*"
@@ -84,37 +281,18 @@ class QuadTree {
     private:
 
         /**
-         * Simple hash function to allow a pair of pointers to be in an unordered_map
+         * Shared part of both QueryRect() calls
+         * @param output void(int64_t x, int64_t y), gets each cell's offsets from (x0, y0)
+         * @return number of cells
          */
-        class PairHash {
-            public:
-                template <class T1, class T2>
-                std::size_t operator () (const std::pair<T1,T2> &p) const {
-                    auto h1 = std::hash<T1>{}(p.first);
-                    auto h2 = std::hash<T2>{}(p.second);
-                    // just multiply the second function by a prime number
-                    return h1 + 11 * h2;
-                }
-        };
+        template <class Output>
+        size_t QueryRect(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                         Output output) const;
 
-#if (ENABLE_BIG_INT)
         /**
-         * Simple hash function to allow a pair of multi precision objects to be in an unordered_map
-         * We don't use any multiplication because of speed
-         */
-        class MpzClassHash {
-            public:
-                template <class T1, class T2>
-                std::size_t operator () (const std::pair<T1,T2> &p) const {
-                    // just add them together to get a hash. they could be beyond si limits anyway and we
-                    // don't want this to be very slow.
-                    size_t hash = p.first.get_si() + p.second.get_si();
-                    return hash;
-                }
-        };
-#endif
-
-    private:
+         * Shared part of the constructors
+         */
+        void Initialize();
 
         /**
          * Turn a cell alive
@@ -126,6 +304,34 @@ class QuadTree {
          */
         void SetCellAlive(int64_t x, int64_t y);
 
+        /**
+         * Set the display coordinates of the tree's center
+         * @param new_origin_x
+         * @param new_origin_y
+         */
+        void SetOrigin(int64_t new_origin_x, int64_t new_origin_y);
+
+        /**
+         * Draw the cells inside a rectangle a row at a time, with alive cells as "*" and empty cells as "_"
+         * @param out stream to draw to
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         */
+        void DrawRect(std::ostream& out, const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const;
+
+        /**
+         * Draw a rectangle zoomed out by the smallest power of 2 that makes it fit in DEBUG_RENDER_SIZE_MAX characters,
+         * with empty pixels as "_" and the rest darker the more of their cells are alive
+         * @param out stream to draw to
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         */
+        void DrawZoomed(std::ostream& out, const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1) const;
+
         /**
          * Print out the current hashtable, mainly for debugging
          */
@@ -137,27 +343,32 @@ class QuadTree {
          * @return if garbage collection was performed
          */
         bool CollectGarbage();
-
-        /**
-         * Helper for garbage collection, called recursively to iterate
-         * Through a quad tree node structure
-         * @param nodesInUse
-         * @param curr
-         */
-        void CollectGarbageHelper(std::unordered_map<QuadTreeNode *, QuadTreeNode *> &nodesInUse, QuadTreeNode *curr);
 #endif
 
+        // we register our root with the store by address, so we can't be copied
+        QuadTree(const QuadTree& other);
+        QuadTree& operator=(const QuadTree& other);
+
 #if (ENABLE_QUADTREE_CENTER_ALIGN)
         /**
          * This is an optimization to calculate an x, y origin that exists in the center of the input cluster
          * This is an optimization if input is clustered away from the origin, say at our 64 bit signed integer
          * boundaries or otherwise so that we save memory by creating a smaller tree
          * @param input
+         * @param num_cells the number of input pairs
+         * @param new_origin_x the origin we picked, which is also stored in origin_x
+         * @param new_origin_y the origin we picked, which is also stored in origin_y
          */
-        void CenterQuadTreeInput(std::vector<std::pair<int64_t, int64_t>> input);
+        void CenterQuadTreeInput(const std::pair<int64_t, int64_t>* input, size_t num_cells, int64_t& new_origin_x, int64_t& new_origin_y);
 #endif
 
     private:
+        // The store we made for ourselves, or 0 if we were given one
+        QuadTreeNodeStore* owned_store;
+
+        // The store our nodes live in
+        QuadTreeNodeStore& store;
+
         // The root note of our quad tree
         QuadTreeNode* root;
 
@@ -170,12 +381,52 @@ class QuadTree {
         int64_t origin_y;
 #endif
 
+        // Root and origin when we last marked a generation, which Diff() compares with
+        QuadTreeNode* marked_root;
+#if (ENABLE_BIG_INT)
+        mpz_class marked_origin_x;
+        mpz_class marked_origin_y;
+#else
+        int64_t marked_origin_x;
+        int64_t marked_origin_y;
+#endif
+
         // Number of generations
+#if (ENABLE_BIG_INT)
+        mpz_class num_generations;
+#else
         int64_t num_generations;
+#endif
+
+#if (GARBAGE_COLLECTION_MODE_GENERATIONS)
+        // Number of generations since we last collected garbage, saturated at UINT64_MAX
+        uint64_t generations_since_collection;
+#endif
+
+        // Writes frames after our steps, or 0
+        QuadTreeFrameWriter* frame_writer;
+
+        // Where we save checkpoints, or "" if we don't, the generations between them and when the next one is due
+        std::string checkpoint_path;
+        uint64_t checkpoint_interval;
+#if (ENABLE_BIG_INT)
+        mpz_class next_checkpoint;
+#else
+        int64_t next_checkpoint;
+#endif
+
+        // Checkpoints saved, and ones that couldn't be written
+        uint64_t num_checkpoints;
+        uint64_t num_checkpoints_failed;
+
+        // Hash table lookups and slots probed while stepping, and the number of steps they were counted over
+        uint64_t num_steps;
+        uint64_t step_lookups;
+        uint64_t step_probes;
 
         // define the number of levels to construct the quad tree with
-        // this should never be under 3
-        const int kStartLevels = 3;
+        // this should never be under 4, which is one level above our 8x8 leaves
+        const int kStartLevels = 4;
 };
 
 #endif //GOL_QUADTREE_H
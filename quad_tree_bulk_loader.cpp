@@ -0,0 +1,358 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <algorithm>
+#include <functional>
+#include "quad_tree_bulk_loader.h"
+#include "quad_tree_node_store.h"
+
+/**
+ * Build a tree with the given cells alive
+ * @param store store to create nodes in
+ * @param cells cells to set alive, in the form of {x, y}. Duplicates are fine
+ * @param num_cells number of cells
+ * @param origin_x cell x coordinates are relative to this
+ * @param origin_y cell y coordinates are relative to this
+ * @param min_level smallest level of the tree we return
+ * @return a canonical node at min_level or above, big enough to hold every cell
+ */
+QuadTreeNode* QuadTreeBulkLoader::Build(QuadTreeNodeStore& store, const std::pair<int64_t, int64_t>* cells, size_t num_cells,
+                                        int64_t origin_x, int64_t origin_y, int min_level) {
+    if (num_cells == 0) {
+        return store.EmptyQuadTree(min_level);
+    }
+    // find the smallest and biggest coordinate on either axis, relative to the origin
+    int64_t min = INT64_MAX;
+    int64_t max = INT64_MIN;
+    for (size_t i = 0; i < num_cells; ++i) {
+        int64_t x = (int64_t) ((uint64_t) cells[i].first - (uint64_t) origin_x);
+        int64_t y = (int64_t) ((uint64_t) cells[i].second - (uint64_t) origin_y);
+        min = std::min(min, std::min(x, y));
+        max = std::max(max, std::max(x, y));
+    }
+    int level = Level(min, max, min_level);
+
+    // offset every cell so the tree covers [0, 2^level) on both axes, which is what Morton order works on
+    uint64_t offset = UINT64_C(1) << (level - 1);
+    std::vector<Cell> sorted(num_cells);
+    for (size_t i = 0; i < num_cells; ++i) {
+        sorted[i].x = (uint64_t) cells[i].first - (uint64_t) origin_x + offset;
+        sorted[i].y = (uint64_t) cells[i].second - (uint64_t) origin_y + offset;
+    }
+    Sort(store, sorted, level);
+
+    // this caches every empty node we can hit on the way down
+    store.EmptyQuadTree(level);
+    return BuildNode(store, sorted.data(), sorted.data() + sorted.size(), 0, 0, level);
+}
+
+/**
+ * Build a tree with a rectangle of random cells. Leaves are visited in Morton order from a single random
+ * stream, so the same arguments always give the same tree
+ * @param store store to create nodes in
+ * @param min_x smallest x coordinate of the rectangle, relative to the tree's origin
+ * @param max_x biggest x coordinate of the rectangle, inclusive
+ * @param min_y smallest y coordinate of the rectangle, relative to the tree's origin
+ * @param max_y biggest y coordinate of the rectangle, inclusive
+ * @param density chance of each cell in the rectangle being alive, [0, 1]
+ * @param seed seed for QuadTreeRandom
+ * @param min_level smallest level of the tree we return
+ * @return a canonical node at min_level or above, big enough to hold the rectangle
+ */
+QuadTreeNode* QuadTreeBulkLoader::BuildSoup(QuadTreeNodeStore& store, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y,
+                                            double density, uint64_t seed, int min_level) {
+    uint32_t threshold = QuadTreeRandom::Threshold(density);
+    if (min_x > max_x || min_y > max_y || threshold == 0) {
+        return store.EmptyQuadTree(min_level);
+    }
+    int level = Level(std::min(min_x, min_y), std::max(max_x, max_y), min_level);
+
+    // offset the rectangle the same way Build() offsets cells
+    uint64_t offset = UINT64_C(1) << (level - 1);
+    Rect rect;
+    rect.min_x = (uint64_t) min_x + offset;
+    rect.max_x = (uint64_t) max_x + offset;
+    rect.min_y = (uint64_t) min_y + offset;
+    rect.max_y = (uint64_t) max_y + offset;
+
+    QuadTreeRandom random(seed);
+    store.EmptyQuadTree(level);
+    return BuildSoupNode(store, random, threshold, rect, 0, 0, level);
+}
+
+/**
+ * Combine two nodes of the same level, so a cell is alive if it's alive in either of them
+ * @param store store to create nodes in
+ * @param a
+ * @param b
+ * @return a canonical node with the cells of both
+ */
+QuadTreeNode* QuadTreeBulkLoader::Union(QuadTreeNodeStore& store, QuadTreeNode* a, QuadTreeNode* b) {
+    if (a == b || b->empty) {
+        return a;
+    }
+    if (a->empty) {
+        return b;
+    }
+    if (a->level == QuadTreeNode::kLeafLevel) {
+        return store.CanonicalLeaf(a->bits | b->bits);
+    }
+    return store.Canonical(Union(store, a->nw, b->nw), Union(store, a->ne, b->ne),
+                           Union(store, a->sw, b->sw), Union(store, a->se, b->se), a->level);
+}
+
+/**
+ * Find the level of the smallest tree centered on the origin that holds a range of coordinates
+ * @param min smallest coordinate on either axis, relative to the origin
+ * @param max biggest coordinate on either axis, relative to the origin
+ * @param min_level smallest level we return
+ * @return level, up to 64
+ */
+int QuadTreeBulkLoader::Level(int64_t min, int64_t max, int min_level) {
+    // a level n tree holds coordinates from -2^(n-1) to 2^(n-1)-1, and level 64 holds them all
+    int level = min_level;
+    while (level < 64 && (min < -(INT64_C(1) << (level - 1)) || max > (INT64_C(1) << (level - 1)) - 1)) {
+        ++level;
+    }
+    return level;
+}
+
+/**
+ * Does a come before b in Morton order? At every bit y comes before x, which puts the quadrants of a node in
+ * nw, ne, sw, se order. We compare the highest bits that differ instead of building the interleaved key,
+ * which would take 128 bits
+ * @param a
+ * @param b
+ * @return true if a sorts before b
+ */
+bool QuadTreeBulkLoader::MortonLess(const Cell& a, const Cell& b) {
+    uint64_t x_diff = a.x ^ b.x;
+    uint64_t y_diff = a.y ^ b.y;
+    // x decides only if its highest differing bit is above y's, which is the case when y_diff is below x_diff
+    // and also below their xor
+    if (y_diff < x_diff && y_diff < (y_diff ^ x_diff)) {
+        return a.x < b.x;
+    }
+    return a.y < b.y;
+}
+
+/**
+ * Sort cells in Morton order
+ * @param store store whose thread pool we can use
+ * @param cells
+ * @param level level of the tree the cells are in
+ */
+void QuadTreeBulkLoader::Sort(QuadTreeNodeStore& store, std::vector<Cell>& cells, int level) {
+    if (level > 32) {
+        SortInChunks(store, cells.data(), cells.data() + cells.size(), [](Cell* begin, Cell* end) {
+            std::sort(begin, end, MortonLess);
+        }, MortonLess);
+        return;
+    }
+    // every coordinate fits in 32 bits, so the interleaved key fits in 64, with y's bits above x's
+    std::vector<uint64_t> keys(cells.size());
+    for (size_t i = 0; i < cells.size(); ++i) {
+        keys[i] = SpreadBits(cells[i].x) | (SpreadBits(cells[i].y) << 1);
+    }
+    int bits = 2 * level;
+    SortInChunks(store, keys.data(), keys.data() + keys.size(), [bits](uint64_t* begin, uint64_t* end) {
+        RadixSort(begin, end, bits);
+    }, std::less<uint64_t>());
+    for (size_t i = 0; i < cells.size(); ++i) {
+        cells[i].x = CompactBits(keys[i]);
+        cells[i].y = CompactBits(keys[i] >> 1);
+    }
+}
+
+/**
+ * Sort a range with a function, or if it's big, sort chunks of it on the store's thread pool and merge them
+ * @param store store whose thread pool we can use
+ * @param begin
+ * @param end
+ * @param sort sorts a range, sort(begin, end)
+ * @param less the order sort puts things in, less(a, b)
+ */
+template <class T, class SortFunction, class LessFunction>
+void QuadTreeBulkLoader::SortInChunks(QuadTreeNodeStore& store, T* begin, T* end, SortFunction sort, LessFunction less) {
+#if (ENABLE_PARALLEL_EVOLVE)
+    QuadTreeThreadPool* thread_pool = store.thread_pool;
+    size_t size = (size_t) (end - begin);
+    if (thread_pool != 0 && size >= BULK_LOAD_PARALLEL_SORT_MIN) {
+        // one chunk per thread
+        size_t num_chunks = (size_t) thread_pool->NumThreads();
+        std::vector<T*> bounds(num_chunks + 1);
+        for (size_t i = 0; i <= num_chunks; ++i) {
+            bounds[i] = begin + size * i / num_chunks;
+        }
+        QuadTreeThreadPool::TaskGroup sort_group;
+        for (size_t i = 1; i < num_chunks; ++i) {
+            thread_pool->Spawn(sort_group, [&bounds, &sort, i]() {
+                sort(bounds[i], bounds[i + 1]);
+            });
+        }
+        sort(bounds[0], bounds[1]);
+        thread_pool->Wait(sort_group);
+
+        // merge neighbouring runs until there is only one left
+        for (size_t width = 1; width < num_chunks; width *= 2) {
+            QuadTreeThreadPool::TaskGroup merge_group;
+            for (size_t i = 0; i + width < num_chunks; i += 2 * width) {
+                T* first = bounds[i];
+                T* middle = bounds[i + width];
+                T* last = bounds[std::min(i + 2 * width, num_chunks)];
+                thread_pool->Spawn(merge_group, [first, middle, last, &less]() {
+                    std::inplace_merge(first, middle, last, less);
+                });
+            }
+            thread_pool->Wait(merge_group);
+        }
+        return;
+    }
+#else
+    (void) store;
+    (void) less;
+#endif
+    sort(begin, end);
+}
+
+/**
+ * LSD radix sort of Morton keys, 8 bits at a time
+ * @param begin
+ * @param end
+ * @param bits number of low bits that can be set in the keys
+ */
+void QuadTreeBulkLoader::RadixSort(uint64_t* begin, uint64_t* end, int bits) {
+    size_t size = (size_t) (end - begin);
+    std::vector<uint64_t> buffer(size);
+    uint64_t* from = begin;
+    uint64_t* to = buffer.data();
+    for (int shift = 0; shift < bits; shift += 8) {
+        size_t offsets[256] = {0};
+        for (uint64_t* key = from; key != from + size; ++key) {
+            ++offsets[(*key >> shift) & 255];
+        }
+        size_t total = 0;
+        for (size_t& offset : offsets) {
+            size_t count = offset;
+            offset = total;
+            total += count;
+        }
+        for (uint64_t* key = from; key != from + size; ++key) {
+            to[offsets[(*key >> shift) & 255]++] = *key;
+        }
+        std::swap(from, to);
+    }
+    if (from != begin) {
+        std::copy(from, from + size, begin);
+    }
+}
+
+/**
+ * Spread the low 32 bits of a value out to the even bits
+ * @param value
+ * @return value with a zero bit after each of its bits
+ */
+uint64_t QuadTreeBulkLoader::SpreadBits(uint64_t value) {
+    value &= UINT64_C(0x00000000FFFFFFFF);
+    value = (value | (value << 16)) & UINT64_C(0x0000FFFF0000FFFF);
+    value = (value | (value << 8)) & UINT64_C(0x00FF00FF00FF00FF);
+    value = (value | (value << 4)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    value = (value | (value << 2)) & UINT64_C(0x3333333333333333);
+    value = (value | (value << 1)) & UINT64_C(0x5555555555555555);
+    return value;
+}
+
+/**
+ * Gather the even bits of a value into the low 32 bits, which undoes SpreadBits()
+ * @param value
+ * @return the even bits of value
+ */
+uint64_t QuadTreeBulkLoader::CompactBits(uint64_t value) {
+    value &= UINT64_C(0x5555555555555555);
+    value = (value | (value >> 1)) & UINT64_C(0x3333333333333333);
+    value = (value | (value >> 2)) & UINT64_C(0x0F0F0F0F0F0F0F0F);
+    value = (value | (value >> 4)) & UINT64_C(0x00FF00FF00FF00FF);
+    value = (value | (value >> 8)) & UINT64_C(0x0000FFFF0000FFFF);
+    value = (value | (value >> 16)) & UINT64_C(0x00000000FFFFFFFF);
+    return value;
+}
+
+/**
+ * Build the node that covers [x, x + 2^level) by [y, y + 2^level) from a run of sorted cells that are all inside it
+ * @param store store to create nodes in
+ * @param begin first cell
+ * @param end one past the last cell
+ * @param x offset x coordinate of the node's upper left corner
+ * @param y offset y coordinate of the node's upper left corner
+ * @param level level of the node
+ * @return a canonical node
+ */
+QuadTreeNode* QuadTreeBulkLoader::BuildNode(QuadTreeNodeStore& store, const Cell* begin, const Cell* end, uint64_t x, uint64_t y, int level) {
+    if (begin == end) {
+        return store.EmptyQuadTree(level);
+    }
+    if (level == QuadTreeNode::kLeafLevel) {
+        uint64_t bits = 0;
+        for (const Cell* cell = begin; cell != end; ++cell) {
+            bits |= QuadTreeLeafKernel::CellBit((int64_t) (cell->x - x) - 4, (int64_t) (cell->y - y) - 4);
+        }
+        return store.CanonicalLeaf(bits);
+    }
+    // the runs of our quadrants follow each other in nw, ne, sw, se order, so we only have to find where each one ends
+    uint64_t half = UINT64_C(1) << (level - 1);
+    uint64_t mid_x = x + half;
+    uint64_t mid_y = y + half;
+    auto quadrant = [mid_x, mid_y](const Cell& cell) {
+        return (cell.y >= mid_y ? 2 : 0) + (cell.x >= mid_x ? 1 : 0);
+    };
+    const Cell* nw_end = std::partition_point(begin, end, [&quadrant](const Cell& cell) { return quadrant(cell) < 1; });
+    const Cell* ne_end = std::partition_point(nw_end, end, [&quadrant](const Cell& cell) { return quadrant(cell) < 2; });
+    const Cell* sw_end = std::partition_point(ne_end, end, [&quadrant](const Cell& cell) { return quadrant(cell) < 3; });
+    return store.Canonical(
+        BuildNode(store, begin, nw_end, x, y, level - 1),
+        BuildNode(store, nw_end, ne_end, mid_x, y, level - 1),
+        BuildNode(store, ne_end, sw_end, x, mid_y, level - 1),
+        BuildNode(store, sw_end, end, mid_x, mid_y, level - 1),
+        level
+    );
+}
+
+/**
+ * Build the node that covers [x, x + 2^level) by [y, y + 2^level) with random cells wherever it overlaps a rectangle
+ * @param store store to create nodes in
+ * @param random random stream, which every leaf that overlaps the rectangle takes its cells from in turn
+ * @param threshold from QuadTreeRandom::Threshold()
+ * @param rect rectangle to fill
+ * @param x offset x coordinate of the node's upper left corner
+ * @param y offset y coordinate of the node's upper left corner
+ * @param level level of the node
+ * @return a canonical node
+ */
+QuadTreeNode* QuadTreeBulkLoader::BuildSoupNode(QuadTreeNodeStore& store, QuadTreeRandom& random, uint32_t threshold, const Rect& rect,
+                                                uint64_t x, uint64_t y, int level) {
+    // level 64 covers every offset coordinate, so its last one is the biggest uint64_t
+    uint64_t last = level >= 64 ? UINT64_MAX : (UINT64_C(1) << level) - 1;
+    if (rect.max_x < x || rect.min_x > x + last || rect.max_y < y || rect.min_y > y + last) {
+        return store.EmptyQuadTree(level);
+    }
+    if (level == QuadTreeNode::kLeafLevel) {
+        // mask off the rows and columns of the leaf that are outside the rectangle
+        uint64_t first_column = std::max(rect.min_x, x) - x;
+        uint64_t last_column = std::min(rect.max_x, x + last) - x;
+        uint64_t first_row = std::max(rect.min_y, y) - y;
+        uint64_t last_row = std::min(rect.max_y, y + last) - y;
+        uint64_t row_mask = ((UINT64_C(2) << last_column) - 1) & ~((UINT64_C(1) << first_column) - 1);
+        uint64_t mask = 0;
+        for (uint64_t row = first_row; row <= last_row; ++row) {
+            mask |= row_mask << (row * 8);
+        }
+        return store.CanonicalLeaf(random.Bits(threshold) & mask);
+    }
+    // build the quadrants one at a time, so they always take their cells from the stream in the same order
+    uint64_t half = UINT64_C(1) << (level - 1);
+    QuadTreeNode* nw = BuildSoupNode(store, random, threshold, rect, x, y, level - 1);
+    QuadTreeNode* ne = BuildSoupNode(store, random, threshold, rect, x + half, y, level - 1);
+    QuadTreeNode* sw = BuildSoupNode(store, random, threshold, rect, x, y + half, level - 1);
+    QuadTreeNode* se = BuildSoupNode(store, random, threshold, rect, x + half, y + half, level - 1);
+    return store.Canonical(nw, ne, sw, se, level);
+}
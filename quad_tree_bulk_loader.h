@@ -0,0 +1,181 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREEBULKLOADER_H
+#define GOL_QUADTREEBULKLOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+#include "quad_tree_random.h"
+
+class QuadTreeNodeStore;
+
+/**
+ * Builds a tree from a list of alive cells in one go
+ *
+ * Setting cells one at a time copies a whole root to leaf path of nodes for every cell, and all but the last of those
+ * copies are garbage. Instead, we sort the cells in Morton (Z) order, so the cells of every node in the tree sit next
+ * to each other in a run, with the runs of its four quadrants in nw, ne, sw, se order. Then we build the tree bottom up,
+ * splitting each run into its quadrants, so every canonical node is looked up exactly once.
+ *
+ * Trees up to level 32 fit their interleaved Morton keys in 64 bits, so we radix sort those. Bigger trees are sorted by
+ * comparing coordinates. Big inputs are sorted in parallel on the store's thread pool (see BULK_LOAD_PARALLEL_SORT_MIN).
+ *
+ * Random soups skip the cell list altogether. BuildSoup() walks down to every leaf that touches the soup's rectangle and
+ * fills its 64 cells with a few words from a seeded QuadTreeRandom, so the same seed always builds the same tree.
+ */
+class QuadTreeBulkLoader {
+
+    public:
+
+        /**
+         * Build a tree with the given cells alive
+         * @param store store to create nodes in
+         * @param cells cells to set alive, in the form of {x, y}. Duplicates are fine
+         * @param num_cells number of cells
+         * @param origin_x cell x coordinates are relative to this
+         * @param origin_y cell y coordinates are relative to this
+         * @param min_level smallest level of the tree we return
+         * @return a canonical node at min_level or above, big enough to hold every cell
+         */
+        static QuadTreeNode* Build(QuadTreeNodeStore& store, const std::pair<int64_t, int64_t>* cells, size_t num_cells,
+                                   int64_t origin_x, int64_t origin_y, int min_level);
+
+        /**
+         * Build a tree with a rectangle of random cells. Leaves are visited in Morton order from a single random
+         * stream, so the same arguments always give the same tree
+         * @param store store to create nodes in
+         * @param min_x smallest x coordinate of the rectangle, relative to the tree's origin
+         * @param max_x biggest x coordinate of the rectangle, inclusive
+         * @param min_y smallest y coordinate of the rectangle, relative to the tree's origin
+         * @param max_y biggest y coordinate of the rectangle, inclusive
+         * @param density chance of each cell in the rectangle being alive, [0, 1]
+         * @param seed seed for QuadTreeRandom
+         * @param min_level smallest level of the tree we return
+         * @return a canonical node at min_level or above, big enough to hold the rectangle
+         */
+        static QuadTreeNode* BuildSoup(QuadTreeNodeStore& store, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y,
+                                       double density, uint64_t seed, int min_level);
+
+        /**
+         * Combine two nodes of the same level, so a cell is alive if it's alive in either of them
+         * @param store store to create nodes in
+         * @param a
+         * @param b
+         * @return a canonical node with the cells of both
+         */
+        static QuadTreeNode* Union(QuadTreeNodeStore& store, QuadTreeNode* a, QuadTreeNode* b);
+
+    private:
+
+        /**
+         * A cell's coordinates, offset so that the tree we build covers [0, 2^level) on both axes
+         */
+        struct Cell {
+            uint64_t x;
+            uint64_t y;
+        };
+
+        /**
+         * An inclusive rectangle of offset coordinates
+         */
+        struct Rect {
+            uint64_t min_x;
+            uint64_t max_x;
+            uint64_t min_y;
+            uint64_t max_y;
+        };
+
+        /**
+         * Find the level of the smallest tree centered on the origin that holds a range of coordinates
+         * @param min smallest coordinate on either axis, relative to the origin
+         * @param max biggest coordinate on either axis, relative to the origin
+         * @param min_level smallest level we return
+         * @return level, up to 64
+         */
+        static int Level(int64_t min, int64_t max, int min_level);
+
+        /**
+         * Does a come before b in Morton order? At every bit y comes before x, which puts the quadrants of a node in
+         * nw, ne, sw, se order. We compare the highest bits that differ instead of building the interleaved key,
+         * which would take 128 bits
+         * @param a
+         * @param b
+         * @return true if a sorts before b
+         */
+        static bool MortonLess(const Cell& a, const Cell& b);
+
+        /**
+         * Sort cells in Morton order
+         * @param store store whose thread pool we can use
+         * @param cells
+         * @param level level of the tree the cells are in
+         */
+        static void Sort(QuadTreeNodeStore& store, std::vector<Cell>& cells, int level);
+
+        /**
+         * Sort a range with a function, or if it's big, sort chunks of it on the store's thread pool and merge them
+         * @param store store whose thread pool we can use
+         * @param begin
+         * @param end
+         * @param sort sorts a range, sort(begin, end)
+         * @param less the order sort puts things in, less(a, b)
+         */
+        template <class T, class SortFunction, class LessFunction>
+        static void SortInChunks(QuadTreeNodeStore& store, T* begin, T* end, SortFunction sort, LessFunction less);
+
+        /**
+         * LSD radix sort of Morton keys, 8 bits at a time
+         * @param begin
+         * @param end
+         * @param bits number of low bits that can be set in the keys
+         */
+        static void RadixSort(uint64_t* begin, uint64_t* end, int bits);
+
+        /**
+         * Spread the low 32 bits of a value out to the even bits
+         * @param value
+         * @return value with a zero bit after each of its bits
+         */
+        static uint64_t SpreadBits(uint64_t value);
+
+        /**
+         * Gather the even bits of a value into the low 32 bits, which undoes SpreadBits()
+         * @param value
+         * @return the even bits of value
+         */
+        static uint64_t CompactBits(uint64_t value);
+
+        /**
+         * Build the node that covers [x, x + 2^level) by [y, y + 2^level) from a run of sorted cells that are all inside it
+         * @param store store to create nodes in
+         * @param begin first cell
+         * @param end one past the last cell
+         * @param x offset x coordinate of the node's upper left corner
+         * @param y offset y coordinate of the node's upper left corner
+         * @param level level of the node
+         * @return a canonical node
+         */
+        static QuadTreeNode* BuildNode(QuadTreeNodeStore& store, const Cell* begin, const Cell* end, uint64_t x, uint64_t y, int level);
+
+        /**
+         * Build the node that covers [x, x + 2^level) by [y, y + 2^level) with random cells wherever it overlaps a rectangle
+         * @param store store to create nodes in
+         * @param random random stream, which every leaf that overlaps the rectangle takes its cells from in turn
+         * @param threshold from QuadTreeRandom::Threshold()
+         * @param rect rectangle to fill
+         * @param x offset x coordinate of the node's upper left corner
+         * @param y offset y coordinate of the node's upper left corner
+         * @param level level of the node
+         * @return a canonical node
+         */
+        static QuadTreeNode* BuildSoupNode(QuadTreeNodeStore& store, QuadTreeRandom& random, uint32_t threshold, const Rect& rect,
+                                           uint64_t x, uint64_t y, int level);
+};
+
+#endif //GOL_QUADTREEBULKLOADER_H
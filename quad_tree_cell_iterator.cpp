@@ -0,0 +1,325 @@
+//
+// Created by agent on 10/16/26.
+//
+#include "quad_tree_cell_iterator.h"
+#include "quad_tree_leaf_kernel.h"
+
+#if (ENABLE_BIG_INT)
+/**
+ * Start walking a tree
+ * @param root root of the tree
+ * @param origin_x multi precision display coordinate of the root's center
+ * @param origin_y multi precision display coordinate of the root's center
+ */
+QuadTreeCellIterator::QuadTreeCellIterator(const QuadTreeNode* root, const mpz_class& origin_x, const mpz_class& origin_y) {
+    clipped = false;
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    Start(root);
+}
+
+/**
+ * Start walking the cells of a tree inside a rectangle
+ * @param root root of the tree
+ * @param origin_x multi precision display coordinate of the root's center
+ * @param origin_y multi precision display coordinate of the root's center
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ */
+QuadTreeCellIterator::QuadTreeCellIterator(const QuadTreeNode* root, const mpz_class& origin_x, const mpz_class& origin_y,
+                                           const mpz_class& x0, const mpz_class& y0, const mpz_class& x1, const mpz_class& y1) {
+    clipped = true;
+    rect_x0 = x0;
+    rect_y0 = y0;
+    rect_x1 = x1;
+    rect_y1 = y1;
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    Start(root);
+}
+
+/**
+ * Shared part of the constructors, once the origin and the rectangle are set
+ * @param root root of the tree
+ */
+void QuadTreeCellIterator::Start(const QuadTreeNode* root) {
+    leaf_bits = 0;
+    leaf_x = 0;
+    leaf_y = 0;
+    clip_x0 = INT64_MIN;
+    clip_y0 = INT64_MIN;
+    clip_x1 = INT64_MAX;
+    clip_y1 = INT64_MAX;
+    if (root->empty) {
+        return;
+    }
+    // the root is 2^level wide
+    mpz_class half;
+    #if (ENABLE_INFINITE_LEVELS)
+    Pow2(half, (mp_bitcnt_t) root->level.get_ui() - 1);
+    #else
+    Pow2(half, (mp_bitcnt_t) root->level - 1);
+    #endif
+    BigFrame frame;
+    frame.node = root;
+    frame.x = origin_x;
+    frame.y = origin_y;
+    if (!Overlaps(frame, half)) {
+        return;
+    }
+    if (root->level <= kMaxOffsetLevel) {
+        // the whole tree is within 64 bit offsets of its center
+        ClipToOrigin();
+        stack.push_back({root, 0, 0});
+    } else {
+        big_stack.push_back(frame);
+        NextOrigin();
+    }
+}
+#else
+/**
+ * Start walking a tree
+ * @param root root of the tree
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ */
+QuadTreeCellIterator::QuadTreeCellIterator(const QuadTreeNode* root, int64_t origin_x, int64_t origin_y) {
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    clip_x0 = INT64_MIN;
+    clip_y0 = INT64_MIN;
+    clip_x1 = INT64_MAX;
+    clip_y1 = INT64_MAX;
+    Start(root);
+}
+
+/**
+ * Start walking the cells of a tree inside a rectangle
+ * @param root root of the tree
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ */
+QuadTreeCellIterator::QuadTreeCellIterator(const QuadTreeNode* root, int64_t origin_x, int64_t origin_y, int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    clip_x0 = x0 - origin_x;
+    clip_y0 = y0 - origin_y;
+    clip_x1 = x1 - origin_x;
+    clip_y1 = y1 - origin_y;
+    Start(root);
+}
+
+/**
+ * Shared part of the constructors, once the origin and the rectangle are set
+ * @param root root of the tree
+ */
+void QuadTreeCellIterator::Start(const QuadTreeNode* root) {
+    leaf_bits = 0;
+    leaf_x = 0;
+    leaf_y = 0;
+    if (!root->empty && Overlaps(0, 0, INT64_C(1) << (root->level - 1))) {
+        stack.push_back({root, 0, 0});
+    }
+}
+#endif
+
+/**
+ * Write the next chunk of cells into two arrays
+ * @param x x offsets of the cells from OriginX()
+ * @param y y offsets of the cells from OriginY()
+ * @param max_cells room in each array
+ * @return number of cells written, 0 once every cell has been written
+ */
+size_t QuadTreeCellIterator::Next(int64_t* x, int64_t* y, size_t max_cells) {
+    return Fill([x, y](size_t index, int64_t cell_x, int64_t cell_y) {
+        x[index] = cell_x;
+        y[index] = cell_y;
+    }, max_cells);
+}
+
+/**
+ * Write the next chunk of cells into an array of packed cells
+ * @param cells offsets of the cells from the origin
+ * @param max_cells room in the array
+ * @return number of cells written, 0 once every cell has been written
+ */
+size_t QuadTreeCellIterator::Next(Cell* cells, size_t max_cells) {
+    return Fill([cells](size_t index, int64_t cell_x, int64_t cell_y) {
+        cells[index].x = cell_x;
+        cells[index].y = cell_y;
+    }, max_cells);
+}
+
+/**
+ * @return true once every cell has been written
+ */
+bool QuadTreeCellIterator::Done() const {
+#if (ENABLE_BIG_INT)
+    return leaf_bits == 0 && stack.empty() && big_stack.empty();
+#else
+    return leaf_bits == 0 && stack.empty();
+#endif
+}
+
+/**
+ * Shared part of both Next() calls
+ * @param output void(size_t index, int64_t x, int64_t y), writes a cell
+ * @param max_cells most cells to write
+ * @return number of cells written
+ */
+template <class Output>
+size_t QuadTreeCellIterator::Fill(Output output, size_t max_cells) {
+    size_t num_cells = 0;
+    while (num_cells < max_cells) {
+        if (leaf_bits != 0) {
+            // finish the leaf we're in, row by row, and pick up where we left off next time if we run out of room
+            do {
+                int index = QuadTreeLeafKernel::LowestCellIndex(leaf_bits);
+                output(num_cells++, leaf_x + ((index & 7) - 4), leaf_y + ((index >> 3) - 4));
+                leaf_bits &= leaf_bits - 1;
+            } while (leaf_bits != 0 && num_cells < max_cells);
+            continue;
+        }
+        if (stack.empty()) {
+            // the next node has a different origin, so it has to wait for the next chunk
+            if (num_cells != 0 || !NextOrigin()) {
+                break;
+            }
+            continue;
+        }
+        Frame frame = stack.back();
+        stack.pop_back();
+        const QuadTreeNode* node = frame.node;
+        if (node->level == QuadTreeNode::kLeafLevel) {
+            leaf_bits = node->bits;
+            leaf_x = frame.x;
+            leaf_y = frame.y;
+            if (!Inside(frame.x, frame.y, 4)) {
+                // the leaf straddles an edge of the rectangle
+                leaf_bits &= QuadTreeLeafKernel::RectMask(clip_x0 - frame.x, clip_y0 - frame.y, clip_x1 - frame.x, clip_y1 - frame.y);
+            }
+            continue;
+        }
+    #if (ENABLE_INFINITE_LEVELS)
+        int64_t offset = INT64_C(1) << (node->level.get_si() - 2);
+    #else
+        int64_t offset = INT64_C(1) << (node->level - 2);
+    #endif
+        // pushed backwards, so that the northwest child comes off first. Children are 2 * offset wide, and our
+        // quadrants tell us which of them are empty without looking at them
+        if ((node->quadrants & QuadTreeNode::kSoutheast) != 0 && Overlaps(frame.x + offset, frame.y + offset, offset)) {
+            stack.push_back({node->se, frame.x + offset, frame.y + offset});
+        }
+        if ((node->quadrants & QuadTreeNode::kSouthwest) != 0 && Overlaps(frame.x - offset, frame.y + offset, offset)) {
+            stack.push_back({node->sw, frame.x - offset, frame.y + offset});
+        }
+        if ((node->quadrants & QuadTreeNode::kNortheast) != 0 && Overlaps(frame.x + offset, frame.y - offset, offset)) {
+            stack.push_back({node->ne, frame.x + offset, frame.y - offset});
+        }
+        if ((node->quadrants & QuadTreeNode::kNorthwest) != 0 && Overlaps(frame.x - offset, frame.y - offset, offset)) {
+            stack.push_back({node->nw, frame.x - offset, frame.y - offset});
+        }
+    }
+    return num_cells;
+}
+
+/**
+ * Once we're done with a node at kMaxOffsetLevel, walk down the nodes above it until we get to the next one,
+ * and make its center the origin
+ * @return false if there are none left
+ */
+bool QuadTreeCellIterator::NextOrigin() {
+#if (ENABLE_BIG_INT)
+    while (!big_stack.empty()) {
+        BigFrame frame;
+        frame.node = big_stack.back().node;
+        frame.x.swap(big_stack.back().x);
+        frame.y.swap(big_stack.back().y);
+        big_stack.pop_back();
+        const QuadTreeNode* node = frame.node;
+        if (node->level <= kMaxOffsetLevel) {
+            origin_x.swap(frame.x);
+            origin_y.swap(frame.y);
+            ClipToOrigin();
+            stack.push_back({node, 0, 0});
+            return true;
+        }
+        // children are centered 2^(level-2) away from us, which is also half their width
+        mpz_class offset;
+    #if (ENABLE_INFINITE_LEVELS)
+        Pow2(offset, (mp_bitcnt_t) node->level.get_ui() - 2);
+    #else
+        Pow2(offset, (mp_bitcnt_t) node->level - 2);
+    #endif
+        BigFrame children[4];
+        children[0] = {node->se, frame.x + offset, frame.y + offset};
+        children[1] = {node->sw, frame.x - offset, frame.y + offset};
+        children[2] = {node->ne, frame.x + offset, frame.y - offset};
+        children[3] = {node->nw, frame.x - offset, frame.y - offset};
+        for (BigFrame& child : children) {
+            if (!child.node->empty && Overlaps(child, offset)) {
+                big_stack.emplace_back();
+                big_stack.back().node = child.node;
+                big_stack.back().x.swap(child.x);
+                big_stack.back().y.swap(child.y);
+            }
+        }
+    }
+#endif
+    return false;
+}
+
+#if (ENABLE_BIG_INT)
+/**
+ * @param frame a node above kMaxOffsetLevel
+ * @param half half of the node's width
+ * @return true if the node overlaps the rectangle
+ */
+bool QuadTreeCellIterator::Overlaps(const BigFrame& frame, const mpz_class& half) const {
+    if (!clipped) {
+        return true;
+    }
+    return frame.x - half <= rect_x1 && frame.x + half - 1 >= rect_x0 && frame.y - half <= rect_y1 && frame.y + half - 1 >= rect_y0;
+}
+
+/**
+ * Set the rectangle's offsets from a new origin, cut down to what fits in 64 bits. The node at the origin has
+ * to overlap the rectangle
+ */
+void QuadTreeCellIterator::ClipToOrigin() {
+    if (!clipped) {
+        return;
+    }
+    // the node is at most 2^kMaxOffsetLevel wide, so anything past 2^kMaxOffsetLevel away is as good as infinity
+    const mpz_class& limit = QuadTreeNode::mpz_pow2_table[kMaxOffsetLevel];
+    mpz_class edges[4] = {rect_x0 - origin_x, rect_y0 - origin_y, rect_x1 - origin_x, rect_y1 - origin_y};
+    int64_t* clips[4] = {&clip_x0, &clip_y0, &clip_x1, &clip_y1};
+    for (int i = 0; i < 4; ++i) {
+        if (edges[i] > limit) {
+            edges[i] = limit;
+        } else if (edges[i] < -limit) {
+            edges[i] = -limit;
+        }
+        *clips[i] = edges[i].get_si();
+    }
+}
+
+/**
+ * @param result set to 2^exponent, from the precalculated table unless it's too big
+ * @param exponent
+ */
+void QuadTreeCellIterator::Pow2(mpz_class& result, mp_bitcnt_t exponent) {
+    if (exponent < LEVEL_MAX) {
+        result = QuadTreeNode::mpz_pow2_table[exponent];
+    } else {
+        result = 0;
+        mpz_setbit(result.get_mpz_t(), exponent);
+    }
+}
+#endif
@@ -0,0 +1,261 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREECELLITERATOR_H
+#define GOL_QUADTREECELLITERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+
+#if (ENABLE_BIG_INT)
+#include <gmpxx.h>
+#endif
+
+/**
+ * Walks the alive cells of a tree a chunk at a time, so they can be exported without building a display list
+ *
+ * Cells come out as signed 64 bit offsets from an origin, and are written into buffers the caller owns, either as
+ * separate x and y arrays or as packed Cells, as many as fit per call to Next(). We walk the tree depth first with an
+ * explicit stack and skip empty nodes, so nothing is allocated per node or per cell. Cells come out in the same order
+ * as BuildDisplayList() lists them: northwest, northeast, southwest and southeast first, and a leaf's cells row by row.
+ *
+ * With big integers the origin is a multi-precision display coordinate. Offsets from the center of a node up to
+ * kMaxOffsetLevel always fit in 64 bits, so in a tree that size every cell has the tree's origin. In a taller tree,
+ * every non-empty node at kMaxOffsetLevel has an origin of its own, the display coordinates of its center, and we only
+ * do multi-precision math for the few nodes above them. A chunk never mixes two origins, so read OriginX() and
+ * OriginY() after every call to Next().
+ *
+ * An iterator can also be given a rectangle, and then only writes the cells inside it. Nodes that are outside of it
+ * are skipped whole and leaves that straddle its edges are masked, so the work follows the size of what's visible
+ * rather than the size of the tree.
+ *
+ * The iterator reads nodes as it goes, so don't step the tree or collect garbage until you're done with it.
+ */
+class QuadTreeCellIterator {
+
+    public:
+
+        /**
+         * An alive cell, as offsets from the origin
+         */
+        struct Cell {
+            int64_t x;
+            int64_t y;
+        };
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * Start walking a tree
+         * @param root root of the tree
+         * @param origin_x multi precision display coordinate of the root's center
+         * @param origin_y multi precision display coordinate of the root's center
+         */
+        QuadTreeCellIterator(const QuadTreeNode* root, const mpz_class& origin_x, const mpz_class& origin_y);
+
+        /**
+         * Start walking the cells of a tree inside a rectangle
+         * @param root root of the tree
+         * @param origin_x multi precision display coordinate of the root's center
+         * @param origin_y multi precision display coordinate of the root's center
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         */
+        QuadTreeCellIterator(const QuadTreeNode* root, const mpz_class& origin_x, const mpz_class& origin_y,
+                             const mpz_class& x0, const mpz_class& y0, const mpz_class& x1, const mpz_class& y1);
+    #else
+        /**
+         * Start walking a tree
+         * @param root root of the tree
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         */
+        QuadTreeCellIterator(const QuadTreeNode* root, int64_t origin_x, int64_t origin_y);
+
+        /**
+         * Start walking the cells of a tree inside a rectangle
+         * @param root root of the tree
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         */
+        QuadTreeCellIterator(const QuadTreeNode* root, int64_t origin_x, int64_t origin_y, int64_t x0, int64_t y0, int64_t x1, int64_t y1);
+    #endif
+
+        /**
+         * Write the next chunk of cells into two arrays
+         * @param x x offsets of the cells from OriginX()
+         * @param y y offsets of the cells from OriginY()
+         * @param max_cells room in each array
+         * @return number of cells written, 0 once every cell has been written
+         */
+        size_t Next(int64_t* x, int64_t* y, size_t max_cells);
+
+        /**
+         * Write the next chunk of cells into an array of packed cells
+         * @param cells offsets of the cells from the origin
+         * @param max_cells room in the array
+         * @return number of cells written, 0 once every cell has been written
+         */
+        size_t Next(Cell* cells, size_t max_cells);
+
+        /**
+         * @return true once every cell has been written
+         */
+        bool Done() const;
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * @return multi precision x coordinate the last chunk's offsets are from
+         */
+        const mpz_class& OriginX() const { return origin_x; }
+
+        /**
+         * @return multi precision y coordinate the last chunk's offsets are from
+         */
+        const mpz_class& OriginY() const { return origin_y; }
+    #else
+        /**
+         * @return x coordinate the offsets are from
+         */
+        int64_t OriginX() const { return origin_x; }
+
+        /**
+         * @return y coordinate the offsets are from
+         */
+        int64_t OriginY() const { return origin_y; }
+    #endif
+
+        // biggest level whose cells are all within 64 bit offsets of its center
+        static const int kMaxOffsetLevel = 62;
+
+    private:
+
+        /**
+         * A node we still have to walk, and its center as offsets from the origin
+         */
+        struct Frame {
+            const QuadTreeNode* node;
+            int64_t x;
+            int64_t y;
+        };
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * A node above kMaxOffsetLevel we still have to walk, and the display coordinates of its center
+         */
+        struct BigFrame {
+            const QuadTreeNode* node;
+            mpz_class x;
+            mpz_class y;
+        };
+    #endif
+
+        /**
+         * Shared part of the constructors, once the origin and the rectangle are set
+         * @param root root of the tree
+         */
+        void Start(const QuadTreeNode* root);
+
+        /**
+         * @param x offset of a node's center from the origin
+         * @param y offset of a node's center from the origin
+         * @param half half of the node's width
+         * @return true if the node overlaps the rectangle
+         */
+        bool Overlaps(int64_t x, int64_t y, int64_t half) const {
+            return x - half <= clip_x1 && x + half - 1 >= clip_x0 && y - half <= clip_y1 && y + half - 1 >= clip_y0;
+        }
+
+        /**
+         * @param x offset of a node's center from the origin
+         * @param y offset of a node's center from the origin
+         * @param half half of the node's width
+         * @return true if the node is all inside the rectangle
+         */
+        bool Inside(int64_t x, int64_t y, int64_t half) const {
+            return x - half >= clip_x0 && x + half - 1 <= clip_x1 && y - half >= clip_y0 && y + half - 1 <= clip_y1;
+        }
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * @param frame a node above kMaxOffsetLevel
+         * @param half half of the node's width
+         * @return true if the node overlaps the rectangle
+         */
+        bool Overlaps(const BigFrame& frame, const mpz_class& half) const;
+
+        /**
+         * Set the rectangle's offsets from a new origin, cut down to what fits in 64 bits. The node at the origin has
+         * to overlap the rectangle
+         */
+        void ClipToOrigin();
+
+        /**
+         * @param result set to 2^exponent, from the precalculated table unless it's too big
+         * @param exponent
+         */
+        static void Pow2(mpz_class& result, mp_bitcnt_t exponent);
+    #endif
+
+        /**
+         * Shared part of both Next() calls
+         * @param output void(size_t index, int64_t x, int64_t y), writes a cell
+         * @param max_cells most cells to write
+         * @return number of cells written
+         */
+        template <class Output>
+        size_t Fill(Output output, size_t max_cells);
+
+        /**
+         * Once we're done with a node at kMaxOffsetLevel, walk down the nodes above it until we get to the next one,
+         * and make its center the origin
+         * @return false if there are none left
+         */
+        bool NextOrigin();
+
+    private:
+
+        // nodes left to walk, the next one on top
+        std::vector<Frame> stack;
+
+        // cells of the leaf we're in the middle of, and its center
+        uint64_t leaf_bits;
+        int64_t leaf_x;
+        int64_t leaf_y;
+
+        // the rectangle as offsets from the origin. Without one it's everything a 64 bit offset can reach
+        int64_t clip_x0;
+        int64_t clip_y0;
+        int64_t clip_x1;
+        int64_t clip_y1;
+
+    #if (ENABLE_BIG_INT)
+        // nodes above kMaxOffsetLevel left to walk, the next one on top
+        std::vector<BigFrame> big_stack;
+
+        // what the offsets are from
+        mpz_class origin_x;
+        mpz_class origin_y;
+
+        // the rectangle in display coordinates, if we were given one
+        bool clipped;
+        mpz_class rect_x0;
+        mpz_class rect_y0;
+        mpz_class rect_x1;
+        mpz_class rect_y1;
+    #else
+        int64_t origin_x;
+        int64_t origin_y;
+    #endif
+};
+
+#endif //GOL_QUADTREECELLITERATOR_H
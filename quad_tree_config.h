@@ -33,6 +33,48 @@
  */
 #define ENABLE_QUADTREE_CENTER_ALIGN            1&&ENABLE_BIG_INT // enable/disable aligning the quad tree to the center of input
 
+/**
+ * Nodes are allocated in chunks from an arena. With this on, chunks that are at least 2MB are aligned to 2MB and
+ * we ask the kernel to back them with transparent huge pages (Linux only), which helps with big runs that have
+ * millions of nodes. Small runs never get chunks this large, so they are unaffected
+ */
+#define ENABLE_NODE_ARENA_HUGE_PAGES            1   // enable/disable madvise(MADV_HUGEPAGE) on large node arena chunks
+
+/**
+ * Nodes point to each other with 32 bit indices into one block of address space that every arena's chunks come out of,
+ * see QuadTreeNodeHeap. The block is only reserved, so it doesn't use memory until nodes are put in it, and it's the
+ * most memory nodes can ever use. Indices count in 16 byte leaves, so they can't reach past 64GB
+ */
+#define NODE_HEAP_RESERVE_BYTES                 (UINT64_C(1) << 36)   // address space to reserve for nodes
+
+/**
+ * Leaves are 8x8 bitboards that we evolve with a bit parallel kernel. With this on, we use GCC/clang vector extensions
+ * so the kernel works on all 256 cells of four leaves with SIMD instructions. Turn it off for plain 64 bit math
+ */
+#define ENABLE_SIMD_LEAF_KERNEL                 1   // enable/disable vector extensions in the leaf kernel
+
+/**
+ * Instead of the bit parallel kernel, evolve leaves with a 65536 entry table that maps every 4x4 block of cells to the
+ * next generation of its inner 2x2 cells. The table is built at startup and takes 64KB
+ */
+#define ENABLE_LEAF_LOOKUP_TABLE                0   // enable/disable the lookup table leaf kernel
+
+/**
+ * Evolve big nodes on a work stealing thread pool. A node at or above EVOLVE_PARALLEL_LEVEL_MIN evolves its nine
+ * (or four) sub-squares as separate tasks, and everything below that is evolved serially by whichever thread runs the task.
+ * The result is the same canonical node the serial engine computes. Both values can be changed at runtime with
+ * QuadTreeNodeStore::SetThreads()
+ */
+#define ENABLE_PARALLEL_EVOLVE                  1   // enable/disable the evolve thread pool
+#define EVOLVE_THREADS                          0   // number of threads to evolve with, 0 is one per hardware thread
+#define EVOLVE_PARALLEL_LEVEL_MIN               10  // smallest level whose sub-squares are evolved as separate tasks
+
+/**
+ * SetCellsAlive() sorts its cells in Morton (Z) order and builds the tree bottom up, so every node is built once.
+ * Inputs with at least this many cells are sorted in parallel on the store's thread pool
+ */
+#define BULK_LOAD_PARALLEL_SORT_MIN             (1 << 16)   // smallest number of cells we sort in parallel
+
 /**
  * Debug variables
  */
@@ -63,6 +105,69 @@
 #define GARBAGE_COLLECTION_NODES_COUNT          100000    // number of nodes threshold to collect garbage
 #endif
 
+/**
+ * Print what every garbage collection did: how long it paused for, how many nodes it freed, the bytes they took up,
+ * and the bytes of arena chunks it gave back to the system. The totals are always in PrintStats()
+ */
+#define GARBAGE_COLLECTION_REPORT               (1&&ENABLE_GARBAGE_COLLECTION)         // print stats after every collection
+
+/**
+ * How a collection runs once it's triggered (QuadTreeNodeStore::SetCollectionMode() switches at runtime):
+ * 1) Stop the world: mark and sweep everything at once, which holds up the step that triggered it
+ *  - Fastest overall, and the only mode that gives empty arena chunks back to the system
+ * 2) Incremental: mark, clean the node table and sweep the arenas after every step, a budget's worth at a time
+ *  - No step is held up for much more than the budget, but steps pay for a write barrier while we mark, and
+ *      garbage made during a collection waits for the next one
+ * 3) Concurrent sweep: incremental, but the arenas are swept on a helper thread while we keep stepping
+ */
+#define GARBAGE_COLLECTION_INCREMENTAL          (0&&ENABLE_GARBAGE_COLLECTION)         // collect a bit after every step
+#define GARBAGE_COLLECTION_CONCURRENT_SWEEP     (0&&GARBAGE_COLLECTION_INCREMENTAL)    // sweep on a helper thread
+#define GARBAGE_COLLECTION_STEP_BUDGET_US       1000                                   // incremental work per step, in microseconds
+
+/**
+ * Collect garbage in the middle of a step once the store passes a limit, so that one huge step can't run us out of
+ * memory. Nodes at GARBAGE_COLLECTION_PRESSURE_LEVEL or above pin the nodes they're evolving and look at the limits
+ * before each of their sub-squares (QuadTreeNodeStore::SetPressureLimit() changes these at runtime):
+ *  - A lower level checks more often, so we overshoot the limit by less, but pins more frames
+ *  - Everything on the stack is pinned, so the live set in the middle of a step can be bigger than between steps.
+ *      After a collection, we wait for the nodes to grow by a quarter before collecting again
+ */
+#define GARBAGE_COLLECTION_PRESSURE_NODES       0     // collect during a step past this many nodes, 0 for no limit
+#define GARBAGE_COLLECTION_PRESSURE_BYTES       0     // collect during a step past this many bytes of nodes and node table, 0 for no limit
+#define GARBAGE_COLLECTION_PRESSURE_LEVEL       10    // smallest level a step stops at to collect
+
+/**
+ * Keep the store under a budget of bytes by letting go of memoized results that haven't been used lately, instead of
+ * keeping every result a live node points to (QuadTreeNodeStore::SetMemoBudget() changes this at runtime). Nodes age
+ * like a clock: every collection ages them, and evolving or looking them up makes them young again. A collection is
+ * triggered once we pass the budget, and keeps what's young enough to land around half of it:
+ *  - Results that keep getting reused survive, even from nodes nothing points to any more, which a collection without
+ *      a budget would drop. That's what keeps long runs like guns and methuselahs fast in a fixed amount of memory
+ *  - Results we let go of are calculated again if they're needed, so a budget that's too small trades memory for time
+ *  - The budget is checked between steps. Pair it with GARBAGE_COLLECTION_PRESSURE_BYTES for single huge steps
+ */
+#define GARBAGE_COLLECTION_MEMO_BUDGET_BYTES    0     // bytes of nodes and node table to stay under, 0 for no budget
+
+/**
+ * Every so many collections, move every node into one new arena in depth first order, so that a node's children sit
+ * next to each other instead of in whatever holes earlier collections left (QuadTreeNodeStore::Compact() does this
+ * on demand, and SetCompactionInterval() changes the interval at runtime):
+ *  - Long lived universes that mostly stay the same get fewer cache misses when evolving and building display lists
+ *  - Compacting copies every live node and rebuilds the node table, so it costs about as much as a collection, and
+ *      needs room for a second copy of the live nodes while it runs
+ */
+#define GARBAGE_COLLECTION_COMPACT_INTERVAL     0     // collections between compactions, 0 to never compact on our own
+
+/**
+ * A QuadTreeFrameWriter attached to a tree (QuadTree::SetFrameWriter()) queues the tree's root after the steps that
+ * reach every so many generations, for a thread of its own to render, encode and write:
+ *  - Up to this many frames wait for that thread, and past that new frames are dropped and counted, so a slow disk
+ *      costs frames instead of holding up the step
+ *  - Every waiting frame keeps its generation's nodes alive and holds off compaction, so a long queue can keep a lot
+ *      of nodes around if the tree changes quickly
+ */
+#define FRAME_WRITER_QUEUE_FRAMES               8     // frames that can wait to be rendered and written before we drop frames
+
 /**
  * Enable/disable debug printing
  */
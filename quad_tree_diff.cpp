@@ -0,0 +1,196 @@
+//
+// Created by agent on 10/16/26.
+//
+#include "quad_tree_diff.h"
+#include "quad_tree_leaf_kernel.h"
+
+/**
+ * @param old_root root before, which mustn't change or be collected while we diff
+ * @param new_root root after, at the same level as old_root
+ * @param origin_x display coordinate of both roots' center
+ * @param origin_y display coordinate of both roots' center
+ */
+QuadTreeDiff::QuadTreeDiff(const QuadTreeNode* old_root, const QuadTreeNode* new_root, const coordinate_type& origin_x, const coordinate_type& origin_y) {
+    this->old_root = old_root;
+    this->new_root = new_root;
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    clip_x0 = 0;
+    clip_y0 = 0;
+    clip_x1 = 0;
+    clip_y1 = 0;
+    corner_x = 0;
+    corner_y = 0;
+    born = 0;
+    died = 0;
+    nodes_visited = 0;
+}
+
+/**
+ * Find the cells inside a rectangle that changed between the roots
+ * @param x0 display coordinate of the rectangle's west edge
+ * @param y0 display coordinate of the rectangle's north edge
+ * @param x1 display coordinate of the rectangle's east edge, inclusive
+ * @param y1 display coordinate of the rectangle's south edge, inclusive
+ * @param born offsets from (x0, y0) of the cells alive in the new root and not the old one are added to this
+ * @param died offsets from (x0, y0) of the cells alive in the old root and not the new one are added to this
+ * @return number of cells that changed
+ */
+size_t QuadTreeDiff::Diff(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                          std::vector<std::pair<int64_t, int64_t>>& born, std::vector<std::pair<int64_t, int64_t>>& died) {
+    nodes_visited = 0;
+    if (x1 < x0 || y1 < y0 || old_root == new_root) {
+        return 0;
+    }
+    this->born = &born;
+    this->died = &died;
+    size_t num_changes = born.size() + died.size();
+#if (ENABLE_INFINITE_LEVELS)
+    int level = (int) old_root->level.get_si();
+#else
+    int level = old_root->level;
+#endif
+    const QuadTreeNode* old_node = old_root->empty ? 0 : old_root;
+    const QuadTreeNode* new_node = new_root->empty ? 0 : new_root;
+#if (ENABLE_BIG_INT)
+    rect_x0 = x0;
+    rect_y0 = y0;
+    rect_x1 = x1;
+    rect_y1 = y1;
+    DiffBig(old_node, new_node, level, origin_x, origin_y);
+#else
+    clip_x0 = x0 - origin_x;
+    clip_y0 = y0 - origin_y;
+    clip_x1 = x1 - origin_x;
+    clip_y1 = y1 - origin_y;
+    corner_x = origin_x - x0;
+    corner_y = origin_y - y0;
+    Diff(old_node, new_node, level, 0, 0);
+#endif
+    return born.size() + died.size() - num_changes;
+}
+
+#if (ENABLE_BIG_INT)
+/**
+ * Diff a pair of nodes more than 2^kMaxOffsetLevel wide
+ * @param old_node node before, 0 if it's empty
+ * @param new_node node after, 0 if it's empty
+ * @param level level of both nodes
+ * @param x display coordinate of the nodes' center
+ * @param y display coordinate of the nodes' center
+ */
+void QuadTreeDiff::DiffBig(const QuadTreeNode* old_node, const QuadTreeNode* new_node, int level, const mpz_class& x, const mpz_class& y) {
+    if (old_node == new_node) {
+        return;
+    }
+    if (level <= kMaxOffsetLevel) {
+        // the node's center becomes the origin, and anything past 2^kMaxOffsetLevel away from it is as good as infinity
+        const mpz_class& limit = QuadTreeNode::mpz_pow2_table[kMaxOffsetLevel];
+        mpz_class edges[4] = {rect_x0 - x, rect_y0 - y, rect_x1 - x, rect_y1 - y};
+        int64_t* clips[4] = {&clip_x0, &clip_y0, &clip_x1, &clip_y1};
+        for (int i = 0; i < 4; ++i) {
+            if (edges[i] > limit) {
+                edges[i] = limit;
+            } else if (edges[i] < -limit) {
+                edges[i] = -limit;
+            }
+            *clips[i] = edges[i].get_si();
+        }
+        // cells we find are inside the rectangle, so their offsets from its corner fit even if the center's don't
+        corner_x = (int64_t) mpz_class(x - rect_x0).get_si();
+        corner_y = (int64_t) mpz_class(y - rect_y0).get_si();
+        Diff(old_node, new_node, level, 0, 0);
+        return;
+    }
+    ++nodes_visited;
+    mpz_class half = 0;
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) level - 1);
+    if (x - half > rect_x1 || x + half - 1 < rect_x0 || y - half > rect_y1 || y + half - 1 < rect_y0) {
+        return;
+    }
+    // children are centered 2^(level-2) away from us
+    mpz_class offset = 0;
+    mpz_setbit(offset.get_mpz_t(), (mp_bitcnt_t) level - 2);
+    const QuadTreeNode* old_children[4];
+    const QuadTreeNode* new_children[4];
+    Children(old_node, old_children);
+    Children(new_node, new_children);
+    DiffBig(old_children[0], new_children[0], level - 1, x - offset, y - offset);
+    DiffBig(old_children[1], new_children[1], level - 1, x + offset, y - offset);
+    DiffBig(old_children[2], new_children[2], level - 1, x - offset, y + offset);
+    DiffBig(old_children[3], new_children[3], level - 1, x + offset, y + offset);
+}
+#endif
+
+/**
+ * Diff a pair of nodes
+ * @param old_node node before, 0 if it's empty
+ * @param new_node node after, 0 if it's empty
+ * @param level level of both nodes
+ * @param x offset of the nodes' center from the origin
+ * @param y offset of the nodes' center from the origin
+ */
+void QuadTreeDiff::Diff(const QuadTreeNode* old_node, const QuadTreeNode* new_node, int level, int64_t x, int64_t y) {
+    // the same node has the same cells, which is where all the skipping comes from
+    if (old_node == new_node) {
+        return;
+    }
+    ++nodes_visited;
+    int64_t half = INT64_C(1) << (level - 1);
+    if (!Overlaps(x, y, half)) {
+        return;
+    }
+    if (level == QuadTreeNode::kLeafLevel) {
+        uint64_t old_bits = old_node != 0 ? old_node->bits : 0;
+        uint64_t new_bits = new_node != 0 ? new_node->bits : 0;
+        uint64_t changed = old_bits ^ new_bits;
+        if (!Inside(x, y, half)) {
+            // the leaf straddles an edge of the rectangle
+            changed &= QuadTreeLeafKernel::RectMask(clip_x0 - x, clip_y0 - y, clip_x1 - x, clip_y1 - y);
+        }
+        AddCells(changed & new_bits, x, y, *born);
+        AddCells(changed & old_bits, x, y, *died);
+        return;
+    }
+    // children are half our width, and centered half of that away from us
+    int64_t offset = half / 2;
+    const QuadTreeNode* old_children[4];
+    const QuadTreeNode* new_children[4];
+    Children(old_node, old_children);
+    Children(new_node, new_children);
+    Diff(old_children[0], new_children[0], level - 1, x - offset, y - offset);
+    Diff(old_children[1], new_children[1], level - 1, x + offset, y - offset);
+    Diff(old_children[2], new_children[2], level - 1, x - offset, y + offset);
+    Diff(old_children[3], new_children[3], level - 1, x + offset, y + offset);
+}
+
+/**
+ * Add the cells of a leaf to a list of changes
+ * @param bits cells that changed
+ * @param x offset of the leaf's center from the origin
+ * @param y offset of the leaf's center from the origin
+ * @param changes
+ */
+void QuadTreeDiff::AddCells(uint64_t bits, int64_t x, int64_t y, std::vector<std::pair<int64_t, int64_t>>& changes) const {
+    for (; bits != 0; bits &= bits - 1) {
+        // leaf relative coordinates are [-4, 3]
+        int index = QuadTreeLeafKernel::LowestCellIndex(bits);
+        changes.emplace_back(x + corner_x + ((index & 7) - 4), y + corner_y + ((index >> 3) - 4));
+    }
+}
+
+/**
+ * @param node a node above the leaves, or 0 if it's empty
+ * @param children set to the node's northwest, northeast, southwest and southeast children, 0 for empty ones
+ */
+void QuadTreeDiff::Children(const QuadTreeNode* node, const QuadTreeNode* children[4]) {
+    if (node == 0) {
+        children[0] = children[1] = children[2] = children[3] = 0;
+        return;
+    }
+    // our quadrant bits are in the same order as the children, and tell us which are empty without looking at them
+    const QuadTreeNode* quadrants[4] = {node->nw, node->ne, node->sw, node->se};
+    for (int i = 0; i < 4; ++i) {
+        children[i] = (node->quadrants & (1 << i)) != 0 ? quadrants[i] : 0;
+    }
+}
@@ -0,0 +1,156 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREEDIFF_H
+#define GOL_QUADTREEDIFF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+
+#if (ENABLE_BIG_INT)
+#include <gmpxx.h>
+#endif
+
+/**
+ * Finds the cells that were born and the cells that died between two roots, usually the same tree before and after a
+ * step, without building either display list
+ *
+ * Nodes are canonical, so two subtrees with the same cells are the same node. We walk both roots side by side and skip
+ * every pair of children that are the same node, which is everything a step didn't touch: still lifes, empty space,
+ * and whatever is too far from anything that moved. Leaves that differ give their changes straight from their bits. So
+ * a diff costs about as much as the activity between the roots, not their population.
+ *
+ * The roots have to be at the same level, centered on the same display coordinate, and live in the same store, which
+ * is the case for a tree's root before and after a step once the smaller one is expanded. Like QueryRect(), changes
+ * are found inside a rectangle and come out as offsets from its corner, and pairs of nodes outside of it are skipped
+ * whole. Nodes more than 2^62 wide are walked with big integers, and everything below them with 64 bit offsets.
+ */
+class QuadTreeDiff {
+
+    public:
+
+        /**
+         * @param old_root root before, which mustn't change or be collected while we diff
+         * @param new_root root after, at the same level as old_root
+         * @param origin_x display coordinate of both roots' center
+         * @param origin_y display coordinate of both roots' center
+         */
+        QuadTreeDiff(const QuadTreeNode* old_root, const QuadTreeNode* new_root, const coordinate_type& origin_x, const coordinate_type& origin_y);
+
+        /**
+         * Find the cells inside a rectangle that changed between the roots
+         * @param x0 display coordinate of the rectangle's west edge
+         * @param y0 display coordinate of the rectangle's north edge
+         * @param x1 display coordinate of the rectangle's east edge, inclusive
+         * @param y1 display coordinate of the rectangle's south edge, inclusive
+         * @param born offsets from (x0, y0) of the cells alive in the new root and not the old one are added to this
+         * @param died offsets from (x0, y0) of the cells alive in the old root and not the new one are added to this
+         * @return number of cells that changed
+         */
+        size_t Diff(const coordinate_type& x0, const coordinate_type& y0, const coordinate_type& x1, const coordinate_type& y1,
+                    std::vector<std::pair<int64_t, int64_t>>& born, std::vector<std::pair<int64_t, int64_t>>& died);
+
+        /**
+         * @return number of pairs of nodes the last diff looked at, which is the work it did
+         */
+        size_t NodesVisited() const { return nodes_visited; }
+
+        // nodes up to 2^kMaxOffsetLevel wide are walked with 64 bit offsets from their center
+        static const int kMaxOffsetLevel = 62;
+
+    private:
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * Diff a pair of nodes more than 2^kMaxOffsetLevel wide
+         * @param old_node node before, 0 if it's empty
+         * @param new_node node after, 0 if it's empty
+         * @param level level of both nodes
+         * @param x display coordinate of the nodes' center
+         * @param y display coordinate of the nodes' center
+         */
+        void DiffBig(const QuadTreeNode* old_node, const QuadTreeNode* new_node, int level, const mpz_class& x, const mpz_class& y);
+    #endif
+
+        /**
+         * Diff a pair of nodes
+         * @param old_node node before, 0 if it's empty
+         * @param new_node node after, 0 if it's empty
+         * @param level level of both nodes
+         * @param x offset of the nodes' center from the origin
+         * @param y offset of the nodes' center from the origin
+         */
+        void Diff(const QuadTreeNode* old_node, const QuadTreeNode* new_node, int level, int64_t x, int64_t y);
+
+        /**
+         * Add the cells of a leaf to a list of changes
+         * @param bits cells that changed
+         * @param x offset of the leaf's center from the origin
+         * @param y offset of the leaf's center from the origin
+         * @param changes
+         */
+        void AddCells(uint64_t bits, int64_t x, int64_t y, std::vector<std::pair<int64_t, int64_t>>& changes) const;
+
+        /**
+         * @param node a node above the leaves, or 0 if it's empty
+         * @param children set to the node's northwest, northeast, southwest and southeast children, 0 for empty ones
+         */
+        static void Children(const QuadTreeNode* node, const QuadTreeNode* children[4]);
+
+        /**
+         * @param x offset of a node's center from the origin
+         * @param y offset of a node's center from the origin
+         * @param half half of the node's width
+         * @return true if the node overlaps the rectangle
+         */
+        bool Overlaps(int64_t x, int64_t y, int64_t half) const {
+            return x - half <= clip_x1 && x + half - 1 >= clip_x0 && y - half <= clip_y1 && y + half - 1 >= clip_y0;
+        }
+
+        /**
+         * @param x offset of a node's center from the origin
+         * @param y offset of a node's center from the origin
+         * @param half half of the node's width
+         * @return true if the node is all inside the rectangle
+         */
+        bool Inside(int64_t x, int64_t y, int64_t half) const {
+            return x - half >= clip_x0 && x + half - 1 <= clip_x1 && y - half >= clip_y0 && y + half - 1 <= clip_y1;
+        }
+
+    private:
+
+        // the roots
+        const QuadTreeNode* old_root;
+        const QuadTreeNode* new_root;
+        coordinate_type origin_x;
+        coordinate_type origin_y;
+
+        // the rectangle as offsets from the center of the node we're in, cut down to what fits in 64 bits, and that
+        // center as an offset from the rectangle's corner
+        int64_t clip_x0;
+        int64_t clip_y0;
+        int64_t clip_x1;
+        int64_t clip_y1;
+        int64_t corner_x;
+        int64_t corner_y;
+
+    #if (ENABLE_BIG_INT)
+        // the rectangle in display coordinates
+        mpz_class rect_x0;
+        mpz_class rect_y0;
+        mpz_class rect_x1;
+        mpz_class rect_y1;
+    #endif
+
+        // where the changes go
+        std::vector<std::pair<int64_t, int64_t>>* born;
+        std::vector<std::pair<int64_t, int64_t>>* died;
+        size_t nodes_visited;
+};
+
+#endif //GOL_QUADTREEDIFF_H
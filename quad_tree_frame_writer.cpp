@@ -0,0 +1,280 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <cstdio>
+#include <sstream>
+#include "quad_tree_frame_writer.h"
+#include "quad_tree_node_store.h"
+#include "quad_tree_png_encoder.h"
+#include "quad_tree_renderer.h"
+
+/**
+ * Constructs a writer and starts its thread
+ * @param path_prefix path and start of the name of every file
+ * @param format
+ * @param x0 display coordinate in the viewport's northwest pixel
+ * @param y0 display coordinate in the viewport's northwest pixel
+ * @param zoom each pixel is 2^zoom x 2^zoom cells
+ * @param width pixels across
+ * @param height pixels down
+ * @param interval generations between frames, at least 1
+ * @param max_queued_frames frames that can wait to be rendered and written before we drop frames, at least 1
+ */
+QuadTreeFrameWriter::QuadTreeFrameWriter(const std::string& path_prefix, Format format, const coordinate_type& x0, const coordinate_type& y0,
+                                         int zoom, size_t width, size_t height, uint64_t interval, size_t max_queued_frames)
+        : path_prefix(path_prefix), format(format), x0(x0), y0(y0), zoom(zoom), width(width), height(height),
+          interval(interval < 1 ? 1 : interval), next_frame(0), max_queued_frames(max_queued_frames < 1 ? 1 : max_queued_frames),
+          writing(false), stopping(false), stats(), store(0), num_held_roots(0) {
+    // a root for every frame in the queue, and the one our thread took off it
+    root_slots.resize(this->max_queued_frames + 1, 0);
+    for (size_t slot = root_slots.size(); slot > 0; --slot) {
+        free_slots.push_back(slot - 1);
+    }
+    thread = std::thread(&QuadTreeFrameWriter::WriteFrames, this);
+}
+
+/**
+ * Destructor, writes every queued frame and joins our thread
+ */
+QuadTreeFrameWriter::~QuadTreeFrameWriter() {
+    Detach();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    frame_queued.notify_one();
+    thread.join();
+}
+
+/**
+ * Keep the roots of queued frames alive in a store, see QuadTree::SetFrameWriter(). Detaches from any other
+ * store first. Call this on the stepping thread, not in the middle of a step
+ * @param store the store of the tree we capture
+ */
+void QuadTreeFrameWriter::Attach(QuadTreeNodeStore& store) {
+    if (this->store == &store) {
+        return;
+    }
+    Detach();
+    this->store = &store;
+    for (QuadTreeNode*& slot : root_slots) {
+        store.AddRoot(&slot);
+    }
+}
+
+/**
+ * Wait until every queued frame has been rendered and stop keeping roots alive in the store we're attached to,
+ * if any. Call this on the stepping thread, before the store goes away
+ */
+void QuadTreeFrameWriter::Detach() {
+    if (store == 0) {
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ReleaseRoots(lock, true);
+    }
+    for (QuadTreeNode*& slot : root_slots) {
+        store->RemoveRoot(&slot);
+    }
+    store = 0;
+}
+
+/**
+ * Queue the tree's root to be rendered and written, unless the queue is full. Attach() to the tree's store first
+ * @param root root of the tree
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ * @param generation the tree's generation, which names the file
+ */
+void QuadTreeFrameWriter::Capture(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y, const generation_type& generation) {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ReleaseRoots(lock, false);
+        // the next frame is due at the next multiple of the interval, whether we write this one or not
+        next_frame = (generation / (generation_type) interval + 1) * (generation_type) interval;
+        if (store == 0 || queue.size() >= max_queued_frames || free_slots.empty()) {
+            ++stats.frames_dropped;
+            return;
+        }
+        if (stats.frames_queued == 0) {
+            first_frame = std::chrono::steady_clock::now();
+        }
+        // hold on to the root, and keep its nodes where they are, until our thread has rendered it
+        Frame frame;
+        frame.generation = generation;
+        frame.root = root;
+        frame.origin_x = origin_x;
+        frame.origin_y = origin_y;
+        frame.slot = free_slots.back();
+        free_slots.pop_back();
+        root_slots[frame.slot] = const_cast<QuadTreeNode*>(root);
+        ++num_held_roots;
+#if (ENABLE_GARBAGE_COLLECTION)
+        store->PauseCompaction();
+#endif
+        queue.push_back(std::move(frame));
+        ++stats.frames_queued;
+    }
+    frame_queued.notify_one();
+}
+
+/**
+ * Called after every step: capture a frame if the tree reached or passed the next multiple of the interval
+ * @param root root of the tree
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ * @param generation the tree's generation
+ */
+void QuadTreeFrameWriter::Stepped(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y, const generation_type& generation) {
+    // only the stepping thread changes next_frame and the root slots, so it can read them without the lock
+    if (generation >= next_frame) {
+        Capture(root, origin_x, origin_y, generation);
+    } else if (num_held_roots != 0) {
+        std::unique_lock<std::mutex> lock(mutex);
+        ReleaseRoots(lock, false);
+    }
+}
+
+/**
+ * Wait until every queued frame has been written. Call this on the stepping thread
+ */
+void QuadTreeFrameWriter::Flush() {
+    std::unique_lock<std::mutex> lock(mutex);
+    frame_written.wait(lock, [this] { return queue.empty() && !writing; });
+    ReleaseRoots(lock, false);
+}
+
+/**
+ * @return what we've done so far
+ */
+QuadTreeFrameWriter::Stats QuadTreeFrameWriter::GetStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = stats;
+    result.frames_per_second = 0;
+    if (stats.frames_written != 0) {
+        double seconds = std::chrono::duration<double>(last_write - first_frame).count();
+        if (seconds > 0) {
+            result.frames_per_second = (double) stats.frames_written / seconds;
+        }
+    }
+    return result;
+}
+
+/**
+ * @param generation
+ * @return name of the file the frame for a generation is written to
+ */
+std::string QuadTreeFrameWriter::FileName(const generation_type& generation) const {
+    static const char* kExtensions[] = {".pgm", ".ppm", ".png"};
+    std::ostringstream number;
+    number << generation;
+    std::string digits = number.str();
+    if (digits.size() < 8) {
+        digits.insert(0, 8 - digits.size(), '0');
+    }
+    return path_prefix + digits + kExtensions[format];
+}
+
+/**
+ * Empty the root slots of the frames our thread has rendered. Called on the stepping thread with the mutex held
+ * @param lock holds the mutex
+ * @param wait_for_all wait for every queued frame to be rendered first
+ */
+void QuadTreeFrameWriter::ReleaseRoots(std::unique_lock<std::mutex>& lock, bool wait_for_all) {
+    if (wait_for_all) {
+        frame_written.wait(lock, [this] { return rendered_slots.size() == num_held_roots; });
+    }
+    for (size_t slot : rendered_slots) {
+        root_slots[slot] = 0;
+        free_slots.push_back(slot);
+        --num_held_roots;
+#if (ENABLE_GARBAGE_COLLECTION)
+        store->ResumeCompaction();
+#endif
+    }
+    rendered_slots.clear();
+}
+
+/**
+ * Our thread: render, encode and write frames as they're queued, until we're stopped and the queue is empty
+ */
+void QuadTreeFrameWriter::WriteFrames() {
+    std::vector<uint8_t> densities(width * height);
+    std::vector<uint8_t> file;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        frame_queued.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        Frame frame = std::move(queue.front());
+        queue.pop_front();
+        writing = true;
+        lock.unlock();
+
+        // the root's slot keeps every node under it alive and in place until we hand the slot back
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        QuadTreeRenderer(frame.root, frame.origin_x, frame.origin_y).RenderDensity(x0, y0, zoom, width, height, densities.data());
+        uint64_t render_us = MicrosecondsSince(start);
+        lock.lock();
+        rendered_slots.push_back(frame.slot);
+        ++stats.frames_rendered;
+        stats.render_us += render_us;
+        frame_written.notify_all();
+        lock.unlock();
+
+        start = std::chrono::steady_clock::now();
+        std::string file_name = FileName(frame.generation);
+        Encode(densities, file);
+        bool written = false;
+        FILE* out = std::fopen(file_name.c_str(), "wb");
+        if (out != 0) {
+            written = std::fwrite(file.data(), 1, file.size(), out) == file.size();
+            written = std::fclose(out) == 0 && written;
+        }
+        uint64_t encode_us = MicrosecondsSince(start);
+
+        lock.lock();
+        if (written) {
+            ++stats.frames_written;
+            stats.bytes_written += file.size();
+        } else {
+            ++stats.frames_failed;
+        }
+        stats.encode_us += encode_us;
+        last_write = std::chrono::steady_clock::now();
+        writing = false;
+        frame_written.notify_all();
+    }
+}
+
+/**
+ * Encode a frame in our format
+ * @param densities the rendered frame
+ * @param file set to the file's contents
+ */
+void QuadTreeFrameWriter::Encode(const std::vector<uint8_t>& densities, std::vector<uint8_t>& file) const {
+    if (format == kFormatPNG) {
+        QuadTreePngEncoder::Encode(densities.data(), width, height, 1, file);
+        return;
+    }
+    std::ostringstream header;
+    header << (format == kFormatPGM ? "P5" : "P6") << "\n" << width << " " << height << "\n255\n";
+    std::string text = header.str();
+    file.assign(text.begin(), text.end());
+    if (format == kFormatPGM) {
+        file.insert(file.end(), densities.begin(), densities.end());
+        return;
+    }
+    file.reserve(file.size() + densities.size() * 3);
+    for (uint8_t density : densities) {
+        if (density == 0) {
+            file.insert(file.end(), 3, 0);
+        } else {
+            file.push_back(density);
+            file.push_back((uint8_t) (128 + density / 2));
+            file.push_back((uint8_t) (255 - density));
+        }
+    }
+}
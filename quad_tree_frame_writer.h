@@ -0,0 +1,229 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREEFRAMEWRITER_H
+#define GOL_QUADTREEFRAMEWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+
+#if (ENABLE_BIG_INT)
+#include <gmpxx.h>
+#endif
+
+/**
+ * Writes a viewport of a tree to an image file every so many generations, so runs can be archived as image sequences
+ *
+ * Capturing a frame only queues the tree's root and origin, and a thread of our own renders it with QuadTreeRenderer,
+ * which costs about a node per pixel, then encodes and writes the file. Nodes never change once they're made, so the
+ * only things that could pull a root out from under that thread are garbage collection and compaction. Every queued
+ * root is kept alive by a root slot of ours in the node store until it's been rendered, and compaction is paused
+ * while any are, so all that's left on the stepping thread is bookkeeping. Slots are only changed on the stepping
+ * thread, which lets go of rendered roots on its next capture or step. At most max_queued_frames frames wait to be
+ * rendered, and past that new frames are dropped and counted rather than waiting for the disk, so stepping never
+ * waits on us. Our thread renders into the same image every time, so nothing big is allocated per frame.
+ *
+ * Files are named path_prefix, then the generation padded to 8 digits, then the format's extension:
+ *  - PGM: 8 bit grey, each pixel the share of its cells that are alive
+ *  - PPM: the same density as color, black where there are no cells and blue through to yellow as they fill up
+ *  - PNG: the grey image through QuadTreePngEncoder
+ */
+class QuadTreeFrameWriter {
+
+    public:
+
+        enum Format {
+            kFormatPGM,
+            kFormatPPM,
+            kFormatPNG
+        };
+
+    #if (ENABLE_BIG_INT)
+        typedef mpz_class generation_type;
+    #else
+        typedef int64_t generation_type;
+    #endif
+
+        /**
+         * What we've done so far
+         */
+        struct Stats {
+            uint64_t frames_queued;     // captured and queued to be rendered
+            uint64_t frames_rendered;
+            uint64_t frames_written;
+            uint64_t frames_dropped;    // skipped because the queue was full
+            uint64_t frames_failed;     // couldn't be written
+            uint64_t bytes_written;
+            uint64_t render_us;         // spent rendering on our thread
+            uint64_t encode_us;         // spent encoding and writing on our thread
+            double frames_per_second;   // written since the first frame was rendered
+        };
+
+        /**
+         * Constructs a writer and starts its thread
+         * @param path_prefix path and start of the name of every file
+         * @param format
+         * @param x0 display coordinate in the viewport's northwest pixel
+         * @param y0 display coordinate in the viewport's northwest pixel
+         * @param zoom each pixel is 2^zoom x 2^zoom cells
+         * @param width pixels across
+         * @param height pixels down
+         * @param interval generations between frames, at least 1
+         * @param max_queued_frames frames that can wait to be rendered and written before we drop frames, at least 1
+         */
+        QuadTreeFrameWriter(const std::string& path_prefix, Format format, const coordinate_type& x0, const coordinate_type& y0,
+                            int zoom, size_t width, size_t height, uint64_t interval, size_t max_queued_frames = FRAME_WRITER_QUEUE_FRAMES);
+
+        /**
+         * Destructor, writes every queued frame and joins our thread
+         */
+        ~QuadTreeFrameWriter();
+
+        /**
+         * Keep the roots of queued frames alive in a store, see QuadTree::SetFrameWriter(). Detaches from any other
+         * store first. Call this on the stepping thread, not in the middle of a step
+         * @param store the store of the tree we capture
+         */
+        void Attach(QuadTreeNodeStore& store);
+
+        /**
+         * Wait until every queued frame has been rendered and stop keeping roots alive in the store we're attached to,
+         * if any. Call this on the stepping thread, before the store goes away
+         */
+        void Detach();
+
+        /**
+         * Queue the tree's root to be rendered and written, unless the queue is full. Attach() to the tree's store first
+         * @param root root of the tree
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         * @param generation the tree's generation, which names the file
+         */
+        void Capture(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y, const generation_type& generation);
+
+        /**
+         * Called after every step: capture a frame if the tree reached or passed the next multiple of the interval
+         * @param root root of the tree
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         * @param generation the tree's generation
+         */
+        void Stepped(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y, const generation_type& generation);
+
+        /**
+         * Wait until every queued frame has been written. Call this on the stepping thread
+         */
+        void Flush();
+
+        /**
+         * @return what we've done so far
+         */
+        Stats GetStats();
+
+        /**
+         * @param generation
+         * @return name of the file the frame for a generation is written to
+         */
+        std::string FileName(const generation_type& generation) const;
+
+    private:
+
+        /**
+         * A frame waiting to be rendered and written
+         */
+        struct Frame {
+            generation_type generation;
+            const QuadTreeNode* root;
+            coordinate_type origin_x;
+            coordinate_type origin_y;
+            // our root slot that keeps root alive until it's rendered
+            size_t slot;
+        };
+
+        /**
+         * Our thread: render, encode and write frames as they're queued, until we're stopped and the queue is empty
+         */
+        void WriteFrames();
+
+        /**
+         * Empty the root slots of the frames our thread has rendered. Called on the stepping thread with the mutex held
+         * @param lock holds the mutex
+         * @param wait_for_all wait for every queued frame to be rendered first
+         */
+        void ReleaseRoots(std::unique_lock<std::mutex>& lock, bool wait_for_all);
+
+        /**
+         * Encode a frame in our format
+         * @param densities the rendered frame
+         * @param file set to the file's contents
+         */
+        void Encode(const std::vector<uint8_t>& densities, std::vector<uint8_t>& file) const;
+
+        /**
+         * @param start
+         * @return microseconds since start
+         */
+        static uint64_t MicrosecondsSince(std::chrono::steady_clock::time_point start) {
+            return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        }
+
+    private:
+
+        // where and how to write
+        std::string path_prefix;
+        Format format;
+
+        // the viewport
+        coordinate_type x0;
+        coordinate_type y0;
+        int zoom;
+        size_t width;
+        size_t height;
+
+        // the next generation we capture at or after, and the generations between frames
+        uint64_t interval;
+        generation_type next_frame;
+
+        // frames waiting to be rendered, oldest first
+        size_t max_queued_frames;
+        std::deque<Frame> queue;
+
+        // slots of frames our thread has rendered, which the stepping thread can empty
+        std::vector<size_t> rendered_slots;
+
+        // whether our thread is in the middle of writing a frame, and whether it should stop once the queue is empty
+        bool writing;
+        bool stopping;
+
+        // everything above is guarded by the mutex, and so are the stats. frame_written is also notified when a frame
+        // has been rendered
+        std::mutex mutex;
+        std::condition_variable frame_queued;
+        std::condition_variable frame_written;
+        Stats stats;
+
+        // when we queued the first frame and wrote the last
+        std::chrono::steady_clock::time_point first_frame;
+        std::chrono::steady_clock::time_point last_write;
+
+        // only the stepping thread uses these: the store we're attached to or 0, a root slot registered with it for
+        // every frame that can be queued or rendering, the empty ones, and how many aren't
+        QuadTreeNodeStore* store;
+        std::vector<QuadTreeNode*> root_slots;
+        std::vector<size_t> free_slots;
+        size_t num_held_roots;
+
+        std::thread thread;
+};
+
+#endif //GOL_QUADTREEFRAMEWRITER_H
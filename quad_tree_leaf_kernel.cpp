@@ -0,0 +1,227 @@
+//
+// Created by agent on 10/15/26.
+//
+#include "quad_tree_config.h"
+#include "quad_tree_leaf_kernel.h"
+
+#if (ENABLE_LEAF_LOOKUP_TABLE)
+// the next generation of the inner 2x2 cells of every 4x4 block
+uint8_t QuadTreeLeafKernel::block_table[1 << 16];
+#endif
+
+namespace {
+
+#if (ENABLE_SIMD_LEAF_KERNEL && defined(__GNUC__))
+// four words of four 16 bit rows, the compiler picks the widest registers the target has
+typedef uint64_t LeafRows __attribute__((vector_size(32)));
+
+// these helpers never leave this file, so the calling convention for vectors without AVX doesn't matter
+#pragma GCC diagnostic ignored "-Wpsabi"
+#else
+// portable version of the same thing, one word at a time
+struct LeafRows {
+    uint64_t w[4];
+    uint64_t& operator[](int i) { return w[i]; }
+    uint64_t operator[](int i) const { return w[i]; }
+};
+
+#define LEAF_ROWS_OPERATOR(op) \
+    inline LeafRows operator op(const LeafRows& a, const LeafRows& b) { \
+        LeafRows r = {{a.w[0] op b.w[0], a.w[1] op b.w[1], a.w[2] op b.w[2], a.w[3] op b.w[3]}}; \
+        return r; \
+    } \
+    inline LeafRows operator op(const LeafRows& a, uint64_t b) { \
+        LeafRows r = {{a.w[0] op b, a.w[1] op b, a.w[2] op b, a.w[3] op b}}; \
+        return r; \
+    }
+LEAF_ROWS_OPERATOR(&)
+LEAF_ROWS_OPERATOR(|)
+LEAF_ROWS_OPERATOR(^)
+LEAF_ROWS_OPERATOR(<<)
+LEAF_ROWS_OPERATOR(>>)
+#undef LEAF_ROWS_OPERATOR
+
+inline LeafRows operator~(const LeafRows& a) {
+    LeafRows r = {{~a.w[0], ~a.w[1], ~a.w[2], ~a.w[3]}};
+    return r;
+}
+#endif
+
+/**
+ * Spread the 4 bytes of a 32 bit value out to the low half of 4 16 bit lanes
+ */
+inline uint64_t Spread(uint64_t x) {
+    x = (x | (x << 16)) & UINT64_C(0x0000FFFF0000FFFF);
+    x = (x | (x << 8)) & UINT64_C(0x00FF00FF00FF00FF);
+    return x;
+}
+
+/**
+ * Inverse of Spread, pack the low bytes of 4 16 bit lanes into 32 bits
+ */
+inline uint64_t Compress(uint64_t x) {
+    x = (x | (x >> 8)) & UINT64_C(0x0000FFFF0000FFFF);
+    x = (x | (x >> 16)) & UINT64_C(0x00000000FFFFFFFF);
+    return x;
+}
+
+/**
+ * Each row's view of the row to its north, rows past the top edge are empty
+ */
+inline LeafRows FromNorth(const LeafRows& v) {
+    LeafRows above = {0, v[0], v[1], v[2]};
+    return (v << 16) | (above >> 48);
+}
+
+/**
+ * Each row's view of the row to its south, rows past the bottom edge are empty
+ */
+inline LeafRows FromSouth(const LeafRows& v) {
+    LeafRows below = {v[1], v[2], v[3], 0};
+    return (v >> 16) | (below << 48);
+}
+
+/**
+ * Run the game of life rule on every cell of a 16x16 square. Cells on the edge see empty neighbors past the edge,
+ * so only the inner 14x14 cells are exact
+ */
+inline LeafRows Step(const LeafRows& alive) {
+    // west and east neighbors, masked so they don't bleed across rows
+    LeafRows west = (alive << 1) & UINT64_C(0xFFFEFFFEFFFEFFFE);
+    LeafRows east = (alive >> 1) & UINT64_C(0x7FFF7FFF7FFF7FFF);
+
+    // horizontal sums: two bit count of west + east, and of west + center + east
+    LeafRows x = west ^ east;
+    LeafRows y = west & east;
+    LeafRows h3_lo = x ^ alive;
+    LeafRows h3_hi = y | (alive & x);
+
+    // add the three cell sums of the rows above and below to our two neighbors in this row
+    LeafRows n_lo = FromNorth(h3_lo);
+    LeafRows n_hi = FromNorth(h3_hi);
+    LeafRows s_lo = FromSouth(h3_lo);
+    LeafRows s_hi = FromSouth(h3_hi);
+
+    LeafRows t = n_lo ^ s_lo;
+    LeafRows s0 = t ^ x;
+    LeafRows carry = (n_lo & s_lo) | (x & t);
+
+    LeafRows u = n_hi ^ s_hi;
+    LeafRows v = u ^ y;
+    LeafRows s1 = v ^ carry;
+    LeafRows c2 = (n_hi & s_hi) | (y & u);
+    LeafRows c2b = v & carry;
+    LeafRows s2 = c2 ^ c2b;
+    LeafRows s3 = c2 & c2b;
+
+    // alive with 2 or 3 neighbors, or born with 3
+    return s1 & ~s2 & ~s3 & (s0 | alive);
+}
+
+}  // namespace
+
+/**
+ * Build the lookup table, if we're using it
+ */
+void QuadTreeLeafKernel::Initialize() {
+#if (ENABLE_LEAF_LOOKUP_TABLE)
+    for (uint32_t block = 0; block < (1 << 16); ++block) {
+        block_table[block] = EvolveBlock(block);
+    }
+#endif
+}
+
+#if (ENABLE_LEAF_LOOKUP_TABLE)
+/**
+ * Run the game of life rule on the inner 2x2 cells of a 4x4 block
+ * @param block 4 rows of 4 bits
+ * @return 2 rows of 2 bits
+ */
+uint8_t QuadTreeLeafKernel::EvolveBlock(uint32_t block) {
+    uint8_t result = 0;
+    for (int y = 1; y <= 2; ++y) {
+        for (int x = 1; x <= 2; ++x) {
+            int count = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    if (dx != 0 || dy != 0) {
+                        count += (block >> ((y + dy) * 4 + (x + dx))) & 1;
+                    }
+                }
+            }
+            int alive = (block >> (y * 4 + x)) & 1;
+            if (count == 3 || (count == 2 && alive)) {
+                result |= 1 << ((y - 1) * 2 + (x - 1));
+            }
+        }
+    }
+    return result;
+}
+
+/**
+ * Evolve one generation with the lookup table. Each 2x2 block of the center is looked up by the 4x4 block around it
+ * @return cells of the evolved center square
+ */
+uint64_t QuadTreeLeafKernel::EvolveLookupTable(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se) {
+    // rows 3 to 12 of the 16x16 square are all we need
+    uint32_t rows[16];
+    for (int y = 3; y < 8; ++y) {
+        rows[y] = (uint32_t) ((nw >> (y * 8)) & 0xFF) | (uint32_t) ((ne >> (y * 8)) & 0xFF) << 8;
+    }
+    for (int y = 8; y < 13; ++y) {
+        rows[y] = (uint32_t) ((sw >> ((y - 8) * 8)) & 0xFF) | (uint32_t) ((se >> ((y - 8) * 8)) & 0xFF) << 8;
+    }
+
+    uint64_t result = 0;
+    for (int by = 0; by < 4; ++by) {
+        const uint32_t* block_rows = rows + 3 + 2 * by;
+        for (int bx = 0; bx < 4; ++bx) {
+            int shift = 3 + 2 * bx;
+            uint32_t block = ((block_rows[0] >> shift) & 0xF) | ((block_rows[1] >> shift) & 0xF) << 4
+                             | ((block_rows[2] >> shift) & 0xF) << 8 | ((block_rows[3] >> shift) & 0xF) << 12;
+            uint64_t cells = block_table[block];
+            // the top 2 cells go in row 2 * by, the bottom 2 in the row below
+            result |= ((cells & 0x3) | (cells & 0xC) << 6) << (by * 16 + bx * 2);
+        }
+    }
+    return result;
+}
+#endif
+
+/**
+ * Evolve with the bit parallel kernel
+ * @param generations number of generations to evolve, from 1 to kMaxGenerations
+ * @return cells of the evolved center square
+ */
+uint64_t QuadTreeLeafKernel::EvolveBitSliced(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se, int generations) {
+    uint64_t low = UINT64_C(0xFFFFFFFF);
+    LeafRows rows = {
+        Spread(nw & low) | (Spread(ne & low) << 8),
+        Spread(nw >> 32) | (Spread(ne >> 32) << 8),
+        Spread(sw & low) | (Spread(se & low) << 8),
+        Spread(sw >> 32) | (Spread(se >> 32) << 8)
+    };
+
+    // every generation, one more ring of cells around the edge goes wrong, but the center 8x8 is 4 cells in
+    for (int i = 0; i < generations; ++i) {
+        rows = Step(rows);
+    }
+
+    // the center is rows 4 to 11 and columns 4 to 11
+    uint64_t columns = UINT64_C(0x00FF00FF00FF00FF);
+    return Compress((rows[1] >> 4) & columns) | (Compress((rows[2] >> 4) & columns) << 32);
+}
+
+/**
+ * Evolve the 16x16 square made up of four leaves forward and return its center 8x8 square
+ * @param generations number of generations to evolve, from 1 to kMaxGenerations
+ * @return cells of the evolved center square
+ */
+uint64_t QuadTreeLeafKernel::Evolve(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se, int generations) {
+#if (ENABLE_LEAF_LOOKUP_TABLE)
+    if (generations == 1) {
+        return EvolveLookupTable(nw, ne, sw, se);
+    }
+#endif
+    return EvolveBitSliced(nw, ne, sw, se, generations);
+}
@@ -0,0 +1,142 @@
+//
+// Created by agent on 10/15/26.
+//
+
+#ifndef GOL_QUADTREELEAFKERNEL_H
+#define GOL_QUADTREELEAFKERNEL_H
+
+#include <cstdint>
+#include "quad_tree_config.h"
+
+/**
+ * Bit parallel game of life kernel for 8x8 leaves
+ *
+ * A leaf stores its 64 cells in one 64 bit word. Row y is byte y (north to south) and column x is bit x of that
+ * byte (west to east), so a cell at leaf relative coordinates [-4, 3] lives at bit (y + 4) * 8 + (x + 4).
+ *
+ * To evolve four leaves, we lay out their 16x16 cells as four words of four 16 bit rows each and run the rule on every
+ * cell at once with bit sliced adders, 64 cells per word. With GCC or clang the four words are a single vector, so this
+ * turns into SIMD instructions wherever the target has them.
+ *
+ * With ENABLE_LEAF_LOOKUP_TABLE on, we instead evolve the center 8x8 as 16 2x2 blocks, looking each one up by the 4x4
+ * cells around it in a 65536 entry table that Initialize() builds. The table only covers a single generation, so
+ * bigger steps still use the bit parallel kernel.
+ */
+class QuadTreeLeafKernel {
+
+    public:
+
+        /**
+         * Build the lookup table, if we're using it
+         */
+        static void Initialize();
+
+        /**
+         * Get the bit for a cell in a leaf
+         * @param x leaf relative x coordinate [-4, 3]
+         * @param y leaf relative y coordinate [-4, 3]
+         * @return the cell's bit
+         */
+        static uint64_t CellBit(int64_t x, int64_t y) {
+            return UINT64_C(1) << ((y + 4) * 8 + (x + 4));
+        }
+
+        /**
+         * Get the bits of the cells of a leaf that are inside a rectangle
+         * @param x0 leaf relative x coordinate of the rectangle's west edge
+         * @param y0 leaf relative y coordinate of the rectangle's north edge
+         * @param x1 leaf relative x coordinate of the rectangle's east edge, inclusive
+         * @param y1 leaf relative y coordinate of the rectangle's south edge, inclusive
+         * @return the bits of the cells inside, the rectangle has to overlap the leaf
+         */
+        static uint64_t RectMask(int64_t x0, int64_t y0, int64_t x1, int64_t y1) {
+            int west = x0 > -4 ? (int) x0 + 4 : 0;
+            int east = x1 < 3 ? (int) x1 + 4 : 7;
+            int north = y0 > -4 ? (int) y0 + 4 : 0;
+            int south = y1 < 3 ? (int) y1 + 4 : 7;
+            uint64_t columns = ((UINT64_C(0xFF) << west) & (UINT64_C(0xFF) >> (7 - east))) * UINT64_C(0x0101010101010101);
+            uint64_t rows = (UINT64_MAX << (north * 8)) & (UINT64_MAX >> ((7 - south) * 8));
+            return columns & rows;
+        }
+
+        /**
+         * @return number of alive cells in a leaf
+         */
+        static uint64_t PopCount(uint64_t bits) {
+#if defined(__GNUC__)
+            return (uint64_t) __builtin_popcountll(bits);
+#else
+            uint64_t count = 0;
+            for (; bits != 0; bits &= bits - 1) {
+                ++count;
+            }
+            return count;
+#endif
+        }
+
+        /**
+         * @return index of the lowest alive cell in a leaf, bits must not be 0
+         */
+        static int LowestCellIndex(uint64_t bits) {
+#if defined(__GNUC__)
+            return __builtin_ctzll(bits);
+#else
+            int index = 0;
+            for (; (bits & 1) == 0; bits >>= 1) {
+                ++index;
+            }
+            return index;
+#endif
+        }
+
+        /**
+         * Get the 8x8 square centered on the 16x16 square made up of four leaves
+         * @return cells of the center square
+         */
+        static uint64_t Center(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se) {
+            return ((nw & kQuadrantSE) >> 36) | ((ne & kQuadrantSW) >> 28)
+                   | ((sw & kQuadrantNE) << 28) | ((se & kQuadrantNW) << 36);
+        }
+
+        /**
+         * Evolve the 16x16 square made up of four leaves forward and return its center 8x8 square
+         * @param generations number of generations to evolve, from 1 to kMaxGenerations
+         * @return cells of the evolved center square
+         */
+        static uint64_t Evolve(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se, int generations);
+
+        // the center 8x8 square is only exact for this many generations
+        static const int kMaxGenerations = 4;
+
+        // cells in each 4x4 quadrant of a leaf
+        static const uint64_t kQuadrantNW = UINT64_C(0x000000000F0F0F0F);
+        static const uint64_t kQuadrantNE = UINT64_C(0x00000000F0F0F0F0);
+        static const uint64_t kQuadrantSW = UINT64_C(0x0F0F0F0F00000000);
+        static const uint64_t kQuadrantSE = UINT64_C(0xF0F0F0F000000000);
+
+    private:
+
+        /**
+         * Evolve with the bit parallel kernel
+         */
+        static uint64_t EvolveBitSliced(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se, int generations);
+
+    #if (ENABLE_LEAF_LOOKUP_TABLE)
+        /**
+         * Evolve one generation with the lookup table
+         */
+        static uint64_t EvolveLookupTable(uint64_t nw, uint64_t ne, uint64_t sw, uint64_t se);
+
+        /**
+         * Run the game of life rule on the inner 2x2 cells of a 4x4 block
+         * @param block 4 rows of 4 bits
+         * @return 2 rows of 2 bits
+         */
+        static uint8_t EvolveBlock(uint32_t block);
+
+        // the next generation of the inner 2x2 cells of every 4x4 block
+        static uint8_t block_table[1 << 16];
+    #endif
+};
+
+#endif //GOL_QUADTREELEAFKERNEL_H
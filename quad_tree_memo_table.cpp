@@ -0,0 +1,200 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <thread>
+#include "quad_tree_memo_table.h"
+
+/**
+ * Constructs an empty table
+ */
+QuadTreeMemoTable::QuadTreeMemoTable() {
+    num_threads = 1;
+    memory_usage.store(0, std::memory_order_relaxed);
+    for (Shard& shard : shards) {
+        shard.entries = 0;
+        shard.capacity = 0;
+        shard.size = 0;
+        shard.lock.clear();
+    }
+}
+
+/**
+ * Destructor, this does NOT free the nodes in the table
+ */
+QuadTreeMemoTable::~QuadTreeMemoTable() {
+    Clear();
+}
+
+/**
+ * Look up a result
+ * @param node the node that was evolved
+ * @param exponent it was evolved 2^exponent generations
+ * @return the result, or 0 if we don't have one
+ */
+QuadTreeNode* QuadTreeMemoTable::Find(const QuadTreeNode* node, int exponent) {
+    uint32_t index = QuadTreeNodeHeap::Index(node);
+    uint64_t hash = Hash(index, exponent);
+    Shard& shard = shards[hash >> (64 - kShardBits)];
+    QuadTreeNode* result = 0;
+    Lock(shard);
+    if (shard.capacity != 0) {
+        size_t mask = shard.capacity - 1;
+        for (size_t i = (size_t) hash & mask; shard.entries[i].node != 0; i = (i + 1) & mask) {
+            if (shard.entries[i].node == index && shard.entries[i].exponent == (uint32_t) exponent) {
+                result = QuadTreeNodeHeap::Node(shard.entries[i].result);
+                break;
+            }
+        }
+    }
+    Unlock(shard);
+    return result;
+}
+
+/**
+ * Remember a result, unless another thread already has
+ * @param node the node that was evolved
+ * @param exponent it was evolved 2^exponent generations
+ * @param result the center of node evolved 2^exponent generations
+ */
+void QuadTreeMemoTable::Insert(const QuadTreeNode* node, int exponent, QuadTreeNode* result) {
+    Entry entry = {QuadTreeNodeHeap::Index(node), QuadTreeNodeHeap::Index(result), (uint32_t) exponent};
+    uint64_t hash = Hash(entry.node, exponent);
+    Shard& shard = shards[hash >> (64 - kShardBits)];
+    Lock(shard);
+    bool found = false;
+    if (shard.capacity != 0) {
+        size_t mask = shard.capacity - 1;
+        for (size_t i = (size_t) hash & mask; shard.entries[i].node != 0; i = (i + 1) & mask) {
+            if (shard.entries[i].node == entry.node && shard.entries[i].exponent == entry.exponent) {
+                found = true;
+                break;
+            }
+        }
+    }
+    if (!found) {
+        Add(entry);
+    }
+    Unlock(shard);
+}
+
+/**
+ * Set how many threads use the table, which turns locking on if there is more than one. Not thread safe
+ * @param num_threads
+ */
+void QuadTreeMemoTable::SetNumThreads(int num_threads) {
+    this->num_threads = num_threads;
+}
+
+/**
+ * Remove every entry. Not thread safe
+ */
+void QuadTreeMemoTable::Clear() {
+    for (Shard& shard : shards) {
+        delete[] shard.entries;
+        shard.entries = 0;
+        shard.capacity = 0;
+        shard.size = 0;
+    }
+    memory_usage.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @return number of entries
+ */
+size_t QuadTreeMemoTable::Size() const {
+    size_t size = 0;
+    for (const Shard& shard : shards) {
+        size += shard.size;
+    }
+    return size;
+}
+
+/**
+ * @return hash of a node and an exponent, the top bits pick the shard and the low bits the slot
+ */
+uint64_t QuadTreeMemoTable::Hash(uint32_t node, int exponent) {
+    // the murmur3 64 bit mixer, like QuadTreeNodeTable
+    uint64_t h = ((uint64_t) node << 32 | (uint32_t) exponent) * UINT64_C(0x9E3779B97F4A7C15);
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    h ^= h >> 33;
+    return h;
+}
+
+/**
+ * Insert an entry that isn't in the table, growing its shard if it's getting full. Called with the shard locked
+ */
+void QuadTreeMemoTable::Add(const Entry& entry) {
+    uint64_t hash = Hash(entry.node, (int) entry.exponent);
+    Shard& shard = shards[hash >> (64 - kShardBits)];
+    // keep the shard at most half full, so probes stay short
+    if ((shard.size + 1) * 2 > shard.capacity) {
+        Entry* old_entries = shard.entries;
+        size_t old_capacity = shard.capacity;
+        shard.capacity = old_capacity != 0 ? old_capacity * 2 : kInitialCapacity;
+        shard.entries = new Entry[shard.capacity]();
+        memory_usage.fetch_add((shard.capacity - old_capacity) * sizeof(Entry), std::memory_order_relaxed);
+        shard.size = 0;
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_entries[i].node != 0) {
+                Add(old_entries[i]);
+            }
+        }
+        delete[] old_entries;
+    }
+    size_t mask = shard.capacity - 1;
+    size_t i = (size_t) hash & mask;
+    while (shard.entries[i].node != 0) {
+        i = (i + 1) & mask;
+    }
+    shard.entries[i] = entry;
+    shard.size += 1;
+}
+
+/**
+ * Size a shard for its entries and put them back, after some have been removed
+ */
+void QuadTreeMemoTable::Rebuild(Shard& shard) {
+    Entry* old_entries = shard.entries;
+    size_t old_capacity = shard.capacity;
+    size_t capacity = 0;
+    if (shard.size != 0) {
+        capacity = kInitialCapacity;
+        while (capacity < shard.size * 4) {
+            capacity *= 2;
+        }
+    }
+    shard.entries = capacity != 0 ? new Entry[capacity]() : 0;
+    shard.capacity = capacity;
+    shard.size = 0;
+    memory_usage.fetch_sub(old_capacity * sizeof(Entry), std::memory_order_relaxed);
+    memory_usage.fetch_add(capacity * sizeof(Entry), std::memory_order_relaxed);
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old_entries[i].node != 0) {
+            Add(old_entries[i]);
+        }
+    }
+    delete[] old_entries;
+}
+
+/**
+ * Lock a shard, if we have to
+ */
+void QuadTreeMemoTable::Lock(Shard& shard) {
+    if (num_threads > 1) {
+        while (shard.lock.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+ * Unlock a shard locked by Lock()
+ */
+void QuadTreeMemoTable::Unlock(Shard& shard) {
+    if (num_threads > 1) {
+        shard.lock.clear(std::memory_order_release);
+    }
+}
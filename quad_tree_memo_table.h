@@ -0,0 +1,215 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREEMEMOTABLE_H
+#define GOL_QUADTREEMEMOTABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "quad_tree_node_heap.h"
+
+class QuadTreeNode;
+
+/**
+ * Memoized results of evolving a node by a power of 2 that its own memo slot is already taken for
+ *
+ * A node only has room for one result, tagged with its exponent. Stepping an exact number of generations breaks the
+ * number up into several power of 2 jumps, so the same nodes get evolved by several exponents in a row, and each one
+ * would replace the last. The first result a node gets stays in the node, and the others come here, keyed by the node
+ * and the exponent. They're open addressed like QuadTreeNodeTable, with 32 bit node indices instead of pointers, so
+ * an entry is 12 bytes. Shards are only allocated once something is put in them, so stepping by one exponent costs
+ * nothing.
+ *
+ * Lookups and inserts lock their shard if SetNumThreads() says that more than one thread evolves. Everything that
+ * removes or changes entries is for garbage collection and compaction, and isn't thread safe. An entry keeps its
+ * result alive for as long as its node is alive, just like the node's own slot, see QuadTreeNodeStore::MarkMemoResults().
+ */
+class QuadTreeMemoTable {
+
+    public:
+
+        /**
+         * Constructs an empty table
+         */
+        QuadTreeMemoTable();
+
+        /**
+         * Destructor, this does NOT free the nodes in the table
+         */
+        ~QuadTreeMemoTable();
+
+        /**
+         * Look up a result
+         * @param node the node that was evolved
+         * @param exponent it was evolved 2^exponent generations
+         * @return the result, or 0 if we don't have one
+         */
+        QuadTreeNode* Find(const QuadTreeNode* node, int exponent);
+
+        /**
+         * Remember a result, unless another thread already has
+         * @param node the node that was evolved
+         * @param exponent it was evolved 2^exponent generations
+         * @param result the center of node evolved 2^exponent generations
+         */
+        void Insert(const QuadTreeNode* node, int exponent, QuadTreeNode* result);
+
+        /**
+         * Set how many threads use the table, which turns locking on if there is more than one. Not thread safe
+         * @param num_threads
+         */
+        void SetNumThreads(int num_threads);
+
+        /**
+         * Remove every entry that the predicate returns true for. Not thread safe
+         * @param predicate bool(QuadTreeNode* node, int exponent, QuadTreeNode* result)
+         * @return number of entries removed
+         */
+        template <class Predicate>
+        size_t RemoveIf(Predicate predicate) {
+            size_t removed = 0;
+            for (Shard& shard : shards) {
+                size_t removed_from_shard = 0;
+                for (size_t i = 0; i < shard.capacity; ++i) {
+                    Entry& entry = shard.entries[i];
+                    if (entry.node != 0 && predicate(QuadTreeNodeHeap::Node(entry.node), (int) entry.exponent,
+                                                     QuadTreeNodeHeap::Node(entry.result))) {
+                        entry.node = 0;
+                        ++removed_from_shard;
+                    }
+                }
+                if (removed_from_shard > 0) {
+                    shard.size -= removed_from_shard;
+                    removed += removed_from_shard;
+                    Rebuild(shard);
+                }
+            }
+            return removed;
+        }
+
+        /**
+         * Visit every entry. Not thread safe
+         * @param visitor void(QuadTreeNode* node, int exponent, QuadTreeNode* result)
+         */
+        template <class Visitor>
+        void ForEach(Visitor visitor) const {
+            for (const Shard& shard : shards) {
+                for (size_t i = 0; i < shard.capacity; ++i) {
+                    const Entry& entry = shard.entries[i];
+                    if (entry.node != 0) {
+                        visitor(QuadTreeNodeHeap::Node(entry.node), (int) entry.exponent, QuadTreeNodeHeap::Node(entry.result));
+                    }
+                }
+            }
+        }
+
+        /**
+         * Move every node and result somewhere else, like compaction does, and rehash. Not thread safe
+         * @param move QuadTreeNode*(QuadTreeNode*) that returns where a node went
+         */
+        template <class Move>
+        void MoveNodes(Move move) {
+            std::vector<Entry> entries;
+            entries.reserve(Size());
+            for (Shard& shard : shards) {
+                for (size_t i = 0; i < shard.capacity; ++i) {
+                    Entry entry = shard.entries[i];
+                    if (entry.node != 0) {
+                        entry.node = QuadTreeNodeHeap::Index(move(QuadTreeNodeHeap::Node(entry.node)));
+                        entry.result = QuadTreeNodeHeap::Index(move(QuadTreeNodeHeap::Node(entry.result)));
+                        entries.push_back(entry);
+                    }
+                }
+            }
+            // an entry's shard and slot come from its node's index, so they all have to be put back
+            Clear();
+            for (const Entry& entry : entries) {
+                Add(entry);
+            }
+        }
+
+        /**
+         * Remove every entry. Not thread safe
+         */
+        void Clear();
+
+        /**
+         * @return number of entries
+         */
+        size_t Size() const;
+
+        /**
+         * @return memory used by the entry arrays in bytes. This is safe to call while other threads insert
+         */
+        size_t MemoryUsage() const { return memory_usage.load(std::memory_order_relaxed); }
+
+    private:
+
+        /**
+         * One result, 0 in node for an empty slot
+         */
+        struct Entry {
+            uint32_t node;
+            uint32_t result;
+            uint32_t exponent;
+        };
+
+        /**
+         * One shard of the table, on its own cache line
+         */
+        struct alignas(64) Shard {
+            // power of 2 sized array of entries, or 0 until the first insert
+            Entry* entries;
+            size_t capacity;
+            size_t size;
+
+            // held while looking up or inserting, if more than one thread uses the table
+            std::atomic_flag lock;
+        };
+
+        /**
+         * @return hash of a node and an exponent, the top bits pick the shard and the low bits the slot
+         */
+        static uint64_t Hash(uint32_t node, int exponent);
+
+        /**
+         * Insert an entry that isn't in the table, growing its shard if it's getting full. Called with the shard locked
+         */
+        void Add(const Entry& entry);
+
+        /**
+         * Size a shard for its entries and put them back, after some have been removed
+         */
+        void Rebuild(Shard& shard);
+
+        /**
+         * Lock a shard, if we have to
+         */
+        void Lock(Shard& shard);
+
+        /**
+         * Unlock a shard locked by Lock()
+         */
+        void Unlock(Shard& shard);
+
+    private:
+
+        static const int kShardBits = 6;
+        static const int kNumShards = 1 << kShardBits;
+
+        // number of slots a shard starts with
+        static const size_t kInitialCapacity = 1 << 6;
+
+        Shard shards[kNumShards];
+
+        // number of threads that use the table, lookups and inserts lock their shard if this is more than 1
+        int num_threads;
+
+        // bytes of entry arrays in every shard
+        std::atomic<size_t> memory_usage;
+};
+
+#endif //GOL_QUADTREEMEMOTABLE_H
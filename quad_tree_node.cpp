@@ -1,77 +1,72 @@
 //
 // Created by Jenny Spurlock on 5/8/17.
 //
+#include <cstddef>
 #include <vector>
+#include <new>
+#include <mutex>
 #include <assert.h>
 #include "quad_tree_node.h"
-
-// canonical map of all of our nodes
-std::unordered_map<QuadTreeNode*, QuadTreeNode*, QuadTreeNode::HashFunction, QuadTreeNode::EqualFunction> QuadTreeNode::node_map;
-
-// helper variables to let us know how many nodes have been created total
-int64_t QuadTreeNode::num_nodes_created = 0;
+#include "quad_tree_cell_iterator.h"
+#include "quad_tree_node_store.h"
 
 #if (ENABLE_BIG_INT)
 // precalculated multi precision powers of two
 mpz_class QuadTreeNode::mpz_pow2_table[LEVEL_MAX];
 #endif
 
+const size_t QuadTreeNode::kLeafSize = QuadTreeNode::LeafSize();
+
+// makes sure Initialize() only builds our tables once, even if stores are created on several threads
+static std::once_flag initialize_flag;
+
 /**
  * Static initialize because we have some work to do, like initialize a multi precision
- * power of 2 table
+ * power of 2 table. These tables never change, so every store shares them and only the first call builds them
  */
 void QuadTreeNode::Initialize() {
+    std::call_once(initialize_flag, []() {
 #if (ENABLE_BIG_INT)
-    QuadTreeNode::InitializePow2Table();
+        QuadTreeNode::InitializePow2Table();
 #endif
+        QuadTreeLeafKernel::Initialize();
+    });
 }
 
 /**
- * Static shutdown because we have some work to do, like freeing all of our nodes that were
- * created because they are canonical
+ * @return bytes of a leaf, which stops where the children of a non-leaf node start
  */
-void QuadTreeNode::Shutdown() {
-    // clean up all nodes in our hash table
-    for (auto it = QuadTreeNode::node_map.begin(); it != QuadTreeNode::node_map.end(); ++it) {
-        delete (it->first);
-    }
-    // clear out the map
-    node_map.clear();
-}
-
-/**
- * Build an empty quadtree recursively at the specified level
- * @param level this level represents the power of 2 dimensions of this quad tree, which is square
- * @return a new empty quad tree at the specified level
- */
-QuadTreeNode* QuadTreeNode::EmptyQuadTree(level_type level) {
-    // if i'm a leaf, then return an interned node with alive set to false
-    if (level == 0) {
-        return Canonical(0);
-    }
-    // handle non-leaf nodes
-    QuadTreeNode* emptyNode = EmptyQuadTree(level - 1);
-    return Canonical(emptyNode, emptyNode, emptyNode, emptyNode, level);
+size_t QuadTreeNode::LeafSize() {
+#if (!ENABLE_INFINITE_LEVELS)
+    // two nodes to a cache line, and a leaf for every step of a QuadTreeNodeHeap index
+    static_assert(sizeof(QuadTreeNode) == 2 * QuadTreeNodeHeap::kIndexScale, "nodes should be 32 bytes");
+    static_assert(offsetof(QuadTreeNode, nw) == QuadTreeNodeHeap::kIndexScale, "leaves should be 16 bytes");
+#endif
+    return offsetof(QuadTreeNode, nw);
 }
 
-
 /**
  * Copy Constructor
  * @param other the other node to be copied from
  */
 QuadTreeNode::QuadTreeNode (const QuadTreeNode& other) {
-    nw = other.nw;
-    ne = other.ne;
-    sw = other.sw;
-    se = other.se;
-    calc = other.calc;
-    alive = other.alive;
     level = other.level;
-#if (ENABLE_BIG_INT)
-    mpz_init_set(population, other.population);
-#else
-    population = other.population;
-#endif
+    // a leaf is only as big as the fields it has, so we can't copy past them
+    if (level == kLeafLevel) {
+        bits = other.bits;
+    } else {
+        nw = other.nw;
+        ne = other.ne;
+        sw = other.sw;
+        se = other.se;
+        memo.calc.store(other.memo.calc.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        memo.center.store(other.memo.center.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    calc_exponent.store(other.calc_exponent.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    hash_and_mark.store(other.Hash(), std::memory_order_relaxed);
+    empty = other.empty;
+    quadrants = other.quadrants;
+    density = other.density;
 }
 
 /**
@@ -82,8 +77,8 @@ QuadTreeNode::QuadTreeNode (const QuadTreeNode& other) {
 bool QuadTreeNode::operator==(const QuadTreeNode &other) const {
     if (level != other.level) {
         return false;
-    } else if (level == 0) {
-        return alive == other.alive;
+    } else if (level == kLeafLevel) {
+        return bits == other.bits;
     } else {
         return nw == other.nw
                && ne == other.ne
@@ -95,44 +90,44 @@ bool QuadTreeNode::operator==(const QuadTreeNode &other) const {
 /**
  * Expand this node by one level (a power of 2) so that we can effectively process inner squares
  * and not hit boundaries
+ * @param store store this node lives in
  * @return a new node one level higher
  */
-QuadTreeNode* QuadTreeNode::Expand() {
+QuadTreeNode* QuadTreeNode::Expand(QuadTreeNodeStore& store) {
     // have we hit a level size boundary limit?
 #if (!ENABLE_INFINITE_LEVELS)
-    if (level + 1 < level) {
-        std::cout << "Maximum level size has reached a 32 bit integer limit, unable to expand tree." << std::endl;
+    if (level + 1 > kMaxLevel) {
+        std::cout << "Maximum level size has reached an 8 bit integer limit, unable to expand tree." << std::endl;
         return this;
     }
 #endif
     // We're expanding by a factor of 2, so let's create a level above so that we have empty regions to calculate the life rule
-    QuadTreeNode* emptyRegion = EmptyQuadTree(level - 1);
-    QuadTreeNode* newNW = Canonical(emptyRegion, emptyRegion, emptyRegion, this->nw, level);
-    QuadTreeNode* newNE = Canonical(emptyRegion, emptyRegion, this->ne, emptyRegion, level);
-    QuadTreeNode* newSW = Canonical(emptyRegion, this->sw, emptyRegion, emptyRegion, level);
-    QuadTreeNode* newSE = Canonical(this->se, emptyRegion, emptyRegion, emptyRegion, level);
-    return Canonical(newNW, newNE, newSW, newSE, level + 1);
+    QuadTreeNode* emptyRegion = store.EmptyQuadTree(level - 1);
+    QuadTreeNode* newNW = store.Canonical(emptyRegion, emptyRegion, emptyRegion, this->nw, level);
+    QuadTreeNode* newNE = store.Canonical(emptyRegion, emptyRegion, this->ne, emptyRegion, level);
+    QuadTreeNode* newSW = store.Canonical(emptyRegion, this->sw, emptyRegion, emptyRegion, level);
+    QuadTreeNode* newSE = store.Canonical(this->se, emptyRegion, emptyRegion, emptyRegion, level);
+    return store.Canonical(newNW, newNE, newSW, newSE, level + 1);
 }
 
 /**
  * Can we compact this node any smaller? We call this after evolving the root
  * Currently, we can't call this on sub-nodes that are evolved because we always assume
  * pointers to regions are valid
+ * @param store store this node lives in
  * @return a new root (possibly) compacted one level smaller
  */
-QuadTreeNode* QuadTreeNode::Compact() {
+QuadTreeNode* QuadTreeNode::Compact(QuadTreeNodeStore& store) {
     QuadTreeNode* root = this;
     // pop off levels we dont need
     level_type level = root->level;
-    while (level >= 3) {
-        QuadTreeNode *empty_tree = QuadTreeNode::EmptyQuadTree(level - 2);
-        if (root->nw->nw == empty_tree && root->nw->ne == empty_tree && root->nw->sw == empty_tree
-             && root->ne->nw == empty_tree && root->ne->ne == empty_tree && root->ne->se == empty_tree
-             && root->sw->nw == empty_tree && root->sw->sw == empty_tree && root->sw->se == empty_tree
-             && root->se->ne == empty_tree && root->se->sw == empty_tree && root->se->se == empty_tree
+    while (level > kLeafLevel + 1) {
+        // every child's cells have to be in its quadrant next to our center
+        if ((root->nw->quadrants & ~kSoutheast) == 0 && (root->ne->quadrants & ~kSouthwest) == 0
+             && (root->sw->quadrants & ~kNortheast) == 0 && (root->se->quadrants & ~kNorthwest) == 0
         ) {
             level--;
-            root = Canonical(root->nw->se, root->ne->sw, root->sw->ne, root->se->nw, level);
+            root = store.Canonical(root->nw->se, root->ne->sw, root->sw->ne, root->se->nw, level);
         } else {
             break;
         }
@@ -141,248 +136,333 @@ QuadTreeNode* QuadTreeNode::Compact() {
 }
 
 /**
- * The fun part. Evolve this node and all of its sub children one generation forward based on Conway's Game of Life Rule
+ * The fun part. Evolve this node and all of its sub children 2^exponent generations forward based on Conway's Game of Life Rule
+ * The result is the center of this node, one level down. A node can jump at most 2^(level-2) generations, which is
+ * the full HashLife step. Results are memoized per exponent: the first one in this node, tagged with its exponent,
+ * and the others in the store's QuadTreeMemoTable
  * Reference: https://en.wikipedia.org/wiki/Conway%27s_Game_of_Life
- * @return a new node pointing to a QuadTree structure evolved one generation forwared
+ * @param store store this node lives in
+ * @param exponent evolve 2^exponent generations, from 0 to level-2
+ * @return a new node pointing to a QuadTree structure evolved 2^exponent generations forward
  */
-QuadTreeNode* QuadTreeNode::Evolve() {
-    if (calc == 0) {
-#if (ENABLE_BIG_INT)
-        if (mpz_cmp_si(population, 0) == 0) {
-#else
-        if (population == 0) {
-#endif
-            calc = nw;
-        } else if (level == 2) {
-            calc = EvolveLevel2();
-        } else {
-            calc = EvolveLevelN();
+QuadTreeNode* QuadTreeNode::Evolve(QuadTreeNodeStore& store, int exponent) {
+    assert(exponent >= 0 && exponent <= level - 2);
+    // a memo budget keeps the results of nodes that keep getting evolved
+    store.Touch(this);
+    // calc keeps the first result we get, and results for other exponents go in the store's memo table. Within a step,
+    // every node on a level evolves by the same amount, so threads that race to fill in a result all store the same
+    // node. calc is stored before calc_exponent, so a thread that sees our exponent also sees the result that goes with it
+    bool calc_taken = false;
+    if (calc_exponent.load(std::memory_order_acquire) == exponent) {
+        QuadTreeNode* result = memo.calc.load(std::memory_order_acquire);
+        if (result != 0) {
+            store.CountEvolve(true);
+            return result;
+        }
+    } else if (!empty && level > kLeafLevel + 1 && memo.calc.load(std::memory_order_relaxed) != 0) {
+        // level 4 nodes evolve faster with the leaf kernel than we could look them up
+        QuadTreeNode* result = store.memo_table.Find(this, exponent);
+        if (result != 0) {
+            store.CountEvolve(true);
+            return result;
         }
+        calc_taken = true;
+    }
+    store.CountEvolve(false);
+    QuadTreeNode* result;
+    if (empty) {
+        result = nw;
+    } else if (level == kLeafLevel + 1) {
+        result = EvolveLevel4(store, exponent);
+    } else if (level == kLeafLevel + 2) {
+        result = EvolveLevel5(store, exponent);
+    } else {
+        result = EvolveLevelN(store, exponent);
+    }
+    // an incremental collection could be marking, so it has to hear about the pointer we're adding
+    store.Shade(result);
+    if (calc_taken) {
+        store.memo_table.Insert(this, exponent, result);
+    } else {
+        memo.calc.store(result, std::memory_order_release);
+        calc_exponent.store((uint8_t) exponent, std::memory_order_release);
     }
-    return calc;
+    return result;
 }
 
 /**
  * Turn a cell alive
  * This is ONLY called before we run any simulation and is bounded by signed 64 bit integers
  * input is bounded by signed 64 bit integer input [-2^63, 2^63-1]
+ * @param store store this node lives in
  * @param x x coordinate for this simulation (signed 64 bit integer input [-2^63, 2^63-1])
  * @param y y coordinate for this simulation (signed 64 bit integer input [-2^63, 2^63-1])
  * @return
  */
-QuadTreeNode* QuadTreeNode::SetCellAlive(int64_t x, int64_t y) {
-    if (level == 0) {
-        // Return a level 0 alive cell
-        return Canonical(1);
+QuadTreeNode* QuadTreeNode::SetCellAlive(QuadTreeNodeStore& store, int64_t x, int64_t y) {
+    if (level == kLeafLevel) {
+        // Return a leaf with this cell alive
+        return store.CanonicalLeaf(bits | QuadTreeLeafKernel::CellBit(x, y));
     }
 #if (ENABLE_INFINITE_LEVELS)
-    int64_t offset = (level == 1) ? 0 : INT64_C(1) << (level.get_si() - 2);
+    int64_t offset = INT64_C(1) << (level.get_si() - 2);
 #else
-    int64_t offset = (level == 1) ? 0 : INT64_C(1) << (level - 2);
+    int64_t offset = INT64_C(1) << (level - 2);
 #endif
     // Check west quadrants
     if (x < 0) {
         // Northwest
         if (y < 0) {
-            return Canonical(nw->SetCellAlive(x + offset, y + offset), ne, sw, se, level);
+            return store.Canonical(nw->SetCellAlive(store, x + offset, y + offset), ne, sw, se, level);
         }
         // Southwest
         else {
-            return Canonical(nw, ne, sw->SetCellAlive(x + offset, y - offset), se, level);
+            return store.Canonical(nw, ne, sw->SetCellAlive(store, x + offset, y - offset), se, level);
         }
     }
         // Check east quadrants
     else {
         // Northeast
         if (y < 0) {
-            return Canonical(nw, ne->SetCellAlive(x - offset, y + offset), sw, se, level);
+            return store.Canonical(nw, ne->SetCellAlive(store, x - offset, y + offset), sw, se, level);
         }
         // Southeast
         else {
-            return Canonical(nw, ne, sw, se->SetCellAlive(x - offset, y - offset), level);
+            return store.Canonical(nw, ne, sw, se->SetCellAlive(store, x - offset, y - offset), level);
         }
     }
 }
 
-#if (ENABLE_BIG_INT)
 /**
- * Build a display list of coordinates sorted by x and y
- * This will returns a list or cells that are currently alive and their current coordinates
- * @param origin_x multi precision starting coordinate of this quadtree
- * @param origin_y multi precision starting coordinate of this quadtree
- * @list vector of coordinates to return
- * todo: optimize
+ * Helper for ExactPopulation that remembers the population of every node it has already counted,
+ * because subtrees are usually shared many times
+ * @param counted populations of nodes that we've already counted
+ * @return number of alive cells in this node, saturated at UINT64_MAX
  */
-void QuadTreeNode::BuildDisplayList(mpz_class origin_x, mpz_class origin_y, std::vector<std::pair<mpz_class, mpz_class>>& list) {
-    //std::cout << origin_x << ", " << origin_y << std::endl;
-    if (level == 0) {
-        if (alive) {
-            list.push_back(std::make_pair(origin_x, origin_y));
+uint64_t QuadTreeNode::CountPopulation(std::unordered_map<const QuadTreeNode*, uint64_t> &counted) const {
+    if (level == kLeafLevel) {
+        return QuadTreeLeafKernel::PopCount(bits);
+    }
+    if (empty) {
+        return 0;
+    }
+    auto iter = counted.find(this);
+    if (iter != counted.end()) {
+        return iter->second;
+    }
+    // add up our children's populations, saturating instead of overflowing
+    uint64_t population = 0;
+    QuadTreeNode* children[4] = {nw, ne, sw, se};
+    for (QuadTreeNode* child : children) {
+        uint64_t child_population = child->CountPopulation(counted);
+        population += child_population;
+        if (population < child_population) {
+            population = UINT64_MAX;
+            break;
         }
-    } else {
-        mpz_class offset = 0;
-        if (level > 1) {
-            if ((level - 2) < LEVEL_MAX) {
-                // we're still within signed int boundaries for level
-#if (ENABLE_INFINITE_LEVELS)
-                offset = mpz_pow2_table[level.get_si() - 2];
-#else
-                offset = mpz_pow2_table[level - 2];
-#endif
-            } else {
-                // God, this is slow, but we've run out of precalculated multi-precision powers of 2 because
-                // our level must be ginormous. We take care with boundaries here.
-                mpz_class max = (level - 2) - (LEVEL_MAX - 1);
-                mpz_class i = 0;
-                for (; i < max; ++i) {
-                    offset = offset * 2;
+    }
+    counted[this] = population;
+    return population;
+}
+
+/**
+ * Is everything outside the centered square a quarter of our width empty? A root like that has a border wide
+ * enough to jump 2^(level-3) generations without cells running off its edge. Only call this at level 6 or above
+ * Each quadrant can only have cells in the grandchild next to our center
+ * @return true if every alive cell is in the centered square
+ */
+bool QuadTreeNode::HasEmptyBorder() const {
+    // the cells of each child, and of its grandchild next to our center, have to be in the quadrant next to our center
+    return (nw->quadrants & ~kSoutheast) == 0 && (nw->se->quadrants & ~kSoutheast) == 0
+           && (ne->quadrants & ~kSouthwest) == 0 && (ne->sw->quadrants & ~kSouthwest) == 0
+           && (sw->quadrants & ~kNortheast) == 0 && (sw->ne->quadrants & ~kNortheast) == 0
+           && (se->quadrants & ~kNorthwest) == 0 && (se->nw->quadrants & ~kNorthwest) == 0;
+}
+
+/**
+ * How far in from one of our edges is the nearest alive cell? Our quadrants tell us which children to skip
+ * without looking at them, and the half away from the edge is only searched if the half along it has nothing closer
+ * @param edge the edge to measure from
+ * @param limit only look for cells closer than this
+ * @return columns or rows between the edge and the nearest alive cell, or limit if there's none closer
+ */
+coordinate_type QuadTreeNode::EdgeInset(Edge edge, const coordinate_type& limit) const {
+    if (empty || limit <= 0) {
+        return limit;
+    }
+    bool vertical = edge == kWestEdge || edge == kEastEdge;
+    if (level == kLeafLevel) {
+        // fold the leaf into a byte of the columns or rows that have cells, west or north in the low bit
+        uint64_t lines = 0;
+        if (vertical) {
+            lines = bits | (bits >> 32);
+            lines |= lines >> 16;
+            lines |= lines >> 8;
+            lines &= 0xFF;
+        } else {
+            for (int row = 0; row < 8; ++row) {
+                if (((bits >> (row * 8)) & 0xFF) != 0) {
+                    lines |= UINT64_C(1) << row;
                 }
             }
         }
-        //std::cout << offset << std::endl;
-        if (mpz_cmp_si(nw->population, 0) != 0) {
-            //std::cout << "nw" << level << " " << nw->population << " " << origin_x << " " << origin_y << " " << offset << std::endl;
-            if (level == 1) {
-                nw->BuildDisplayList(origin_x - 1, origin_y - 1, list);
-            } else {
-                nw->BuildDisplayList(origin_x - offset, origin_y - offset, list);
-            }
+        int inset = (edge == kWestEdge || edge == kNorthEdge) ? __builtin_ctzll(lines) : __builtin_clzll(lines) - 56;
+        if (inset < limit) {
+            return inset;
         }
-        if (mpz_cmp_si(ne->population, 0) != 0) {
-            //std::cout << "ne" << level << " " << origin_x << " " << origin_y << " " << offset << std::endl;
-            if (level == 1) {
-                ne->BuildDisplayList(origin_x, origin_y-1, list);
-            } else {
-                ne->BuildDisplayList(origin_x + offset, origin_y - offset, list);
-            }
+        return limit;
+    }
+    // the children along the edge come first, then the ones half our width in from it
+    uint8_t near_children;
+    switch (edge) {
+        case kWestEdge: near_children = kNorthwest | kSouthwest; break;
+        case kEastEdge: near_children = kNortheast | kSoutheast; break;
+        case kNorthEdge: near_children = kNorthwest | kNortheast; break;
+        default: near_children = kSouthwest | kSoutheast; break;
+    }
+    const QuadTreeNode* children[4] = {nw, ne, sw, se};
+    coordinate_type inset = limit;
+    for (int i = 0; i < 4; ++i) {
+        if ((quadrants & near_children & (1 << i)) != 0) {
+            inset = children[i]->EdgeInset(edge, inset);
         }
-        if (mpz_cmp_si(sw->population, 0) != 0) {
-            //std::cout << "sw" << level << " " << origin_x << " " << origin_y << " " << offset << std::endl;
-            if (level == 1) {
-                sw->BuildDisplayList(origin_x - 1, origin_y, list);
-            } else {
-                sw->BuildDisplayList(origin_x - offset, origin_y + offset, list);
-            }
+    }
+#if (ENABLE_BIG_INT)
+    mpz_class half = 0;
+ #if (ENABLE_INFINITE_LEVELS)
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) level.get_ui() - 1);
+ #else
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) level - 1);
+ #endif
+#else
+    int64_t half = INT64_C(1) << (level - 1);
+#endif
+    if (inset <= half) {
+        return inset;
+    }
+    for (int i = 0; i < 4; ++i) {
+        if ((quadrants & ~near_children & (1 << i)) != 0) {
+            inset = half + children[i]->EdgeInset(edge, inset - half);
         }
-        if (mpz_cmp_si(se->population, 0) != 0) {
-            //std::cout << "se" << level <<" " << origin_x << " " << origin_y << " " << offset << std::endl;
-            if (level == 1) {
-                se->BuildDisplayList(origin_x, origin_y, list);
-            } else {
-                se->BuildDisplayList(origin_x + offset, origin_y + offset, list);
-            }
+    }
+    return inset;
+}
+
+#if (ENABLE_BIG_INT)
+/**
+ * Exact population of this node. Nodes don't store their population, so this counts the cells of every
+ * distinct node under us once, and only does multi-precision math for nodes too big for a 64 bit count
+ * @return exact number of alive cells in this node
+ */
+mpz_class QuadTreeNode::ExactPopulation() {
+    std::unordered_map<const QuadTreeNode*, uint64_t> counted;
+    std::unordered_map<const QuadTreeNode*, mpz_class> big_counted;
+    return ExactPopulation(counted, big_counted);
+}
+
+/**
+ * Helper for ExactPopulation that counts nodes above kMaxCountLevel with multi-precision math
+ * @param counted populations of nodes up to kMaxCountLevel that we've already counted
+ * @param big_counted populations of bigger nodes that we've already counted
+ * @return exact number of alive cells in this node
+ */
+mpz_class QuadTreeNode::ExactPopulation(std::unordered_map<const QuadTreeNode*, uint64_t> &counted,
+                                        std::unordered_map<const QuadTreeNode*, mpz_class> &big_counted) {
+    if (level <= kMaxCountLevel || empty) {
+        uint64_t population = CountPopulation(counted);
+        mpz_class exact;
+        mpz_import(exact.get_mpz_t(), 1, 1, sizeof(population), 0, 0, &population);
+        return exact;
+    }
+    auto iter = big_counted.find(this);
+    if (iter != big_counted.end()) {
+        return iter->second;
+    }
+    mpz_class exact = nw->ExactPopulation(counted, big_counted) + ne->ExactPopulation(counted, big_counted)
+                      + sw->ExactPopulation(counted, big_counted) + se->ExactPopulation(counted, big_counted);
+    big_counted[this] = exact;
+    return exact;
+}
+
+/**
+ * Build a display list of coordinates sorted by x and y
+ * This will returns a list or cells that are currently alive and their current coordinates
+ * Cells are read out a chunk at a time with a QuadTreeCellIterator, so we only do multi-precision math once per cell
+ * @param origin_x multi precision starting coordinate of this quadtree
+ * @param origin_y multi precision starting coordinate of this quadtree
+ * @list vector of coordinates to return
+ */
+void QuadTreeNode::BuildDisplayList(const mpz_class& origin_x, const mpz_class& origin_y, std::vector<std::pair<mpz_class, mpz_class>>& list) {
+    QuadTreeCellIterator cells(this, origin_x, origin_y);
+    QuadTreeCellIterator::Cell chunk[kDisplayListChunkCells];
+    size_t num_cells;
+    while ((num_cells = cells.Next(chunk, kDisplayListChunkCells)) != 0) {
+        for (size_t i = 0; i < num_cells; ++i) {
+            list.emplace_back(cells.OriginX() + (long) chunk[i].x, cells.OriginY() + (long) chunk[i].y);
         }
     }
 }
 
 #else
+/**
+ * Population of this node, saturated at UINT64_MAX. Nodes don't store their population, so this counts
+ * the cells of every distinct node under us once
+ * @return number of alive cells in this node
+ */
+uint64_t QuadTreeNode::ExactPopulation() {
+    std::unordered_map<const QuadTreeNode*, uint64_t> counted;
+    return CountPopulation(counted);
+}
+
 /**
  * Build a display list of coordinates sorted by x and y
  * This will returns a list or cells that are currently alive and their current coordinates
+ * Cells are read out a chunk at a time with a QuadTreeCellIterator
  * @param origin_x signed 64 bit starting coordinate of this quadtree
  * @param origin_y signed 64 bit starting coordinate of this quadtree
  * @list vector of coordinates to return
- * todo: optimize
  */
 void QuadTreeNode::BuildDisplayList(int64_t origin_x, int64_t origin_y, std::vector<std::pair<int64_t, int64_t>>& list) {
- #if (ENABLE_DEBUG_PRINT)
-        std::cout << originX << ", " << originY << std::endl;
- #endif
-    if (level == 0) {
-        if (alive) {
-            list.push_back(std::make_pair(origin_x, origin_y));
-        }
-    } else {
-        int64_t offset = (level == 1) ? 0 : INT64_C(1) << (level - 2);
-
- #if (ENABLE_DEBUG_PRINT)
-        std::cout << offset << std::endl;
- #endif
-        if (nw->population > 0) {
- #if (ENABLE_DEBUG_PRINT)
-            std::cout << "nw" << level << " " << originX << " " << originY << " " << offset << std::endl;
- #endif
-            if (level == 1) {
-                nw->BuildDisplayList(origin_x - 1, origin_y - 1, list);
-            } else {
-                nw->BuildDisplayList(origin_x - offset, origin_y - offset, list);
-            }
-        }
-        if (ne->population > 0) {
-            //std::cout << "ne" << level <<" " << originX << " " << originY << " " << offset << std::endl;
-            if (level == 1) {
-                ne->BuildDisplayList(origin_x, origin_y - 1, list);
-            } else {
-                ne->BuildDisplayList(origin_x + offset, origin_y - offset, list);
-            }
+    QuadTreeCellIterator cells(this, origin_x, origin_y);
+    QuadTreeCellIterator::Cell chunk[kDisplayListChunkCells];
+    size_t num_cells;
+    while ((num_cells = cells.Next(chunk, kDisplayListChunkCells)) != 0) {
+        for (size_t i = 0; i < num_cells; ++i) {
+            list.emplace_back(origin_x + chunk[i].x, origin_y + chunk[i].y);
         }
-        if (sw->population > 0) {
-            //std::cout << "sw" << level <<" " << originX << " " << originY << " " << offset << std::endl;
-            if (level == 1) {
-                sw->BuildDisplayList(origin_x - 1, origin_y, list);
-            } else {
-                sw->BuildDisplayList(origin_x - offset, origin_y + offset, list);
-            }
-        }
-        if (se->population > 0) {
-            //std::cout << "se" << level <<" " << originX << " " << originY << " " << offset << std::endl;
-            if (level == 1) {
-                se->BuildDisplayList(origin_x, origin_y, list);
-            } else {
-                se->BuildDisplayList(origin_x + offset, origin_y + offset, list);
-            }
-        }
-
     }
 }
 #endif
 
 
 /**
- * This function looks up a node with level > 0 in the hash table and returns a canonical one
- * if it exists. If it doesn't exist, it creates a new node and adds it
- * @param node quad tree node
- * @return a new, canonical node
+ * Get the canonical node centered on the square made up of four nodes, one level below the square.
+ * For leaves this is done by shifting bits around
+ * @param store store the nodes live in
+ * @return a canonical node at the same level as the four nodes
  */
-QuadTreeNode* QuadTreeNode::Canonical(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se, level_type level) {
-    // Create a node on the stack to look up the canonical version
-    QuadTreeNode node(nw, ne, sw, se, level);
-    // Return a pointer to the canonical version
-    return Canonical(&node);
-}
-
-/**
- * This function looks up a leaf node in the hash table and returns a canonical one
- * if it exists. If it doesn't exist, it creates a new node and adds it
- * @param node quad tree node
- * @return a new, canonical node
- */
-QuadTreeNode* QuadTreeNode::Canonical(QuadTreeNode* node) {
-    std::unordered_map<QuadTreeNode*, QuadTreeNode*>::const_iterator iter = node_map.find(node);
-    // if this node isn't in the map, add it
-    if (iter == node_map.end()) {
-        // create a new node on the heap with the copy constructor
-        QuadTreeNode* newNode = new QuadTreeNode(*node);
-        // insert the node in the map
-        node_map.insert(std::make_pair(newNode, newNode));
-        // increment stats
-        num_nodes_created++;
-        return newNode;
+QuadTreeNode* QuadTreeNode::CenteredSubnode(QuadTreeNodeStore& store, QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se) {
+    if (nw->level == kLeafLevel) {
+        return store.CanonicalLeaf(QuadTreeLeafKernel::Center(nw->bits, ne->bits, sw->bits, se->bits));
     }
-    return iter->first;
+    return store.Canonical(nw->se, ne->sw, sw->ne, se->nw, nw->level);
 }
 
 /**
- * This function looks up a node in the hash table and returns a canonical one
- * if it exists. If it doesn't exist, it creates a new node and adds it
- * @param node quad tree node
- * @return a new, canonical node
+ * Get the canonical node one level down that is centered on this non-leaf node. This is cached on the node
+ * because every parent that evolves this node as one of its quadrants needs it
+ * @param store store this node lives in
+ * @return the centered node, one level down
  */
-QuadTreeNode* QuadTreeNode::Canonical(int alive) {
-    // Create a node on the stack
-    QuadTreeNode node(alive);
-    // Return a pointer to the canonical version
-    return Canonical(&node);
+QuadTreeNode* QuadTreeNode::Center(QuadTreeNodeStore& store) {
+    QuadTreeNode* result = memo.center.load(std::memory_order_acquire);
+    if (result == 0) {
+        // threads that race here compute the same canonical node
+        result = CenteredSubnode(store, nw, ne, sw, se);
+        store.Shade(result);
+        memo.center.store(result, std::memory_order_release);
+    }
+    return result;
 }
 
 /**
@@ -398,79 +478,117 @@ QuadTreeNode::QuadTreeNode(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw,
     this->ne = ne;
     this->sw = sw;
     this->se = se;
-    this->calc = 0;
+    this->memo.calc.store(0, std::memory_order_relaxed);
+    this->calc_exponent.store(0, std::memory_order_relaxed);
+    this->memo.center.store(0, std::memory_order_relaxed);
+#if (ENABLE_INFINITE_LEVELS)
     this->level = level;
-#if (ENABLE_BIG_INT)
-    mpz_init(population);
-    mpz_add(population, nw->population, ne->population);
-    mpz_add(population, population, sw->population);
-    mpz_add(population, population, se->population);
-    alive = (population > 0) ? 1 : 0;
 #else
-    population = nw->population + ne->population + sw->population + se->population;
-                alive = (population > 0) ? 1 : 0;
+    this->level = (uint8_t) level;
 #endif
+    // we're not in the table until the store gives us our hash
+    this->hash_and_mark.store(kFreeWord, std::memory_order_relaxed);
+    quadrants = (uint8_t) ((nw->empty ? 0 : kNorthwest) | (ne->empty ? 0 : kNortheast) | (sw->empty ? 0 : kSouthwest) | (se->empty ? 0 : kSoutheast));
+    empty = quadrants == 0;
+    density = (uint8_t) ((nw->density + ne->density + sw->density + se->density + 2) / 4);
+    if (density == 0 && !empty) {
+        density = 1;
+    }
 }
 
 
 /**
- * Leaf node constructor (1x1 square, level 0, which is 2^0 x 2^0 in size)
- * @param alive is this cell alive?
+ * Leaf node constructor (8x8 square, level 3, which is 2^3 x 2^3 in size)
+ * Leaves are only kLeafSize bytes, so this only writes the fields they have
+ * @param bits the leaf's 8x8 cells, see QuadTreeLeafKernel for the layout
  */
-QuadTreeNode::QuadTreeNode(int alive) {
-    this->alive = alive;
-    nw = 0;
-    ne = 0;
-    sw = 0;
-    se = 0;
-    calc = 0;
-    level = 0;
-#if (ENABLE_BIG_INT)
-    mpz_init_set_si(population, alive & 1);
-#else
-    population = (alive & 1);
-#endif
+QuadTreeNode::QuadTreeNode(uint64_t bits) {
+    this->bits = bits;
+    calc_exponent.store(0, std::memory_order_relaxed);
+    level = kLeafLevel;
+    hash_and_mark.store(kFreeWord, std::memory_order_relaxed);
+    quadrants = (uint8_t) (((bits & QuadTreeLeafKernel::kQuadrantNW) != 0 ? kNorthwest : 0) | ((bits & QuadTreeLeafKernel::kQuadrantNE) != 0 ? kNortheast : 0)
+                           | ((bits & QuadTreeLeafKernel::kQuadrantSW) != 0 ? kSouthwest : 0) | ((bits & QuadTreeLeafKernel::kQuadrantSE) != 0 ? kSoutheast : 0));
+    empty = bits == 0;
+    density = (uint8_t) ((QuadTreeLeafKernel::PopCount(bits) * 255 + 32) / 64);
+    if (density == 0 && !empty) {
+        density = 1;
+    }
 }
 
 /**
- * Function to evolve a level 2 square, which is 2^2 by 2^2 in size
- * Level 2 squares calculate and apply the game of life rule to their four inner squares
- * to calculate the next generation. We don't do borders because those are taking care of in the recursive
- * level above, which calculates  overlapping inner squares
+ * Function to evolve a level 4 square, which is 2^4 by 2^4 in size and made up of four leaves.
+ * We run the game of life rule on all 256 cells at once with a bit parallel kernel, up to 4 generations,
+ * and keep the center 8x8 square, which is a new leaf. We don't do borders because those are taken care of in the
+ * recursive level above, which calculates overlapping inner squares
  *   +--+--+--+--+
- *   |__|__|__|__|
  *   |  |  |  |  |
- *   +--|--|--|--+
- *   |__|__|__|__|
+ *   +--+--+--+--+
+ *   |  |##|##|  |
+ *   +--+--+--+--+
+ *   |  |##|##|  |
+ *   +--+--+--+--+
  *   |  |  |  |  |
  *   +--+--+--+--+
- * @return a new calculated result for a level 2 square
- */
-QuadTreeNode* QuadTreeNode::EvolveLevel2() {
-    // calculate our inner region
-    // todo: accessing all of these pointers can cause cache misses/is probably slow. we can optimize this by making a level 2 node a leaf
-    // node and packing all of these into a short (16 bits)
-    QuadTreeNode* newNW = Canonical(RunRule(nw->se->alive,
-                               nw->nw->alive + nw->ne->alive + ne->nw->alive + nw->sw->alive + ne->sw->alive +
-                               sw->nw->alive + sw->ne->alive + se->nw->alive));
-    QuadTreeNode* newNE = Canonical(RunRule(ne->sw->alive,
-                               nw->ne->alive + ne->nw->alive + ne->ne->alive + nw->se->alive + ne->se->alive +
-                               sw->ne->alive + se->nw->alive + se->ne->alive));
-    QuadTreeNode* newSW = Canonical(RunRule(sw->ne->alive,
-                               nw->sw->alive + nw->se->alive + ne->sw->alive + sw->nw->alive + se->nw->alive +
-                               sw->sw->alive + sw->se->alive + se->sw->alive));
-    QuadTreeNode* newSE = Canonical(RunRule(se->nw->alive,
-                               nw->se->alive + ne->sw->alive + ne->se->alive + sw->ne->alive + se->ne->alive +
-                               sw->se->alive + se->sw->alive + se->se->alive));
-    return Canonical(newNW, newNE, newSW, newSE, level-1);
-}
-
-
-/**
- * Function to evolve a level N square, which is 2^N by 2^N in size and N is > 2
- * Level 2 squares evolve their inner squares, and a level above we combine the results
+ * @param store store this node lives in
+ * @param exponent evolve 2^exponent generations, from 0 to 2
+ * @return a new calculated result for a level 4 square, which is a leaf
+ */
+QuadTreeNode* QuadTreeNode::EvolveLevel4(QuadTreeNodeStore& store, int exponent) {
+    return store.CanonicalLeaf(QuadTreeLeafKernel::Evolve(nw->bits, ne->bits, sw->bits, se->bits, 1 << exponent));
+}
+
+/**
+ * Function to evolve a level 5 square, which is 2^5 by 2^5 in size and made up of 16 leaves.
+ * This is the same as EvolveLevelN, but the inner leaves and the level 4 squares we evolve are only
+ * ever bits, so the only nodes we look up are the four result leaves and the result itself
+ * @param store store this node lives in
+ * @param exponent evolve 2^exponent generations, from 0 to 3
+ * @return a new calculated result for a level 5 square, one level down
+ */
+QuadTreeNode* QuadTreeNode::EvolveLevel5(QuadTreeNodeStore& store, int exponent) {
+    // our 4x4 grid of leaves
+    uint64_t g[4][4] = {
+        {nw->nw->bits, nw->ne->bits, ne->nw->bits, ne->ne->bits},
+        {nw->sw->bits, nw->se->bits, ne->sw->bits, ne->se->bits},
+        {sw->nw->bits, sw->ne->bits, se->nw->bits, se->ne->bits},
+        {sw->sw->bits, sw->se->bits, se->sw->bits, se->se->bits}
+    };
+    // the 3x3 grid of inner leaves. For the full jump they are evolved halfway, like EvolveLevelN
+    int generations = 1 << exponent;
+    uint64_t n[3][3];
+    for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 3; ++x) {
+            if (exponent == level - 2) {
+                n[y][x] = QuadTreeLeafKernel::Evolve(g[y][x], g[y][x + 1], g[y + 1][x], g[y + 1][x + 1], generations / 2);
+            } else {
+                n[y][x] = QuadTreeLeafKernel::Center(g[y][x], g[y][x + 1], g[y + 1][x], g[y + 1][x + 1]);
+            }
+        }
+    }
+    if (exponent == level - 2) {
+        generations /= 2;
+    }
+    // evolve the four overlapping 16x16 squares
+    QuadTreeNode* result[2][2];
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            result[y][x] = store.CanonicalLeaf(QuadTreeLeafKernel::Evolve(n[y][x], n[y][x + 1], n[y + 1][x], n[y + 1][x + 1], generations));
+        }
+    }
+    return store.Canonical(result[0][0], result[0][1], result[1][0], result[1][1], level - 1);
+}
+
+
+/**
+ * Function to evolve a level N square, which is 2^N by 2^N in size and N is > 5
+ * Level 4 squares evolve their inner squares, and a level above we combine the results
  * and keep recursing down. This algorithm works because the tree has an empty border to ensure
  * That calculations will be correct at edges
+ *
+ * For the full 2^(N-2) generation jump, the nine squares are the overlapping halves of this node, and each of
+ * them evolves halfway. The four squares we combine from those results evolve the other half. For smaller jumps
+ * the nine squares are centered inner nodes, which don't move in time, and only the four combined squares evolve
  *   +--+--+--+--+--+--+--+--+--+
  *   |                          |
  *   +   +--+--+--+--+--+--+    +
@@ -485,108 +603,160 @@ QuadTreeNode* QuadTreeNode::EvolveLevel2() {
  *   +   +--+--+--+--+--+--+    +
  *   |                          |
  *   +--+--+--+--+--+--+--+--+--+
+ * @param store store this node lives in
+ * @param exponent evolve 2^exponent generations, from 0 to N-2
  * @return a new calculated result for a level N square, one level down
  */
-QuadTreeNode* QuadTreeNode::EvolveLevelN() {
-    QuadTreeNode* n00 = GetInnerNWNode();
-    QuadTreeNode* n01 = GetInnerNNode();
-    QuadTreeNode* n02 = GetInnerNENode();
-    QuadTreeNode* n10 = GetInnerWNode();
-    QuadTreeNode* n11 = GetInnerCNode();
-    QuadTreeNode* n12 = GetInnerENode();
-    QuadTreeNode* n20 = GetInnerSWNode();
-    QuadTreeNode* n21 = GetInnerSNode();
-    QuadTreeNode* n22 = GetInnerSENode();
-    QuadTreeNode* newNW = Canonical(n00, n01, n10, n11, n00->level+1)->Evolve();
-    QuadTreeNode* newNE = Canonical(n01, n02, n11, n12, n00->level+1)->Evolve();
-    QuadTreeNode* newSW = Canonical(n10, n11, n20, n21, n00->level+1)->Evolve();
-    QuadTreeNode* newSE = Canonical(n11, n12, n21, n22, n00->level+1)->Evolve();
-    return Canonical(newNW, newNE, newSW, newSE, newNW->level + 1);
+QuadTreeNode* QuadTreeNode::EvolveLevelN(QuadTreeNodeStore& store, int exponent) {
+    QuadTreeNode* n[9] = {0};
+    QuadTreeNode* squares[4] = {0};
+    QuadTreeNode* result[4] = {0};
+    // big nodes pin everything they're working on, so that the store can collect garbage in between their sub-squares.
+    // We're pinned by our parent, or we're the root
+    bool pinned = level >= store.PinLevel();
+    if (pinned) {
+        store.CheckPressure();
+        store.Pin(n, 9);
+        store.Pin(squares, 4);
+        store.Pin(result, 4);
+    }
+    if (exponent == level - 2) {
+        // full jump: evolve the nine overlapping halves of this node halfway, then the four squares made of those results
+        QuadTreeNode* halves[9] = {
+            nw, store.Canonical(nw->ne, ne->nw, nw->se, ne->sw, level - 1), ne,
+            store.Canonical(nw->sw, nw->se, sw->nw, sw->ne, level - 1), Center(store), store.Canonical(ne->sw, ne->se, se->nw, se->ne, level - 1),
+            sw, store.Canonical(sw->ne, se->nw, sw->se, se->sw, level - 1), se
+        };
+        if (pinned) {
+            store.Pin(halves, 9);
+        }
+        exponent--;
+        EvolveSquares(store, halves, n, 9, exponent);
+        if (pinned) {
+            store.Unpin(1);
+        }
+    } else {
+        n[0] = GetInnerNWNode(store);
+        n[1] = GetInnerNNode(store);
+        n[2] = GetInnerNENode(store);
+        n[3] = GetInnerWNode(store);
+        n[4] = GetInnerCNode(store);
+        n[5] = GetInnerENode(store);
+        n[6] = GetInnerSWNode(store);
+        n[7] = GetInnerSNode(store);
+        n[8] = GetInnerSENode(store);
+    }
+    squares[0] = store.Canonical(n[0], n[1], n[3], n[4], level - 1);
+    squares[1] = store.Canonical(n[1], n[2], n[4], n[5], level - 1);
+    squares[2] = store.Canonical(n[3], n[4], n[6], n[7], level - 1);
+    squares[3] = store.Canonical(n[4], n[5], n[7], n[8], level - 1);
+    EvolveSquares(store, squares, result, 4, exponent);
+    QuadTreeNode* evolved = store.Canonical(result[0], result[1], result[2], result[3], level - 1);
+    if (pinned) {
+        store.Unpin(3);
+    }
+    return evolved;
 }
 
 /**
- * Helper function to get inner nodes
+ * Evolve a handful of squares 2^exponent generations forward. If this node is big enough, the squares are
+ * evolved as tasks on the store's thread pool. We run the first square ourselves and help with the rest while we wait
+ * @param store store this node lives in
+ * @param squares nodes to evolve, one level below this node
+ * @param results evolved nodes, in the same order
+ * @param count number of squares
+ * @param exponent evolve 2^exponent generations
  */
-QuadTreeNode* QuadTreeNode::GetInnerNWNode() {
-    return Canonical(nw->nw->se, nw->ne->sw, nw->sw->ne, nw->se->nw, level-2);
+void QuadTreeNode::EvolveSquares(QuadTreeNodeStore& store, QuadTreeNode** squares, QuadTreeNode** results, int count, int exponent) {
+#if (ENABLE_PARALLEL_EVOLVE)
+    QuadTreeThreadPool* thread_pool = store.thread_pool;
+    if (thread_pool != 0 && level >= store.parallel_level) {
+        QuadTreeThreadPool::TaskGroup group;
+        for (int i = 1; i < count; ++i) {
+            thread_pool->Spawn(group, [&store, squares, results, i, exponent]() {
+                results[i] = squares[i]->Evolve(store, exponent);
+            });
+        }
+        results[0] = squares[0]->Evolve(store, exponent);
+        thread_pool->Wait(group);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; ++i) {
+        results[i] = squares[i]->Evolve(store, exponent);
+    }
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerNNode() {
-    QuadTreeNode* w = nw;
-    QuadTreeNode* e = ne;
-    return Canonical(w->ne->se, e->nw->sw, w->se->ne, e->sw->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerNWNode(QuadTreeNodeStore& store) {
+    return nw->Center(store);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerNENode() {
-    return Canonical(ne->nw->se, ne->ne->sw, ne->sw->ne, ne->se->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerNNode(QuadTreeNodeStore& store) {
+    return CenteredSubnode(store, nw->ne, ne->nw, nw->se, ne->sw);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerWNode() {
-    QuadTreeNode* n = nw;
-    QuadTreeNode* s = sw;
-    return Canonical(n->sw->se, n->se->sw, s->nw->ne, s->ne->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerNENode(QuadTreeNodeStore& store) {
+    return ne->Center(store);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerCNode() {
-    return Canonical(nw->se->se, ne->sw->sw, sw->ne->ne, se->nw->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerWNode(QuadTreeNodeStore& store) {
+    return CenteredSubnode(store, nw->sw, nw->se, sw->nw, sw->ne);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerENode() {
-    QuadTreeNode* n = ne;
-    QuadTreeNode* s = se;
-    return Canonical(n->sw->se, n->se->sw, s->nw->ne, s->ne->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerCNode(QuadTreeNodeStore& store) {
+    return CenteredSubnode(store, nw->se, ne->sw, sw->ne, se->nw);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerSWNode() {
-    return Canonical(sw->nw->se, sw->ne->sw, sw->sw->ne, sw->se->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerENode(QuadTreeNodeStore& store) {
+    return CenteredSubnode(store, ne->sw, ne->se, se->nw, se->ne);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerSNode() {
-    QuadTreeNode* w = sw;
-    QuadTreeNode* e = se;
-    return Canonical(w->ne->se, e->nw->sw, w->se->ne, e->sw->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerSWNode(QuadTreeNodeStore& store) {
+    return sw->Center(store);
 }
 
 /**
  * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-QuadTreeNode* QuadTreeNode::GetInnerSENode() {
-    return Canonical(se->nw->se, se->ne->sw, se->sw->ne, se->se->nw, level-2);
+QuadTreeNode* QuadTreeNode::GetInnerSNode(QuadTreeNodeStore& store) {
+    return CenteredSubnode(store, sw->ne, se->nw, sw->se, se->sw);
 }
 
 /**
- * Run the game of life rule give an alive status and a neighbor count
- * @param alive current alive status
- * @param count current neighbor count
- * @return if this node is alive in the next generation
+ * Helper function to get inner nodes
+ * @param store store this node lives in
  */
-int QuadTreeNode::RunRule(int alive, int count) {
-    if (alive) {
-        return (count == 2 || count == 3) ? 1 : 0;
-    } else {
-        return (count == 3) ? 1 : 0;
-    }
+QuadTreeNode* QuadTreeNode::GetInnerSENode(QuadTreeNodeStore& store) {
+    return se->Center(store);
 }
 
 
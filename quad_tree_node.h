@@ -5,11 +5,15 @@
 #ifndef GOL_QUADTREENODE_H
 #define GOL_QUADTREENODE_H
 
+#include <atomic>
 #include <cstdio>
 #include <cstdint>
 #include <iostream>
+#include <vector>
 #include <unordered_map>
 #include "quad_tree_config.h"
+#include "quad_tree_leaf_kernel.h"
+#include "quad_tree_node_heap.h"
 
 #if (ENABLE_BIG_INT)
 #include <gmpxx.h>
@@ -17,14 +21,27 @@
 
 /**
  * Quad Tree Node class
- * This class is based on the HashLife algorithm, invented by Bill Gosper, only it doesn't do a full hashlife calculation a power of 2 forward.
- * Instead, it calculates the next generation one step at a time
+ * This class is based on the HashLife algorithm, invented by Bill Gosper. A node evolves its center any power of 2
+ * generations forward, up to 2^(level-2), which is the full HashLife jump, and memoizes a result for every power of 2
+ * it's evolved by
+ *
+ * The tree bottoms out at level 3 leaves, which store their 8x8 cells as one 64 bit word. Levels 0 through 2 don't exist
+ * as nodes, and a level 4 node is evolved with the bit parallel kernel in QuadTreeLeafKernel.
+ *
+ * Nodes live in a QuadTreeNodeStore, which every method that can create nodes takes as a parameter. Big nodes evolve
+ * their sub-squares as tasks on the store's thread pool (see QuadTreeNodeStore::SetThreads()). Canonical nodes can be
+ * created from any of its threads, and memoized results are published with atomics.
+ *
+ * A node is 32 bytes, so that two fit in a cache line. Nodes point to each other with 32 bit indices into the
+ * QuadTreeNodeHeap instead of pointers, the level is a byte, and instead of a population count we only remember
+ * whether the node is empty, which of its quadrants have cells, and a byte of approximate density. A leaf is only the
+ * first kLeafSize (16) bytes of a node: its cells take the place of the memoized result and center it never has, and
+ * it has no children, so the store gives leaves their own arenas with slots half the size. Leaves are about half of
+ * all nodes.
  *
  * It isn't meant to be instantiated with constructors, so those are private. Instead you should use the following methods:
- * Initialize();
- * Shutdown();
- * CreateEmptyTree();
- * SetCell();
+ * QuadTreeNodeStore::EmptyQuadTree();
+ * SetCellAlive();
  *
  * HashLife References:
  * https://en.wikipedia.org/wiki/Hashlife
@@ -37,32 +54,47 @@ typedef  mpz_class level_type;
 #else
 typedef  int level_type;
 #endif
+#if (ENABLE_BIG_INT)
+typedef  mpz_class coordinate_type;
+#else
+typedef  int64_t coordinate_type;
+#endif
+
+class QuadTreeNodeStore;
 
 class QuadTreeNode {
 
     friend class QuadTree;
+    friend class QuadTreeBulkLoader;
+    friend class QuadTreeCellIterator;
+    friend class QuadTreeDiff;
+    friend class QuadTreeRenderer;
+    friend class QuadTreeNodeStore;
+    friend class QuadTreeNodeTable;
+    friend class QuadTreeSnapshot;
+    friend class QuadTreeTests;
 
     public:
 
-        /**
-         * Static initialize because we have some work to do, like initialize a multi precision
-         * power of 2 table
-         */
-        static void Initialize();
+        // Leaves are 8x8 squares, so the tree bottoms out at level 3 instead of single cells
+        static const int kLeafLevel = 3;
 
-        /**
-         * Static shutdown because we have some work to do, like freeing all of our nodes that were
-         * created because they are canonical
-         */
-        static void Shutdown();
+        // bytes of a leaf, which stops where the children of a non-leaf node start
+        static const size_t kLeafSize;
 
+        // the edges EdgeInset() measures from
+        enum Edge {
+            kWestEdge,
+            kEastEdge,
+            kNorthEdge,
+            kSouthEdge
+        };
 
         /**
-         * Build an empty quadtree recursively at the specified level
-         * @param level this level represents the power of 2 dimensions of this quad tree, which is square
-         * @return a new empty quad tree at the specified level
+         * Static initialize because we have some work to do, like initialize a multi precision
+         * power of 2 table. These tables never change, so every store shares them and only the first call builds them
          */
-        static QuadTreeNode* EmptyQuadTree(level_type level);
+        static void Initialize();
 
         /**
         * Copy Constructor
@@ -80,126 +112,121 @@ class QuadTreeNode {
         /**
          * Expand this node by one level (a power of 2) so that we can effectively process inner squares
          * and not hit boundaries
+         * @param store store this node lives in
          * @return a new node one level higher
          */
-        QuadTreeNode* Expand();
+        QuadTreeNode* Expand(QuadTreeNodeStore& store);
 
         /**
          * Can we compact this node any smaller? We call this after evolving the root
          * Currently, we can't call this on sub-nodes that are evolved because we always assume
          * pointers to regions are valid
+         * @param store store this node lives in
          * @return a new root (possibly) compacted one level smaller
          */
-        QuadTreeNode* Compact();
+        QuadTreeNode* Compact(QuadTreeNodeStore& store);
 
         /**
-         * The fun part. Evolve this node and all of its subchildren one generation forward based on Conway's Game of Life Rule
+         * The fun part. Evolve this node and all of its subchildren 2^exponent generations forward based on Conway's Game of Life Rule
+         * The result is the center of this node, one level down. A node can jump at most 2^(level-2) generations, which is
+         * the full HashLife step. Results are memoized per exponent: the first one in this node, tagged with its exponent,
+         * and the others in the store's QuadTreeMemoTable
          * Reference: https://en.wikipedia.org/wiki/Conway%27s_Game_of_Life
-         * @return a new node pointing to a QuadTree structure evolved one generation forwared
+         * @param store store this node lives in
+         * @param exponent evolve 2^exponent generations, from 0 to level-2
+         * @return a new node pointing to a QuadTree structure evolved 2^exponent generations forward
          */
-        QuadTreeNode* Evolve();
+        QuadTreeNode* Evolve(QuadTreeNodeStore& store, int exponent);
 
         /**
          * Turn a cell alive
          * This is ONLY called before we run any simulation and is bounded by signed 64 bit integers
          * input is bounded by signed 64 bit integer input [-2^63, 2^63-1]
+         * @param store store this node lives in
          * @param x x coordinate for this simulation (signed 64 bit integer input [-2^63, 2^63-1])
          * @param y y coordinate for this simulation (signed 64 bit integer input [-2^63, 2^63-1])
          * @return a canonical, alive node
          */
-        QuadTreeNode* SetCellAlive(int64_t x, int64_t y);
+        QuadTreeNode* SetCellAlive(QuadTreeNodeStore& store, int64_t x, int64_t y);
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * Exact population of this node. Nodes don't store their population, so this counts the cells of every
+         * distinct node under us once, and only does multi-precision math for nodes too big for a 64 bit count
+         * @return exact number of alive cells in this node
+         */
+        mpz_class ExactPopulation();
+    #else
+        /**
+         * Population of this node, saturated at UINT64_MAX. Nodes don't store their population, so this counts
+         * the cells of every distinct node under us once
+         * @return number of alive cells in this node
+         */
+        uint64_t ExactPopulation();
+    #endif
+
+        /**
+         * Is everything outside the centered square a quarter of our width empty? A root like that has a border wide
+         * enough to jump 2^(level-3) generations without cells running off its edge. Only call this at level 6 or above
+         * @return true if every alive cell is in the centered square
+         */
+        bool HasEmptyBorder() const;
+
+        /**
+         * How far in from one of our edges is the nearest alive cell? Our quadrants tell us which children to skip
+         * without looking at them, and the half away from the edge is only searched if the half along it has nothing
+         * closer, so most of the time this walks down the edge about a node a level
+         * @param edge the edge to measure from
+         * @param limit only look for cells closer than this
+         * @return columns or rows between the edge and the nearest alive cell, or limit if there's none closer
+         */
+        coordinate_type EdgeInset(Edge edge, const coordinate_type& limit) const;
 
     #if (ENABLE_BIG_INT)
         /**
          * Build a display list of coordinates sorted by x and y
          * This will returns a list or cells that are currently alive and their current coordinates
+         * Cells are read out a chunk at a time with a QuadTreeCellIterator, so we only do multi-precision math once per cell
          * @param origin_x multi precision starting coordinate of this quadtree
          * @param origin_y multi precision starting coordinate of this quadtree
          * @list vector of coordinates to return
-         * todo: optimize
          */
-        void BuildDisplayList(mpz_class origin_x, mpz_class origin_y, std::vector<std::pair<mpz_class, mpz_class>> &list);
+        void BuildDisplayList(const mpz_class& origin_x, const mpz_class& origin_y, std::vector<std::pair<mpz_class, mpz_class>> &list);
     #else
         /**
          * Build a display list of coordinates sorted by x and y
          * This will returns a list or cells that are currently alive and their current coordinates
+         * Cells are read out a chunk at a time with a QuadTreeCellIterator
          * @param origin_x signed 64 bit starting coordinate of this quadtree
          * @param origin_y signed 64 bit starting coordinate of this quadtree
          * @list vector of coordinates to return
-         * todo: optimize
          */
         void BuildDisplayList(int64_t origin_x, int64_t origin_y, std::vector<std::pair<int64_t, int64_t>> &list);
     #endif
 
 
-    private:
-        /**
-         * Hash function to make nodes canonical
-         * For a level 0 node, the hash will just be the population (1 or 0)
-         * For higher level nodes, we just hash the pointers with some primes
-         */
-        struct HashFunction {
-            public:
-                size_t operator() (QuadTreeNode* node) const {
-                    if (node->level == 0) {
-                        return node->population > 0 ? 1 : 0;
-                    } else {
-                        size_t hashCalc =
-                                (size_t) node->nw +
-                                3 * (size_t) node->ne +
-                                3 * (size_t) node->sw +
-                                3 * (size_t) node->se;
-                        return hashCalc;
-                    }
-                }
-        };
-
-        /**
-         * Function to test if two node pointers are equal
-         * We early out if they are not the same level, and again for level 0 we just
-         * compare if both nodes are alive or not. For other level nodes, we compare the pointers
-         */
-        struct EqualFunction {
-            public:
-                bool operator()(QuadTreeNode* node1, QuadTreeNode* node2) const{
-                    if (node1->level != node2->level) {
-                        return false;
-                    }
-                    if (node1->level == 0) {
-                        return (node1->alive == node2->alive);
-                    }
-                    return (node1->nw == node2->nw)
-                           && (node1->ne == node2->ne)
-                           && (node1->sw == node2->sw)
-                           && (node1->se == node2->se);
-                }
-        };
-
     private:
 
         /**
-         * This function looks up a node with level > 0 in the hash table and returns a canonical one
-         * if it exists. If it doesn't exist, it creates a new node and adds it
-         * @param node quad tree node
-         * @return a new, canonical node
+         * @return bytes of a leaf, which stops where the children of a non-leaf node start
          */
-        static QuadTreeNode* Canonical(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se, level_type level);
+        static size_t LeafSize();
 
         /**
-         * This function looks up a leaf node in the hash table and returns a canonical one
-         * if it exists. If it doesn't exist, it creates a new node and adds it
-         * @param node quad tree node
-         * @return a new, canonical node
+         * Get the canonical node centered on the square made up of four nodes, one level below the square.
+         * For leaves this is done by shifting bits around
+         * @param store store the nodes live in
+         * @return a canonical node at the same level as the four nodes
          */
-        static QuadTreeNode* Canonical(int alive);
+        static QuadTreeNode* CenteredSubnode(QuadTreeNodeStore& store, QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se);
 
         /**
-         * This function looks up a node in the hash table and returns a canonical one
-         * if it exists. If it doesn't exist, it creates a new node and adds it
-         * @param node quad tree node
-         * @return a new, canonical node
+         * Get the canonical node one level down that is centered on this non-leaf node. This is cached on the node
+         * because every parent that evolves this node as one of its quadrants needs it
+         * @param store store this node lives in
+         * @return the centered node, one level down
          */
-        static QuadTreeNode* Canonical(QuadTreeNode* node);
+        QuadTreeNode* Center(QuadTreeNodeStore& store);
 
         /**
          * Private non-leaf node constructor
@@ -212,32 +239,50 @@ class QuadTreeNode {
         QuadTreeNode(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se, level_type level);
 
         /**
-         * Private Leaf node constructor (1x1 square, level 0, which is 2^0 x 2^0 in size)
-         * @param alive is this cell alive?
+         * Private Leaf node constructor (8x8 square, level 3, which is 2^3 x 2^3 in size)
+         * Leaves are only kLeafSize bytes, so this only writes the fields they have
+         * @param bits the leaf's 8x8 cells, see QuadTreeLeafKernel for the layout
          */
-        QuadTreeNode(int alive);
+        explicit QuadTreeNode(uint64_t bits);
 
         /**
-         * Function to evolve a level 2 square, which is 2^2 by 2^2 in size
-         * Level 2 squares calculate and apply the game of life rule to their four inner squares
-         * to calculate the next generation. We don't do borders because those are taking care of in the recursive
-         * level above, which calculates  overlapping inner squares
+         * Function to evolve a level 4 square, which is 2^4 by 2^4 in size and made up of four leaves.
+         * We run the game of life rule on all 256 cells at once with a bit parallel kernel, up to 4 generations,
+         * and keep the center 8x8 square, which is a new leaf
          *   +--+--+--+--+
-         *   |__|__|__|__|
          *   |  |  |  |  |
-         *   +--|--|--|--+
-         *   |__|__|__|__|
+         *   +--+--+--+--+
+         *   |  |##|##|  |
+         *   +--+--+--+--+
+         *   |  |##|##|  |
+         *   +--+--+--+--+
          *   |  |  |  |  |
          *   +--+--+--+--+
-         * @return a new calculated result for a level 2 square
+         * @param store store this node lives in
+         * @param exponent evolve 2^exponent generations, from 0 to 2
+         * @return a new calculated result for a level 4 square, which is a leaf
+         */
+        QuadTreeNode* EvolveLevel4(QuadTreeNodeStore& store, int exponent);
+
+        /**
+         * Function to evolve a level 5 square, which is 2^5 by 2^5 in size and made up of 16 leaves.
+         * This is the same as EvolveLevelN, but the inner leaves and the level 4 squares we evolve are only
+         * ever bits, so the only nodes we look up are the four result leaves and the result itself
+         * @param store store this node lives in
+         * @param exponent evolve 2^exponent generations, from 0 to 3
+         * @return a new calculated result for a level 5 square, one level down
          */
-        QuadTreeNode* EvolveLevel2();
+        QuadTreeNode* EvolveLevel5(QuadTreeNodeStore& store, int exponent);
 
         /**
-         * Function to evolve a level N square, which is 2^N by 2^N in size and N is > 2
-         * Level 2 squares evolve their inner squares, and a level above we combine the results
+         * Function to evolve a level N square, which is 2^N by 2^N in size and N is > 5
+         * Level 4 squares evolve their inner squares, and a level above we combine the results
          * and keep recursing down. This algorithm works because the tree has an empty border to ensure
          * That calculations will be correct at edges
+         *
+         * For the full 2^(N-2) generation jump, the nine squares are the overlapping halves of this node, and each of
+         * them evolves halfway. The four squares we combine from those results evolve the other half. For smaller jumps
+         * the nine squares are centered inner nodes, which don't move in time, and only the four combined squares evolve
          *   +--+--+--+--+--+--+--+--+--+
          *   |                          |
          *   |   +--+--+--+--+--+--+    |
@@ -252,18 +297,23 @@ class QuadTreeNode {
          *   |   +--+--+--+--+--+--+    |
          *   |                          |
          *   +--+--+--+--+--+--+--+--+--+
+         * @param store store this node lives in
+         * @param exponent evolve 2^exponent generations, from 0 to N-2
          * @return a new calculated result for a level N square, one level down
          */
-        QuadTreeNode* EvolveLevelN();
-
+        QuadTreeNode* EvolveLevelN(QuadTreeNodeStore& store, int exponent);
 
         /**
-         * Run the game of life rule give an alive status and a neighbor count
-         * @param alive current alive status
-         * @param count current neighbor count
-         * @return if this node is alive in the next generation
+         * Evolve a handful of squares 2^exponent generations forward. If this node is big enough, the squares are
+         * evolved as tasks on the store's thread pool
+         * @param store store this node lives in
+         * @param squares nodes to evolve, one level below this node
+         * @param results evolved nodes, in the same order
+         * @param count number of squares
+         * @param exponent evolve 2^exponent generations
          */
-        int RunRule(int alive, int count);
+        void EvolveSquares(QuadTreeNodeStore& store, QuadTreeNode** squares, QuadTreeNode** results, int count, int exponent);
+
 
         /**
          * Helper functions to get inner nodes
@@ -281,17 +331,131 @@ class QuadTreeNode {
          *   |   +--+--+--+--+--+--+    |
          *   |                          |
          *   +--+--+--+--+--+--+--+--+--+
+         * @param store store this node lives in
          * @return
          */
-        QuadTreeNode* GetInnerNWNode();
-        QuadTreeNode* GetInnerNNode();
-        QuadTreeNode* GetInnerNENode();
-        QuadTreeNode* GetInnerWNode();
-        QuadTreeNode* GetInnerCNode();
-        QuadTreeNode* GetInnerENode();
-        QuadTreeNode* GetInnerSWNode();
-        QuadTreeNode* GetInnerSNode();
-        QuadTreeNode* GetInnerSENode();
+        QuadTreeNode* GetInnerNWNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerNNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerNENode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerWNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerCNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerENode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerSWNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerSNode(QuadTreeNodeStore& store);
+        QuadTreeNode* GetInnerSENode(QuadTreeNodeStore& store);
+
+        /**
+         * @return hash of our children, see QuadTreeNodeTable::Hash()
+         */
+        uint32_t Hash() const { return hash_and_mark.load(std::memory_order_relaxed) & kHashMask; }
+
+        /**
+         * Set our hash and mark. Only call this before we're in the node table
+         * @param hash from QuadTreeNodeTable::Hash() or QuadTreeNodeTable::HashLeaf()
+         * @param mark the store's current mark, kMarkBit or 0, along with our starting age in the kAgeMask bits
+         */
+        void SetHash(uint32_t hash, uint32_t mark) { hash_and_mark.store(hash | mark, std::memory_order_relaxed); }
+
+        /**
+         * The mark bit means "reachable" when it matches the store's current mark, which flips every collection.
+         * That way nobody has to clear the marks we leave behind
+         * @param mark the store's current mark, kMarkBit or 0
+         * @return true if garbage collection has marked us as reachable
+         */
+        bool IsMarked(uint32_t mark) const { return (hash_and_mark.load(std::memory_order_relaxed) & kMarkBit) == mark; }
+
+        /**
+         * Mark us as reachable. Only the collector calls this, while no step is running, so a plain load and store is
+         * enough
+         * @param mark the store's current mark, kMarkBit or 0
+         * @return true if we weren't marked before, so the caller should go on to mark our children
+         */
+        bool Mark(uint32_t mark) {
+            uint32_t value = hash_and_mark.load(std::memory_order_relaxed);
+            if ((value & kMarkBit) == mark) {
+                return false;
+            }
+            hash_and_mark.store((value & ~kMarkBit) | mark, std::memory_order_relaxed);
+            return true;
+        }
+
+        /**
+         * Mark us as reachable in the middle of a step, where other threads can be marking or touching us too
+         * @param mark the store's current mark, kMarkBit or 0
+         * @return true if this call marked us, so the caller should go on to mark our children
+         */
+        bool MarkShared(uint32_t mark) {
+            if (IsMarked(mark)) {
+                return false;
+            }
+            uint32_t value = mark != 0 ? hash_and_mark.fetch_or(kMarkBit, std::memory_order_relaxed)
+                                       : hash_and_mark.fetch_and(~kMarkBit, std::memory_order_relaxed);
+            return (value & kMarkBit) != mark;
+        }
+
+        /**
+         * @return how recently we were used, from 0 (not since the last kMaxAge collections) to kMaxAge (since the
+         * last collection)
+         */
+        uint32_t Age() const { return (hash_and_mark.load(std::memory_order_relaxed) & kAgeMask) >> kAgeShift; }
+
+        /**
+         * Set our age. Only the collector calls this, while no step is running
+         * @param age from 0 to kMaxAge
+         */
+        void SetAge(uint32_t age) {
+            uint32_t value = hash_and_mark.load(std::memory_order_relaxed);
+            hash_and_mark.store((value & ~kAgeMask) | (age << kAgeShift), std::memory_order_relaxed);
+        }
+
+        /**
+         * Note that a step used us, which makes us as young as we get. Nodes are used over and over, so we only pay
+         * for an atomic write the first time after a collection aged us
+         */
+        void Touch() {
+            if ((hash_and_mark.load(std::memory_order_relaxed) & kAgeMask) != kAgeMask) {
+                hash_and_mark.fetch_or(kAgeMask, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @return true if we aren't a node in the table: either a free arena slot, or a new node that hasn't been given
+         * its hash yet
+         */
+        bool IsFree() const { return hash_and_mark.load(std::memory_order_relaxed) == kFreeWord; }
+
+        /**
+         * Flag our slot as free, right before it goes back to an arena
+         */
+        void SetFree() { hash_and_mark.store(kFreeWord, std::memory_order_relaxed); }
+
+        /**
+         * @param mark the store's current mark, kMarkBit or 0
+         * @return true if we're a node that isn't free and isn't marked, so a finished marking says we're dead
+         */
+        bool IsGarbage(uint32_t mark) const {
+            uint32_t value = hash_and_mark.load(std::memory_order_relaxed);
+            return value != kFreeWord && (value & kMarkBit) != mark;
+        }
+
+        /**
+         * Helper for ExactPopulation that remembers the population of every node it has already counted,
+         * because subtrees are usually shared many times
+         * @param counted populations of nodes that we've already counted
+         * @return number of alive cells in this node, saturated at UINT64_MAX
+         */
+        uint64_t CountPopulation(std::unordered_map<const QuadTreeNode*, uint64_t> &counted) const;
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * Helper for ExactPopulation that counts nodes above kMaxCountLevel with multi-precision math
+         * @param counted populations of nodes up to kMaxCountLevel that we've already counted
+         * @param big_counted populations of bigger nodes that we've already counted
+         * @return exact number of alive cells in this node
+         */
+        mpz_class ExactPopulation(std::unordered_map<const QuadTreeNode*, uint64_t> &counted,
+                                  std::unordered_map<const QuadTreeNode*, mpz_class> &big_counted);
+    #endif
 
 #if (ENABLE_BIG_INT)
         /**
@@ -303,45 +467,99 @@ class QuadTreeNode {
 
     private:
 
+        /**
+         * What a non-leaf node remembers about itself. It's a named struct because anonymous ones can't hold atomics
+         */
+        struct Memo {
+            // Memoization: store the result of this node being evolved 2^calc_exponent generations forward. Results
+            // for other exponents go in the store's QuadTreeMemoTable. This is atomic because several threads can
+            // evolve the same node at once
+            QuadTreeAtomicNodeRef calc;
+
+            // Cached Center() of a non-leaf node, or 0 if it hasn't been needed yet
+            QuadTreeAtomicNodeRef center;
+        };
+
+        union {
+            // memoized result and center of a non-leaf node
+            Memo memo;
+
+            // Cells of a leaf node, 8 rows of 8 bits. Leaves are never evolved or centered, so their cells take the
+            // place of the memo
+            uint64_t bits;
+        };
+
+        // Hash of our children in the low 29 bits, stored so that the node table never has to recompute it, our age
+        // in the two bits above, and our garbage collection mark in the top bit. It's atomic so that we can be marked
+        // and touched while other threads read the hash. A free arena slot keeps its free list pointer where calc
+        // and center are, so this stays readable in free slots of both sizes
+        std::atomic<uint32_t> hash_and_mark;
+
+        // Level of this node, meaning this node is 2^level x 2^level in size, with coordinates
+        // ranging from [-2^(n-1), 2^(n-1)-1]
+    #if (ENABLE_INFINITE_LEVELS)
+        level_type level;
+    #else
+        uint8_t level;
+    #endif
+
+        // Exponent of the generations calc is evolved by, only valid if calc isn't 0
+        std::atomic<uint8_t> calc_exponent;
+
+        // Are all of our cells dead? We don't keep a population count, which wouldn't fit in 32 bytes,
+        // so ExactPopulation() counts cells when it's asked to
+        bool empty : 1;
+
+        // Which of our quadrants have alive cells, as kNorthwest through kSoutheast, so that compacting, the border
+        // check, bounding boxes and viewport culling can see where our cells are without looking at empty children.
+        // It's 0 exactly when we're empty, and shares empty's byte
+        uint8_t quadrants : 4;
+
+        // Share of our cells that are alive, in 255ths, which renderers use instead of counting cells. It's the
+        // rounded average of our children's, so it's within about level / 2 of exact, and it's only 0 if we're empty.
+        // It fits in the byte after empty that was padding
+        uint8_t density;
+
+        // A leaf ends here, kLeafSize bytes in. Only non-leaf nodes have the children below, as indices into the
+        // QuadTreeNodeHeap, so never touch them without checking the level first
+
         // Northwest node
-        QuadTreeNode* nw;
+        QuadTreeNodeRef nw;
 
         // Northeast node
-        QuadTreeNode* ne;
+        QuadTreeNodeRef ne;
 
         // Southwest node
-        QuadTreeNode* sw;
+        QuadTreeNodeRef sw;
 
         // Southeast node
-        QuadTreeNode* se;
+        QuadTreeNodeRef se;
 
-        // Memoization: store the result of this node being evolved one generation forward
-        QuadTreeNode* calc;
+        // bits of quadrants, one per child
+        static const uint8_t kNorthwest = 1;
+        static const uint8_t kNortheast = 2;
+        static const uint8_t kSouthwest = 4;
+        static const uint8_t kSoutheast = 8;
 
-        // Indicates if this node is alive. We store this here because it's faster to check this
-        // than to compare a multi precision value if bigint is enabled
-        int8_t alive;
+        // highest level a node can be, so that the level fits in a byte
+        static const int kMaxLevel = UINT8_MAX;
 
-        // Level of this node, meaning this node is 2^level x 2^level in size, with coordinates
-        // ranging from [-2^(n-1), 2^(n-1)-1]
-        level_type level;
+        // biggest level whose population always fits in 64 bits
+        static const int kMaxCountLevel = 31;
 
-    #if (ENABLE_BIG_INT)
-        // population count of this node. We use a multiprecision integer because we can have a multiprecision boundary size
-        // todo: this is huge overkill for every node.
-        mpz_t population;
-    #else
-        // population count of this node. This really won't work if big int is off and the number
-        // of nodes exceeds a signed 64 bit int, which it can because our coordinates are between [-2^63, 2^63-1]
-        // and every row could be full
-        int64_t population;
-    #endif
+        // cells BuildDisplayList() reads out of the tree at a time
+        static const size_t kDisplayListChunkCells = 1024;
 
-        // canonical map of all of our nodes
-        static std::unordered_map<QuadTreeNode*, QuadTreeNode*, HashFunction, EqualFunction> node_map;
+        // garbage collection mark bit in hash_and_mark, the age bits under it, and the bits of the hash under those
+        static const uint32_t kMarkBit = UINT32_C(1) << 31;
+        static const int kAgeShift = 29;
+        static const uint32_t kMaxAge = 3;
+        static const uint32_t kAgeMask = kMaxAge << kAgeShift;
+        static const uint32_t kHashMask = (UINT32_C(1) << kAgeShift) - 1;
 
-        // helper variables to let us know how many nodes have been created total
-        static int64_t num_nodes_created;
+        // hash_and_mark of a node that isn't in the table. QuadTreeNodeTable never hands out kHashMask as a hash,
+        // so this can't be mistaken for a real node whichever way the mark and age bits point
+        static const uint32_t kFreeWord = UINT32_MAX;
 
     #if (ENABLE_BIG_INT)
         // precalculated multi precision powers of two
@@ -0,0 +1,117 @@
+//
+// Created by agent on 10/15/26.
+//
+#include <cstdlib>
+#include <new>
+#include "quad_tree_config.h"
+#include "quad_tree_node_arena.h"
+#include "quad_tree_node_heap.h"
+
+#if (ENABLE_NODE_ARENA_HUGE_PAGES) && defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/**
+ * Constructs an empty arena
+ * @param object_size size of the objects we hand out, this gets rounded up to our slot size
+ */
+QuadTreeNodeArena::QuadTreeNodeArena(size_t object_size) {
+    // round small objects up to a power of 2 so they pack evenly into a cache line,
+    // and large objects up to a whole number of cache lines
+    if (object_size < sizeof(FreeSlot)) {
+        object_size = sizeof(FreeSlot);
+    }
+    if (object_size <= kCacheLineSize) {
+        slot_size = sizeof(FreeSlot);
+        while (slot_size < object_size) {
+            slot_size <<= 1;
+        }
+    } else {
+        slot_size = (object_size + kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+    }
+    chunk_next = 0;
+    chunk_end = 0;
+    next_chunk_bytes = kMinChunkBytes;
+    chunk_bytes = 0;
+    free_list = 0;
+    num_allocated = 0;
+    num_free = 0;
+    num_allocations = 0;
+}
+
+/**
+ * Destructor, frees every chunk
+ */
+QuadTreeNodeArena::~QuadTreeNodeArena() {
+    FreeAll();
+}
+
+/**
+ * Free every chunk at once. Every pointer handed out by this arena becomes invalid
+ */
+void QuadTreeNodeArena::FreeAll() {
+    for (Chunk& chunk : chunks) {
+        QuadTreeNodeHeap::FreeChunk(chunk.memory, chunk.bytes);
+    }
+    chunks.clear();
+    chunk_next = 0;
+    chunk_end = 0;
+    next_chunk_bytes = kMinChunkBytes;
+    chunk_bytes = 0;
+    free_list = 0;
+    num_allocated = 0;
+    num_free = 0;
+}
+
+/**
+ * Free our chunks and take over every chunk and free slot of another arena, which is left empty. Our count
+ * of allocations is kept, so filling an arena and handing its chunks over doesn't count as allocating
+ * @param other arena with the same slot size
+ */
+void QuadTreeNodeArena::TakeChunks(QuadTreeNodeArena& other) {
+    FreeAll();
+    chunks.swap(other.chunks);
+    chunk_next = other.chunk_next;
+    chunk_end = other.chunk_end;
+    next_chunk_bytes = other.next_chunk_bytes;
+    chunk_bytes = other.chunk_bytes;
+    free_list = other.free_list;
+    num_allocated = other.num_allocated;
+    num_free = other.num_free;
+    // other's chunks are now the empty list we had, so this only resets it
+    other.FreeAll();
+}
+
+/**
+ * Allocate the next chunk, which is twice as big as the last one (up to a limit). Chunks come from the
+ * QuadTreeNodeHeap, so that every slot has a 32 bit index
+ */
+void QuadTreeNodeArena::AllocateChunk() {
+    size_t bytes = next_chunk_bytes;
+    size_t alignment = kCacheLineSize;
+#if (ENABLE_NODE_ARENA_HUGE_PAGES) && defined(__linux__)
+    if (bytes >= kHugePageSize) {
+        alignment = kHugePageSize;
+    }
+#endif
+    void* memory = QuadTreeNodeHeap::AllocateChunk(bytes, alignment);
+#if (ENABLE_NODE_ARENA_HUGE_PAGES) && defined(__linux__)
+    if (alignment == kHugePageSize) {
+        // this is only a hint, if transparent huge pages are off we just get regular pages
+        madvise(memory, bytes, MADV_HUGEPAGE);
+    }
+#endif
+    Chunk chunk;
+    chunk.memory = static_cast<char*>(memory);
+    chunk.bytes = bytes;
+    chunks.push_back(chunk);
+    chunk_bytes += bytes;
+
+    // only use whole slots
+    chunk_next = chunk.memory;
+    chunk_end = chunk.memory + (bytes / slot_size) * slot_size;
+
+    if (next_chunk_bytes < kMaxChunkBytes) {
+        next_chunk_bytes <<= 1;
+    }
+}
@@ -0,0 +1,304 @@
+//
+// Created by agent on 10/15/26.
+//
+
+#ifndef GOL_QUADTREENODEARENA_H
+#define GOL_QUADTREENODEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include "quad_tree_node_heap.h"
+
+/**
+ * Chunked arena allocator for quad tree nodes
+ *
+ * Nodes are carved out of large chunks instead of being allocated one at a time with new, and nodes
+ * that are freed by garbage collection go on a free list so that their slots get reused by the next
+ * nodes we create. Slots are sized and aligned so that a node never straddles a cache line.
+ *
+ * Chunks start small and double in size up to a maximum. If huge pages are enabled in quad_tree_config.h,
+ * large chunks are aligned to 2MB and we ask the kernel to back them with transparent huge pages, which cuts
+ * down on TLB misses when we have millions of nodes. Chunks come out of the QuadTreeNodeHeap, so that every node
+ * can be named by a 32 bit index, and go back to it when they're freed.
+ *
+ * The arena doesn't run destructors, it only hands out and takes back raw memory. It isn't thread safe, so every
+ * thread that creates nodes gets its own arena.
+ *
+ * Garbage collection sweeps the arena directly with Sweep(), which walks every slot in address order instead of
+ * looking nodes up one at a time. An incremental collection sweeps a bit at a time instead: it takes the ranges of
+ * slots handed out so far with HandedOut(), sweeps them with SweepRange(), which doesn't touch the arena and so can
+ * run on another thread, and gives the slots it freed back with Free(FreeSlots&).
+ */
+class QuadTreeNodeArena {
+
+    public:
+
+        /**
+         * A run of slots that have all been handed out at some point, [begin, end)
+         */
+        struct SlotRange {
+            char* begin;
+            char* end;
+        };
+
+        /**
+         * Slots freed by SweepRange(), linked together so that they go back to the arena all at once
+         */
+        struct FreeSlots {
+            void* head;
+            void* tail;
+            size_t count;
+        };
+
+        /**
+         * Constructs an empty arena
+         * @param object_size size of the objects we hand out, this gets rounded up to our slot size
+         */
+        explicit QuadTreeNodeArena(size_t object_size);
+
+        /**
+         * Destructor, frees every chunk
+         */
+        ~QuadTreeNodeArena();
+
+        /**
+         * Get memory for one object, from the free list if possible
+         * @return cache line aligned memory for one object
+         */
+        void* Allocate() {
+            ++num_allocations;
+            if (free_list != 0) {
+                FreeSlot* slot = free_list;
+                free_list = slot->next;
+                --num_free;
+                return slot;
+            }
+            if (chunk_next == chunk_end) {
+                AllocateChunk();
+            }
+            void* memory = chunk_next;
+            chunk_next += slot_size;
+            ++num_allocated;
+            return memory;
+        }
+
+        /**
+         * Give memory back to the arena, it goes on the free list
+         * @param memory memory previously returned by Allocate()
+         */
+        void Free(void* memory) {
+            FreeSlot* slot = static_cast<FreeSlot*>(memory);
+            slot->next = free_list;
+            free_list = slot;
+            ++num_free;
+        }
+
+        /**
+         * Free every chunk at once. Every pointer handed out by this arena becomes invalid
+         */
+        void FreeAll();
+
+        /**
+         * Free our chunks and take over every chunk and free slot of another arena, which is left empty. Our count
+         * of allocations is kept, so filling an arena and handing its chunks over doesn't count as allocating
+         * @param other arena with the same slot size
+         */
+        void TakeChunks(QuadTreeNodeArena& other);
+
+        /**
+         * Rebuild the free list out of every slot that isn't live. The list is in address order, so new objects fill
+         * in the oldest chunks first. Chunks with nothing live left in them, other than the one we're carving new slots
+         * out of, are given back to the system
+         * @param is_live bool(void* slot), called once for every slot handed out so far, including free ones
+         * @return number of bytes given back to the system
+         */
+        template <class IsLive>
+        size_t Sweep(IsLive is_live) {
+            free_list = 0;
+            num_free = 0;
+            FreeSlot** tail = &free_list;
+            size_t released_bytes = 0;
+            size_t num_kept = 0;
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                Chunk chunk = chunks[i];
+                bool carving = i + 1 == chunks.size();
+                char* end = carving ? chunk_next : chunk.memory + (chunk.bytes / slot_size) * slot_size;
+                FreeSlot** chunk_tail = tail;
+                size_t chunk_slots = 0;
+                size_t chunk_free = 0;
+                for (char* slot = chunk.memory; slot != end; slot += slot_size) {
+                    ++chunk_slots;
+                    if (!is_live(slot)) {
+                        FreeSlot* free_slot = reinterpret_cast<FreeSlot*>(slot);
+                        *tail = free_slot;
+                        tail = &free_slot->next;
+                        ++chunk_free;
+                    }
+                }
+                if (!carving && chunk_free == chunk_slots) {
+                    // nothing lives here, so cut the chunk's slots back out of the free list and let it go
+                    tail = chunk_tail;
+                    num_allocated -= chunk_slots;
+                    chunk_bytes -= chunk.bytes;
+                    released_bytes += chunk.bytes;
+                    QuadTreeNodeHeap::FreeChunk(chunk.memory, chunk.bytes);
+                    continue;
+                }
+                num_free += chunk_free;
+                chunks[num_kept++] = chunk;
+            }
+            *tail = 0;
+            chunks.resize(num_kept);
+            return released_bytes;
+        }
+
+        /**
+         * Get every slot handed out so far, in address order, as ranges of at most max_bytes
+         * @param max_bytes biggest range we add, at least one slot
+         * @param ranges ranges are appended to this
+         */
+        void HandedOut(size_t max_bytes, std::vector<SlotRange>& ranges) const {
+            size_t max_range = max_bytes / slot_size * slot_size;
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                char* end = i + 1 == chunks.size() ? chunk_next : chunks[i].memory + (chunks[i].bytes / slot_size) * slot_size;
+                for (char* begin = chunks[i].memory; begin != end; ) {
+                    char* range_end = (size_t) (end - begin) > max_range ? begin + max_range : end;
+                    ranges.push_back({begin, range_end});
+                    begin = range_end;
+                }
+            }
+        }
+
+        /**
+         * Visit every slot handed out so far in address order, whether it's free or not
+         * @param visitor void(void* slot)
+         */
+        template <class Visitor>
+        void ForEachSlot(Visitor visitor) const {
+            for (size_t i = 0; i < chunks.size(); ++i) {
+                char* end = i + 1 == chunks.size() ? chunk_next : chunks[i].memory + (chunks[i].bytes / slot_size) * slot_size;
+                for (char* slot = chunks[i].memory; slot != end; slot += slot_size) {
+                    visitor(slot);
+                }
+            }
+        }
+
+        /**
+         * Link every dead slot in a range into a list of free slots. This only touches the dead slots, not the
+         * arena, so it can run on another thread while the arena's owner keeps allocating, as long as is_dead never
+         * says yes to a slot that's on the free list or could be handed out again
+         * @param range from HandedOut()
+         * @param slot_size SlotSize() of the arena the range came from
+         * @param is_dead bool(void* slot), true for slots that should be freed
+         * @param freed dead slots are added to the end of this, which starts out with count 0
+         */
+        template <class IsDead>
+        static void SweepRange(const SlotRange& range, size_t slot_size, IsDead is_dead, FreeSlots& freed) {
+            for (char* slot = range.begin; slot != range.end; slot += slot_size) {
+                if (is_dead(slot)) {
+                    FreeSlot* free_slot = reinterpret_cast<FreeSlot*>(slot);
+                    free_slot->next = 0;
+                    if (freed.count == 0) {
+                        freed.head = free_slot;
+                    } else {
+                        static_cast<FreeSlot*>(freed.tail)->next = free_slot;
+                    }
+                    freed.tail = free_slot;
+                    ++freed.count;
+                }
+            }
+        }
+
+        /**
+         * Put slots from SweepRange() on the front of the free list
+         * @param freed slots from this arena, which is emptied
+         */
+        void Free(FreeSlots& freed) {
+            if (freed.count == 0) {
+                return;
+            }
+            static_cast<FreeSlot*>(freed.tail)->next = free_list;
+            free_list = static_cast<FreeSlot*>(freed.head);
+            num_free += freed.count;
+            freed = FreeSlots();
+        }
+
+        /**
+         * @return number of objects currently handed out
+         */
+        size_t Size() const { return num_allocated - num_free; }
+
+        /**
+         * @return number of Allocate() calls over the arena's whole life. This isn't reset by FreeAll()
+         */
+        uint64_t NumAllocations() const { return num_allocations; }
+
+        /**
+         * @return number of bytes reserved in chunks
+         */
+        size_t MemoryUsage() const { return chunk_bytes; }
+
+        /**
+         * @return number of bytes per slot
+         */
+        size_t SlotSize() const { return slot_size; }
+
+    private:
+
+        /**
+         * A free slot stores a pointer to the next free slot
+         */
+        struct FreeSlot {
+            FreeSlot* next;
+        };
+
+        /**
+         * A chunk of slots
+         */
+        struct Chunk {
+            char* memory;
+            size_t bytes;
+        };
+
+        /**
+         * Allocate the next chunk, which is twice as big as the last one (up to a limit). Chunks come from the
+         * QuadTreeNodeHeap, so that every slot has a 32 bit index
+         */
+        void AllocateChunk();
+
+    private:
+
+        // size of each slot, a power of 2 under a cache line or a multiple of a cache line
+        size_t slot_size;
+
+        // all of our chunks, in the order they were allocated
+        std::vector<Chunk> chunks;
+
+        // bump pointer into the last chunk
+        char* chunk_next;
+        char* chunk_end;
+
+        // size of the next chunk we allocate
+        size_t next_chunk_bytes;
+
+        // total bytes in all chunks
+        size_t chunk_bytes;
+
+        // free list of slots that have been given back
+        FreeSlot* free_list;
+
+        // stats
+        size_t num_allocated;
+        size_t num_free;
+        uint64_t num_allocations;
+
+        // constants
+        static const size_t kCacheLineSize = 64;
+        static const size_t kHugePageSize = 2 * 1024 * 1024;
+        static const size_t kMinChunkBytes = 64 * 1024;
+        static const size_t kMaxChunkBytes = 32 * 1024 * 1024;
+};
+
+#endif //GOL_QUADTREENODEARENA_H
@@ -0,0 +1,108 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <map>
+#include <mutex>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include "quad_tree_config.h"
+#include "quad_tree_node_heap.h"
+
+#if !defined(MAP_NORESERVE)
+#define MAP_NORESERVE 0
+#endif
+
+char* QuadTreeNodeHeap::base = 0;
+size_t QuadTreeNodeHeap::reserved_bytes = 0;
+size_t QuadTreeNodeHeap::next_offset = 0;
+
+// guards everything but base and reserved_bytes, which only change under it before there are any nodes
+static std::mutex heap_mutex;
+
+// chunks that have been given back, by size
+static std::map<size_t, std::vector<char*>> free_chunks;
+
+// we settle for a block this small before we give up
+static const size_t kMinReserveBytes = 1024 * 1024 * 1024;
+
+// chunks start on a page of their own, so giving one back never touches its neighbours
+static const size_t kPageSize = 4096;
+
+/**
+ * Get a chunk of memory for an arena
+ * @param bytes size of the chunk
+ * @param alignment a power of 2, at least kIndexScale
+ * @return memory inside the block. Throws std::bad_alloc once the block is full
+ */
+void* QuadTreeNodeHeap::AllocateChunk(size_t bytes, size_t alignment) {
+    std::lock_guard<std::mutex> lock(heap_mutex);
+    if (base == 0) {
+        Reserve();
+    }
+    if (alignment < kPageSize) {
+        alignment = kPageSize;
+    }
+    // arenas ask for the same few sizes over and over, so a chunk that was given back usually fits
+    auto iter = free_chunks.find(bytes);
+    if (iter != free_chunks.end()) {
+        std::vector<char*>& chunks = iter->second;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            if (((uintptr_t) chunks[i] & (alignment - 1)) == 0) {
+                char* memory = chunks[i];
+                chunks[i] = chunks.back();
+                chunks.pop_back();
+                return memory;
+            }
+        }
+    }
+    // offset 0 is index 0, so the first chunk starts past it
+    size_t offset = next_offset != 0 ? next_offset : kIndexScale;
+    offset = (size_t) ((((uintptr_t) base + offset + alignment - 1) & ~(uintptr_t) (alignment - 1)) - (uintptr_t) base);
+    if (offset > reserved_bytes || bytes > reserved_bytes - offset) {
+        throw std::bad_alloc();
+    }
+    char* memory = base + offset;
+    size_t page_bytes = (bytes + kPageSize - 1) & ~(kPageSize - 1);
+    if (mprotect(memory, page_bytes, PROT_READ | PROT_WRITE) != 0) {
+        throw std::bad_alloc();
+    }
+    next_offset = offset + page_bytes;
+    return memory;
+}
+
+/**
+ * Give a chunk back. Its pages go back to the system, and its addresses to the next arena that wants a chunk this size
+ * @param memory a chunk from AllocateChunk()
+ * @param bytes the size it was allocated with
+ */
+void QuadTreeNodeHeap::FreeChunk(void* memory, size_t bytes) {
+    std::lock_guard<std::mutex> lock(heap_mutex);
+    size_t page_bytes = (bytes + kPageSize - 1) & ~(kPageSize - 1);
+#if defined(__linux__)
+    madvise(memory, page_bytes, MADV_DONTNEED);
+#else
+    // mapping fresh pages over the old ones drops them, and leaves the range usable
+    mmap(memory, page_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+#endif
+    free_chunks[bytes].push_back(static_cast<char*>(memory));
+}
+
+/**
+ * Reserve the block of address space. Called with the lock held
+ * The block is mapped without access, so it doesn't count against memory until a chunk in it is handed out
+ */
+void QuadTreeNodeHeap::Reserve() {
+    // any more than this and indices wouldn't fit in 32 bits
+    size_t max_bytes = (size_t) kIndexScale << 32;
+    size_t bytes = (size_t) NODE_HEAP_RESERVE_BYTES < max_bytes ? (size_t) NODE_HEAP_RESERVE_BYTES : max_bytes;
+    for (; bytes >= kMinReserveBytes; bytes >>= 1) {
+        void* memory = mmap(0, bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory != MAP_FAILED) {
+            base = static_cast<char*>(memory);
+            reserved_bytes = bytes;
+            return;
+        }
+    }
+    throw std::bad_alloc();
+}
@@ -0,0 +1,139 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREENODEHEAP_H
+#define GOL_QUADTREENODEHEAP_H
+
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class QuadTreeNode;
+
+/**
+ * One block of address space that every node arena carves its chunks out of, so that a node can be named by a
+ * 32 bit index instead of a 64 bit pointer
+ *
+ * The block is reserved the first time an arena needs a chunk, without any memory behind it, and each chunk is made
+ * usable when it's handed out. Chunks that arenas give back have their pages returned to the system but keep their
+ * addresses, and go to the next arena that asks for a chunk of the same size. Index i is the node kIndexScale * i
+ * bytes into the block, and index 0 is never handed out, so it stands for a null pointer. Indices count in the size of
+ * a leaf, so that leaves can have slots of their own half the size of other nodes. That's 2^32 steps of 16 bytes,
+ * which is the 64GB NODE_HEAP_RESERVE_BYTES reserves by default. If the system won't give us that much address
+ * space, we settle for less.
+ *
+ * Everything is static, because an index has to mean the same node to every store. Chunks are handed out under a
+ * lock, which is fine because an arena only asks for one every few thousand nodes.
+ */
+class QuadTreeNodeHeap {
+
+    public:
+
+        /**
+         * Get a chunk of memory for an arena
+         * @param bytes size of the chunk
+         * @param alignment a power of 2, at least kIndexScale
+         * @return memory inside the block. Throws std::bad_alloc once the block is full
+         */
+        static void* AllocateChunk(size_t bytes, size_t alignment);
+
+        /**
+         * Give a chunk back. Its pages go back to the system, and its addresses to the next arena that wants a chunk this size
+         * @param memory a chunk from AllocateChunk()
+         * @param bytes the size it was allocated with
+         */
+        static void FreeChunk(void* memory, size_t bytes);
+
+        /**
+         * @param node a node in a chunk from AllocateChunk(), or 0
+         * @return the node's index, 0 for no node
+         */
+        static uint32_t Index(const QuadTreeNode* node) {
+            if (node == 0) {
+                return 0;
+            }
+            size_t offset = (size_t) (reinterpret_cast<const char*>(node) - base);
+            assert(offset < reserved_bytes && offset % kIndexScale == 0);
+            return (uint32_t) (offset / kIndexScale);
+        }
+
+        /**
+         * @param index from Index()
+         * @return the node with this index, or 0
+         */
+        static QuadTreeNode* Node(uint32_t index) {
+            return index != 0 ? reinterpret_cast<QuadTreeNode*>(base + (size_t) index * kIndexScale) : 0;
+        }
+
+        /**
+         * @return bytes of address space we reserved, 0 if no chunk has been allocated yet
+         */
+        static size_t ReservedBytes() { return reserved_bytes; }
+
+        // indices count in steps of this many bytes, the size of a leaf. Every node is aligned to it
+        static const size_t kIndexScale = 16;
+
+    private:
+
+        /**
+         * Reserve the block of address space. Called with the lock held
+         */
+        static void Reserve();
+
+    private:
+
+        // start of the block. It's written once, before any node in it exists, so reading it needs no lock
+        static char* base;
+
+        // size of the block
+        static size_t reserved_bytes;
+
+        // chunks are handed out from here once there are no free ones of the right size
+        static size_t next_offset;
+};
+
+/**
+ * A node stored as its 4 byte index in the QuadTreeNodeHeap, which reads and writes like a QuadTreeNode*.
+ * It's left uninitialized, like a pointer, so that nodes can keep their children in a union
+ */
+class QuadTreeNodeRef {
+
+    public:
+
+        operator QuadTreeNode*() const { return QuadTreeNodeHeap::Node(index); }
+
+        QuadTreeNode* operator->() const { return QuadTreeNodeHeap::Node(index); }
+
+        QuadTreeNodeRef& operator=(QuadTreeNode* node) {
+            index = QuadTreeNodeHeap::Index(node);
+            return *this;
+        }
+
+    private:
+
+        uint32_t index;
+};
+
+/**
+ * An atomic QuadTreeNodeRef, with the load() and store() of std::atomic<QuadTreeNode*>
+ */
+class QuadTreeAtomicNodeRef {
+
+    public:
+
+        QuadTreeNode* load(std::memory_order order = std::memory_order_seq_cst) const {
+            return QuadTreeNodeHeap::Node(index.load(order));
+        }
+
+        void store(QuadTreeNode* node, std::memory_order order = std::memory_order_seq_cst) {
+            index.store(QuadTreeNodeHeap::Index(node), order);
+        }
+
+    private:
+
+        std::atomic<uint32_t> index;
+};
+
+#endif //GOL_QUADTREENODEHEAP_H
@@ -0,0 +1,1038 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <thread>
+#include "quad_tree_node_store.h"
+
+/**
+ * Constructs an empty store that evolves with EVOLVE_THREADS threads
+ */
+QuadTreeNodeStore::QuadTreeNodeStore() {
+    // tables that every store shares, which are only built once
+    QuadTreeNode::Initialize();
+    thread_pool = 0;
+    num_threads = 1;
+    parallel_level = EVOLVE_PARALLEL_LEVEL_MIN;
+    pin_level = INT_MAX;
+    for (EvolveStats& stats : evolve_stats) {
+        stats.evolves = 0;
+        stats.memo_hits = 0;
+    }
+#if (ENABLE_GARBAGE_COLLECTION)
+    pressure_nodes = GARBAGE_COLLECTION_PRESSURE_NODES;
+    pressure_bytes = GARBAGE_COLLECTION_PRESSURE_BYTES;
+    pressure_level = GARBAGE_COLLECTION_PRESSURE_LEVEL;
+    pressure_floor = 0;
+ #if (GARBAGE_COLLECTION_CONCURRENT_SWEEP)
+    collection_mode = kConcurrentSweep;
+ #elif (GARBAGE_COLLECTION_INCREMENTAL)
+    collection_mode = kIncremental;
+ #else
+    collection_mode = kStopTheWorld;
+ #endif
+    collection_budget_us = GARBAGE_COLLECTION_STEP_BUDGET_US;
+    collection_phase = kIdle;
+    collection_mark = 0;
+    cleaning_shard = 0;
+    sweep_arena = 0;
+    sweep_range = 0;
+    sweep_done.store(false, std::memory_order_relaxed);
+    current_collection = CollectionStats();
+    last_collection = CollectionStats();
+    all_collections = CollectionStats();
+    SetMemoBudget(GARBAGE_COLLECTION_MEMO_BUDGET_BYTES);
+    compaction_interval = GARBAGE_COLLECTION_COMPACT_INTERVAL;
+    // until we've collected, assume every node is as big as a non-leaf node
+    node_bytes = sizeof(QuadTreeNode);
+    collections_at_compaction = 0;
+    compaction_pauses = 0;
+    compaction_deferred = false;
+#endif
+    SetThreads(EVOLVE_THREADS);
+}
+
+/**
+ * Destructor, frees every node in the store and stops its threads
+ */
+QuadTreeNodeStore::~QuadTreeNodeStore() {
+#if (ENABLE_GARBAGE_COLLECTION)
+    // a concurrent sweep could still be writing to the arenas
+    if (sweep_thread.joinable()) {
+        sweep_thread.join();
+    }
+#endif
+    delete thread_pool;
+    // every node, leaves included, lives in the arenas, so we can free them all at once
+    node_table.Clear();
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        delete arena;
+    }
+}
+
+/**
+ * Allocate a store on a cache line, since plain new before C++17 doesn't honor our alignas(64) members
+ * @param size bytes to allocate
+ * @return memory aligned to 64 bytes
+ */
+void* QuadTreeNodeStore::operator new(size_t size) {
+    void* memory = 0;
+    if (posix_memalign(&memory, 64, size) != 0) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+/**
+ * Free a store allocated with our operator new
+ * @param memory memory to free
+ */
+void QuadTreeNodeStore::operator delete(void* memory) {
+    free(memory);
+}
+
+/**
+ * Set how many threads we evolve with. Don't call this in the middle of a step
+ * @param num_threads number of threads including the calling thread, 0 for one per hardware thread
+ * @param parallel_level nodes at this level or above evolve their sub-squares as separate tasks
+ */
+void QuadTreeNodeStore::SetThreads(int num_threads, int parallel_level) {
+#if (ENABLE_PARALLEL_EVOLVE)
+    if (num_threads <= 0) {
+        num_threads = (int) std::thread::hardware_concurrency();
+    }
+    if (num_threads < 1) {
+        num_threads = 1;
+    } else if (num_threads > QuadTreeThreadPool::kMaxThreads) {
+        num_threads = QuadTreeThreadPool::kMaxThreads;
+    }
+#else
+    num_threads = 1;
+#endif
+    this->num_threads = num_threads;
+    this->parallel_level = parallel_level;
+    // every thread needs its arenas before it creates its first node: one for non-leaf nodes and one for leaves,
+    // which are half the size
+    while ((int) node_arenas.size() < 2 * num_threads) {
+        node_arenas.push_back(new QuadTreeNodeArena(sizeof(QuadTreeNode)));
+        node_arenas.push_back(new QuadTreeNodeArena(QuadTreeNode::kLeafSize));
+    }
+#if (ENABLE_PARALLEL_EVOLVE)
+    if (thread_pool != 0 && thread_pool->NumThreads() != num_threads) {
+        delete thread_pool;
+        thread_pool = 0;
+    }
+    if (thread_pool == 0 && num_threads > 1) {
+        thread_pool = new QuadTreeThreadPool(num_threads);
+    }
+#endif
+    // the node table only needs locks if other threads can add nodes
+    node_table.SetNumThreads(thread_pool != 0 ? num_threads : 1);
+    memo_table.SetNumThreads(thread_pool != 0 ? num_threads : 1);
+    UpdatePinLevel();
+}
+
+/**
+ * Work out the pin level from the pressure limits and the thread pool
+ */
+void QuadTreeNodeStore::UpdatePinLevel() {
+    pin_level = INT_MAX;
+#if (ENABLE_GARBAGE_COLLECTION)
+    if (pressure_nodes != 0 || pressure_bytes != 0) {
+        pin_level = pressure_level;
+    #if (ENABLE_PARALLEL_EVOLVE)
+        // a thread waiting on its tasks isn't at a safe point, so every node that can wait has to pin
+        if (thread_pool != 0 && parallel_level < pin_level) {
+            pin_level = parallel_level;
+        }
+    #endif
+    }
+#endif
+}
+
+/**
+ * @return number of nodes created so far, on all threads
+ */
+int64_t QuadTreeNodeStore::NumNodesCreated() const {
+    int64_t num_nodes_created = 0;
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        num_nodes_created += (int64_t) arena->NumAllocations();
+    }
+    return num_nodes_created;
+}
+
+/**
+ * @return bytes used by node arenas, the node table and the memo table
+ */
+size_t QuadTreeNodeStore::MemoryUsage() const {
+    size_t memory = node_table.MemoryUsage() + memo_table.MemoryUsage();
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        memory += arena->MemoryUsage();
+    }
+    return memory;
+}
+
+/**
+ * @return number of times a node was evolved so far, on all threads
+ */
+uint64_t QuadTreeNodeStore::NumEvolves() const {
+    uint64_t num_evolves = 0;
+    for (const EvolveStats& stats : evolve_stats) {
+        num_evolves += stats.evolves;
+    }
+    return num_evolves;
+}
+
+/**
+ * @return number of those evolves that found a memoized result, in the node or in the memo table
+ */
+uint64_t QuadTreeNodeStore::NumMemoHits() const {
+    uint64_t num_memo_hits = 0;
+    for (const EvolveStats& stats : evolve_stats) {
+        num_memo_hits += stats.memo_hits;
+    }
+    return num_memo_hits;
+}
+
+/**
+ * Get the canonical empty quadtree at the specified level
+ * @param level this level represents the power of 2 dimensions of this quad tree, which is square
+ * @return a new empty quad tree at the specified level
+ */
+QuadTreeNode* QuadTreeNodeStore::EmptyQuadTree(level_type level) {
+#if (ENABLE_INFINITE_LEVELS)
+    size_t index = (size_t) level.get_ui();
+#else
+    size_t index = (size_t) level;
+#endif
+    // we need these every step when we expand and compact, so each level is only built once, from the ones under it
+    if (index < empty_nodes.size() && empty_nodes[index] != 0) {
+        return empty_nodes[index];
+    }
+    if (index >= empty_nodes.size()) {
+        empty_nodes.resize(index + 1, 0);
+    }
+    for (size_t i = QuadTreeNode::kLeafLevel; i <= index; ++i) {
+        if (empty_nodes[i] == 0) {
+            // a leaf with no cells alive, or four empty nodes from the level below
+            empty_nodes[i] = i == QuadTreeNode::kLeafLevel ? CanonicalLeaf(0)
+                : Canonical(empty_nodes[i - 1], empty_nodes[i - 1], empty_nodes[i - 1], empty_nodes[i - 1], (int) i);
+        }
+    }
+    return empty_nodes[index];
+}
+
+/**
+ * Keep everything reachable from a root alive when we collect garbage
+ * @param root where the root is stored, which is read every time we collect
+ */
+void QuadTreeNodeStore::AddRoot(QuadTreeNode** root) {
+    roots.push_back(root);
+}
+
+/**
+ * Stop keeping a root alive
+ * @param root a root that was passed to AddRoot()
+ */
+void QuadTreeNodeStore::RemoveRoot(QuadTreeNode** root) {
+    roots.erase(std::remove(roots.begin(), roots.end(), root), roots.end());
+}
+
+#if (ENABLE_GARBAGE_COLLECTION)
+/**
+ * Free every node that can't be reached from a root or a cached empty node. If an incremental collection is
+ * under way, this finishes it instead. Don't call this in the middle of a step
+ */
+void QuadTreeNodeStore::CollectGarbage() {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (collection_phase != kIdle) {
+        CollectionWork(std::chrono::steady_clock::time_point::max());
+        RecordPause(start, true);
+        return;
+    }
+
+    // mark everything in use, by any tree sharing this store
+    current_collection = CollectionStats();
+    collection_mark ^= QuadTreeNode::kMarkBit;
+    if (memo_budget != 0) {
+        PickMemoAge();
+    }
+    if (memo_min_age != 0) {
+        DropOldMemos();
+    }
+    size_t num_marked = MarkRoots();
+    Trace(std::chrono::steady_clock::time_point::max(), num_marked);
+    if (memo_min_age != 0) {
+        // a memo budget also keeps nodes nothing points to if they were used lately
+        num_marked += MarkHotNodes();
+        Trace(std::chrono::steady_clock::time_point::max(), num_marked);
+    }
+    // results in the memo table live as long as their nodes, and what they point to can be a node with results too
+    for (size_t num_results = MarkMemoResults(); num_results != 0; num_results = MarkMemoResults()) {
+        num_marked += num_results;
+        Trace(std::chrono::steady_clock::time_point::max(), num_marked);
+    }
+    RemoveDeadMemos();
+    // the sweep puts marked nodes back in an empty table and frees the slots of everything else
+    size_t nodes_freed = node_table.Size() - num_marked;
+    node_table.Reset(num_marked);
+    size_t bytes_released = 0;
+    size_t bytes_freed = 0;
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        size_t slot_size = arena->SlotSize();
+        bytes_released += arena->Sweep([this, slot_size, &bytes_freed](void* slot) {
+            QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+            if (node->IsGarbage(collection_mark)) {
+                node->SetFree();
+                bytes_freed += slot_size;
+                return false;
+            }
+            if (node->IsFree()) {
+                return false;
+            }
+            node_table.Restore(node);
+            return true;
+        });
+    }
+    current_collection.nodes_freed = nodes_freed;
+    current_collection.bytes_freed = bytes_freed;
+    current_collection.bytes_released = bytes_released;
+    RecordPause(start, true);
+}
+
+/**
+ * Set how collections run. A collection that's under way is finished first. Don't call this in the middle of a step
+ * @param mode
+ * @param budget_us how long an incremental collection works for each time ContinueCollection() is called
+ */
+void QuadTreeNodeStore::SetCollectionMode(CollectionMode mode, uint64_t budget_us) {
+    if (collection_phase != kIdle) {
+        CollectGarbage();
+    }
+    collection_mode = mode;
+    collection_budget_us = budget_us;
+}
+
+/**
+ * Collect in the middle of a step once we pass a limit. Don't call this in the middle of a step
+ * @param max_nodes number of nodes in the table, 0 for no limit
+ * @param max_bytes bytes of nodes plus the node table, 0 for no limit
+ * @param level smallest level that pins what it's evolving and checks the limits
+ */
+void QuadTreeNodeStore::SetPressureLimit(size_t max_nodes, size_t max_bytes, int level) {
+    pressure_nodes = max_nodes;
+    pressure_bytes = max_bytes;
+    pressure_level = level;
+    pressure_floor = 0;
+    UpdatePinLevel();
+}
+
+/**
+ * Keep memory under a budget by letting go of memoized results that steps haven't used lately, instead of
+ * keeping every result that a live node points to. Collections also keep nodes that nothing points to if a
+ * step used them lately, so results that keep getting reused survive. Don't call this in the middle of a step
+ * @param max_bytes bytes of nodes plus the node table, 0 for no budget
+ */
+void QuadTreeNodeStore::SetMemoBudget(size_t max_bytes) {
+    // a collection under way would mix up ages from before and after
+    if (collection_phase != kIdle) {
+        CollectGarbage();
+    }
+    memo_budget = max_bytes;
+    memo_floor = 0;
+    memo_min_age = max_bytes != 0 ? 1 : 0;
+    // new nodes start one younger than nodes that get used again, so a collection can tell them apart
+    new_node_age = max_bytes != 0 ? (QuadTreeNode::kMaxAge - 1) << QuadTreeNode::kAgeShift : 0;
+    if (max_bytes != 0) {
+        // nodes haven't been aging until now, so they all start out young
+        node_table.ForEach([](QuadTreeNode* node) {
+            node->Touch();
+        });
+    }
+}
+
+/**
+ * @return true if we're over the memo budget and have grown enough since the last collection, so it's time
+ * to collect
+ */
+bool QuadTreeNodeStore::OverMemoBudget() const {
+    if (memo_budget == 0) {
+        return false;
+    }
+    size_t bytes = node_table.Size() * node_bytes + node_table.LiveMemoryUsage() + memo_table.MemoryUsage();
+    return bytes > std::max(memo_budget, memo_floor);
+}
+
+/**
+ * Move every node into one new arena, depth first from the roots so that each node's children sit next to
+ * each other, and fix up every pointer to them. Nodes the roots don't reach, like the ones a memo budget keeps,
+ * go after them. A collection that's under way is finished first. While compaction is paused, this waits for
+ * the first collection after it's resumed instead. Don't call this in the middle of a step
+ */
+void QuadTreeNodeStore::Compact() {
+    if (compaction_pauses != 0) {
+        // another thread is reading nodes where they are, so CompactionDue() brings us back here later
+        compaction_deferred = true;
+        return;
+    }
+    if (collection_phase != kIdle) {
+        CollectGarbage();
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    // every node in the table carries the current mark, so after flipping it, a marked node is one we've moved
+    collection_mark ^= QuadTreeNode::kMarkBit;
+    QuadTreeNodeArena compacted(sizeof(QuadTreeNode));
+    QuadTreeNodeArena compacted_leaves(QuadTreeNode::kLeafSize);
+    size_t num_moved = 0;
+    // copy a node the first time we see it, and leave its new address in the old copy's calc. A leaf's cells are
+    // where calc would be, but we've already copied them
+    auto move = [this, &compacted, &compacted_leaves, &num_moved](QuadTreeNode* node) -> QuadTreeNode* {
+        if (node == 0) {
+            return 0;
+        }
+        if (node->IsMarked(collection_mark)) {
+            return node->memo.calc.load(std::memory_order_relaxed);
+        }
+        QuadTreeNodeArena& arena = node->level == QuadTreeNode::kLeafLevel ? compacted_leaves : compacted;
+        QuadTreeNode* moved = new (arena.Allocate()) QuadTreeNode(*node);
+        moved->hash_and_mark.store(node->hash_and_mark.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        node->Mark(collection_mark);
+        node->memo.calc.store(moved, std::memory_order_relaxed);
+        mark_stack.push_back(moved);
+        ++num_moved;
+        return moved;
+    };
+    // the moved nodes still point to old nodes until we take them off the stack
+    auto fix_up = [this, &move]() {
+        while (!mark_stack.empty()) {
+            QuadTreeNode* node = mark_stack.back();
+            mark_stack.pop_back();
+            size_t num_pushed = mark_stack.size();
+            if (node->level != QuadTreeNode::kLeafLevel) {
+                node->nw = move(node->nw);
+                node->ne = move(node->ne);
+                node->sw = move(node->sw);
+                node->se = move(node->se);
+                node->memo.center.store(move(node->memo.center.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+                node->memo.calc.store(move(node->memo.calc.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+            }
+            // the children are next to each other, and we go down into the northwest one first
+            std::reverse(mark_stack.begin() + num_pushed, mark_stack.end());
+        }
+    };
+    for (QuadTreeNode** root : roots) {
+        *root = move(*root);
+        fix_up();
+    }
+    for (QuadTreeNode*& empty_node : empty_nodes) {
+        empty_node = move(empty_node);
+        fix_up();
+    }
+    node_table.ForEach([&move, &fix_up](QuadTreeNode* node) {
+        move(node);
+        fix_up();
+    });
+    // every node is in the table, so the memo table's nodes and results have all moved by now
+    memo_table.MoveNodes(move);
+    fix_up();
+    // hashes come from where the children are, so the table starts over
+    node_table.Reset(num_moved);
+    auto restore = [this](void* slot) {
+        QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+        uint32_t hash = node->level == QuadTreeNode::kLeafLevel ? QuadTreeNodeTable::HashLeaf(node->bits)
+                                                                : QuadTreeNodeTable::Hash(node->nw, node->ne, node->sw, node->se);
+        node->SetHash(hash, collection_mark | (node->hash_and_mark.load(std::memory_order_relaxed) & QuadTreeNode::kAgeMask));
+        node_table.Restore(node);
+    };
+    compacted.ForEachSlot(restore);
+    compacted_leaves.ForEachSlot(restore);
+    // the first thread's arenas get the moved nodes, and everybody's old chunks go back to the system
+    node_arenas[0]->TakeChunks(compacted);
+    node_arenas[1]->TakeChunks(compacted_leaves);
+    for (size_t i = 2; i < node_arenas.size(); ++i) {
+        node_arenas[i]->FreeAll();
+    }
+    UpdateNodeBytes();
+    collections_at_compaction = all_collections.num_collections;
+    compaction_deferred = false;
+    uint64_t compact_us = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    CollectionStats* stats[2] = {&last_collection, &all_collections};
+    for (CollectionStats* collection : stats) {
+        collection->num_compactions += 1;
+        collection->nodes_moved += num_moved;
+        collection->compact_us += compact_us;
+        collection->num_pauses += 1;
+        collection->pause_us += compact_us;
+        collection->max_pause_us = std::max(collection->max_pause_us, compact_us);
+    }
+}
+
+/**
+ * Compact after every so many collections. Don't call this in the middle of a step
+ * @param num_collections collections between compactions, 0 to only compact when Compact() is called
+ */
+void QuadTreeNodeStore::SetCompactionInterval(uint64_t num_collections) {
+    compaction_interval = num_collections;
+}
+
+/**
+ * @return true if we've collected often enough since the last compaction to compact again, or Compact() was put off,
+ * and compaction isn't paused
+ */
+bool QuadTreeNodeStore::CompactionDue() const {
+    if (compaction_pauses != 0) {
+        return false;
+    }
+    return compaction_deferred || (compaction_interval != 0 && all_collections.num_collections - collections_at_compaction >= compaction_interval);
+}
+
+/**
+ * @return true if we're over a pressure limit and have grown enough since the last collection
+ */
+bool QuadTreeNodeStore::OverPressureLimit() const {
+    size_t num_nodes = node_table.Size();
+    if (num_nodes < pressure_floor) {
+        return false;
+    }
+    if (pressure_nodes != 0 && num_nodes > pressure_nodes) {
+        return true;
+    }
+    return pressure_bytes != 0 && num_nodes * node_bytes + node_table.LiveMemoryUsage() + memo_table.MemoryUsage() > pressure_bytes;
+}
+
+/**
+ * Start a collection. When stopping the world, this is the same as CollectGarbage(). Otherwise call
+ * ContinueCollection() after every step until it's done. Don't call this in the middle of a step
+ */
+void QuadTreeNodeStore::StartCollection() {
+    if (collection_mode == kStopTheWorld) {
+        CollectGarbage();
+        return;
+    }
+    if (collection_phase != kIdle) {
+        return;
+    }
+    // flipping the mark unmarks every node at once. The first call to ContinueCollection() marks the roots
+    current_collection = CollectionStats();
+    collection_mark ^= QuadTreeNode::kMarkBit;
+    collection_phase = kMarking;
+    if (memo_min_age != 0) {
+        DropOldMemos();
+    }
+}
+
+/**
+ * Work on the collection that's under way for up to our time budget. Don't call this in the middle of a step
+ * @return true if this finished the collection
+ */
+bool QuadTreeNodeStore::ContinueCollection() {
+    if (collection_phase == kIdle) {
+        return false;
+    }
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool finished = CollectionWork(start + std::chrono::microseconds(collection_budget_us));
+    RecordPause(start, finished);
+    return finished;
+}
+
+/**
+ * Mark every root and cached empty node that isn't marked yet, and push them on the mark stack
+ * @return number of nodes we marked
+ */
+size_t QuadTreeNodeStore::MarkRoots() {
+    size_t num_marked = 0;
+    for (QuadTreeNode** root : roots) {
+        if (*root != 0 && (*root)->Mark(collection_mark)) {
+            mark_stack.push_back(*root);
+            ++num_marked;
+        }
+    }
+    // and so is everything a step in progress has pinned
+    for (const PinStack& pin_stack : pin_stacks) {
+        for (const PinnedNodes& pinned : pin_stack.pins) {
+            for (int i = 0; i < pinned.count; ++i) {
+                if (pinned.nodes[i] != 0 && pinned.nodes[i]->Mark(collection_mark)) {
+                    mark_stack.push_back(pinned.nodes[i]);
+                    ++num_marked;
+                }
+            }
+        }
+    }
+    // our cached empty nodes stay around too
+    for (QuadTreeNode* empty_node : empty_nodes) {
+        if (empty_node != 0 && empty_node->Mark(collection_mark)) {
+            mark_stack.push_back(empty_node);
+            ++num_marked;
+        }
+    }
+    return num_marked;
+}
+
+/**
+ * Mark everything reachable from the mark stack and the gray stacks: children, memoized results and cached
+ * centers alike
+ * @param deadline when to stop, checked every so often
+ * @param num_marked incremented by the number of nodes we mark
+ * @return true if there's nothing left to mark, false if we ran out of time
+ */
+bool QuadTreeNodeStore::Trace(std::chrono::steady_clock::time_point deadline, size_t& num_marked) {
+    // the gray stacks only grow during steps, so we only need to pick them up once
+    for (GrayStack& gray_stack : gray_stacks) {
+        mark_stack.insert(mark_stack.end(), gray_stack.nodes.begin(), gray_stack.nodes.end());
+        gray_stack.nodes.clear();
+    }
+    size_t num_traced = 0;
+    while (!mark_stack.empty()) {
+        if ((++num_traced & 1023) == 0 && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        QuadTreeNode* curr = mark_stack.back();
+        mark_stack.pop_back();
+        // a leaf has no memoized result or center, its cells are in their place
+        bool leaf = curr->level == QuadTreeNode::kLeafLevel;
+        QuadTreeNode* calc = !leaf ? curr->memo.calc.load(std::memory_order_relaxed) : 0;
+        QuadTreeNode* center = !leaf ? curr->memo.center.load(std::memory_order_relaxed) : 0;
+        if (memo_min_age != 0) {
+            uint32_t age = curr->Age();
+            if (age < memo_min_age) {
+                // not used lately enough to be worth what its results keep alive
+                if (calc != 0) {
+                    curr->memo.calc.store(0, std::memory_order_relaxed);
+                    current_collection.memos_dropped += 1;
+                    calc = 0;
+                }
+                if (center != 0) {
+                    curr->memo.center.store(0, std::memory_order_relaxed);
+                    center = 0;
+                }
+            }
+            if (age > 0) {
+                curr->SetAge(age - 1);
+            }
+        }
+        QuadTreeNode* next[6] = {calc, center};
+        int num_next = 2;
+        if (!leaf) {
+            next[2] = curr->nw;
+            next[3] = curr->ne;
+            next[4] = curr->sw;
+            next[5] = curr->se;
+            num_next = 6;
+        }
+        for (int i = 0; i < num_next; ++i) {
+            if (next[i] != 0 && next[i]->Mark(collection_mark)) {
+                mark_stack.push_back(next[i]);
+                ++num_marked;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Mark the nodes that nothing marked points to, but that a step used lately enough for the memo budget to
+ * keep them, and push them on the mark stack. Only a collection that stops the world does this, because it
+ * has to look at every slot
+ * @return number of nodes we marked
+ */
+size_t QuadTreeNodeStore::MarkHotNodes() {
+    size_t num_marked = 0;
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        arena->ForEachSlot([this, &num_marked](void* slot) {
+            QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+            if (node->IsGarbage(collection_mark) && node->Age() >= memo_min_age) {
+                node->Mark(collection_mark);
+                mark_stack.push_back(node);
+                ++num_marked;
+            }
+        });
+    }
+    current_collection.hot_nodes_kept += num_marked;
+    return num_marked;
+}
+
+/**
+ * Mark the results in the memo table whose nodes are marked, and push them on the mark stack. A result there
+ * lives as long as its node, like the result in the node itself, so tracing has to go on until this doesn't
+ * find anything new
+ * @return number of nodes we marked
+ */
+size_t QuadTreeNodeStore::MarkMemoResults() {
+    size_t num_marked = 0;
+    memo_table.ForEach([this, &num_marked](QuadTreeNode* node, int, QuadTreeNode* result) {
+        if (node->IsMarked(collection_mark) && result->Mark(collection_mark)) {
+            mark_stack.push_back(result);
+            ++num_marked;
+        }
+    });
+    return num_marked;
+}
+
+/**
+ * Once a collection has marked everything, forget the results of nodes that aren't marked
+ */
+void QuadTreeNodeStore::RemoveDeadMemos() {
+    memo_table.RemoveIf([this](QuadTreeNode* node, int, QuadTreeNode*) {
+        return !node->IsMarked(collection_mark);
+    });
+}
+
+/**
+ * At the start of a collection with a memo budget, forget the results in the memo table of nodes that are too
+ * old to keep theirs, like Trace() does for the result in the node
+ */
+void QuadTreeNodeStore::DropOldMemos() {
+    current_collection.memos_dropped += memo_table.RemoveIf([this](QuadTreeNode* node, int, QuadTreeNode*) {
+        return node->Age() < memo_min_age;
+    });
+}
+
+/**
+ * Before a collection that stops the world, count the nodes of every age and pick how lately a node has to have
+ * been used to keep it and its memoized result, so that what we keep fits in half of the memo budget
+ */
+void QuadTreeNodeStore::PickMemoAge() {
+    size_t num_nodes = node_table.Size();
+    if (num_nodes == 0) {
+        return;
+    }
+    size_t num_aged[QuadTreeNode::kMaxAge + 1] = {};
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        arena->ForEachSlot([&num_aged](void* slot) {
+            QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+            if (!node->IsFree()) {
+                num_aged[node->Age()] += 1;
+            }
+        });
+    }
+    // the node table grows with the nodes, so we count our share of it too
+    size_t bytes_per_node = node_bytes + node_table.MemoryUsage() / num_nodes;
+    size_t max_kept = memo_budget / 2 / bytes_per_node;
+    size_t num_kept = 0;
+    memo_min_age = QuadTreeNode::kMaxAge + 1;
+    while (memo_min_age > 1 && num_kept + num_aged[memo_min_age - 1] <= max_kept) {
+        num_kept += num_aged[--memo_min_age];
+    }
+}
+
+/**
+ * After a collection, move the age a node has to be to keep its memoized result, so that what incremental
+ * collections keep settles around half of the memo budget. They can't look at every node at once like
+ * PickMemoAge() does. Then don't collect for the budget again until we've grown some
+ */
+void QuadTreeNodeStore::UpdateMemoAge() {
+    size_t bytes = node_table.Size() * node_bytes + node_table.MemoryUsage() + memo_table.MemoryUsage();
+    if (bytes > memo_budget / 2 && memo_min_age <= QuadTreeNode::kMaxAge) {
+        ++memo_min_age;
+    } else if (bytes < memo_budget / 4 && memo_min_age > 1) {
+        --memo_min_age;
+    }
+    // even keeping no results at all can leave us over budget, so wait until we've grown by a quarter
+    memo_floor = bytes + bytes / 4;
+}
+
+/**
+ * Work out how many bytes of arena slots a node takes on average, which depends on how many of them are
+ * leaves. Limits are checked in the middle of steps, when we can't look at the arenas, so they go by this
+ */
+void QuadTreeNodeStore::UpdateNodeBytes() {
+    size_t num_nodes = 0;
+    size_t bytes = 0;
+    for (QuadTreeNodeArena* arena : node_arenas) {
+        num_nodes += arena->Size();
+        bytes += arena->Size() * arena->SlotSize();
+    }
+    if (num_nodes != 0) {
+        node_bytes = (bytes + num_nodes - 1) / num_nodes;
+    }
+}
+
+/**
+ * Move the collection that's under way along until it's done or we pass a deadline
+ * @param deadline when to stop, checked between pieces of work
+ * @return true if the collection is done
+ */
+bool QuadTreeNodeStore::CollectionWork(std::chrono::steady_clock::time_point deadline) {
+    bool first = true;
+    size_t num_marked = 0;
+    while (collection_phase != kIdle) {
+        // every phase does some work before it looks at the clock, so we always get somewhere
+        if (!first && std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+        first = false;
+        switch (collection_phase) {
+            case kMarking:
+                if (!Trace(deadline, num_marked)) {
+                    return false;
+                }
+                // the roots could have moved on to nodes we haven't seen since we last marked them. If they
+                // haven't, nothing marked points to anything unmarked, so everything reachable is marked
+                if (MarkRoots() > 0) {
+                    break;
+                }
+                // and results in the memo table live as long as their nodes
+                if (MarkMemoResults() > 0) {
+                    break;
+                }
+                RemoveDeadMemos();
+                node_table.SetVisibleMark(true, collection_mark);
+                cleaning_shard = 0;
+                collection_phase = kCleaningTable;
+                break;
+            case kCleaningTable:
+                do {
+                    node_table.RemoveIfInShard(cleaning_shard, [this](QuadTreeNode* node) {
+                        return !node->IsMarked(collection_mark);
+                    });
+                } while (++cleaning_shard < QuadTreeNodeTable::NumShards() && std::chrono::steady_clock::now() < deadline);
+                if (cleaning_shard == QuadTreeNodeTable::NumShards()) {
+                    // nothing unmarked is left to hide
+                    node_table.SetVisibleMark(false, 0);
+                    node_table.Reclaim();
+                    StartSweep();
+                    collection_phase = kSweeping;
+                }
+                break;
+            case kSweeping:
+                if (!Sweep(deadline)) {
+                    return false;
+                }
+                collection_phase = kIdle;
+                break;
+            case kIdle:
+                break;
+        }
+    }
+    return true;
+}
+
+/**
+ * Take the ranges of slots to sweep from every arena, and start the helper thread if we sweep concurrently
+ */
+void QuadTreeNodeStore::StartSweep() {
+    // arenas only hand out slots from here on that are already free, or new nodes that are marked
+    sweep_ranges.resize(node_arenas.size());
+    sweep_freed.assign(node_arenas.size(), QuadTreeNodeArena::FreeSlots());
+    for (size_t i = 0; i < node_arenas.size(); ++i) {
+        sweep_ranges[i].clear();
+        node_arenas[i]->HandedOut(kSweepRangeBytes, sweep_ranges[i]);
+    }
+    sweep_arena = 0;
+    sweep_range = 0;
+    if (collection_mode == kConcurrentSweep) {
+        sweep_done.store(false, std::memory_order_relaxed);
+        std::vector<size_t> slot_sizes;
+        for (QuadTreeNodeArena* arena : node_arenas) {
+            slot_sizes.push_back(arena->SlotSize());
+        }
+        uint32_t mark = collection_mark;
+        sweep_thread = std::thread([this, slot_sizes, mark]() {
+            for (size_t i = 0; i < sweep_ranges.size(); ++i) {
+                for (const QuadTreeNodeArena::SlotRange& range : sweep_ranges[i]) {
+                    QuadTreeNodeArena::SweepRange(range, slot_sizes[i], [mark](void* slot) {
+                        QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+                        if (node->IsGarbage(mark)) {
+                            node->SetFree();
+                            return true;
+                        }
+                        return false;
+                    }, sweep_freed[i]);
+                }
+            }
+            sweep_done.store(true, std::memory_order_release);
+        });
+    }
+}
+
+/**
+ * Sweep until we're done or we pass a deadline, or with a concurrent sweep, check whether the helper thread is
+ * done. Freed slots go back to the arenas
+ * @param deadline when to stop
+ * @return true if the sweep is done
+ */
+bool QuadTreeNodeStore::Sweep(std::chrono::steady_clock::time_point deadline) {
+    if (sweep_thread.joinable()) {
+        if (deadline != std::chrono::steady_clock::time_point::max() && !sweep_done.load(std::memory_order_acquire)) {
+            return false;
+        }
+        sweep_thread.join();
+        for (size_t i = 0; i < sweep_freed.size(); ++i) {
+            current_collection.nodes_freed += sweep_freed[i].count;
+            current_collection.bytes_freed += sweep_freed[i].count * node_arenas[i]->SlotSize();
+            node_arenas[i]->Free(sweep_freed[i]);
+        }
+        return true;
+    }
+    while (sweep_arena < sweep_ranges.size()) {
+        if (sweep_range == sweep_ranges[sweep_arena].size()) {
+            ++sweep_arena;
+            sweep_range = 0;
+            continue;
+        }
+        QuadTreeNodeArena::FreeSlots& freed = sweep_freed[sweep_arena];
+        size_t slot_size = node_arenas[sweep_arena]->SlotSize();
+        QuadTreeNodeArena::SweepRange(sweep_ranges[sweep_arena][sweep_range++], slot_size, [this](void* slot) {
+            QuadTreeNode* node = static_cast<QuadTreeNode*>(slot);
+            if (node->IsGarbage(collection_mark)) {
+                node->SetFree();
+                return true;
+            }
+            return false;
+        }, freed);
+        current_collection.nodes_freed += freed.count;
+        current_collection.bytes_freed += freed.count * slot_size;
+        node_arenas[sweep_arena]->Free(freed);
+        if (std::chrono::steady_clock::now() >= deadline) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Add a pause to the stats of the collection that's under way, and if it's finished, to the totals
+ * @param start when the pause started
+ * @param finished true if the collection finished in this pause
+ */
+void QuadTreeNodeStore::RecordPause(std::chrono::steady_clock::time_point start, bool finished) {
+    uint64_t pause_us = (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    current_collection.num_pauses += 1;
+    current_collection.pause_us += pause_us;
+    current_collection.max_pause_us = std::max(current_collection.max_pause_us, pause_us);
+    if (!finished) {
+        return;
+    }
+    current_collection.num_collections = 1;
+    UpdateNodeBytes();
+    last_collection = current_collection;
+    all_collections.num_collections += 1;
+    all_collections.num_pauses += last_collection.num_pauses;
+    all_collections.pause_us += last_collection.pause_us;
+    all_collections.max_pause_us = std::max(all_collections.max_pause_us, last_collection.max_pause_us);
+    all_collections.nodes_freed += last_collection.nodes_freed;
+    all_collections.bytes_freed += last_collection.bytes_freed;
+    all_collections.bytes_released += last_collection.bytes_released;
+    all_collections.memos_dropped += last_collection.memos_dropped;
+    all_collections.hot_nodes_kept += last_collection.hot_nodes_kept;
+    if (memo_budget != 0) {
+        UpdateMemoAge();
+    }
+}
+#endif
+
+/**
+ * Safe point in the middle of a step: collect if we're over a pressure limit, or wait if another thread is
+ * collecting. Everything the calling thread and any other busy thread still needs has to be pinned
+ */
+void QuadTreeNodeStore::CheckPressure() {
+#if (ENABLE_GARBAGE_COLLECTION)
+ #if (ENABLE_PARALLEL_EVOLVE)
+    if (thread_pool != 0 && thread_pool->IsPaused()) {
+        thread_pool->Park();
+        return;
+    }
+ #endif
+    if (!OverPressureLimit()) {
+        return;
+    }
+ #if (ENABLE_PARALLEL_EVOLVE)
+    // once every other thread has parked or is waiting on tasks, nobody is touching a node
+    if (thread_pool != 0 && !thread_pool->TryPause()) {
+        thread_pool->Park();
+        return;
+    }
+ #endif
+    // an incremental collection only frees what was garbage when it started, so finish it and collect everything
+    if (collection_phase != kIdle) {
+        CollectGarbage();
+    }
+    CollectGarbage();
+    last_collection.num_in_step = 1;
+    all_collections.num_in_step += 1;
+    size_t num_nodes = node_table.Size();
+    pressure_floor = num_nodes + num_nodes / 4;
+ #if (ENABLE_PARALLEL_EVOLVE)
+    if (thread_pool != 0) {
+        thread_pool->Resume();
+    }
+ #endif
+#endif
+}
+
+/**
+ * This function looks up a node with level > 0 in the hash table and returns a canonical one
+ * if it exists. If it doesn't exist, it creates a new node and adds it
+ * @return a new, canonical node
+ */
+QuadTreeNode* QuadTreeNodeStore::Canonical(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se, level_type level) {
+    uint32_t hash = QuadTreeNodeTable::Hash(nw, ne, sw, se);
+    QuadTreeNodeTable::InsertHint hint;
+    QuadTreeNode* node = node_table.Find(nw, ne, sw, se, hash, hint);
+    // if this node isn't in the table, add it
+    if (node == 0) {
+        QuadTreeNode* new_node = new (ThreadArena(false)->Allocate()) QuadTreeNode(nw, ne, sw, se, level);
+    #if (ENABLE_GARBAGE_COLLECTION)
+        // new nodes are born marked, so the write barrier has to cover their children
+        new_node->SetHash(hash, collection_mark | new_node_age);
+        Shade(nw);
+        Shade(ne);
+        Shade(sw);
+        Shade(se);
+    #else
+        new_node->SetHash(hash, 0);
+    #endif
+        node = node_table.Insert(new_node, hint);
+        // another thread added the same node after we looked, so we use theirs
+        if (node != new_node) {
+            FreeNode(new_node);
+        }
+    } else {
+        // a node we found is being reused
+        Touch(node);
+    }
+    return node;
+}
+
+/**
+ * This function looks up a leaf node in the hash table and returns a canonical one
+ * if it exists. If it doesn't exist, it creates a new node and adds it
+ * @param bits the leaf's 8x8 cells, see QuadTreeLeafKernel for the layout
+ * @return a new, canonical leaf node
+ */
+QuadTreeNode* QuadTreeNodeStore::CanonicalLeaf(uint64_t bits) {
+    uint32_t hash = QuadTreeNodeTable::HashLeaf(bits);
+    QuadTreeNodeTable::InsertHint hint;
+    QuadTreeNode* node = node_table.FindLeaf(bits, hash, hint);
+    // if this leaf isn't in the table, add it
+    if (node == 0) {
+        QuadTreeNode* new_node = new (ThreadArena(true)->Allocate()) QuadTreeNode(bits);
+    #if (ENABLE_GARBAGE_COLLECTION)
+        new_node->SetHash(hash, collection_mark | new_node_age);
+    #else
+        new_node->SetHash(hash, 0);
+    #endif
+        node = node_table.Insert(new_node, hint);
+        // another thread added the same leaf after we looked, so we use theirs
+        if (node != new_node) {
+            FreeNode(new_node);
+        }
+    } else {
+        // a node we found is being reused
+        Touch(node);
+    }
+    return node;
+}
+
+/**
+ * Give a node back to the calling thread's arena
+ * @param node
+ */
+void QuadTreeNodeStore::FreeNode(QuadTreeNode* node) {
+    bool leaf = node->level == QuadTreeNode::kLeafLevel;
+    node->SetFree();
+    ThreadArena(leaf)->Free(node);
+}
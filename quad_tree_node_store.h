@@ -0,0 +1,693 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREENODESTORE_H
+#define GOL_QUADTREENODESTORE_H
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+#include "quad_tree_memo_table.h"
+#include "quad_tree_node_arena.h"
+#include "quad_tree_node_table.h"
+#include "quad_tree_thread_pool.h"
+
+/**
+ * Everything canonical nodes need to live: the node table, the arenas the nodes are allocated from, the thread pool
+ * we evolve with, the cached empty nodes and the stats that go with them.
+ *
+ * Every QuadTree holds a store by reference. Several trees can share one store, so they also share its nodes and
+ * memoized results, which is a big win when the trees run similar patterns. Trees that share a store have to be
+ * stepped one at a time, because a step can collect garbage for all of them. Trees on different threads need
+ * their own stores, which don't share anything and don't need any locks.
+ *
+ * Every tree registers its root with AddRoot(), and garbage collection keeps everything reachable from any root.
+ * Destroying the store frees all of its nodes, so it has to outlive every tree that uses it.
+ *
+ * Garbage collection is mark and sweep. Marking sets the mark bit in every reachable node, working off an explicit
+ * stack so tall trees can't overflow the call stack. Then we empty the node table and sweep the arenas slot by slot:
+ * marked nodes go back in the table, everything else goes on a free list. That way we never touch the node table or
+ * a dead node at random, and the cost of a collection follows the live set and the arenas, which we read in order.
+ * The meaning of the mark bit flips every collection, so nodes never need unmarking and new nodes are born marked.
+ *
+ * That pauses the step that triggers it for the whole collection, so there are two other modes (see
+ * SetCollectionMode()). An incremental collection does a little work after every step, within a time budget: first
+ * it marks, then it removes unmarked nodes from the node table one shard at a time, then it sweeps the arenas a range
+ * at a time. While it's marking, steps run a write barrier: a new node shades its children, and so does storing a
+ * memoized result or a center, so no marked node ever points to an unmarked one. Marking is done when there's nothing
+ * left to shade and the roots are all marked. From then on the node table hides unmarked nodes until they're
+ * removed. A concurrent sweep does the same, except that the arenas are swept on a helper thread while we keep
+ * stepping. Either way, we only hand freed slots back to the arenas between steps.
+ *
+ * A single step can also collect in the middle of evolving, once we pass a limit on nodes or bytes (see
+ * SetPressureLimit()). Nodes being evolved at the pin level or above put their arrays of sub-squares and results on
+ * their thread's pin stack, and those count as roots. They check the limit before each sub-square, and if we're
+ * over it, pause the thread pool and stop the world.
+ *
+ * Without a budget, a collection keeps every memoized result a live node points to, and drops every node nothing
+ * points to. A memo budget (see SetMemoBudget()) ages nodes instead, like a clock: steps make the nodes they evolve or
+ * look up young again, and every collection ages the nodes it looks at by one. Nodes older than a threshold let go of
+ * their memoized results, and a collection that stops the world keeps nodes nothing points to if they're young
+ * enough. The threshold moves after every collection so that what we keep settles around half the budget.
+ *
+ * Nodes freed by collections leave holes that new nodes fill in wherever they are, so after a while a node's children
+ * can be anywhere in memory. Compact() copies every node into one new arena, depth first from the roots, so that the
+ * four children of a node sit next to each other and near their parent. The old copy of a node holds its new address
+ * in calc while we fix up pointers, and its mark bit says that it has moved. Hashes depend on where the children are,
+ * so the node table is rebuilt afterwards.
+ *
+ * Leaves are half the size of other nodes (see QuadTreeNode::kLeafSize), so every thread has a second arena for them,
+ * and so does a compaction. Everything that walks the arenas walks both kinds.
+ */
+class QuadTreeNodeStore {
+
+    friend class QuadTree;
+    friend class QuadTreeBulkLoader;
+    friend class QuadTreeNode;
+    friend class QuadTreeSnapshot;
+    friend class QuadTreeTests;
+
+    public:
+
+        /**
+         * What garbage collection did, for one collection or added up over all of them
+         */
+        struct CollectionStats {
+            // number of collections
+            uint64_t num_collections;
+
+            // number of times we stopped: once per collection that stops the world, or once per step an incremental
+            // collection did some work after
+            uint64_t num_pauses;
+
+            // time we stopped for, in microseconds, and the longest single pause
+            uint64_t pause_us;
+            uint64_t max_pause_us;
+
+            // nodes we freed, and the bytes of arena slots they took up, which new nodes reuse
+            uint64_t nodes_freed;
+            uint64_t bytes_freed;
+
+            // bytes of arena chunks that were left empty, which we gave back to the system. Only collections that
+            // stop the world release chunks
+            uint64_t bytes_released;
+
+            // collections that ran in the middle of a step because we passed a pressure limit
+            uint64_t num_in_step;
+
+            // memoized results and centers we let go of because their nodes weren't used lately, and nodes nothing
+            // points to that we kept because they were. Only a memo budget does either
+            uint64_t memos_dropped;
+            uint64_t hot_nodes_kept;
+
+            // times we moved every node into one arena, the nodes we moved, and how long it took in microseconds.
+            // Compacting is a pause of its own, so it's in the pause stats too
+            uint64_t num_compactions;
+            uint64_t nodes_moved;
+            uint64_t compact_us;
+        };
+
+        /**
+         * How garbage collection runs, see GARBAGE_COLLECTION_INCREMENTAL
+         */
+        enum CollectionMode {
+            // collect everything at once
+            kStopTheWorld,
+
+            // mark, clean the node table and sweep a bit at a time between steps
+            kIncremental,
+
+            // like kIncremental, but sweep the arenas on a helper thread
+            kConcurrentSweep
+        };
+
+        /**
+         * Constructs an empty store that evolves with EVOLVE_THREADS threads
+         */
+        QuadTreeNodeStore();
+
+        /**
+         * Destructor, frees every node in the store and stops its threads
+         */
+        ~QuadTreeNodeStore();
+
+        /**
+         * Allocate a store on a cache line, since plain new before C++17 doesn't honor our alignas(64) members
+         * @param size bytes to allocate
+         * @return memory aligned to 64 bytes
+         */
+        static void* operator new(size_t size);
+
+        /**
+         * Free a store allocated with our operator new
+         * @param memory memory to free
+         */
+        static void operator delete(void* memory);
+
+        /**
+         * Set how many threads we evolve with. Don't call this in the middle of a step
+         * @param num_threads number of threads including the calling thread, 0 for one per hardware thread
+         * @param parallel_level nodes at this level or above evolve their sub-squares as separate tasks
+         */
+        void SetThreads(int num_threads, int parallel_level = EVOLVE_PARALLEL_LEVEL_MIN);
+
+        /**
+         * @return number of canonical nodes in the store
+         */
+        size_t NumNodes() const { return node_table.Size(); }
+
+        /**
+         * @return number of nodes created so far, on all threads
+         */
+        int64_t NumNodesCreated() const;
+
+        /**
+         * @return bytes used by node arenas, the node table and the memo table
+         */
+        size_t MemoryUsage() const;
+
+        /**
+         * @return number of times a node was evolved so far, on all threads
+         */
+        uint64_t NumEvolves() const;
+
+        /**
+         * @return number of those evolves that found a memoized result, in the node or in the memo table
+         */
+        uint64_t NumMemoHits() const;
+
+        /**
+         * Get the canonical empty quadtree at the specified level
+         * @param level this level represents the power of 2 dimensions of this quad tree, which is square
+         * @return a new empty quad tree at the specified level
+         */
+        QuadTreeNode* EmptyQuadTree(level_type level);
+
+        /**
+         * Keep everything reachable from a root alive when we collect garbage
+         * @param root where the root is stored, which is read every time we collect
+         */
+        void AddRoot(QuadTreeNode** root);
+
+        /**
+         * Stop keeping a root alive
+         * @param root a root that was passed to AddRoot()
+         */
+        void RemoveRoot(QuadTreeNode** root);
+
+#if (ENABLE_GARBAGE_COLLECTION)
+        /**
+         * Free every node that can't be reached from a root or a cached empty node. If an incremental collection is
+         * under way, this finishes it instead. Don't call this in the middle of a step
+         */
+        void CollectGarbage();
+
+        /**
+         * Set how collections run. A collection that's under way is finished first. Don't call this in the middle of a step
+         * @param mode
+         * @param budget_us how long an incremental collection works for each time ContinueCollection() is called
+         */
+        void SetCollectionMode(CollectionMode mode, uint64_t budget_us = GARBAGE_COLLECTION_STEP_BUDGET_US);
+
+        /**
+         * @return how collections run
+         */
+        CollectionMode GetCollectionMode() const { return collection_mode; }
+
+        /**
+         * Start a collection. When stopping the world, this is the same as CollectGarbage(). Otherwise call
+         * ContinueCollection() after every step until it's done. Don't call this in the middle of a step
+         */
+        void StartCollection();
+
+        /**
+         * Work on the collection that's under way for up to our time budget. Don't call this in the middle of a step
+         * @return true if this finished the collection
+         */
+        bool ContinueCollection();
+
+        /**
+         * @return true if a collection is under way
+         */
+        bool IsCollecting() const { return collection_phase != kIdle; }
+
+        /**
+         * Collect in the middle of a step once we pass a limit. Don't call this in the middle of a step
+         * @param max_nodes number of nodes in the table, 0 for no limit
+         * @param max_bytes bytes of nodes plus the node table, 0 for no limit
+         * @param level smallest level that pins what it's evolving and checks the limits
+         */
+        void SetPressureLimit(size_t max_nodes, size_t max_bytes = 0, int level = GARBAGE_COLLECTION_PRESSURE_LEVEL);
+
+        /**
+         * Keep memory under a budget by letting go of memoized results that steps haven't used lately, instead of
+         * keeping every result that a live node points to. Collections also keep nodes that nothing points to if a
+         * step used them lately, so results that keep getting reused survive. Don't call this in the middle of a step
+         * @param max_bytes bytes of nodes plus the node table, 0 for no budget
+         */
+        void SetMemoBudget(size_t max_bytes);
+
+        /**
+         * @return bytes of nodes plus the node table we try to stay under, or 0 for no budget
+         */
+        size_t MemoBudget() const { return memo_budget; }
+
+        /**
+         * @return true if we're over the memo budget and have grown enough since the last collection, so it's time
+         * to collect
+         */
+        bool OverMemoBudget() const;
+
+        /**
+         * Move every node into one new arena, depth first from the roots so that each node's children sit next to
+         * each other, and fix up every pointer to them. Nodes the roots don't reach, like the ones a memo budget keeps,
+         * go after them. A collection that's under way is finished first. While compaction is paused, this waits for
+         * the first collection after it's resumed instead. Don't call this in the middle of a step
+         */
+        void Compact();
+
+        /**
+         * Compact after every so many collections. Don't call this in the middle of a step
+         * @param num_collections collections between compactions, 0 to only compact when Compact() is called
+         */
+        void SetCompactionInterval(uint64_t num_collections);
+
+        /**
+         * Hold off compacting while another thread reads nodes that compacting would move, like a frame writer
+         * rendering a root it's keeping alive. Compact() is put off until the first collection after every
+         * PauseCompaction() has been matched by a ResumeCompaction(). Don't call this in the middle of a step
+         */
+        void PauseCompaction() { ++compaction_pauses; }
+
+        /**
+         * Let go of a PauseCompaction(). Don't call this in the middle of a step
+         */
+        void ResumeCompaction() { --compaction_pauses; }
+
+        /**
+         * @return what the last garbage collection did
+         */
+        const CollectionStats& LastCollection() const { return last_collection; }
+
+        /**
+         * @return what every garbage collection so far did, added up
+         */
+        const CollectionStats& AllCollections() const { return all_collections; }
+#endif
+
+    private:
+
+        /**
+         * This function looks up a node with level > 0 in the hash table and returns a canonical one
+         * if it exists. If it doesn't exist, it creates a new node and adds it
+         * @return a new, canonical node
+         */
+        QuadTreeNode* Canonical(QuadTreeNode* nw, QuadTreeNode* ne, QuadTreeNode* sw, QuadTreeNode* se, level_type level);
+
+        /**
+         * This function looks up a leaf node in the hash table and returns a canonical one
+         * if it exists. If it doesn't exist, it creates a new node and adds it
+         * @param bits the leaf's 8x8 cells, see QuadTreeLeafKernel for the layout
+         * @return a new, canonical leaf node
+         */
+        QuadTreeNode* CanonicalLeaf(uint64_t bits);
+
+        /**
+         * Give a node back to the calling thread's arena
+         * @param node
+         */
+        void FreeNode(QuadTreeNode* node);
+
+        /**
+         * @param leaf true for the arena leaves come from
+         * @return the calling thread's arena for leaves or for non-leaf nodes
+         */
+        QuadTreeNodeArena* ThreadArena(bool leaf) const {
+            return node_arenas[2 * QuadTreeThreadPool::WorkerIndex() + (leaf ? 1 : 0)];
+        }
+
+        /**
+         * Mark the calling thread as evolving, around evolving a root. Threads in the pool are counted while they
+         * run tasks, and a collection in the middle of a step waits for all of them to stop
+         */
+        void BeginEvolve() {
+#if (ENABLE_PARALLEL_EVOLVE)
+            if (thread_pool != 0) {
+                thread_pool->Enter();
+            }
+#endif
+        }
+
+        /**
+         * Count an evolve on the calling thread
+         * @param memo_hit true if it found a memoized result
+         */
+        void CountEvolve(bool memo_hit) {
+            EvolveStats& stats = evolve_stats[QuadTreeThreadPool::WorkerIndex()];
+            stats.evolves += 1;
+            stats.memo_hits += memo_hit ? 1 : 0;
+        }
+
+        /**
+         * The calling thread is done evolving a root
+         */
+        void EndEvolve() {
+#if (ENABLE_PARALLEL_EVOLVE)
+            if (thread_pool != 0) {
+                thread_pool->Leave();
+            }
+#endif
+        }
+
+        /**
+         * Keep the nodes in an array alive if we collect in the middle of a step. Pins are per thread and must be
+         * undone in reverse order
+         * @param nodes array of nodes, where empty entries are 0. The array is read when we collect, so it can
+         * still be filled in after it's pinned
+         * @param count number of entries
+         */
+        void Pin(QuadTreeNode** nodes, int count) {
+#if (ENABLE_GARBAGE_COLLECTION)
+            pin_stacks[QuadTreeThreadPool::WorkerIndex()].pins.push_back(PinnedNodes{nodes, count});
+#else
+            (void) nodes;
+            (void) count;
+#endif
+        }
+
+        /**
+         * Undo the calling thread's latest pins
+         * @param num_pins number of Pin() calls to undo
+         */
+        void Unpin(int num_pins) {
+#if (ENABLE_GARBAGE_COLLECTION)
+            std::vector<PinnedNodes>& pins = pin_stacks[QuadTreeThreadPool::WorkerIndex()].pins;
+            pins.resize(pins.size() - num_pins);
+#else
+            (void) num_pins;
+#endif
+        }
+
+        /**
+         * @return smallest level that pins what it's evolving and calls CheckPressure()
+         */
+        int PinLevel() const { return pin_level; }
+
+        /**
+         * Safe point in the middle of a step: collect if we're over a pressure limit, or wait if another thread is
+         * collecting. Everything the calling thread and any other busy thread still needs has to be pinned
+         */
+        void CheckPressure();
+
+        /**
+         * Write barrier for pointers we add to nodes that are already in the table. While an incremental collection
+         * is marking, this marks the node and leaves it for the collection to look at its children
+         * @param node node being pointed to, or 0
+         */
+        void Shade(QuadTreeNode* node) {
+#if (ENABLE_GARBAGE_COLLECTION)
+            if (collection_phase == kMarking && node != 0 && node->MarkShared(collection_mark)) {
+                gray_stacks[QuadTreeThreadPool::WorkerIndex()].nodes.push_back(node);
+            }
+#else
+            (void) node;
+#endif
+        }
+
+        /**
+         * Note that a step used a node, so that a memo budget keeps its memoized result longer
+         * @param node
+         */
+        void Touch(QuadTreeNode* node) {
+#if (ENABLE_GARBAGE_COLLECTION)
+            if (memo_budget != 0) {
+                node->Touch();
+            }
+#else
+            (void) node;
+#endif
+        }
+
+        /**
+         * Work out the pin level from the pressure limits and the thread pool
+         */
+        void UpdatePinLevel();
+
+        /**
+         * One thread's evolves, on their own cache line
+         */
+        struct alignas(64) EvolveStats {
+            uint64_t evolves;
+            uint64_t memo_hits;
+        };
+
+#if (ENABLE_GARBAGE_COLLECTION)
+        /**
+         * Where a collection is up to
+         */
+        enum CollectionPhase {
+            kIdle,
+            kMarking,
+            kCleaningTable,
+            kSweeping
+        };
+
+        /**
+         * Nodes one thread's write barrier shaded, on their own cache line
+         */
+        struct alignas(64) GrayStack {
+            std::vector<QuadTreeNode*> nodes;
+        };
+
+        /**
+         * An array of nodes from Pin()
+         */
+        struct PinnedNodes {
+            QuadTreeNode** nodes;
+            int count;
+        };
+
+        /**
+         * One thread's pins, on their own cache line
+         */
+        struct alignas(64) PinStack {
+            std::vector<PinnedNodes> pins;
+        };
+
+        /**
+         * @return true if we're over a pressure limit and have grown enough since the last collection
+         */
+        bool OverPressureLimit() const;
+
+        /**
+         * Mark every root and cached empty node that isn't marked yet, and push them on the mark stack
+         * @return number of nodes we marked
+         */
+        size_t MarkRoots();
+
+        /**
+         * Mark everything reachable from the mark stack and the gray stacks: children, memoized results and cached
+         * centers alike. With a memo budget, nodes that are too old let go of their results and centers instead, and
+         * every node we look at ages by one
+         * @param deadline when to stop, checked every so often
+         * @param num_marked incremented by the number of nodes we mark
+         * @return true if there's nothing left to mark, false if we ran out of time
+         */
+        bool Trace(std::chrono::steady_clock::time_point deadline, size_t& num_marked);
+
+        /**
+         * Mark the nodes that nothing marked points to, but that a step used lately enough for the memo budget to
+         * keep them, and push them on the mark stack. Only a collection that stops the world does this, because it
+         * has to look at every slot
+         * @return number of nodes we marked
+         */
+        size_t MarkHotNodes();
+
+        /**
+         * Mark the results in the memo table whose nodes are marked, and push them on the mark stack. A result there
+         * lives as long as its node, like the result in the node itself, so tracing has to go on until this doesn't
+         * find anything new
+         * @return number of nodes we marked
+         */
+        size_t MarkMemoResults();
+
+        /**
+         * Once a collection has marked everything, forget the results of nodes that aren't marked
+         */
+        void RemoveDeadMemos();
+
+        /**
+         * At the start of a collection with a memo budget, forget the results in the memo table of nodes that are too
+         * old to keep theirs, like Trace() does for the result in the node
+         */
+        void DropOldMemos();
+
+        /**
+         * Before a collection that stops the world, count the nodes of every age and pick how lately a node has to have
+         * been used to keep it and its memoized result, so that what we keep fits in half of the memo budget
+         */
+        void PickMemoAge();
+
+        /**
+         * After a collection, move the age a node has to be to keep its memoized result, so that what incremental
+         * collections keep settles around half of the memo budget. They can't look at every node at once like
+         * PickMemoAge() does. Then don't collect for the budget again until we've grown some
+         */
+        void UpdateMemoAge();
+
+        /**
+         * Work out how many bytes of arena slots a node takes on average, which depends on how many of them are
+         * leaves. Limits are checked in the middle of steps, when we can't look at the arenas, so they go by this
+         */
+        void UpdateNodeBytes();
+
+        /**
+         * @return true if we've collected often enough since the last compaction to compact again, or Compact() was put off,
+         * and compaction isn't paused
+         */
+        bool CompactionDue() const;
+
+        /**
+         * Move the collection that's under way along until it's done or we pass a deadline
+         * @param deadline when to stop, checked between pieces of work
+         * @return true if the collection is done
+         */
+        bool CollectionWork(std::chrono::steady_clock::time_point deadline);
+
+        /**
+         * Take the ranges of slots to sweep from every arena, and start the helper thread if we sweep concurrently
+         */
+        void StartSweep();
+
+        /**
+         * Sweep until we're done or we pass a deadline, or with a concurrent sweep, check whether the helper thread is
+         * done. Freed slots go back to the arenas
+         * @param deadline when to stop
+         * @return true if the sweep is done
+         */
+        bool Sweep(std::chrono::steady_clock::time_point deadline);
+
+        /**
+         * Add a pause to the stats of the collection that's under way, and if it's finished, to the totals
+         * @param start when the pause started
+         * @param finished true if the collection finished in this pause
+         */
+        void RecordPause(std::chrono::steady_clock::time_point start, bool finished);
+#endif
+
+        // we own nodes, so we can't be copied
+        QuadTreeNodeStore(const QuadTreeNodeStore& other);
+        QuadTreeNodeStore& operator=(const QuadTreeNodeStore& other);
+
+    private:
+
+        // canonical table of all of our nodes
+        QuadTreeNodeTable node_table;
+
+        // memoized results for the exponents that a node's own slot isn't holding
+        QuadTreeMemoTable memo_table;
+
+        // every node is allocated from an arena of the thread that creates it. Each thread has two, see ThreadArena():
+        // one for non-leaf nodes and one with smaller slots for leaves
+        std::vector<QuadTreeNodeArena*> node_arenas;
+
+        // threads we evolve with, or 0 if we evolve serially
+        QuadTreeThreadPool* thread_pool;
+
+        // number of threads to use, including the main thread
+        int num_threads;
+
+        // smallest level that evolves its sub-squares as tasks
+        int parallel_level;
+
+        // smallest level that pins what it's evolving, or INT_MAX if there are no pressure limits
+        int pin_level;
+
+        // roots of the trees using this store
+        std::vector<QuadTreeNode**> roots;
+
+        // evolve stats, one per thread so that evolves never share a cache line
+        EvolveStats evolve_stats[QuadTreeThreadPool::kMaxThreads];
+
+    #if (ENABLE_GARBAGE_COLLECTION)
+        // how collections run, and how long an incremental collection works between steps
+        CollectionMode collection_mode;
+        uint64_t collection_budget_us;
+
+        // where the collection is up to
+        CollectionPhase collection_phase;
+
+        // a node is marked if its mark bit equals this, kMarkBit or 0. Flipped at the start of every collection
+        uint32_t collection_mark;
+
+        // nodes we've marked but whose children we haven't looked at yet, kept around so we don't reallocate it
+        std::vector<QuadTreeNode*> mark_stack;
+
+        // nodes the write barrier marked on each thread, indexed by QuadTreeThreadPool::WorkerIndex()
+        GrayStack gray_stacks[QuadTreeThreadPool::kMaxThreads];
+
+        // next node table shard to clean
+        int cleaning_shard;
+
+        // slots to sweep in each arena, and where we're up to
+        std::vector<std::vector<QuadTreeNodeArena::SlotRange>> sweep_ranges;
+        size_t sweep_arena;
+        size_t sweep_range;
+
+        // slots the helper thread freed in each arena, which we hand back once it's done
+        std::vector<QuadTreeNodeArena::FreeSlots> sweep_freed;
+        std::thread sweep_thread;
+        std::atomic<bool> sweep_done;
+
+        // pressure limits, 0 for none, and the level that checks them
+        size_t pressure_nodes;
+        size_t pressure_bytes;
+        int pressure_level;
+
+        // we don't collect under pressure again until we're past this many nodes
+        size_t pressure_floor;
+
+        // memo budget, 0 for none, and we don't collect for it again until we're past memo_floor bytes
+        size_t memo_budget;
+        size_t memo_floor;
+
+        // nodes keep their memoized results and centers if their age is at least this, 0 to keep them all
+        uint32_t memo_min_age;
+
+        // age bits new nodes start with, one younger than the youngest if there's a memo budget
+        uint32_t new_node_age;
+
+        // bytes of arena slots per node, as of the last collection or compaction
+        size_t node_bytes;
+
+        // collections between compactions, 0 for none, and how many collections there had been at the last one
+        uint64_t compaction_interval;
+        uint64_t collections_at_compaction;
+
+        // PauseCompaction() calls that haven't been resumed yet, and whether Compact() was called while there were any
+        int compaction_pauses;
+        bool compaction_deferred;
+
+        // arrays of nodes that steps have pinned on each thread
+        PinStack pin_stacks[QuadTreeThreadPool::kMaxThreads];
+
+        // garbage collection stats, for the collection under way too
+        CollectionStats current_collection;
+        CollectionStats last_collection;
+        CollectionStats all_collections;
+
+        // biggest range of slots we sweep without checking the time
+        static const size_t kSweepRangeBytes = 1024 * 1024;
+    #endif
+
+        // canonical empty node for each level, filled in as we need them. Garbage collection always keeps these
+        std::vector<QuadTreeNode*> empty_nodes;
+};
+
+#endif //GOL_QUADTREENODESTORE_H
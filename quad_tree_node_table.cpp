@@ -0,0 +1,508 @@
+//
+// Created by agent on 10/15/26.
+//
+#include <cstring>
+#include <thread>
+#include "quad_tree_node_table.h"
+#include "quad_tree_node.h"
+
+/**
+ * Constructs an empty table
+ */
+QuadTreeNodeTable::QuadTreeNodeTable() {
+    num_threads = 1;
+    visible_mask = QuadTreeNode::kHashMask;
+    visible_mark = 0;
+    has_retired.store(false, std::memory_order_relaxed);
+    for (Shard& shard : shards) {
+        shard.current.store(NewSlotArray(kInitialCapacity), std::memory_order_relaxed);
+        shard.old.store(0, std::memory_order_relaxed);
+        shard.size.store(0, std::memory_order_relaxed);
+        shard.migrate_index = 0;
+        shard.version.store(0, std::memory_order_relaxed);
+        shard.lock.clear();
+    }
+    for (LookupStats& stats : lookup_stats) {
+        stats.lookups = 0;
+        stats.probes = 0;
+    }
+}
+
+/**
+ * Destructor, this does NOT free the nodes in the table
+ */
+QuadTreeNodeTable::~QuadTreeNodeTable() {
+    Reclaim();
+    for (Shard& shard : shards) {
+        DeleteSlotArray(shard.current.load(std::memory_order_relaxed));
+        DeleteSlotArray(shard.old.load(std::memory_order_relaxed));
+    }
+}
+
+/**
+ * Hash four child pointers into a well mixed 29 bit value
+ * Each pointer gets a different multiplier so that swapping children changes the hash, and
+ * we finish with the murmur3 64 bit mixer so the low bits we use for indexing are well distributed
+ * @return hash for a non-leaf node with these children
+ */
+uint32_t QuadTreeNodeTable::Hash(const QuadTreeNode* nw, const QuadTreeNode* ne, const QuadTreeNode* sw, const QuadTreeNode* se) {
+    uint64_t h = (uint64_t) (uintptr_t) nw;
+    h = h * UINT64_C(0x9E3779B97F4A7C15) + (uint64_t) (uintptr_t) ne;
+    h = h * UINT64_C(0x9E3779B97F4A7C15) + (uint64_t) (uintptr_t) sw;
+    h = h * UINT64_C(0x9E3779B97F4A7C15) + (uint64_t) (uintptr_t) se;
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    // the top bits are the best mixed, and nodes keep their garbage collection mark and age above the 29 we return.
+    // kHashMask itself is how nodes flag a free slot, so it's never a hash
+    uint32_t hash = (uint32_t) (h >> 35);
+    return hash != QuadTreeNode::kHashMask ? hash : 0;
+}
+
+/**
+ * Hash the cells of a leaf into a well mixed 29 bit value
+ * @return hash for a leaf node with these cells
+ */
+uint32_t QuadTreeNodeTable::HashLeaf(uint64_t bits) {
+    uint64_t h = bits ^ UINT64_C(0x9E3779B97F4A7C15);
+    h ^= h >> 33;
+    h *= UINT64_C(0xFF51AFD7ED558CCD);
+    h ^= h >> 33;
+    h *= UINT64_C(0xC4CEB9FE1A85EC53);
+    // the top bits are the best mixed, and nodes keep their garbage collection mark and age above the 29 we return.
+    // kHashMask itself is how nodes flag a free slot, so it's never a hash
+    uint32_t hash = (uint32_t) (h >> 35);
+    return hash != QuadTreeNode::kHashMask ? hash : 0;
+}
+
+/**
+ * Look for a node in the shard's current and old tables
+ * @param match bool(const QuadTreeNode*) that compares a node with the same hash to the key
+ * @param probes incremented by the number of slots we look at
+ * @param insert_index if not 0 and the node isn't found, set to the empty slot in the current table where it goes
+ * @return the node or 0
+ */
+template <class Match>
+QuadTreeNode* QuadTreeNodeTable::Lookup(const Shard &shard, uint32_t hash, Match match, size_t &probes, size_t* insert_index) const {
+    // the acquire loads pair with the release stores in Insert() and Grow(), so we see every field of a node we find
+    const SlotArray* table = shard.current.load(std::memory_order_acquire);
+    size_t mask = table->capacity - 1;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+        ++probes;
+        QuadTreeNode* node = table->slots[i].load(std::memory_order_acquire);
+        if (node == 0) {
+            if (insert_index != 0) {
+                *insert_index = i;
+            }
+            break;
+        }
+        if ((node->hash_and_mark.load(std::memory_order_relaxed) & visible_mask) == (hash | visible_mark) && match(node)) {
+            return node;
+        }
+    }
+    // if we're in the middle of growing, the node could still be in the old table
+    const SlotArray* old_table = shard.old.load(std::memory_order_acquire);
+    if (old_table != 0) {
+        size_t old_mask = old_table->capacity - 1;
+        for (size_t i = hash & old_mask; ; i = (i + 1) & old_mask) {
+            ++probes;
+            QuadTreeNode* node = old_table->slots[i].load(std::memory_order_acquire);
+            if (node == 0) {
+                break;
+            }
+            if ((node->hash_and_mark.load(std::memory_order_relaxed) & visible_mask) == (hash | visible_mark) && match(node)) {
+                return node;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Look up a non-leaf node by its children, without locking
+ * @param hash precalculated hash from Hash()
+ * @param hint if the node isn't found, this is where it should be inserted with Insert()
+ * @return the canonical node or 0 if it doesn't exist (or is being added by another thread right now)
+ */
+QuadTreeNode* QuadTreeNodeTable::Find(const QuadTreeNode* nw, const QuadTreeNode* ne, const QuadTreeNode* sw, const QuadTreeNode* se,
+                                      uint32_t hash, InsertHint &hint) const {
+    const Shard& shard = ShardFor(hash);
+    // read the version first, so any change after it makes Insert() look again
+    hint.version = shard.version.load(std::memory_order_acquire);
+    size_t probes = 0;
+    QuadTreeNode* found = Lookup(shard, hash, [nw, ne, sw, se](const QuadTreeNode* node) {
+        // a leaf with the same hash has no children to compare
+        return node->level != QuadTreeNode::kLeafLevel && node->nw == nw && node->ne == ne && node->sw == sw && node->se == se;
+    }, probes, &hint.index);
+    // stats are only written once, so they don't get in the way of the loops above
+    LookupStats& stats = lookup_stats[QuadTreeThreadPool::WorkerIndex()];
+    ++stats.lookups;
+    stats.probes += probes;
+    return found;
+}
+
+/**
+ * Look up a leaf node by its cells, without locking
+ * @param hash precalculated hash from HashLeaf()
+ * @param hint if the leaf isn't found, this is where it should be inserted with Insert()
+ * @return the canonical leaf or 0 if it doesn't exist (or is being added by another thread right now)
+ */
+QuadTreeNode* QuadTreeNodeTable::FindLeaf(uint64_t bits, uint32_t hash, InsertHint &hint) const {
+    const Shard& shard = ShardFor(hash);
+    // read the version first, so any change after it makes Insert() look again
+    hint.version = shard.version.load(std::memory_order_acquire);
+    size_t probes = 0;
+    QuadTreeNode* found = Lookup(shard, hash, [bits](const QuadTreeNode* node) {
+        return node->level == QuadTreeNode::kLeafLevel && node->bits == bits;
+    }, probes, &hint.index);
+    // stats are only written once, so they don't get in the way of the loops above
+    LookupStats& stats = lookup_stats[QuadTreeThreadPool::WorkerIndex()];
+    ++stats.lookups;
+    stats.probes += probes;
+    return found;
+}
+
+/**
+ * Insert a new node unless an equal node is already in the table, which can happen if another thread
+ * added it after our Find() missed
+ * @param node new node, its hash must already be set
+ * @param hint hint from the Find() or FindLeaf() call that missed
+ * @return the canonical node, which is node if it was inserted. Otherwise the caller still owns node
+ */
+QuadTreeNode* QuadTreeNodeTable::Insert(QuadTreeNode* node, const InsertHint &hint) {
+    Shard& shard = ShardFor(node->Hash());
+    if (num_threads > 1) {
+        while (shard.lock.test_and_set(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+    }
+    uint32_t version = shard.version.load(std::memory_order_relaxed);
+    size_t insert_index = hint.index;
+    QuadTreeNode* found = 0;
+    if (version != hint.version) {
+        // the shard changed since the node was looked up. Nobody else can insert into it now, so this lookup is exact
+        size_t probes = 0;
+        if (node->level == QuadTreeNode::kLeafLevel) {
+            uint64_t bits = node->bits;
+            found = Lookup(shard, node->Hash(), [bits](const QuadTreeNode* other) {
+                return other->level == QuadTreeNode::kLeafLevel && other->bits == bits;
+            }, probes, &insert_index);
+        } else {
+            found = Lookup(shard, node->Hash(), [node](const QuadTreeNode* other) {
+                return other->level != QuadTreeNode::kLeafLevel
+                       && other->nw == node->nw && other->ne == node->ne && other->sw == node->sw && other->se == node->se;
+            }, probes, &insert_index);
+        }
+    }
+    if (found == 0) {
+        // publish the node after it has been fully built
+        shard.current.load(std::memory_order_relaxed)->slots[insert_index].store(node, std::memory_order_release);
+        shard.size.store(shard.size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (shard.old.load(std::memory_order_relaxed) != 0) {
+            MigrateSome(shard);
+        } else if (shard.size.load(std::memory_order_relaxed) > (shard.current.load(std::memory_order_relaxed)->capacity >> 1)) {
+            Grow(shard);
+        }
+        shard.version.store(version + 1, std::memory_order_release);
+        found = node;
+    }
+    if (num_threads > 1) {
+        shard.lock.clear(std::memory_order_release);
+    }
+    return found;
+}
+
+/**
+ * Set how many threads use the table, which turns locking on if there is more than one. Not thread safe
+ * @param num_threads from 1 to QuadTreeThreadPool::kMaxThreads, each thread is identified by QuadTreeThreadPool::WorkerIndex()
+ */
+void QuadTreeNodeTable::SetNumThreads(int num_threads) {
+    // we only add up the stats of threads we know about, so fold the stats of threads we're dropping into the first one
+    for (int i = num_threads; i < this->num_threads; ++i) {
+        lookup_stats[0].lookups += lookup_stats[i].lookups;
+        lookup_stats[0].probes += lookup_stats[i].probes;
+        lookup_stats[i].lookups = 0;
+        lookup_stats[i].probes = 0;
+    }
+    this->num_threads = num_threads;
+}
+
+/**
+ * Finish any incremental rehash that is in progress. Not thread safe
+ */
+void QuadTreeNodeTable::FinishRehash() {
+    for (Shard& shard : shards) {
+        while (shard.old.load(std::memory_order_relaxed) != 0) {
+            MigrateSome(shard);
+        }
+    }
+}
+
+/**
+ * Hide nodes whose mark doesn't match from Find() and FindLeaf(). An incremental garbage collection turns this
+ * on once marking is done, so nobody picks up a dead node while it's still waiting to be removed; they get a
+ * fresh copy instead. Don't call this in the middle of a step
+ * @param only_marked true to hide unmarked nodes, false to see every node again
+ * @param mark the store's current mark, see QuadTreeNode::IsMarked()
+ */
+void QuadTreeNodeTable::SetVisibleMark(bool only_marked, uint32_t mark) {
+    visible_mask = only_marked ? QuadTreeNode::kMarkBit | QuadTreeNode::kHashMask : QuadTreeNode::kHashMask;
+    visible_mark = only_marked ? mark : 0;
+}
+
+/**
+ * Free slot arrays that rehashing replaced while lookups on other threads could have been reading them.
+ * Only call this when no other thread is using the table
+ */
+void QuadTreeNodeTable::Reclaim() {
+    if (!has_retired.load(std::memory_order_relaxed)) {
+        return;
+    }
+    has_retired.store(false, std::memory_order_relaxed);
+    for (Shard& shard : shards) {
+        for (SlotArray* table : shard.retired) {
+            DeleteSlotArray(table);
+        }
+        shard.retired.clear();
+    }
+}
+
+/**
+ * Remove all nodes from the table, but don't free them. Not thread safe
+ */
+void QuadTreeNodeTable::Clear() {
+    Reclaim();
+    for (Shard& shard : shards) {
+        DeleteSlotArray(shard.old.load(std::memory_order_relaxed));
+        shard.old.store(0, std::memory_order_relaxed);
+        shard.migrate_index = 0;
+        DeleteSlotArray(shard.current.load(std::memory_order_relaxed));
+        shard.current.store(NewSlotArray(kInitialCapacity), std::memory_order_relaxed);
+        shard.size.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Empty the table and size it for a number of nodes, which are then put back one at a time with Restore().
+ * Garbage collection uses this to drop every dead node at once without looking at them. Not thread safe
+ * @param num_nodes number of nodes that are going to be restored
+ */
+void QuadTreeNodeTable::Reset(size_t num_nodes) {
+    Reclaim();
+    // leave each shard at most half full if the nodes spread out evenly. Restore() grows any shard that gets more
+    size_t capacity = kInitialCapacity;
+    while ((capacity >> 1) < num_nodes / kNumShards + 1) {
+        capacity <<= 1;
+    }
+    for (Shard& shard : shards) {
+        DeleteSlotArray(shard.old.load(std::memory_order_relaxed));
+        shard.old.store(0, std::memory_order_relaxed);
+        shard.migrate_index = 0;
+        DeleteSlotArray(shard.current.load(std::memory_order_relaxed));
+        shard.current.store(NewSlotArray(capacity), std::memory_order_relaxed);
+        shard.size.store(0, std::memory_order_relaxed);
+        shard.version.store(shard.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Put a node back after Reset(). Not thread safe
+ * @param node a node that isn't in the table, with its hash set
+ */
+void QuadTreeNodeTable::Restore(QuadTreeNode* node) {
+    Shard& shard = ShardFor(node->Hash());
+    if (shard.size.load(std::memory_order_relaxed) + 1 > (shard.current.load(std::memory_order_relaxed)->capacity >> 1)) {
+        Grow(shard);
+        while (shard.old.load(std::memory_order_relaxed) != 0) {
+            MigrateSome(shard);
+        }
+    }
+    Place(shard.current.load(std::memory_order_relaxed), node);
+    shard.size.store(shard.size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/**
+ * @return number of nodes in the table
+ */
+size_t QuadTreeNodeTable::Size() const {
+    size_t size = 0;
+    for (const Shard& shard : shards) {
+        size += shard.size.load(std::memory_order_relaxed);
+    }
+    return size;
+}
+
+/**
+ * @return memory used by the slot arrays in bytes
+ */
+size_t QuadTreeNodeTable::MemoryUsage() const {
+    size_t num_slots = 0;
+    for (const Shard& shard : shards) {
+        num_slots += shard.current.load(std::memory_order_relaxed)->capacity;
+        const SlotArray* old_table = shard.old.load(std::memory_order_relaxed);
+        if (old_table != 0) {
+            num_slots += old_table->capacity;
+        }
+        for (const SlotArray* table : shard.retired) {
+            num_slots += table->capacity;
+        }
+    }
+    return num_slots * sizeof(QuadTreeAtomicNodeRef);
+}
+
+/**
+ * @return memory used by the slot arrays that lookups can see, in bytes. Unlike MemoryUsage(), this is safe
+ * to call while other threads insert
+ */
+size_t QuadTreeNodeTable::LiveMemoryUsage() const {
+    size_t num_slots = 0;
+    for (const Shard& shard : shards) {
+        num_slots += shard.current.load(std::memory_order_acquire)->capacity;
+        const SlotArray* old_table = shard.old.load(std::memory_order_acquire);
+        if (old_table != 0) {
+            num_slots += old_table->capacity;
+        }
+    }
+    return num_slots * sizeof(QuadTreeAtomicNodeRef);
+}
+
+/**
+ * @return number of Find() and FindLeaf() calls so far, on all threads
+ */
+uint64_t QuadTreeNodeTable::NumLookups() const {
+    uint64_t lookups = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        lookups += lookup_stats[i].lookups;
+    }
+    return lookups;
+}
+
+/**
+ * @return number of slots that Find() and FindLeaf() have looked at so far, on all threads
+ */
+uint64_t QuadTreeNodeTable::NumProbes() const {
+    uint64_t probes = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        probes += lookup_stats[i].probes;
+    }
+    return probes;
+}
+
+/**
+ * Start growing a shard to twice its capacity. Called with the shard locked
+ * The old table is kept read only until every slot has been migrated, so its probe sequences stay intact
+ */
+void QuadTreeNodeTable::Grow(Shard &shard) {
+    while (shard.old.load(std::memory_order_relaxed) != 0) {
+        MigrateSome(shard);
+    }
+    SlotArray* table = shard.current.load(std::memory_order_relaxed);
+    shard.migrate_index = 0;
+    // lookups read current before old, so set old first and they never miss both
+    shard.old.store(table, std::memory_order_release);
+    shard.current.store(NewSlotArray(table->capacity << 1), std::memory_order_release);
+}
+
+/**
+ * Move a few slots from the shard's old table over to the current one. Called with the shard locked
+ */
+void QuadTreeNodeTable::MigrateSome(Shard &shard) {
+    SlotArray* old_table = shard.old.load(std::memory_order_relaxed);
+    SlotArray* table = shard.current.load(std::memory_order_relaxed);
+    size_t end = shard.migrate_index + kMigrateSlotsPerInsert;
+    if (end > old_table->capacity) {
+        end = old_table->capacity;
+    }
+    for (; shard.migrate_index < end; ++shard.migrate_index) {
+        QuadTreeNode* node = old_table->slots[shard.migrate_index].load(std::memory_order_relaxed);
+        if (node != 0) {
+            Place(table, node);
+        }
+    }
+    if (shard.migrate_index == old_table->capacity) {
+        // lookups on other threads could still be in the old table, so it's freed later by Reclaim()
+        shard.old.store(0, std::memory_order_release);
+        shard.retired.push_back(old_table);
+        has_retired.store(true, std::memory_order_relaxed);
+        shard.migrate_index = 0;
+    }
+}
+
+/**
+ * Insert a node into a table without growing or migrating
+ * @param node
+ */
+void QuadTreeNodeTable::Place(SlotArray* table, QuadTreeNode* node) {
+    size_t mask = table->capacity - 1;
+    size_t i = node->Hash() & mask;
+    while (table->slots[i].load(std::memory_order_relaxed) != 0) {
+        i = (i + 1) & mask;
+    }
+    table->slots[i].store(node, std::memory_order_release);
+}
+
+/**
+ * After removing nodes, move the remaining nodes so that no probe sequence runs into a hole
+ * We start right after an empty slot and re-place every node in order. A node can only move towards
+ * its home slot, and every slot between its home and its new position is filled by nodes we've already
+ * placed, so all lookups stay valid. We shrink the table if it has become mostly empty.
+ */
+void QuadTreeNodeTable::RepairChains(Shard &shard) {
+    SlotArray* table = shard.current.load(std::memory_order_relaxed);
+    // shrink if we're using less than an eighth of the table, by rebuilding it
+    if (table->capacity > kInitialCapacity && shard.size.load(std::memory_order_relaxed) < (table->capacity >> 3)) {
+        size_t new_capacity = table->capacity;
+        while (new_capacity > kInitialCapacity && shard.size.load(std::memory_order_relaxed) < (new_capacity >> 3)) {
+            new_capacity >>= 1;
+        }
+        SlotArray* new_table = NewSlotArray(new_capacity);
+        for (size_t i = 0; i < table->capacity; ++i) {
+            QuadTreeNode* node = table->slots[i].load(std::memory_order_relaxed);
+            if (node != 0) {
+                Place(new_table, node);
+            }
+        }
+        shard.current.store(new_table, std::memory_order_relaxed);
+        DeleteSlotArray(table);
+        return;
+    }
+
+    size_t mask = table->capacity - 1;
+    size_t start = 0;
+    while (table->slots[start].load(std::memory_order_relaxed) != 0) {
+        ++start;
+    }
+    for (size_t n = 1; n <= table->capacity; ++n) {
+        size_t i = (start + n) & mask;
+        QuadTreeNode* node = table->slots[i].load(std::memory_order_relaxed);
+        if (node != 0) {
+            table->slots[i].store(0, std::memory_order_relaxed);
+            Place(table, node);
+        }
+    }
+}
+
+/**
+ * Allocate an empty slot array
+ * @param capacity number of slots, a power of 2
+ */
+QuadTreeNodeTable::SlotArray* QuadTreeNodeTable::NewSlotArray(size_t capacity) {
+    SlotArray* table = new SlotArray();
+    table->capacity = capacity;
+    table->slots = new QuadTreeAtomicNodeRef[capacity];
+    for (size_t i = 0; i < capacity; ++i) {
+        table->slots[i].store(0, std::memory_order_relaxed);
+    }
+    return table;
+}
+
+/**
+ * Free a slot array, but not the nodes in it
+ */
+void QuadTreeNodeTable::DeleteSlotArray(SlotArray* table) {
+    if (table != 0) {
+        delete[] table->slots;
+        delete table;
+    }
+}
@@ -0,0 +1,367 @@
+//
+// Created by agent on 10/15/26.
+//
+
+#ifndef GOL_QUADTREENODETABLE_H
+#define GOL_QUADTREENODETABLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "quad_tree_node_heap.h"
+#include "quad_tree_thread_pool.h"
+
+class QuadTreeNode;
+
+/**
+ * Open addressing hash table used to make quad tree nodes canonical (hash consing)
+ *
+ * Nodes are stored directly in a flat array of 32 bit node indices (see QuadTreeNodeHeap) and probed linearly,
+ * so a lookup is a couple of cache lines instead of a walk through heap allocated buckets. Every node stores its
+ * own hash, which means we never need to recompute it when the table grows, and lookups are done
+ * with the four child pointers so callers don't need to build a temporary node. Leaves live in the same table
+ * and are looked up by their cells instead.
+ *
+ * Growing the table is incremental: when we pass our load factor we allocate a table twice the size
+ * and move a handful of slots over on every insert. Until that is done, lookups check both tables.
+ * This way a single insert never has to stall on rehashing millions of nodes.
+ *
+ * The table is safe to use from several threads while we evolve. It is split into shards by the top bits of the hash,
+ * and each shard is its own table with a spin lock. Lookups never take the lock: slots are only ever filled in while
+ * evolving, so a lookup either finds the canonical node or misses. A miss hands back where the node would go along with
+ * the shard's version, and Insert() uses that slot if the version hasn't changed. If another thread inserted or rehashed
+ * in the meantime, Insert() looks again while holding the lock. The locks are skipped unless SetNumThreads() says
+ * that more than one thread uses the table. Slot arrays that a rehash replaces are kept around
+ * until Reclaim(), because a lookup on another thread could still be reading them. Removing nodes isn't thread safe.
+ */
+class QuadTreeNodeTable {
+
+    public:
+
+        /**
+         * Where a node that Find() missed should be inserted, as long as its shard hasn't changed since
+         */
+        struct InsertHint {
+            size_t index;
+            uint32_t version;
+        };
+
+        /**
+         * Constructs an empty table
+         */
+        QuadTreeNodeTable();
+
+        /**
+         * Destructor, this does NOT free the nodes in the table
+         */
+        ~QuadTreeNodeTable();
+
+        /**
+         * Hash four child pointers into a well mixed 29 bit value
+         * @return hash for a non-leaf node with these children
+         */
+        static uint32_t Hash(const QuadTreeNode* nw, const QuadTreeNode* ne, const QuadTreeNode* sw, const QuadTreeNode* se);
+
+        /**
+         * Hash the cells of a leaf into a well mixed 29 bit value
+         * @return hash for a leaf node with these cells
+         */
+        static uint32_t HashLeaf(uint64_t bits);
+
+        /**
+         * Look up a non-leaf node by its children, without locking
+         * @param hash precalculated hash from Hash()
+         * @param hint if the node isn't found, this is where it should be inserted with Insert()
+         * @return the canonical node or 0 if it doesn't exist (or is being added by another thread right now)
+         */
+        QuadTreeNode* Find(const QuadTreeNode* nw, const QuadTreeNode* ne, const QuadTreeNode* sw, const QuadTreeNode* se,
+                           uint32_t hash, InsertHint &hint) const;
+
+        /**
+         * Look up a leaf node by its cells, without locking
+         * @param hash precalculated hash from HashLeaf()
+         * @param hint if the leaf isn't found, this is where it should be inserted with Insert()
+         * @return the canonical leaf or 0 if it doesn't exist (or is being added by another thread right now)
+         */
+        QuadTreeNode* FindLeaf(uint64_t bits, uint32_t hash, InsertHint &hint) const;
+
+        /**
+         * Insert a new node unless an equal node is already in the table, which can happen if another thread
+         * added it after our Find() missed
+         * @param node new node, its hash must already be set
+         * @param hint hint from the Find() or FindLeaf() call that missed
+         * @return the canonical node, which is node if it was inserted. Otherwise the caller still owns node
+         */
+        QuadTreeNode* Insert(QuadTreeNode* node, const InsertHint &hint);
+
+        /**
+         * Set how many threads use the table, which turns locking on if there is more than one. Not thread safe
+         * @param num_threads from 1 to QuadTreeThreadPool::kMaxThreads, each thread is identified by QuadTreeThreadPool::WorkerIndex()
+         */
+        void SetNumThreads(int num_threads);
+
+        /**
+         * Finish any incremental rehash that is in progress. Not thread safe
+         */
+        void FinishRehash();
+
+        /**
+         * Free slot arrays that rehashing replaced while lookups on other threads could have been reading them.
+         * Only call this when no other thread is using the table
+         */
+        void Reclaim();
+
+        /**
+         * Remove every node that the predicate returns true for. The predicate may free the node
+         * because it will never be touched by the table again. Not thread safe
+         * @param predicate bool(QuadTreeNode*)
+         * @return number of nodes removed
+         */
+        template <class Predicate>
+        size_t RemoveIf(Predicate predicate) {
+            Reclaim();
+            size_t removed = 0;
+            for (int shard_index = 0; shard_index < kNumShards; ++shard_index) {
+                removed += RemoveIfInShard(shard_index, predicate);
+            }
+            return removed;
+        }
+
+        /**
+         * Remove every node in one shard that the predicate returns true for, so that cleaning the whole table can be
+         * spread out over time. Not thread safe, and slot arrays it retires wait for Reclaim()
+         * @param shard_index [0, NumShards())
+         * @param predicate bool(QuadTreeNode*)
+         * @return number of nodes removed
+         */
+        template <class Predicate>
+        size_t RemoveIfInShard(int shard_index, Predicate predicate) {
+            Shard& shard = shards[shard_index];
+            while (shard.old.load(std::memory_order_relaxed) != 0) {
+                MigrateSome(shard);
+            }
+            SlotArray* table = shard.current.load(std::memory_order_relaxed);
+            size_t removed = 0;
+            for (size_t i = 0; i < table->capacity; ++i) {
+                QuadTreeNode* node = table->slots[i].load(std::memory_order_relaxed);
+                if (node != 0 && predicate(node)) {
+                    table->slots[i].store(0, std::memory_order_relaxed);
+                    ++removed;
+                }
+            }
+            shard.size.store(shard.size.load(std::memory_order_relaxed) - removed, std::memory_order_relaxed);
+            if (removed > 0) {
+                RepairChains(shard);
+            }
+            return removed;
+        }
+
+        /**
+         * @return number of shards, for RemoveIfInShard()
+         */
+        static int NumShards() { return kNumShards; }
+
+        /**
+         * Hide nodes whose mark doesn't match from Find() and FindLeaf(). An incremental garbage collection turns this
+         * on once marking is done, so nobody picks up a dead node while it's still waiting to be removed; they get a
+         * fresh copy instead. Don't call this in the middle of a step
+         * @param only_marked true to hide unmarked nodes, false to see every node again
+         * @param mark the store's current mark, see QuadTreeNode::IsMarked()
+         */
+        void SetVisibleMark(bool only_marked, uint32_t mark);
+
+        /**
+         * Empty the table and size it for a number of nodes, which are then put back one at a time with Restore().
+         * Garbage collection uses this to drop every dead node at once without looking at them. Not thread safe
+         * @param num_nodes number of nodes that are going to be restored
+         */
+        void Reset(size_t num_nodes);
+
+        /**
+         * Put a node back after Reset(). Not thread safe
+         * @param node a node that isn't in the table, with its hash set
+         */
+        void Restore(QuadTreeNode* node);
+
+        /**
+         * Visit every node in the table. Not thread safe
+         * @param visitor void(QuadTreeNode*)
+         */
+        template <class Visitor>
+        void ForEach(Visitor visitor) const {
+            for (const Shard& shard : shards) {
+                const SlotArray* table = shard.current.load(std::memory_order_relaxed);
+                for (size_t i = 0; i < table->capacity; ++i) {
+                    QuadTreeNode* node = table->slots[i].load(std::memory_order_relaxed);
+                    if (node != 0) {
+                        visitor(node);
+                    }
+                }
+                // nodes that haven't been moved over from the old table yet
+                const SlotArray* old_table = shard.old.load(std::memory_order_relaxed);
+                if (old_table != 0) {
+                    for (size_t i = shard.migrate_index; i < old_table->capacity; ++i) {
+                        QuadTreeNode* node = old_table->slots[i].load(std::memory_order_relaxed);
+                        if (node != 0) {
+                            visitor(node);
+                        }
+                    }
+                }
+            }
+        }
+
+        /**
+         * Remove all nodes from the table, but don't free them. Not thread safe
+         */
+        void Clear();
+
+        /**
+         * @return number of nodes in the table
+         */
+        size_t Size() const;
+
+        /**
+         * @return memory used by the slot arrays in bytes
+         */
+        size_t MemoryUsage() const;
+
+        /**
+         * @return memory used by the slot arrays that lookups can see, in bytes. Unlike MemoryUsage(), this is safe
+         * to call while other threads insert
+         */
+        size_t LiveMemoryUsage() const;
+
+        /**
+         * @return number of Find() and FindLeaf() calls so far, on all threads
+         */
+        uint64_t NumLookups() const;
+
+        /**
+         * @return number of slots that Find() and FindLeaf() have looked at so far, on all threads
+         */
+        uint64_t NumProbes() const;
+
+    private:
+
+        /**
+         * A power of 2 sized array of slots
+         */
+        struct SlotArray {
+            QuadTreeAtomicNodeRef* slots;
+            size_t capacity;
+        };
+
+        /**
+         * One shard of the table, which is a complete table on its own. Shards sit on their own cache lines so
+         * that threads inserting into different shards don't slow each other down
+         */
+        struct alignas(64) Shard {
+            // current table
+            std::atomic<SlotArray*> current;
+
+            // table we're migrating away from while growing, or 0
+            std::atomic<SlotArray*> old;
+
+            // number of nodes in both tables. Only changed under the lock, but Size() can read it from any thread
+            std::atomic<size_t> size;
+
+            // all old slots below this index have been migrated
+            size_t migrate_index;
+
+            // bumped by every insert, so Insert() knows whether a hint is still good
+            std::atomic<uint32_t> version;
+
+            // held while inserting, growing or migrating
+            std::atomic_flag lock;
+
+            // slot arrays we're done with, which are freed by Reclaim()
+            std::vector<SlotArray*> retired;
+        };
+
+        /**
+         * Lookup stats for one thread, on their own cache line
+         */
+        struct alignas(64) LookupStats {
+            uint64_t lookups;
+            uint64_t probes;
+        };
+
+        /**
+         * @return the shard a hash belongs to
+         */
+        Shard& ShardFor(uint32_t hash) { return shards[hash >> kShardShift]; }
+        const Shard& ShardFor(uint32_t hash) const { return shards[hash >> kShardShift]; }
+
+        /**
+         * Look for a node in the shard's current and old tables
+         * @param match bool(const QuadTreeNode*) that compares a node with the same hash to the key
+         * @param probes incremented by the number of slots we look at
+         * @param insert_index if not 0 and the node isn't found, set to the empty slot in the current table where it goes
+         * @return the node or 0
+         */
+        template <class Match>
+        QuadTreeNode* Lookup(const Shard &shard, uint32_t hash, Match match, size_t &probes, size_t* insert_index) const;
+
+        /**
+         * Start growing a shard to twice its capacity. Called with the shard locked
+         */
+        void Grow(Shard &shard);
+
+        /**
+         * Move a few slots from the shard's old table over to the current one. Called with the shard locked
+         */
+        void MigrateSome(Shard &shard);
+
+        /**
+         * Insert a node into a table without growing or migrating
+         * @param node
+         */
+        static void Place(SlotArray* table, QuadTreeNode* node);
+
+        /**
+         * After removing nodes, move the remaining nodes so that no probe sequence runs into a hole
+         */
+        void RepairChains(Shard &shard);
+
+        /**
+         * Allocate an empty slot array
+         * @param capacity number of slots, a power of 2
+         */
+        static SlotArray* NewSlotArray(size_t capacity);
+
+        /**
+         * Free a slot array, but not the nodes in it
+         */
+        static void DeleteSlotArray(SlotArray* table);
+
+    private:
+
+        // number of shards is 2^kShardBits, picked by the top bits of the hash so that the low bits still index slots
+        static const int kShardBits = 6;
+        static const int kNumShards = 1 << kShardBits;
+        static const int kShardShift = 29 - kShardBits;
+
+        Shard shards[kNumShards];
+
+        // number of threads that use the table, inserts lock their shard if this is more than 1
+        int num_threads;
+
+        // lookups match (hash_and_mark & visible_mask) against (hash | visible_mark), see SetVisibleMark()
+        uint32_t visible_mask;
+        uint32_t visible_mark;
+
+        // do any shards have retired slot arrays for Reclaim() to free?
+        std::atomic<bool> has_retired;
+
+        // stats, one per thread so that lookups never share a cache line
+        mutable LookupStats lookup_stats[QuadTreeThreadPool::kMaxThreads];
+
+        // starting number of slots per shard
+        static const size_t kInitialCapacity = 1 << 8;
+
+        // number of old slots to migrate per insert
+        static const size_t kMigrateSlotsPerInsert = 64;
+};
+
+#endif //GOL_QUADTREENODETABLE_H
@@ -0,0 +1,225 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <array>
+#include "quad_tree_png_encoder.h"
+
+namespace {
+    // base lengths and extra bits of the deflate length symbols 257 to 285
+    const uint16_t kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83,
+                                      99, 115, 131, 163, 195, 227, 258};
+    const uint8_t kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+
+    // base distances and extra bits of the deflate distance symbols 0 to 29
+    const uint16_t kDistanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+                                        1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    const uint8_t kDistanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11,
+                                        12, 12, 13, 13};
+}
+
+/**
+ * Encode an image
+ * @param pixels height rows of width pixels, north to south, with channels bytes per pixel
+ * @param width pixels across
+ * @param height pixels down
+ * @param channels 1 for grey, 3 for RGB
+ * @param png set to the PNG file
+ */
+void QuadTreePngEncoder::Encode(const uint8_t* pixels, size_t width, size_t height, int channels, std::vector<uint8_t>& png) {
+    static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    png.assign(kSignature, kSignature + 8);
+
+    std::vector<uint8_t> header;
+    WriteBigEndian((uint32_t) width, header);
+    WriteBigEndian((uint32_t) height, header);
+    header.push_back(8);                                // bits per channel
+    header.push_back((uint8_t) (channels == 3 ? 2 : 0)); // RGB or grey
+    header.push_back(0);                                // deflate
+    header.push_back(0);                                // filters per row
+    header.push_back(0);                                // not interlaced
+    WriteChunk("IHDR", header, png);
+
+    // every row starts with its filter, which is always none
+    size_t row_bytes = width * (size_t) channels;
+    std::vector<uint8_t> rows;
+    rows.reserve((row_bytes + 1) * height);
+    for (size_t y = 0; y < height; ++y) {
+        rows.push_back(0);
+        rows.insert(rows.end(), pixels + y * row_bytes, pixels + (y + 1) * row_bytes);
+    }
+    std::vector<uint8_t> data;
+    Deflate(rows.data(), rows.size(), row_bytes + 1, (size_t) channels, data);
+    WriteChunk("IDAT", data, png);
+    WriteChunk("IEND", std::vector<uint8_t>(), png);
+}
+
+/**
+ * Compress data into a zlib stream with one fixed Huffman deflate block
+ * @param data
+ * @param size
+ * @param stride bytes in a row, which is how far back to look for a match with the row above
+ * @param pixel_size bytes in a pixel, which is how far back to look for a repeated pixel
+ * @param out the stream is added to the end of this
+ */
+void QuadTreePngEncoder::Deflate(const uint8_t* data, size_t size, size_t stride, size_t pixel_size, std::vector<uint8_t>& out) {
+    // zlib header: deflate with a 32KB window, no dictionary, and a check that makes it a multiple of 31
+    out.push_back(0x78);
+    out.push_back(0x01);
+    BitWriter writer(out);
+    // the final block, with fixed Huffman codes
+    writer.Write(1, 1);
+    writer.Write(1, 2);
+    size_t distances[2] = {pixel_size, stride};
+    size_t i = 0;
+    while (i < size) {
+        size_t best_length = 0;
+        size_t best_distance = 0;
+        for (size_t distance : distances) {
+            if (distance > i || distance > kMaxDistance) {
+                continue;
+            }
+            size_t length = 0;
+            size_t max_length = size - i < kMaxMatch ? size - i : kMaxMatch;
+            while (length < max_length && data[i + length] == data[i + length - distance]) {
+                ++length;
+            }
+            if (length > best_length) {
+                best_length = length;
+                best_distance = distance;
+            }
+        }
+        if (best_length < 3) {
+            // literals 0 to 143 have 8 bit codes starting at 0x30, and 144 to 255 have 9 bit codes starting at 0x190
+            uint32_t literal = data[i];
+            if (literal < 144) {
+                writer.WriteCode(0x30 + literal, 8);
+            } else {
+                writer.WriteCode(0x190 + literal - 144, 9);
+            }
+            ++i;
+            continue;
+        }
+        int length_symbol = 28;
+        while (kLengthBase[length_symbol] > best_length) {
+            --length_symbol;
+        }
+        // length symbols 257 to 279 have 7 bit codes starting at 0, and 280 to 285 have 8 bit codes starting at 0xC0
+        if (length_symbol < 23) {
+            writer.WriteCode((uint32_t) length_symbol + 1, 7);
+        } else {
+            writer.WriteCode(0xC0 + (uint32_t) length_symbol - 23, 8);
+        }
+        writer.Write((uint32_t) (best_length - kLengthBase[length_symbol]), kLengthExtra[length_symbol]);
+        int distance_symbol = 29;
+        while (kDistanceBase[distance_symbol] > best_distance) {
+            --distance_symbol;
+        }
+        writer.WriteCode((uint32_t) distance_symbol, 5);
+        writer.Write((uint32_t) (best_distance - kDistanceBase[distance_symbol]), kDistanceExtra[distance_symbol]);
+        i += best_length;
+    }
+    // end of block
+    writer.WriteCode(0, 7);
+    writer.Flush();
+    WriteBigEndian(Adler32(data, size), out);
+}
+
+/**
+ * Add a chunk to a PNG file: its length, type, data and CRC
+ * @param type four letter chunk type
+ * @param data
+ * @param png
+ */
+void QuadTreePngEncoder::WriteChunk(const char* type, const std::vector<uint8_t>& data, std::vector<uint8_t>& png) {
+    WriteBigEndian((uint32_t) data.size(), png);
+    size_t start = png.size();
+    png.insert(png.end(), type, type + 4);
+    png.insert(png.end(), data.begin(), data.end());
+    // the CRC covers the type and the data
+    WriteBigEndian(Crc32(png.data() + start, png.size() - start, 0), png);
+}
+
+/**
+ * Add a 32 bit number to the end of a buffer, highest byte first
+ */
+void QuadTreePngEncoder::WriteBigEndian(uint32_t value, std::vector<uint8_t>& out) {
+    out.push_back((uint8_t) (value >> 24));
+    out.push_back((uint8_t) (value >> 16));
+    out.push_back((uint8_t) (value >> 8));
+    out.push_back((uint8_t) value);
+}
+
+/**
+ * @return CRC-32 of some bytes, continued from crc
+ */
+uint32_t QuadTreePngEncoder::Crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    // built once, on whichever frame writer thread gets here first
+    static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> crcs;
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) != 0 ? UINT32_C(0xEDB88320) ^ (c >> 1) : c >> 1;
+            }
+            crcs[n] = c;
+        }
+        return crcs;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+/**
+ * @return Adler-32 of some bytes
+ */
+uint32_t QuadTreePngEncoder::Adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < size; ++i) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+/**
+ * @param value bits to write, lowest first
+ * @param count number of bits
+ */
+void QuadTreePngEncoder::BitWriter::Write(uint32_t value, int count) {
+    for (int i = 0; i < count; ++i) {
+        bits |= ((value >> i) & 1) << num_bits;
+        if (++num_bits == 8) {
+            out.push_back((uint8_t) bits);
+            bits = 0;
+            num_bits = 0;
+        }
+    }
+}
+
+/**
+ * Write a Huffman code, which deflate stores highest bit first
+ * @param code
+ * @param count number of bits in the code
+ */
+void QuadTreePngEncoder::BitWriter::WriteCode(uint32_t code, int count) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; ++i) {
+        reversed |= ((code >> i) & 1) << (count - 1 - i);
+    }
+    Write(reversed, count);
+}
+
+/**
+ * Write out the last partial byte
+ */
+void QuadTreePngEncoder::BitWriter::Flush() {
+    if (num_bits != 0) {
+        out.push_back((uint8_t) bits);
+        bits = 0;
+        num_bits = 0;
+    }
+}
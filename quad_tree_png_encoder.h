@@ -0,0 +1,105 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREEPNGENCODER_H
+#define GOL_QUADTREEPNGENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * Small PNG encoder for 8 bit grey or RGB images, so that we can write frames without linking zlib or libpng
+ *
+ * Rows aren't filtered, and the image data is one deflate block with the fixed Huffman codes. Matches are only looked
+ * for one pixel back and one row back, which finds the long runs of empty space and the still lifes Life images are
+ * mostly made of, and needs no hash table. Anything that decodes PNG can read the result, it's just bigger than what
+ * zlib would make of busy images.
+ */
+class QuadTreePngEncoder {
+
+    public:
+
+        /**
+         * Encode an image
+         * @param pixels height rows of width pixels, north to south, with channels bytes per pixel
+         * @param width pixels across
+         * @param height pixels down
+         * @param channels 1 for grey, 3 for RGB
+         * @param png set to the PNG file
+         */
+        static void Encode(const uint8_t* pixels, size_t width, size_t height, int channels, std::vector<uint8_t>& png);
+
+    private:
+
+        /**
+         * Writes bits into bytes, the lowest bit first like deflate wants
+         */
+        class BitWriter {
+            public:
+                explicit BitWriter(std::vector<uint8_t>& out) : out(out), bits(0), num_bits(0) {}
+
+                /**
+                 * @param value bits to write, lowest first
+                 * @param count number of bits
+                 */
+                void Write(uint32_t value, int count);
+
+                /**
+                 * Write a Huffman code, which deflate stores highest bit first
+                 * @param code
+                 * @param count number of bits in the code
+                 */
+                void WriteCode(uint32_t code, int count);
+
+                /**
+                 * Write out the last partial byte
+                 */
+                void Flush();
+
+            private:
+                std::vector<uint8_t>& out;
+                uint32_t bits;
+                int num_bits;
+        };
+
+        /**
+         * Compress data into a zlib stream with one fixed Huffman deflate block
+         * @param data
+         * @param size
+         * @param stride bytes in a row, which is how far back to look for a match with the row above
+         * @param pixel_size bytes in a pixel, which is how far back to look for a repeated pixel
+         * @param out the stream is added to the end of this
+         */
+        static void Deflate(const uint8_t* data, size_t size, size_t stride, size_t pixel_size, std::vector<uint8_t>& out);
+
+        /**
+         * Add a chunk to a PNG file: its length, type, data and CRC
+         * @param type four letter chunk type
+         * @param data
+         * @param png
+         */
+        static void WriteChunk(const char* type, const std::vector<uint8_t>& data, std::vector<uint8_t>& png);
+
+        /**
+         * Add a 32 bit number to the end of a buffer, highest byte first
+         */
+        static void WriteBigEndian(uint32_t value, std::vector<uint8_t>& out);
+
+        /**
+         * @return CRC-32 of some bytes, continued from crc
+         */
+        static uint32_t Crc32(const uint8_t* data, size_t size, uint32_t crc);
+
+        /**
+         * @return Adler-32 of some bytes
+         */
+        static uint32_t Adler32(const uint8_t* data, size_t size);
+
+        // longest match and farthest distance deflate can encode
+        static const size_t kMaxMatch = 258;
+        static const size_t kMaxDistance = 32768;
+};
+
+#endif //GOL_QUADTREEPNGENCODER_H
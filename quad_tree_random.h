@@ -0,0 +1,121 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREERANDOM_H
+#define GOL_QUADTREERANDOM_H
+
+#include <cstdint>
+
+/**
+ * Small, fast, seeded random number generator for building random soups
+ *
+ * This is xoshiro256** (http://prng.di.unimi.it/), seeded with splitmix64 so that any 64 bit seed, including 0, gives
+ * a good state. The same seed always gives the same numbers on every platform, so soups built from a seed can be
+ * rebuilt exactly, which std::random_device can't do.
+ *
+ * Bits() fills a whole word with cells at once, so a leaf of 64 cells only costs a few calls.
+ */
+class QuadTreeRandom {
+
+    public:
+
+        /**
+         * Number of bits of precision a density is rounded to
+         */
+        static const int kDensityBits = 16;
+
+        /**
+         * Constructs a generator from a seed
+         * @param seed
+         */
+        explicit QuadTreeRandom(uint64_t seed) {
+            for (uint64_t& word : state) {
+                seed += UINT64_C(0x9E3779B97F4A7C15);
+                uint64_t z = seed;
+                z = (z ^ (z >> 30)) * UINT64_C(0xBF58476D1CE4E5B9);
+                z = (z ^ (z >> 27)) * UINT64_C(0x94D049BB133111EB);
+                word = z ^ (z >> 31);
+            }
+        }
+
+        /**
+         * @return the next 64 random bits
+         */
+        uint64_t Next() {
+            uint64_t result = Rotate(state[1] * 5, 7) * 9;
+            uint64_t t = state[1] << 17;
+            state[2] ^= state[0];
+            state[3] ^= state[1];
+            state[1] ^= state[2];
+            state[0] ^= state[3];
+            state[2] ^= t;
+            state[3] = Rotate(state[3], 45);
+            return result;
+        }
+
+        /**
+         * Turn a density into the threshold Bits() takes
+         * @param density chance of a bit being set, clamped to [0, 1]
+         * @return density rounded to kDensityBits bits, as a fraction of 2^kDensityBits
+         */
+        static uint32_t Threshold(double density) {
+            if (!(density > 0.0)) {
+                return 0;
+            }
+            if (density >= 1.0) {
+                return UINT32_C(1) << kDensityBits;
+            }
+            return (uint32_t) (density * (double) (UINT32_C(1) << kDensityBits) + 0.5);
+        }
+
+        /**
+         * Get a word where every bit is set with the same chance
+         *
+         * We go through the binary digits of the threshold from the lowest set one up, ORing in a fresh random word
+         * for a 1 and ANDing for a 0. Each step halves the chance of a bit so far and adds a half for a 1, so we end up
+         * with exactly threshold / 2^kDensityBits. Densities like 1/2 or 3/8 only take a couple of calls
+         * @param threshold from Threshold()
+         * @return random bits
+         */
+        uint64_t Bits(uint32_t threshold) {
+            if (threshold == 0) {
+                return 0;
+            }
+            if (threshold >= (UINT32_C(1) << kDensityBits)) {
+                return UINT64_MAX;
+            }
+            int bit = 0;
+            while (((threshold >> bit) & 1) == 0) {
+                ++bit;
+            }
+            uint64_t bits = Next();
+            for (++bit; bit < kDensityBits; ++bit) {
+                if ((threshold >> bit) & 1) {
+                    bits |= Next();
+                } else {
+                    bits &= Next();
+                }
+            }
+            return bits;
+        }
+
+    private:
+
+        /**
+         * Rotate a word left
+         * @param value
+         * @param shift [1, 63]
+         * @return rotated value
+         */
+        static uint64_t Rotate(uint64_t value, int shift) {
+            return (value << shift) | (value >> (64 - shift));
+        }
+
+    private:
+
+        // xoshiro256** state, never all zero
+        uint64_t state[4];
+};
+
+#endif //GOL_QUADTREERANDOM_H
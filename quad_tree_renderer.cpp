@@ -0,0 +1,239 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <algorithm>
+#include "quad_tree_renderer.h"
+#include "quad_tree_leaf_kernel.h"
+
+/**
+ * @param root root of the tree to render, which mustn't change while we render
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ */
+QuadTreeRenderer::QuadTreeRenderer(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y) {
+    this->root = root;
+    this->origin_x = origin_x;
+    this->origin_y = origin_y;
+    zoom = 0;
+    width = 0;
+    height = 0;
+    densities = 0;
+    bitmap = 0;
+    row_words = 0;
+}
+
+/**
+ * Render the share of alive cells in every pixel of a viewport
+ * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+ * @param width pixels across
+ * @param height pixels down
+ * @param density width * height bytes, row by row north to south. Each is the share of the pixel's cells that
+ * are alive in 255ths, and only 0 if none are
+ */
+void QuadTreeRenderer::RenderDensity(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint8_t* density) {
+    this->zoom = zoom;
+    this->width = (int64_t) width;
+    this->height = (int64_t) height;
+    densities = density;
+    bitmap = 0;
+    std::fill(density, density + width * height, (uint8_t) 0);
+    Render(x0, y0);
+}
+
+/**
+ * Render which pixels of a viewport have any alive cells
+ * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+ * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+ * @param width pixels across
+ * @param height pixels down
+ * @param bitmap height rows of OccupancyWords(width) words each, north to south. Pixel (i, j) is bit i % 64 of
+ * word i / 64 of row j
+ */
+void QuadTreeRenderer::RenderOccupancy(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint64_t* bitmap) {
+    this->zoom = zoom;
+    this->width = (int64_t) width;
+    this->height = (int64_t) height;
+    densities = 0;
+    this->bitmap = bitmap;
+    row_words = OccupancyWords(width);
+    std::fill(bitmap, bitmap + row_words * height, UINT64_C(0));
+    Render(x0, y0);
+}
+
+/**
+ * Shared part of both renders, once the output is set
+ */
+void QuadTreeRenderer::Render(const coordinate_type& x0, const coordinate_type& y0) {
+    if (root->empty || width == 0 || height == 0) {
+        return;
+    }
+    int level = Level(root);
+    const QuadTreeNode* children[4] = {root->nw, root->ne, root->sw, root->se};
+#if (ENABLE_BIG_INT)
+    // the viewport's northwest pixel, in pixels from the root's center
+    mpz_class pixel_x = x0 - origin_x;
+    mpz_class pixel_y = y0 - origin_y;
+    mpz_fdiv_q_2exp(pixel_x.get_mpz_t(), pixel_x.get_mpz_t(), (mp_bitcnt_t) zoom);
+    mpz_fdiv_q_2exp(pixel_y.get_mpz_t(), pixel_y.get_mpz_t(), (mp_bitcnt_t) zoom);
+
+    // the root is centered on the corner of a pixel rather than lined up with one, so we start from its children,
+    // whose corners are 2^(level-1) cells from its center
+    mpz_class half = 0;
+    mpz_setbit(half.get_mpz_t(), (mp_bitcnt_t) level - 1);
+    mpz_class corners[4][2] = {{-half, -half}, {0, -half}, {-half, 0}, {0, 0}};
+    for (int i = 0; i < 4; ++i) {
+        mpz_class& x = corners[i][0];
+        mpz_class& y = corners[i][1];
+        mpz_fdiv_q_2exp(x.get_mpz_t(), x.get_mpz_t(), (mp_bitcnt_t) zoom);
+        mpz_fdiv_q_2exp(y.get_mpz_t(), y.get_mpz_t(), (mp_bitcnt_t) zoom);
+        x -= pixel_x;
+        y -= pixel_y;
+        if (level - 1 >= zoom) {
+            RenderBig(children[i], x, y);
+        } else if (!children[i]->empty && x >= 0 && x < width && y >= 0 && y < height) {
+            // the whole tree is a few pixels, so a child is only part of one
+            Plot(x.get_si(), y.get_si(), children[i]->density, 2 * (zoom - (level - 1)));
+        }
+    }
+#else
+    // the viewport's northwest pixel, in pixels from the root's center, rounded down
+    int64_t pixel_x = (x0 - origin_x) >= 0 ? (x0 - origin_x) >> zoom : ~(~(x0 - origin_x) >> zoom);
+    int64_t pixel_y = (y0 - origin_y) >= 0 ? (y0 - origin_y) >> zoom : ~(~(y0 - origin_y) >> zoom);
+
+    // the root is centered on the corner of a pixel rather than lined up with one, so we start from its children,
+    // whose corners are 2^(level-1) cells from its center
+    int64_t half = INT64_C(1) << (level - 1);
+    int64_t corners[4][2] = {{-half, -half}, {0, -half}, {-half, 0}, {0, 0}};
+    for (int i = 0; i < 4; ++i) {
+        int64_t x = (corners[i][0] >= 0 ? corners[i][0] >> zoom : ~(~corners[i][0] >> zoom)) - pixel_x;
+        int64_t y = (corners[i][1] >= 0 ? corners[i][1] >> zoom : ~(~corners[i][1] >> zoom)) - pixel_y;
+        if (level - 1 >= zoom) {
+            Render(children[i], x, y);
+        } else if (!children[i]->empty && x >= 0 && x < width && y >= 0 && y < height) {
+            // the whole tree is a few pixels, so a child is only part of one
+            Plot(x, y, children[i]->density, 2 * (zoom - (level - 1)));
+        }
+    }
+#endif
+}
+
+#if (ENABLE_BIG_INT)
+/**
+ * Render a node more than 2^kMaxOffsetLevel pixels wide
+ * @param node node at least as big as a pixel
+ * @param x pixel offset of the node's northwest corner from the viewport's
+ * @param y pixel offset of the node's northwest corner from the viewport's
+ */
+void QuadTreeRenderer::RenderBig(const QuadTreeNode* node, const mpz_class& x, const mpz_class& y) {
+    if (node->empty) {
+        return;
+    }
+    int shift = Level(node) - zoom;
+    mpz_class size = 0;
+    mpz_setbit(size.get_mpz_t(), (mp_bitcnt_t) shift);
+    if (x >= width || y >= height || x + size <= 0 || y + size <= 0) {
+        return;
+    }
+    if (shift <= kMaxOffsetLevel) {
+        // we overlap the viewport, so our corner is less than 2^kMaxOffsetLevel pixels from it
+        Render(node, x.get_si(), y.get_si());
+        return;
+    }
+    mpz_class half = size / 2;
+    RenderBig(node->nw, x, y);
+    RenderBig(node->ne, x + half, y);
+    RenderBig(node->sw, x, y + half);
+    RenderBig(node->se, x + half, y + half);
+}
+#endif
+
+/**
+ * Render a node at least as big as a pixel
+ * @param node
+ * @param x pixel offset of the node's northwest corner from the viewport's
+ * @param y pixel offset of the node's northwest corner from the viewport's
+ */
+void QuadTreeRenderer::Render(const QuadTreeNode* node, int64_t x, int64_t y) {
+    if (node->empty) {
+        return;
+    }
+    int level = Level(node);
+    int64_t size = INT64_C(1) << (level - zoom);
+    if (x >= width || y >= height || x + size <= 0 || y + size <= 0) {
+        return;
+    }
+    if (size == 1) {
+        // we're the pixel
+        Plot(x, y, node->density, 0);
+        return;
+    }
+    if (level == QuadTreeNode::kLeafLevel) {
+        RenderLeaf(node, x, y);
+        return;
+    }
+    // our quadrants tell us which children are empty, so we never look at them
+    int64_t half = size / 2;
+    if ((node->quadrants & QuadTreeNode::kNorthwest) != 0) {
+        Render(node->nw, x, y);
+    }
+    if ((node->quadrants & QuadTreeNode::kNortheast) != 0) {
+        Render(node->ne, x + half, y);
+    }
+    if ((node->quadrants & QuadTreeNode::kSouthwest) != 0) {
+        Render(node->sw, x, y + half);
+    }
+    if ((node->quadrants & QuadTreeNode::kSoutheast) != 0) {
+        Render(node->se, x + half, y + half);
+    }
+}
+
+/**
+ * Render a leaf that's bigger than a pixel, counting its cells in each pixel
+ * @param node
+ * @param x pixel offset of the leaf's northwest corner from the viewport's
+ * @param y pixel offset of the leaf's northwest corner from the viewport's
+ */
+void QuadTreeRenderer::RenderLeaf(const QuadTreeNode* node, int64_t x, int64_t y) {
+    int cells = 1 << zoom;
+    int pixels = (1 << QuadTreeNode::kLeafLevel) >> zoom;
+    // the cells of the northwest pixel, which we slide over the others. Leaf rows are bytes and columns are bits
+    uint64_t block = QuadTreeLeafKernel::RectMask(-4, -4, cells - 5, cells - 5);
+    for (int j = 0; j < pixels; ++j) {
+        if (y + j < 0 || y + j >= height) {
+            continue;
+        }
+        for (int i = 0; i < pixels; ++i) {
+            if (x + i < 0 || x + i >= width) {
+                continue;
+            }
+            uint64_t count = QuadTreeLeafKernel::PopCount(node->bits & (block << (j * cells * 8 + i * cells)));
+            // a pixel is at most 16 cells here, so one alive cell is already more than 1 in 255
+            Plot(x + i, y + j, (uint8_t) ((count * 255 + (UINT64_C(1) << (2 * zoom)) / 2) >> (2 * zoom)), 0);
+        }
+    }
+}
+
+/**
+ * Add a node's cells to a pixel
+ * @param x pixel, which has to be in the viewport
+ * @param y pixel, which has to be in the viewport
+ * @param density share of alive cells in the node in 255ths, 0 if it's empty
+ * @param shift 2 * how many levels smaller than a pixel the node is
+ */
+void QuadTreeRenderer::Plot(int64_t x, int64_t y, uint8_t density, int shift) {
+    if (density == 0) {
+        return;
+    }
+    if (bitmap != 0) {
+        bitmap[(size_t) y * row_words + (size_t) x / 64] |= UINT64_C(1) << (x % 64);
+        return;
+    }
+    uint8_t& pixel = densities[(size_t) y * (size_t) width + (size_t) x];
+    // a node 16 times smaller than the pixel or more adds less than half of a 255th, unless it's a big one
+    uint32_t added = shift <= 8 ? ((uint32_t) density + ((UINT32_C(1) << shift) >> 1)) >> shift : 0;
+    uint32_t value = pixel + added;
+    pixel = (uint8_t) (value > 255 ? 255 : (value == 0 ? 1 : value));
+}
@@ -0,0 +1,145 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREERENDERER_H
+#define GOL_QUADTREERENDERER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+
+#if (ENABLE_BIG_INT)
+#include <gmpxx.h>
+#endif
+
+/**
+ * Renders a viewport of a tree at any zoom into an image the caller owns, either 8 bit density or 1 bit occupancy
+ *
+ * At zoom z every pixel is a 2^z x 2^z square of cells, and the squares are aligned to the tree so that every node at
+ * level z is exactly one pixel. We descend only into nodes that overlap the viewport and aren't empty, and stop at the
+ * node that is the pixel, whose density byte is the pixel's density. Below level 3 a leaf covers several pixels, and
+ * we count its cells for each of them. So rendering costs about one node per pixel, whatever the population or the
+ * level of the tree.
+ *
+ * Nodes more than 2^62 pixels wide are walked with big integers, and everything below them with 64 bit pixel offsets
+ * from the viewport.
+ */
+class QuadTreeRenderer {
+
+    public:
+
+        /**
+         * @param root root of the tree to render, which mustn't change while we render
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         */
+        QuadTreeRenderer(const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y);
+
+        /**
+         * Render the share of alive cells in every pixel of a viewport
+         * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+         * @param width pixels across
+         * @param height pixels down
+         * @param density width * height bytes, row by row north to south. Each is the share of the pixel's cells that
+         * are alive in 255ths, and only 0 if none are
+         */
+        void RenderDensity(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint8_t* density);
+
+        /**
+         * Render which pixels of a viewport have any alive cells
+         * @param x0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param y0 display coordinate in the viewport's northwest pixel, which is rounded down to the pixel's corner
+         * @param zoom each pixel is 2^zoom x 2^zoom cells, zoom >= 0
+         * @param width pixels across
+         * @param height pixels down
+         * @param bitmap height rows of OccupancyWords(width) words each, north to south. Pixel (i, j) is bit i % 64 of
+         * word i / 64 of row j
+         */
+        void RenderOccupancy(const coordinate_type& x0, const coordinate_type& y0, int zoom, size_t width, size_t height, uint64_t* bitmap);
+
+        /**
+         * @param width pixels across
+         * @return number of words in each row of an occupancy bitmap
+         */
+        static size_t OccupancyWords(size_t width) { return (width + 63) / 64; }
+
+        // nodes up to 2^kMaxOffsetLevel pixels wide are rendered with 64 bit pixel offsets
+        static const int kMaxOffsetLevel = 62;
+
+    private:
+
+        /**
+         * Shared part of both renders, once the output is set
+         */
+        void Render(const coordinate_type& x0, const coordinate_type& y0);
+
+    #if (ENABLE_BIG_INT)
+        /**
+         * Render a node more than 2^kMaxOffsetLevel pixels wide
+         * @param node node at least as big as a pixel
+         * @param x pixel offset of the node's northwest corner from the viewport's
+         * @param y pixel offset of the node's northwest corner from the viewport's
+         */
+        void RenderBig(const QuadTreeNode* node, const mpz_class& x, const mpz_class& y);
+    #endif
+
+        /**
+         * Render a node at least as big as a pixel
+         * @param node
+         * @param x pixel offset of the node's northwest corner from the viewport's
+         * @param y pixel offset of the node's northwest corner from the viewport's
+         */
+        void Render(const QuadTreeNode* node, int64_t x, int64_t y);
+
+        /**
+         * Render a leaf that's bigger than a pixel, counting its cells in each pixel
+         * @param node
+         * @param x pixel offset of the leaf's northwest corner from the viewport's
+         * @param y pixel offset of the leaf's northwest corner from the viewport's
+         */
+        void RenderLeaf(const QuadTreeNode* node, int64_t x, int64_t y);
+
+        /**
+         * Add a node's cells to a pixel
+         * @param x pixel, which has to be in the viewport
+         * @param y pixel, which has to be in the viewport
+         * @param density share of alive cells in the node in 255ths, 0 if it's empty
+         * @param shift 2 * how many levels smaller than a pixel the node is
+         */
+        void Plot(int64_t x, int64_t y, uint8_t density, int shift);
+
+        /**
+         * @param node
+         * @return the node's level as an int
+         */
+        static int Level(const QuadTreeNode* node) {
+        #if (ENABLE_INFINITE_LEVELS)
+            return (int) node->level.get_si();
+        #else
+            return node->level;
+        #endif
+        }
+
+    private:
+
+        // the tree
+        const QuadTreeNode* root;
+        coordinate_type origin_x;
+        coordinate_type origin_y;
+
+        // the viewport, in pixels of 2^zoom x 2^zoom cells
+        int zoom;
+        int64_t width;
+        int64_t height;
+
+        // the image we render into, one of them is 0
+        uint8_t* densities;
+        uint64_t* bitmap;
+        size_t row_words;
+};
+
+#endif //GOL_QUADTREERENDERER_H
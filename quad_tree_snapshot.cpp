@@ -0,0 +1,261 @@
+//
+// Created by agent on 10/16/26.
+//
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "quad_tree_snapshot.h"
+#include "quad_tree_node_store.h"
+
+const char* const QuadTreeSnapshot::kRule = "B3/S23";
+const char QuadTreeSnapshot::kMagic[8] = {'G', 'O', 'L', 'S', 'N', 'A', 'P', 1};
+
+/**
+ * Save a tree
+ * @param path file to write, which is replaced once the new one has been written whole
+ * @param root root of the tree, which mustn't change or be collected while we save
+ * @param origin_x display coordinate of the root's center
+ * @param origin_y display coordinate of the root's center
+ * @param generation the tree's generation
+ * @return false if the file couldn't be written
+ */
+bool QuadTreeSnapshot::Save(const std::string& path, const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y,
+                            const generation_type& generation) {
+    // number every distinct node children first, leaves and other nodes separately. The stack holds nodes to visit,
+    // and whether we've pushed their children yet
+    std::unordered_map<const QuadTreeNode*, uint32_t> ids;
+    std::vector<uint64_t> leaves;
+    std::vector<const QuadTreeNode*> nodes;
+    std::vector<std::pair<const QuadTreeNode*, bool>> stack(1, std::make_pair(root, false));
+    while (!stack.empty()) {
+        std::pair<const QuadTreeNode*, bool> frame = stack.back();
+        stack.pop_back();
+        const QuadTreeNode* node = frame.first;
+        if (ids.find(node) != ids.end()) {
+            continue;
+        }
+        if (node->level == QuadTreeNode::kLeafLevel) {
+            ids[node] = (uint32_t) leaves.size();
+            leaves.push_back(node->bits);
+        } else if (frame.second) {
+            ids[node] = (uint32_t) nodes.size();
+            nodes.push_back(node);
+        } else {
+            stack.push_back(std::make_pair(node, true));
+            const QuadTreeNode* children[4] = {node->nw, node->ne, node->sw, node->se};
+            for (const QuadTreeNode* child : children) {
+                if (ids.find(child) == ids.end()) {
+                    stack.push_back(std::make_pair(child, false));
+                }
+            }
+        }
+    }
+    // ids are 32 bits, like the store's node indices
+    if (leaves.size() + nodes.size() > UINT32_MAX) {
+        return false;
+    }
+    uint64_t num_leaves = leaves.size();
+    std::vector<uint32_t> children;
+    children.reserve(nodes.size() * 4);
+    for (const QuadTreeNode* node : nodes) {
+        const QuadTreeNode* quadrants[4] = {node->nw, node->ne, node->sw, node->se};
+        for (const QuadTreeNode* child : quadrants) {
+            children.push_back(child->level == QuadTreeNode::kLeafLevel ? ids[child] : (uint32_t) (num_leaves + ids[child]));
+        }
+    }
+
+    std::ostringstream text;
+    text << kRule << '\0' << origin_x << '\0' << origin_y << '\0' << generation << '\0';
+    std::string fields = text.str();
+    fields.resize((fields.size() + 7) / 8 * 8, '\0');
+    Header header;
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.byte_order = kByteOrder;
+    header.header_bytes = (uint32_t) (sizeof(Header) + fields.size());
+    header.num_leaves = num_leaves;
+    header.num_nodes = nodes.size();
+    header.root = root->level == QuadTreeNode::kLeafLevel ? ids[root] : num_leaves + ids[root];
+
+    // write next to the old file and then replace it, so there's always a whole snapshot at path
+    std::string temporary_path = path + ".tmp";
+    FILE* out = std::fopen(temporary_path.c_str(), "wb");
+    if (out == 0) {
+        return false;
+    }
+    bool written = std::fwrite(&header, sizeof(Header), 1, out) == 1
+                   && std::fwrite(fields.data(), 1, fields.size(), out) == fields.size()
+                   && std::fwrite(leaves.data(), sizeof(uint64_t), leaves.size(), out) == leaves.size()
+                   && std::fwrite(children.data(), sizeof(uint32_t), children.size(), out) == children.size();
+    // the data has to be on disk before the rename is, or a crash could leave us with a renamed but empty file
+    written = written && std::fflush(out) == 0 && fsync(fileno(out)) == 0;
+    written = std::fclose(out) == 0 && written;
+    if (!written || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+    // and the rename is only on disk once the directory is. Some file systems can't sync a directory, and the new
+    // snapshot is in place either way, so this is as far as we can go
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int directory_file = open(directory.c_str(), O_RDONLY);
+    if (directory_file >= 0) {
+        fsync(directory_file);
+        close(directory_file);
+    }
+    return true;
+}
+
+/**
+ * Load a tree
+ * @param path file to read
+ * @param store store to create nodes in
+ * @param origin_x set to the display coordinate of the root's center
+ * @param origin_y set to the display coordinate of the root's center
+ * @param generation set to the tree's generation
+ * @return the root, or 0 if the file couldn't be read or isn't a snapshot, in which case nothing is set
+ */
+QuadTreeNode* QuadTreeSnapshot::Load(const std::string& path, QuadTreeNodeStore& store, coordinate_type& origin_x, coordinate_type& origin_y,
+                                     generation_type& generation) {
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size < (off_t) sizeof(Header)) {
+        close(file);
+        return 0;
+    }
+    size_t size = (size_t) info.st_size;
+    void* memory = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (memory == MAP_FAILED) {
+        return 0;
+    }
+#if defined(__linux__)
+    // we read it front to back once
+    madvise(memory, size, MADV_SEQUENTIAL);
+#endif
+    const Header* header = (const Header*) memory;
+    QuadTreeNode* root = 0;
+    std::string fields[4];
+    coordinate_type new_origin_x;
+    coordinate_type new_origin_y;
+    generation_type new_generation;
+    bool valid = std::memcmp(header->magic, kMagic, sizeof(kMagic)) == 0 && header->byte_order == kByteOrder
+                 && header->header_bytes >= sizeof(Header) && header->header_bytes % 8 == 0 && header->header_bytes <= size;
+    if (valid) {
+        // the records have to fill the rest of the file exactly
+        size_t record_bytes = size - header->header_bytes;
+        valid = header->num_leaves <= record_bytes / sizeof(uint64_t)
+                && header->num_nodes <= record_bytes / (4 * sizeof(uint32_t))
+                && record_bytes - header->num_leaves * sizeof(uint64_t) == header->num_nodes * 4 * sizeof(uint32_t)
+                && header->root < header->num_leaves + header->num_nodes;
+    }
+    if (valid) {
+        valid = ReadFields((const char*) memory + sizeof(Header), header->header_bytes - sizeof(Header), fields)
+                && fields[0] == kRule && ParseNumber(fields[1], new_origin_x) && ParseNumber(fields[2], new_origin_y)
+                && ParseNumber(fields[3], new_generation);
+    }
+    if (valid) {
+        root = Build(header, store);
+    }
+    munmap(memory, size);
+    if (root != 0) {
+        origin_x = new_origin_x;
+        origin_y = new_origin_y;
+        generation = new_generation;
+    }
+    return root;
+}
+
+/**
+ * Read the fields after the header
+ * @param fields start of the fields
+ * @param size bytes of fields
+ * @param values set to the rule, origin x, origin y and generation
+ * @return false if there aren't four NUL terminated strings
+ */
+bool QuadTreeSnapshot::ReadFields(const char* fields, size_t size, std::string values[4]) {
+    size_t start = 0;
+    for (int i = 0; i < 4; ++i) {
+        const void* end = std::memchr(fields + start, '\0', size - start);
+        if (end == 0) {
+            return false;
+        }
+        size_t length = (size_t) ((const char*) end - (fields + start));
+        values[i].assign(fields + start, length);
+        start += length + 1;
+    }
+    return true;
+}
+
+/**
+ * @param text a decimal number
+ * @param value set to the number
+ * @return false if text isn't one
+ */
+#if (ENABLE_BIG_INT)
+bool QuadTreeSnapshot::ParseNumber(const std::string& text, mpz_class& value) {
+    return !text.empty() && value.set_str(text, 10) == 0;
+}
+#else
+bool QuadTreeSnapshot::ParseNumber(const std::string& text, int64_t& value) {
+    char* end = 0;
+    errno = 0;
+    long long number = std::strtoll(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || errno != 0) {
+        return false;
+    }
+    value = (int64_t) number;
+    return true;
+}
+#endif
+
+/**
+ * Build the nodes of a mapped snapshot
+ * @param header the mapped file's header, which has been checked against its size
+ * @param store store to create nodes in
+ * @return the root, or 0 if a node's children aren't valid
+ */
+QuadTreeNode* QuadTreeSnapshot::Build(const Header* header, QuadTreeNodeStore& store) {
+    uint64_t num_leaves = header->num_leaves;
+    uint64_t num_ids = num_leaves + header->num_nodes;
+    // a tree's root is above the leaves, and ids are 32 bits
+    if (header->root < num_leaves || num_ids > UINT32_MAX) {
+        return 0;
+    }
+    std::vector<QuadTreeNode*> nodes((size_t) num_ids);
+    const uint64_t* leaves = (const uint64_t*) ((const char*) header + header->header_bytes);
+    for (uint64_t id = 0; id < num_leaves; ++id) {
+        nodes[id] = store.CanonicalLeaf(leaves[id]);
+    }
+    const uint32_t* children = (const uint32_t*) (leaves + num_leaves);
+    for (uint64_t id = num_leaves; id < num_ids; ++id, children += 4) {
+        // children come before their parents, so they've all been built
+        if (children[0] >= id || children[1] >= id || children[2] >= id || children[3] >= id) {
+            return 0;
+        }
+        QuadTreeNode* nw = nodes[children[0]];
+        QuadTreeNode* ne = nodes[children[1]];
+        QuadTreeNode* sw = nodes[children[2]];
+        QuadTreeNode* se = nodes[children[3]];
+        if (nw->level != ne->level || nw->level != sw->level || nw->level != se->level) {
+            return 0;
+        }
+    #if (!ENABLE_INFINITE_LEVELS)
+        if (nw->level >= QuadTreeNode::kMaxLevel) {
+            return 0;
+        }
+    #endif
+        nodes[id] = store.Canonical(nw, ne, sw, se, nw->level + 1);
+    }
+    return nodes[header->root];
+}
@@ -0,0 +1,126 @@
+//
+// Created by agent on 10/16/26.
+//
+
+#ifndef GOL_QUADTREESNAPSHOT_H
+#define GOL_QUADTREESNAPSHOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "quad_tree_config.h"
+#include "quad_tree_node.h"
+
+#if (ENABLE_BIG_INT)
+#include <gmpxx.h>
+#endif
+
+class QuadTreeNodeStore;
+
+/**
+ * Saves a tree to a binary file and loads it back, so a universe can be kept at any generation and picked up later
+ *
+ * A snapshot is the canonical node DAG under a root, with every distinct node written once, so it's about as big as
+ * the nodes in memory rather than the cells. Nodes get ids children first: leaves are 0 to num_leaves - 1, and the
+ * rest follow in an order where every node comes after its children. So loading is one pass that builds a canonical
+ * node per record, and the only thing it needs to look up is an array from ids to the nodes it already built. The file
+ * is memory mapped and the records are read straight out of the mapping, without parsing or copying them. Nodes can't
+ * be adopted where they lie, since they need slots in the store's arenas and entries in its node table, but that one
+ * lookup per node is all the work there is: a million nodes load in well under a second.
+ *
+ * The layout is, in the byte order of the machine that wrote it:
+ *  - Header: magic, byte order mark, header size, number of leaves, number of other nodes and the root's id
+ *  - The rule, origin x, origin y and generation as NUL terminated decimal strings, padded to 8 bytes
+ *  - Leaves: the 64 bit cells of each, see QuadTreeLeafKernel for the layout
+ *  - Nodes: four 32 bit child ids each, nw, ne, sw, se
+ *
+ * Loading checks the sizes, that children come before their parents and are all the same level, and the rule.
+ * We only run Conway's Game of Life, so the rule is always B3/S23, but it's in the file so other rules can't be
+ * mistaken for it. Saving writes a temporary file next to the snapshot, syncs it to disk and renames it over the old
+ * one, then syncs the directory, so a run or a machine that dies in the middle of a checkpoint still has the
+ * checkpoint before.
+ */
+class QuadTreeSnapshot {
+
+    public:
+
+    #if (ENABLE_BIG_INT)
+        typedef mpz_class generation_type;
+    #else
+        typedef int64_t generation_type;
+    #endif
+
+        /**
+         * Save a tree
+         * @param path file to write, which is replaced once the new one has been written whole
+         * @param root root of the tree, which mustn't change or be collected while we save
+         * @param origin_x display coordinate of the root's center
+         * @param origin_y display coordinate of the root's center
+         * @param generation the tree's generation
+         * @return false if the file couldn't be written
+         */
+        static bool Save(const std::string& path, const QuadTreeNode* root, const coordinate_type& origin_x, const coordinate_type& origin_y,
+                         const generation_type& generation);
+
+        /**
+         * Load a tree
+         * @param path file to read
+         * @param store store to create nodes in
+         * @param origin_x set to the display coordinate of the root's center
+         * @param origin_y set to the display coordinate of the root's center
+         * @param generation set to the tree's generation
+         * @return the root, or 0 if the file couldn't be read or isn't a snapshot, in which case nothing is set
+         */
+        static QuadTreeNode* Load(const std::string& path, QuadTreeNodeStore& store, coordinate_type& origin_x, coordinate_type& origin_y,
+                                  generation_type& generation);
+
+        // the only rule we evolve
+        static const char* const kRule;
+
+    private:
+
+        /**
+         * The start of a file
+         */
+        struct Header {
+            char magic[8];              // kMagic, whose last byte is the format version
+            uint32_t byte_order;        // kByteOrder as the writer saw it
+            uint32_t header_bytes;      // bytes before the leaves, fields included, a multiple of 8
+            uint64_t num_leaves;
+            uint64_t num_nodes;         // nodes above the leaves
+            uint64_t root;              // id of the root
+        };
+
+        /**
+         * Read the fields after the header
+         * @param fields start of the fields
+         * @param size bytes of fields
+         * @param values set to the rule, origin x, origin y and generation
+         * @return false if there aren't four NUL terminated strings
+         */
+        static bool ReadFields(const char* fields, size_t size, std::string values[4]);
+
+        /**
+         * @param text a decimal number
+         * @param value set to the number
+         * @return false if text isn't one
+         */
+    #if (ENABLE_BIG_INT)
+        static bool ParseNumber(const std::string& text, mpz_class& value);
+    #else
+        static bool ParseNumber(const std::string& text, int64_t& value);
+    #endif
+
+        /**
+         * Build the nodes of a mapped snapshot
+         * @param header the mapped file's header, which has been checked against its size
+         * @param store store to create nodes in
+         * @return the root, or 0 if a node's children aren't valid
+         */
+        static QuadTreeNode* Build(const Header* header, QuadTreeNodeStore& store);
+
+        static const char kMagic[8];
+        static const uint32_t kByteOrder = UINT32_C(0x01020304);
+};
+
+#endif //GOL_QUADTREESNAPSHOT_H
@@ -1,9 +1,17 @@
 //
 // Created by Jenny Spurlock on 5/8/17.
 //
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
 #include <vector>
 #include <fstream>
+#include <iterator>
+#include <new>
 #include <random>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 #include "quad_tree_tests.h"
 #include "quad_tree.h"
 
@@ -15,8 +23,27 @@
  * @param origin_y
  */
 void QuadTreeTests::RunRLEPatternTest(const char* pattern_file_name, int num_generations, int64_t origin_x, int64_t origin_y, bool draw_result) {
+    RunRLEPattern(pattern_file_name, (uint64_t) num_generations, origin_x, origin_y, draw_result, false);
+}
+
+/**
+ * Read in an RLE pattern and jump straight to the specified generation with HashLife power of 2 steps
+ * @param pattern_file_name
+ * @param num_generations
+ * @param origin_x
+ * @param origin_y
+ */
+void QuadTreeTests::RunRLEPatternJumpTest(const char* pattern_file_name, uint64_t num_generations, int64_t origin_x, int64_t origin_y, bool draw_result) {
+    RunRLEPattern(pattern_file_name, num_generations, origin_x, origin_y, draw_result, true);
+}
+
+/**
+ * Shared implementation of RunRLEPatternTest and RunRLEPatternJumpTest
+ * @param jump step all of the generations at once instead of one at a time
+ */
+void QuadTreeTests::RunRLEPattern(const char* pattern_file_name, uint64_t num_generations, int64_t origin_x, int64_t origin_y, bool draw_result, bool jump) {
     std::cout << "======================================================================================\n";
-    std::cout << "Running Pattern Test: " << pattern_file_name << " " << "Generations: " << num_generations << " Location: (" << origin_x << ", " << origin_y << ")" << std::endl;
+    std::cout << "Running Pattern " << (jump ? "Jump " : "") << "Test: " << pattern_file_name << " " << "Generations: " << num_generations << " Location: (" << origin_x << ", " << origin_y << ")" << std::endl;
     std::cout << "======================================================================================\n";
 
     std::cout << "Reading in RLE pattern ..\n";
@@ -30,8 +57,12 @@ void QuadTreeTests::RunRLEPatternTest(const char* pattern_file_name, int num_gen
 
         // Run the test
         std::cout << "Evolving for " << num_generations << " generations..\n";
-        for (int x = 0; x < num_generations; ++x) {
-            quad_tree.Step();
+        if (jump) {
+            quad_tree.Step(num_generations);
+        } else {
+            for (uint64_t x = 0; x < num_generations; ++x) {
+                quad_tree.Step();
+            }
         }
 
         // print statistics
@@ -142,10 +173,9 @@ void QuadTreeTests::RunMegaRandomMaxBoundariesTest(int64_t num_nodes, int64_t nu
 
     std::cout << "Initializing with random nodes..\n";
 
-    // Apparently this is how we do random signed 64 bit integers?
+    // Apparently this is how we do random signed 64 bit integers? A fixed seed keeps runs comparable
     std::vector<std::pair<int64_t, int64_t>> pattern_coords;
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(1);
     std::uniform_int_distribution<int64_t> gen_random_x(min_x, max_x);
     std::uniform_int_distribution<int64_t> gen_random_y(min_y, max_y);
 
@@ -183,4 +213,1514 @@ void QuadTreeTests::RunMegaRandomMaxBoundariesTest(int64_t num_nodes, int64_t nu
     } else {
         std::cout << "DONE." << std::endl << std::endl;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Benchmark the canonical node table against the std::unordered_map we used to use.
+ * This runs RunMegaRandomMaxBoundariesTest, then replays a Canonical() lookup for every node that is
+ * left in the table into a fresh node table and a fresh unordered_map, and times both
+ * @param num_nodes
+ * @param num_generations
+ */
+void QuadTreeTests::RunNodeTableBenchmark(int64_t num_nodes, int64_t num_generations, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running NodeTableBenchmark -> Random Nodes: " << num_nodes << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int64_t> gen_random_x(min_x, max_x);
+    std::uniform_int_distribution<int64_t> gen_random_y(min_y, max_y);
+    for (int64_t i = 0; i < num_nodes; ++i) {
+        pattern_coords.push_back(std::make_pair(gen_random_x(gen), gen_random_y(gen)));
+    }
+
+    QuadTree quad_tree;
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    quad_tree.SetCellsAlive(pattern_coords);
+    for (int x = 0; x < num_generations; ++x) {
+        quad_tree.Step();
+    }
+    std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Built and evolved tree in " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " milliseconds" << std::endl;
+
+    // These are the keys we replay, in the order they sit in the table. Leaves are keyed by their cells, so we leave them out
+    std::vector<QuadTreeNode*> nodes;
+    quad_tree.store.node_table.ForEach([&nodes](QuadTreeNode* node) {
+        if (node->level != QuadTreeNode::kLeafLevel) {
+            nodes.push_back(node);
+        }
+    });
+    std::cout << "Replaying " << nodes.size() << " canonical lookups, inserting on the first pass and hitting on the second..\n";
+
+    // The old map: a node on the stack is built to look up the canonical version, hashed by adding pointers together
+    {
+        auto hash = [](QuadTreeNode* node) {
+            return (size_t) (QuadTreeNode*) node->nw + 3 * (size_t) (QuadTreeNode*) node->ne
+                   + 3 * (size_t) (QuadTreeNode*) node->sw + 3 * (size_t) (QuadTreeNode*) node->se;
+        };
+        auto equal = [](QuadTreeNode* node1, QuadTreeNode* node2) {
+            return node1->level == node2->level && node1->nw == node2->nw && node1->ne == node2->ne
+                   && node1->sw == node2->sw && node1->se == node2->se;
+        };
+        std::unordered_map<QuadTreeNode*, QuadTreeNode*, decltype(hash), decltype(equal)> node_map(16, hash, equal);
+        for (int pass = 0; pass < 2; ++pass) {
+            std::chrono::high_resolution_clock::time_point p1 = std::chrono::high_resolution_clock::now();
+            for (QuadTreeNode* key : nodes) {
+                QuadTreeNode node(key->nw, key->ne, key->sw, key->se, key->level);
+                auto iter = node_map.find(&node);
+                if (iter == node_map.end()) {
+                    QuadTreeNode* new_node = new QuadTreeNode(node);
+                    node_map.insert(std::make_pair(new_node, new_node));
+                }
+            }
+            std::chrono::high_resolution_clock::time_point p2 = std::chrono::high_resolution_clock::now();
+            std::cout << "\tunordered_map " << (pass == 0 ? "insert" : "lookup") << ": "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(p2 - p1).count() << " milliseconds" << std::endl;
+        }
+        for (auto it = node_map.begin(); it != node_map.end(); ++it) {
+            delete it->first;
+        }
+    }
+
+    // The node table: lookups are done by child pointers with a stored, mixed hash. It holds nodes by their index,
+    // so they have to come from an arena
+    {
+        QuadTreeNodeTable node_table;
+        QuadTreeNodeArena arena(sizeof(QuadTreeNode));
+        for (int pass = 0; pass < 2; ++pass) {
+            std::chrono::high_resolution_clock::time_point p1 = std::chrono::high_resolution_clock::now();
+            for (QuadTreeNode* key : nodes) {
+                uint32_t hash = QuadTreeNodeTable::Hash(key->nw, key->ne, key->sw, key->se);
+                QuadTreeNodeTable::InsertHint hint;
+                if (node_table.Find(key->nw, key->ne, key->sw, key->se, hash, hint) == 0) {
+                    QuadTreeNode* new_node = new (arena.Allocate()) QuadTreeNode(key->nw, key->ne, key->sw, key->se, key->level);
+                    new_node->SetHash(hash, 0);
+                    node_table.Insert(new_node, hint);
+                }
+            }
+            std::chrono::high_resolution_clock::time_point p2 = std::chrono::high_resolution_clock::now();
+            std::cout << "\tQuadTreeNodeTable " << (pass == 0 ? "insert" : "lookup") << ": "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(p2 - p1).count() << " milliseconds" << std::endl;
+        }
+        // the arena frees the nodes
+        node_table.Clear();
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Benchmark evolving the same random soup with 1, 2, 4... up to max_threads threads, and check that every
+ * run ends up with exactly the same cells as the single threaded run
+ * @param num_nodes
+ * @param num_generations
+ * @param max_threads most threads to try, 0 for one per hardware thread
+ */
+void QuadTreeTests::RunThreadScalingBenchmark(int64_t num_nodes, int64_t num_generations, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, int max_threads) {
+    if (max_threads <= 0) {
+        max_threads = (int) std::thread::hardware_concurrency();
+    }
+    // always try at least two threads, so we check the parallel engine against the serial one
+    if (max_threads < 2) {
+        max_threads = 2;
+    }
+    std::cout << "======================================================================================\n";
+    std::cout << "Running ThreadScalingBenchmark -> Random Nodes: " << num_nodes << " Generations: " << num_generations << " Max Threads: " << max_threads << std::endl;
+    std::cout << "======================================================================================\n";
+
+    // every run evolves the same soup
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int64_t> gen_random_x(min_x, max_x);
+    std::uniform_int_distribution<int64_t> gen_random_y(min_y, max_y);
+    for (int64_t i = 0; i < num_nodes; ++i) {
+        pattern_coords.push_back(std::make_pair(gen_random_x(gen), gen_random_y(gen)));
+    }
+
+#if (ENABLE_BIG_INT)
+    std::vector<std::pair<mpz_class, mpz_class>> serial_cells;
+#else
+    std::vector<std::pair<int64_t, int64_t>> serial_cells;
+#endif
+    double serial_duration = 0;
+    for (int num_threads = 1; ; num_threads *= 2) {
+        if (num_threads > max_threads) {
+            num_threads = max_threads;
+        }
+        QuadTreeNodeStore store;
+        store.SetThreads(num_threads);
+        QuadTree quad_tree(store);
+        quad_tree.SetCellsAlive(pattern_coords);
+
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        for (int64_t x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        double duration = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.0;
+
+#if (ENABLE_BIG_INT)
+        std::vector<std::pair<mpz_class, mpz_class>> cells;
+#else
+        std::vector<std::pair<int64_t, int64_t>> cells;
+#endif
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        std::cout << "\tThreads: " << num_threads << " Evolve: " << duration << " milliseconds";
+        if (num_threads == 1) {
+            serial_cells.swap(cells);
+            serial_duration = duration;
+            std::cout << " Population: " << serial_cells.size() << std::endl;
+        } else {
+            std::cout << " Speedup: " << serial_duration / duration << "x"
+                      << " Matches serial result: " << (cells == serial_cells ? "yes" : "NO") << std::endl;
+        }
+        if (num_threads == max_threads) {
+            break;
+        }
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Run a pattern in a tree with its own store, in two trees that share a store, and in two trees with their own stores
+ * on separate threads, and check that every tree ends up with the same cells
+ * @param pattern_file_name
+ * @param num_generations
+ */
+void QuadTreeTests::RunNodeStoreTest(const char* pattern_file_name, int num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running NodeStoreTest: " << pattern_file_name << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords = ReadRLEPattern(pattern_file_name);
+    if (pattern_coords.size() == 0) {
+        std::cout << "Unable to load pattern: " << pattern_file_name << std::endl << std::endl;
+        return;
+    }
+#if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+#else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+#endif
+    // evolve a tree and return how long it took, in milliseconds
+    auto evolve = [&pattern_coords, num_generations](QuadTree& quad_tree, CellList& cells) -> int64_t {
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        quad_tree.SetCellsAlive(pattern_coords);
+        for (int x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        return (int64_t) std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+    };
+
+    // a tree on its own
+    CellList expected;
+    {
+        QuadTree quad_tree;
+        int64_t duration = evolve(quad_tree, expected);
+        std::cout << "\tOwn store: " << duration << " milliseconds, " << quad_tree.store.NumNodes() << " nodes" << std::endl;
+    }
+
+    // two trees sharing a store, one after the other. The second one finds the first one's results memoized,
+    // and garbage collection in the second one has to keep the first one alive
+    {
+        QuadTreeNodeStore store;
+        QuadTree first(store);
+        QuadTree second(store);
+        CellList first_cells;
+        CellList second_cells;
+        int64_t first_duration = evolve(first, first_cells);
+        int64_t second_duration = evolve(second, second_cells);
+        std::cout << "\tShared store: " << first_duration << " milliseconds, then " << second_duration << " milliseconds, "
+                  << store.NumNodes() << " nodes. Matches: " << (first_cells == expected && second_cells == expected ? "yes" : "NO") << std::endl;
+    }
+
+    // two trees with their own stores, on their own threads at the same time
+    {
+        CellList cells[2];
+        std::thread threads[2];
+        for (int i = 0; i < 2; ++i) {
+            threads[i] = std::thread([&evolve, &cells, i]() {
+                QuadTreeNodeStore store;
+                QuadTree quad_tree(store);
+                evolve(quad_tree, cells[i]);
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        std::cout << "\tStores on separate threads. Matches: " << (cells[0] == expected && cells[1] == expected ? "yes" : "NO") << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Benchmark building a tree from a random soup with the bulk loader against setting the cells one at a time,
+ * and check that both give us the same canonical root
+ * @param num_nodes
+ */
+void QuadTreeTests::RunBulkLoadBenchmark(int64_t num_nodes, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running BulkLoadBenchmark -> Random Nodes: " << num_nodes << std::endl;
+    std::cout << "======================================================================================\n";
+
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords;
+    std::mt19937 gen(1);
+    std::uniform_int_distribution<int64_t> gen_random_x(min_x, max_x);
+    std::uniform_int_distribution<int64_t> gen_random_y(min_y, max_y);
+    for (int64_t i = 0; i < num_nodes; ++i) {
+        pattern_coords.push_back(std::make_pair(gen_random_x(gen), gen_random_y(gen)));
+    }
+
+    // both trees share a store, so if they hold the same cells they have the same root
+    QuadTreeNodeStore store;
+    QuadTree bulk_tree(store);
+    QuadTree cell_tree(store);
+
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    bulk_tree.SetCellsAlive(pattern_coords);
+    std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+    size_t bulk_nodes = store.NumNodes();
+    std::cout << "\tBulk load: " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " milliseconds, "
+              << bulk_nodes << " nodes" << std::endl;
+
+    // the old way, around the same origin
+    int64_t origin_x = 0;
+    int64_t origin_y = 0;
+#if (ENABLE_QUADTREE_CENTER_ALIGN)
+    cell_tree.CenterQuadTreeInput(pattern_coords.data(), pattern_coords.size(), origin_x, origin_y);
+#endif
+    t1 = std::chrono::high_resolution_clock::now();
+    for (const std::pair<int64_t, int64_t>& pair : pattern_coords) {
+        cell_tree.SetCellAlive(pair.first - origin_x, pair.second - origin_y);
+    }
+    t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "\tOne cell at a time: " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " milliseconds, "
+              << store.NumNodes() - bulk_nodes << " more nodes. Same root: " << (bulk_tree.root == cell_tree.root ? "yes" : "NO") << std::endl;
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Fill a rectangle with a random soup straight into the tree, check that the same seed gives the same tree
+ * and that adding a full rectangle on top fills it, then evolve it
+ * @param min_x
+ * @param max_x
+ * @param min_y
+ * @param max_y
+ * @param density chance of each cell being alive
+ * @param seed
+ * @param num_generations
+ */
+void QuadTreeTests::RunRandomSoupTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running RandomSoupTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+
+    QuadTreeNodeStore store;
+    QuadTree quad_tree(store);
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+    std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+    double area = ((double) max_x - (double) min_x + 1) * ((double) max_y - (double) min_y + 1);
+    std::cout << "\tBuilt soup in " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " milliseconds, "
+              << store.NumNodes() << " nodes, population " << quad_tree.root->ExactPopulation()
+              << " (expected about " << (int64_t) (area * density) << ")" << std::endl;
+
+    // the same seed in the same store has to give us the very same root, and another seed a different one
+    {
+        QuadTree same_tree(store);
+        same_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        QuadTree other_tree(store);
+        other_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed + 1);
+        std::cout << "\tSame seed, same root: " << (same_tree.root == quad_tree.root ? "yes" : "NO")
+                  << ". Other seed, other root: " << (other_tree.root != quad_tree.root ? "yes" : "NO") << std::endl;
+
+        // adding a full soup on top of a random one has to fill the rectangle exactly
+        same_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, 1.0, seed);
+        std::cout << "\tFull soup on top fills the rectangle: " << (same_tree.root->ExactPopulation() == (int64_t) area ? "yes" : "NO") << std::endl;
+    }
+
+    std::cout << "Evolving for " << num_generations << " generations..\n";
+    t1 = std::chrono::high_resolution_clock::now();
+    for (int64_t x = 0; x < num_generations; ++x) {
+        quad_tree.Step();
+    }
+    t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "Processed generations in " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " milliseconds" << std::endl;
+    quad_tree.PrintStats();
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Evolve the same random soup with garbage collection stopping the world, running incrementally and sweeping
+ * concurrently, compare the slowest step of each, and check that they all end up with the same cells
+ * @param num_generations
+ */
+void QuadTreeTests::RunCollectionLatencyTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running CollectionLatencyTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_GARBAGE_COLLECTION)
+ #if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+ #else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+ #endif
+    const QuadTreeNodeStore::CollectionMode modes[3] = {
+        QuadTreeNodeStore::kStopTheWorld, QuadTreeNodeStore::kIncremental, QuadTreeNodeStore::kConcurrentSweep
+    };
+    const char* mode_names[3] = {"Stop the world", "Incremental", "Concurrent sweep"};
+    CellList expected;
+    for (int i = 0; i < 3; ++i) {
+        QuadTreeNodeStore store;
+        store.SetCollectionMode(modes[i]);
+        QuadTree quad_tree(store);
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        int64_t total_us = 0;
+        int64_t max_step_us = 0;
+        for (int64_t x = 0; x < num_generations; ++x) {
+            std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+            quad_tree.Step();
+            std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+            int64_t step_us = (int64_t) std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+            total_us += step_us;
+            max_step_us = std::max(max_step_us, step_us);
+        }
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        if (i == 0) {
+            expected.swap(cells);
+        }
+        const QuadTreeNodeStore::CollectionStats& collections = store.AllCollections();
+        std::cout << "\t" << mode_names[i] << ": " << total_us / 1000 << " milliseconds, slowest step " << max_step_us
+                  << " us, " << collections.num_collections << " collections paused " << collections.pause_us
+                  << " us in " << collections.num_pauses << " pauses (longest " << collections.max_pause_us << " us)";
+        if (i > 0) {
+            std::cout << ". Matches: " << (cells == expected ? "yes" : "NO");
+        }
+        std::cout << std::endl;
+    }
+#else
+    (void) min_x;
+    (void) max_x;
+    (void) min_y;
+    (void) max_y;
+    std::cout << "\tGarbage collection is disabled" << std::endl;
+#endif
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Evolve a random soup in one big jump with and without a limit on nodes, which makes the store collect
+ * garbage in the middle of the step, then compare the memory they end up with and check that the cells match
+ * @param exponent jump 2^exponent generations
+ * @param max_nodes pressure limit on the number of nodes
+ */
+void QuadTreeTests::RunMemoryPressureTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int exponent, size_t max_nodes) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running MemoryPressureTest -> Density: " << density << " Seed: " << seed << " Jump: 2^" << exponent << " Node limit: " << max_nodes << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_GARBAGE_COLLECTION)
+ #if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+ #else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+ #endif
+    CellList expected;
+    for (int limited = 0; limited < 2; ++limited) {
+        QuadTreeNodeStore store;
+        if (limited) {
+            store.SetPressureLimit(max_nodes);
+        }
+        QuadTree quad_tree(store);
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        quad_tree.StepPow2(exponent);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        if (!limited) {
+            expected.swap(cells);
+        }
+        const QuadTreeNodeStore::CollectionStats& collections = store.AllCollections();
+        std::cout << "\t" << (limited ? "Node limit: " : "No limit: ") << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                  << " milliseconds, " << store.MemoryUsage() / 1024 << " KB, " << store.NumNodesCreated() << " nodes created, "
+                  << collections.num_in_step << " collections during the step";
+        if (limited) {
+            std::cout << ". Matches: " << (cells == expected ? "yes" : "NO");
+        }
+        std::cout << std::endl;
+    }
+#else
+    (void) min_x;
+    (void) max_x;
+    (void) min_y;
+    (void) max_y;
+    std::cout << "\tGarbage collection is disabled" << std::endl;
+#endif
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Evolve a pattern 2^exponent generations at a time with and without a memo budget, compare the time, peak
+ * memory and nodes created, and check that the cells match
+ * @param exponent step 2^exponent generations at a time
+ * @param max_bytes memo budget
+ */
+void QuadTreeTests::RunMemoBudgetTest(const char* pattern_file_name, uint64_t num_generations, int exponent, size_t max_bytes) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running MemoBudgetTest: " << pattern_file_name << " Generations: " << num_generations << " Step: 2^" << exponent << " Budget: " << max_bytes / 1024 << " KB" << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_GARBAGE_COLLECTION)
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords = ReadRLEPattern(pattern_file_name);
+    if (pattern_coords.size() == 0) {
+        std::cout << "Unable to load pattern: " << pattern_file_name << std::endl << std::endl;
+        return;
+    }
+ #if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+ #else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+ #endif
+    CellList expected;
+    for (int budgeted = 0; budgeted < 2; ++budgeted) {
+        QuadTreeNodeStore store;
+        store.SetMemoBudget(budgeted ? max_bytes : 0);
+        QuadTree quad_tree(store);
+        quad_tree.SetCellsAlive(pattern_coords);
+        size_t peak_memory = 0;
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        for (uint64_t generation = 0; generation < num_generations; generation += UINT64_C(1) << exponent) {
+            quad_tree.StepPow2(exponent);
+            peak_memory = std::max(peak_memory, store.MemoryUsage());
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        if (!budgeted) {
+            expected.swap(cells);
+        }
+        const QuadTreeNodeStore::CollectionStats& collections = store.AllCollections();
+        std::cout << "\t" << (budgeted ? "Memo budget: " : "No budget: ") << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                  << " milliseconds, peak " << peak_memory / 1024 << " KB, " << store.NumNodesCreated() << " nodes created, "
+                  << collections.num_collections << " collections";
+        if (budgeted) {
+            std::cout << ", dropped " << collections.memos_dropped << " memos and kept " << collections.hot_nodes_kept
+                      << " unreachable nodes. Matches: " << (cells == expected ? "yes" : "NO");
+        }
+        std::cout << std::endl;
+    }
+#else
+    std::cout << "\tGarbage collection is disabled" << std::endl;
+#endif
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Evolve the same random soup with and without compacting after every collection, compare the time it takes
+ * to step and to build a display list, and the memory left at the end, and check that the cells match
+ * @param num_generations
+ */
+void QuadTreeTests::RunCompactionTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running CompactionTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_GARBAGE_COLLECTION)
+ #if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+ #else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+ #endif
+    CellList expected;
+    for (int compacting = 0; compacting < 2; ++compacting) {
+        QuadTreeNodeStore store;
+        store.SetCompactionInterval(compacting ? 1 : 0);
+        QuadTree quad_tree(store);
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        for (int64_t x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        if (!compacting) {
+            expected.swap(cells);
+        }
+        const QuadTreeNodeStore::CollectionStats& collections = store.AllCollections();
+        std::cout << "\t" << (compacting ? "Compacting: " : "Not compacting: ") << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                  << " milliseconds, display list in " << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() << " us, "
+                  << store.MemoryUsage() / 1024 << " KB left, " << collections.num_compactions << " compactions moved "
+                  << collections.nodes_moved << " nodes in " << collections.compact_us / 1000 << " ms";
+        if (compacting) {
+            std::cout << ". Matches: " << (cells == expected ? "yes" : "NO");
+        }
+        std::cout << std::endl;
+    }
+#else
+    (void) min_x;
+    (void) max_x;
+    (void) min_y;
+    (void) max_y;
+    std::cout << "\tGarbage collection is disabled" << std::endl;
+#endif
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Export the cells of a random soup into flat x and y arrays with a QuadTreeCellIterator and compare that with
+ * building a display list, then check that four blocks 2^63 apart, in a tree too tall
+ * for 64 bit offsets, come out right when we read them a few cells at a time
+ * @param density chance of each cell being alive
+ * @param num_generations
+ */
+void QuadTreeTests::RunCellIteratorTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running CellIteratorTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+#else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+#endif
+    {
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        for (int64_t x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+
+        // the caller owns the arrays, and the iterator fills them a chunk at a time
+        std::vector<int64_t> xs(cells.size());
+        std::vector<int64_t> ys(cells.size());
+        const size_t chunk_cells = 4096;
+        size_t num_cells = 0;
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        QuadTreeCellIterator iterator = quad_tree.Cells();
+        size_t num_chunk;
+        while ((num_chunk = iterator.Next(xs.data() + num_cells, ys.data() + num_cells, std::min(chunk_cells, xs.size() - num_cells))) != 0) {
+            num_cells += num_chunk;
+        }
+        std::chrono::high_resolution_clock::time_point t4 = std::chrono::high_resolution_clock::now();
+
+        bool matches = num_cells == cells.size() && iterator.Done();
+        for (size_t i = 0; i < num_cells && matches; ++i) {
+            matches = iterator.OriginX() + xs[i] == cells[i].first && iterator.OriginY() + ys[i] == cells[i].second;
+        }
+        std::cout << "\tDisplay list: " << cells.size() << " cells in " << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()
+                  << " us" << std::endl;
+        std::cout << "\tIterator into flat arrays: " << num_cells << " cells in " << std::chrono::duration_cast<std::chrono::microseconds>(t4 - t3).count()
+                  << " us. Matches: " << (matches ? "yes" : "NO") << std::endl;
+    }
+    {
+        // blocks 2^63 apart make a tree taller than 64 bit offsets reach
+        std::vector<std::pair<int64_t, int64_t>> input;
+        int64_t corners[2] = {-(INT64_C(1) << 62), (INT64_C(1) << 62) - 2};
+        for (int64_t corner_y : corners) {
+            for (int64_t corner_x : corners) {
+                input.push_back(std::make_pair(corner_x, corner_y));
+                input.push_back(std::make_pair(corner_x + 1, corner_y));
+                input.push_back(std::make_pair(corner_x, corner_y + 1));
+                input.push_back(std::make_pair(corner_x + 1, corner_y + 1));
+            }
+        }
+        QuadTree quad_tree;
+        quad_tree.SetCellsAlive(input);
+        // blocks are still lifes, so stepping only grows the tree
+        for (int64_t x = 0; x < 4; ++x) {
+            quad_tree.Step();
+        }
+        CellList expected;
+        for (const std::pair<int64_t, int64_t>& cell : input) {
+            expected.push_back(std::make_pair(cell.first, cell.second));
+        }
+        std::sort(expected.begin(), expected.end());
+        // a few cells at a time, so that chunks end in the middle of leaves
+        CellList cells;
+        CellList origins;
+        QuadTreeCellIterator iterator = quad_tree.Cells();
+        QuadTreeCellIterator::Cell chunk[3];
+        size_t num_chunk;
+        while ((num_chunk = iterator.Next(chunk, 3)) != 0) {
+            if (origins.empty() || origins.back().first != iterator.OriginX() || origins.back().second != iterator.OriginY()) {
+                origins.push_back(std::make_pair(iterator.OriginX(), iterator.OriginY()));
+            }
+            for (size_t i = 0; i < num_chunk; ++i) {
+                cells.push_back(std::make_pair(iterator.OriginX() + chunk[i].x, iterator.OriginY() + chunk[i].y));
+            }
+        }
+        std::sort(cells.begin(), cells.end());
+        std::cout << "\tBlocks 2^63 apart: " << cells.size() << " cells, "
+                  << origins.size() << " origins. Matches: " << (cells == expected ? "yes" : "NO") << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Query random rectangles of an evolved soup, as cells and as bitmaps, and check them against filtering its
+ * display list, then time a small viewport into a tree with cells 2^62 apart against building the display list
+ * @param density chance of each cell being alive
+ * @param num_generations
+ * @param num_queries number of random rectangles
+ */
+void QuadTreeTests::RunRectQueryTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_queries) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running RectQueryTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+#else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+#endif
+    {
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        for (int64_t x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        CellList display_list;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, display_list);
+
+        // rectangles of every size, some of them hanging off the soup or missing it altogether
+        std::mt19937 gen((unsigned int) seed);
+        int64_t margin = (max_x - min_x) / 2;
+        std::uniform_int_distribution<int64_t> gen_x(min_x - margin, max_x + margin);
+        std::uniform_int_distribution<int64_t> gen_y(min_y - margin, max_y + margin);
+        std::uniform_int_distribution<int64_t> gen_size(0, max_x - min_x);
+        int num_failed = 0;
+        size_t num_found = 0;
+        for (int query = 0; query < num_queries; ++query) {
+            int64_t x0 = gen_x(gen);
+            int64_t y0 = gen_y(gen);
+            // mostly small viewports, sometimes a big one
+            int64_t width = query % 4 == 0 ? gen_size(gen) : gen_size(gen) % 70;
+            int64_t height = query % 4 == 0 ? gen_size(gen) : gen_size(gen) % 70;
+            int64_t x1 = x0 + width;
+            int64_t y1 = y0 + height;
+
+            std::vector<std::pair<int64_t, int64_t>> expected;
+            for (const CellList::value_type& cell : display_list) {
+                if (cell.first >= x0 && cell.first <= x1 && cell.second >= y0 && cell.second <= y1) {
+                    coordinate_type x = cell.first - x0;
+                    coordinate_type y = cell.second - y0;
+                #if (ENABLE_BIG_INT)
+                    expected.push_back(std::make_pair(x.get_si(), y.get_si()));
+                #else
+                    expected.push_back(std::make_pair(x, y));
+                #endif
+                }
+            }
+            std::vector<std::pair<int64_t, int64_t>> cells;
+            quad_tree.QueryRect(x0, y0, x1, y1, cells);
+            std::vector<uint64_t> bitmap(QuadTree::BitmapWords(x0, x1) * (size_t) (height + 1));
+            size_t num_bitmap = quad_tree.QueryRect(x0, y0, x1, y1, bitmap.data());
+            bool bitmap_matches = num_bitmap == expected.size();
+            size_t num_bits = 0;
+            for (uint64_t word : bitmap) {
+                num_bits += QuadTreeLeafKernel::PopCount(word);
+            }
+            for (const std::pair<int64_t, int64_t>& cell : expected) {
+                size_t word = (size_t) cell.second * QuadTree::BitmapWords(x0, x1) + (size_t) cell.first / 64;
+                bitmap_matches = bitmap_matches && ((bitmap[word] >> (cell.first % 64)) & 1) != 0;
+            }
+            if (cells != expected || !bitmap_matches || num_bits != expected.size()) {
+                ++num_failed;
+            }
+            num_found += expected.size();
+        }
+        std::cout << "\t" << num_queries << " rectangles, " << num_found << " cells found. Failed: " << num_failed << std::endl;
+    }
+    {
+        // a 256x256 soup with gliders 2^62 away in every direction, so the tree is about 2^64 wide
+        int64_t far = INT64_C(1) << 62;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-128, 127, -128, 127, 0.375, seed);
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        int64_t corners[4][2] = {{-far, -far}, {far, -far}, {-far, far}, {far - 8, far - 8}};
+        std::vector<std::pair<int64_t, int64_t>> gliders;
+        for (const int64_t* corner : corners) {
+            for (const int64_t* cell : glider) {
+                gliders.push_back(std::make_pair(corner[0] + cell[0], corner[1] + cell[1]));
+            }
+        }
+        quad_tree.SetCellsAlive(gliders);
+        for (int64_t x = 0; x < 64; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        CellList display_list;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, display_list);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        // the glider in the middle of the southeast corner moved 16 cells southeast
+        coordinate_type x0 = far - 16;
+        coordinate_type y0 = far - 16;
+        coordinate_type x1 = far + 32;
+        coordinate_type y1 = far + 32;
+        std::vector<std::pair<int64_t, int64_t>> cells;
+        quad_tree.QueryRect(x0, y0, x1, y1, cells);
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        size_t num_expected = 0;
+        for (const CellList::value_type& cell : display_list) {
+            if (cell.first >= x0 && cell.first <= x1 && cell.second >= y0 && cell.second <= y1) {
+                ++num_expected;
+            }
+        }
+        std::cout << "\tDisplay list of " << display_list.size() << " cells: " << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()
+                  << " us. Viewport of " << cells.size() << " cells: " << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()
+                  << " us. Matches: " << (cells.size() == num_expected && num_expected == 5 ? "yes" : "NO") << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Render random viewports of an evolved soup at zooms 0 through 7, as density and occupancy, and check them
+ * against counting its display list cell by cell, then time rendering a tree with cells 2^62 apart whole
+ * @param density chance of each cell being alive
+ * @param num_generations
+ * @param num_viewports number of random viewports at each zoom
+ */
+void QuadTreeTests::RunRenderTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_viewports) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running RenderTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+#if (ENABLE_BIG_INT)
+    typedef std::vector<std::pair<mpz_class, mpz_class>> CellList;
+#else
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+#endif
+    // render a viewport both ways and compare it with counting the cells in every pixel. Densities can be off by
+    // the rounding of each level between the leaves and the pixel. Returns the number of wrong pixels
+    auto check_viewport = [](const QuadTree& quad_tree, const CellList& cells, const coordinate_type& x0, const coordinate_type& y0,
+                             int zoom, size_t width, size_t height, double& max_error) {
+        // pixels are counted from the root's center, see QuadTreeRenderer
+        auto pixel = [&quad_tree, zoom](const coordinate_type& coordinate, const coordinate_type& origin) {
+        #if (ENABLE_BIG_INT)
+            mpz_class offset = coordinate - origin;
+            mpz_fdiv_q_2exp(offset.get_mpz_t(), offset.get_mpz_t(), (mp_bitcnt_t) zoom);
+            return offset;
+        #else
+            int64_t offset = coordinate - origin;
+            return offset >= 0 ? offset >> zoom : ~(~offset >> zoom);
+        #endif
+        };
+        coordinate_type first_x = pixel(x0, quad_tree.origin_x);
+        coordinate_type first_y = pixel(y0, quad_tree.origin_y);
+        std::vector<uint64_t> counts(width * height);
+        for (const CellList::value_type& cell : cells) {
+            coordinate_type x = pixel(cell.first, quad_tree.origin_x) - first_x;
+            coordinate_type y = pixel(cell.second, quad_tree.origin_y) - first_y;
+            if (x >= 0 && x < (int64_t) width && y >= 0 && y < (int64_t) height) {
+            #if (ENABLE_BIG_INT)
+                ++counts[(size_t) y.get_si() * width + (size_t) x.get_si()];
+            #else
+                ++counts[(size_t) y * width + (size_t) x];
+            #endif
+            }
+        }
+        std::vector<uint8_t> densities(width * height);
+        std::vector<uint64_t> bitmap(QuadTreeRenderer::OccupancyWords(width) * height);
+        quad_tree.RenderDensity(x0, y0, zoom, width, height, densities.data());
+        quad_tree.RenderOccupancy(x0, y0, zoom, width, height, bitmap.data());
+        double tolerance = zoom < QuadTreeNode::kLeafLevel ? 0.5 : (zoom - QuadTreeNode::kLeafLevel) / 2.0 + 1;
+        int num_wrong = 0;
+        for (size_t y = 0; y < height; ++y) {
+            for (size_t x = 0; x < width; ++x) {
+                uint64_t count = counts[y * width + x];
+                uint8_t rendered = densities[y * width + x];
+                bool occupied = ((bitmap[y * QuadTreeRenderer::OccupancyWords(width) + x / 64] >> (x % 64)) & 1) != 0;
+                double error = rendered - std::ldexp((double) count * 255, -2 * zoom);
+                max_error = std::max(max_error, std::abs(error));
+                if ((count != 0) != occupied || (count != 0) != (rendered != 0) || std::abs(error) > tolerance) {
+                    ++num_wrong;
+                }
+            }
+        }
+        return num_wrong;
+    };
+    {
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        for (int64_t x = 0; x < num_generations; ++x) {
+            quad_tree.Step();
+        }
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        std::mt19937 gen((unsigned int) seed);
+        std::uniform_int_distribution<int64_t> gen_x(min_x - (max_x - min_x) / 2, max_x);
+        std::uniform_int_distribution<int64_t> gen_y(min_y - (max_y - min_y) / 2, max_y);
+        std::uniform_int_distribution<size_t> gen_size(1, 100);
+        for (int zoom = 0; zoom < 8; ++zoom) {
+            int num_wrong = 0;
+            double max_error = 0;
+            for (int viewport = 0; viewport < num_viewports; ++viewport) {
+                num_wrong += check_viewport(quad_tree, cells, gen_x(gen), gen_y(gen), zoom, gen_size(gen), gen_size(gen), max_error);
+            }
+            std::cout << "\tZoom " << zoom << ": " << num_viewports << " viewports, largest density error " << max_error
+                      << "/255. Wrong pixels: " << num_wrong << std::endl;
+        }
+    }
+    {
+        // a 256x256 soup with gliders 2^62 away in every direction, so the tree is about 2^64 wide
+        int64_t far = INT64_C(1) << 62;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-128, 127, -128, 127, 0.375, seed);
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        int64_t corners[4][2] = {{-far, -far}, {far, -far}, {-far, far}, {far - 8, far - 8}};
+        std::vector<std::pair<int64_t, int64_t>> gliders;
+        for (const int64_t* corner : corners) {
+            for (const int64_t* cell : glider) {
+                gliders.push_back(std::make_pair(corner[0] + cell[0], corner[1] + cell[1]));
+            }
+        }
+        quad_tree.SetCellsAlive(gliders);
+        for (int64_t x = 0; x < 64; ++x) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        CellList cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        // the whole tree in 256x256 pixels, then the soup at one cell per pixel, then everything in one pixel
+        coordinate_type corner = -2 * far;
+        std::vector<uint8_t> densities(256 * 256);
+        quad_tree.RenderDensity(corner, corner, 56, 256, 256, densities.data());
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        size_t num_occupied = 256 * 256 - (size_t) std::count(densities.begin(), densities.end(), 0);
+        double max_error = 0;
+        int num_wrong = check_viewport(quad_tree, cells, corner, corner, 56, 256, 256, max_error);
+        num_wrong += check_viewport(quad_tree, cells, -128, -128, 0, 256, 256, max_error);
+        // zoomed out past the root, so its children are only part of a pixel
+        num_wrong += check_viewport(quad_tree, cells, corner, corner, 70, 2, 2, max_error);
+        std::cout << "\tDisplay list of " << cells.size() << " cells: " << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count()
+                  << " us. Whole tree in 256x256 pixels: " << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count()
+                  << " us, " << num_occupied << " pixels with cells. Wrong pixels: " << num_wrong << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Evolve a soup with a frame writer attached in each format, and check every file it wrote against rendering the
+ * same generations ourselves, then time stepping with and without a writer, and check the frames of a tree we
+ * collect and compact after every step
+ * @param num_generations
+ * @param interval generations between frames
+ */
+void QuadTreeTests::RunFrameWriterTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, uint64_t interval) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running FrameWriterTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations
+              << " Interval: " << interval << std::endl;
+    std::cout << "======================================================================================\n";
+    // the soup at 2x2 cells per pixel
+    const int zoom = 1;
+    size_t width = (size_t) ((max_x - min_x) >> zoom) + 1;
+    size_t height = (size_t) ((max_y - min_y) >> zoom) + 1;
+    // render the frames ourselves, and time the steps without a writer
+    std::vector<std::vector<uint8_t>> expected;
+    std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+    {
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        for (int64_t x = 0; x <= num_generations; ++x) {
+            if (x % (int64_t) interval == 0) {
+                expected.push_back(std::vector<uint8_t>(width * height));
+                quad_tree.RenderDensity(min_x, min_y, zoom, width, height, expected.back().data());
+            }
+            if (x < num_generations) {
+                quad_tree.Step();
+            }
+        }
+    }
+    std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+    std::cout << "\tStepping and rendering " << expected.size() << " frames ourselves: "
+              << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms" << std::endl;
+    const char* names[] = {"PGM", "PPM", "PNG"};
+    QuadTreeFrameWriter::Format formats[] = {QuadTreeFrameWriter::kFormatPGM, QuadTreeFrameWriter::kFormatPPM, QuadTreeFrameWriter::kFormatPNG};
+    for (int i = 0; i < 3; ++i) {
+        QuadTreeFrameWriter writer(std::string("frame_writer_test_") + names[i] + "_", formats[i], min_x, min_y, zoom, width, height, interval);
+        t1 = std::chrono::high_resolution_clock::now();
+        {
+            QuadTree quad_tree;
+            quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+            quad_tree.SetFrameWriter(&writer);
+            for (int64_t x = 0; x < num_generations; ++x) {
+                quad_tree.Step();
+            }
+            t2 = std::chrono::high_resolution_clock::now();
+        }
+        writer.Flush();
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        // read every frame back and compare it with ours
+        int num_wrong = 0;
+        for (size_t frame = 0; frame < expected.size(); ++frame) {
+            std::string file_name = writer.FileName((int64_t) (frame * interval));
+            std::ifstream input(file_name, std::ios::binary);
+            std::vector<uint8_t> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            input.close();
+            std::remove(file_name.c_str());
+            const std::vector<uint8_t>& densities = expected[frame];
+            std::string header = std::string(i == 1 ? "P6" : "P5") + "\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+            bool right;
+            if (i == 0) {
+                right = file.size() == header.size() + densities.size() && std::equal(header.begin(), header.end(), file.begin())
+                        && std::equal(densities.begin(), densities.end(), file.begin() + header.size());
+            } else if (i == 1) {
+                right = file.size() == header.size() + densities.size() * 3 && std::equal(header.begin(), header.end(), file.begin());
+                for (size_t pixel = 0; right && pixel < densities.size(); ++pixel) {
+                    // black where there are no cells, and red goes up with the density
+                    right = file[header.size() + pixel * 3] == densities[pixel]
+                            && (densities[pixel] == 0) == (file[header.size() + pixel * 3 + 1] == 0);
+                }
+            } else {
+                // the signature, a header with our size, and the end chunk with its fixed CRC
+                static const uint8_t kSignature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+                static const uint8_t kEnd[12] = {0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82};
+                right = file.size() > 33 + 12 && std::equal(kSignature, kSignature + 8, file.begin())
+                        && std::equal(kEnd, kEnd + 12, file.end() - 12)
+                        && file[16] == (uint8_t) (width >> 24) && file[17] == (uint8_t) (width >> 16) && file[18] == (uint8_t) (width >> 8) && file[19] == (uint8_t) width
+                        && file[20] == (uint8_t) (height >> 24) && file[21] == (uint8_t) (height >> 16) && file[22] == (uint8_t) (height >> 8) && file[23] == (uint8_t) height;
+            }
+            if (!right) {
+                ++num_wrong;
+            }
+        }
+        QuadTreeFrameWriter::Stats stats = writer.GetStats();
+        std::cout << "\t" << names[i] << ": stepping took " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                  << " ms, waited " << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count() << " ms for the last frames. "
+                  << stats.frames_written << " frames written (" << stats.bytes_written / 1024 << " KB), " << stats.frames_dropped
+                  << " dropped, " << stats.frames_per_second << " fps, rendering took " << stats.render_us / 1000 << " ms and encoding "
+                  << stats.encode_us / 1000 << " ms. Wrong frames: " << num_wrong << std::endl;
+    }
+    {
+        // a PNG of every generation with room for one frame in the queue, which the encoder can't always keep up with
+        QuadTreeFrameWriter writer("frame_writer_test_dropped_", QuadTreeFrameWriter::kFormatPNG, min_x, min_y, zoom, width, height, 1, 1);
+        t1 = std::chrono::high_resolution_clock::now();
+        {
+            QuadTree quad_tree;
+            quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+            quad_tree.SetFrameWriter(&writer);
+            for (int64_t x = 0; x < num_generations; ++x) {
+                quad_tree.Step();
+            }
+            t2 = std::chrono::high_resolution_clock::now();
+        }
+        writer.Flush();
+        for (int64_t x = 0; x <= num_generations; ++x) {
+            std::remove(writer.FileName(x).c_str());
+        }
+        QuadTreeFrameWriter::Stats stats = writer.GetStats();
+        std::cout << "\tPNG every generation with a queue of 1: stepping took "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms, " << stats.frames_written
+                  << " frames written, " << stats.frames_dropped << " dropped, " << stats.frames_per_second << " fps, rendering took " << stats.render_us / 1000 << " ms" << std::endl;
+    }
+#if (ENABLE_GARBAGE_COLLECTION)
+    {
+        // collect and try to compact after every step, while our thread is still rendering the roots it was given
+        QuadTreeFrameWriter writer("frame_writer_test_collected_", QuadTreeFrameWriter::kFormatPGM, min_x, min_y, zoom, width, height, interval);
+        QuadTreeNodeStore store;
+        uint64_t num_compactions;
+        {
+            QuadTree quad_tree(store);
+            quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+            quad_tree.SetFrameWriter(&writer);
+            for (int64_t x = 0; x < num_generations; ++x) {
+                quad_tree.Step();
+                store.CollectGarbage();
+                store.Compact();
+            }
+            num_compactions = store.AllCollections().num_compactions;
+        }
+        writer.Flush();
+        int num_wrong = 0;
+        std::string header = "P5\n" + std::to_string(width) + " " + std::to_string(height) + "\n255\n";
+        for (size_t frame = 0; frame < expected.size(); ++frame) {
+            std::string file_name = writer.FileName((int64_t) (frame * interval));
+            std::ifstream input(file_name, std::ios::binary);
+            std::vector<uint8_t> file((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            input.close();
+            std::remove(file_name.c_str());
+            if (file.size() != header.size() + expected[frame].size() || !std::equal(expected[frame].begin(), expected[frame].end(), file.begin() + header.size())) {
+                ++num_wrong;
+            }
+        }
+        std::cout << "\tCollecting and compacting every step: " << num_compactions << " of " << num_generations
+                  << " compactions done, the rest put off while frames were rendered. Wrong frames: " << num_wrong << std::endl;
+    }
+#endif
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Diff an evolving soup against the generation before, whole and in random rectangles, and check it against
+ * comparing the cells, then time a step where only a few cells change, and diff a tree with cells 2^62 apart
+ * @param num_generations
+ * @param num_queries number of random rectangles
+ */
+void QuadTreeTests::RunDiffTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_queries) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running DiffTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+    typedef std::vector<std::pair<int64_t, int64_t>> CellList;
+    // what should have changed, from the cells before and after
+    auto expected_changes = [](CellList before, CellList after, CellList& born, CellList& died) {
+        std::sort(before.begin(), before.end());
+        std::sort(after.begin(), after.end());
+        born.clear();
+        died.clear();
+        std::set_difference(after.begin(), after.end(), before.begin(), before.end(), std::back_inserter(born));
+        std::set_difference(before.begin(), before.end(), after.begin(), after.end(), std::back_inserter(died));
+    };
+    auto same_cells = [](CellList a, CellList b) {
+        std::sort(a.begin(), a.end());
+        std::sort(b.begin(), b.end());
+        return a == b;
+    };
+    {
+        // nothing in the soup gets further than a cell a generation past its edges, and the last step is 1000
+        int64_t x0 = min_x - num_generations - 1000;
+        int64_t y0 = min_y - num_generations - 1000;
+        int64_t x1 = max_x + num_generations + 1000;
+        int64_t y1 = max_y + num_generations + 1000;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        std::mt19937 gen((unsigned int) seed);
+        std::uniform_int_distribution<int64_t> gen_x(min_x - num_generations, max_x);
+        std::uniform_int_distribution<int64_t> gen_y(min_y - num_generations, max_y);
+        std::uniform_int_distribution<int64_t> gen_size(1, (max_x - min_x) / 4);
+        CellList before;
+        CellList after;
+        CellList born;
+        CellList died;
+        CellList expected_born;
+        CellList expected_died;
+        // everything is born since we had no cells
+        quad_tree.Diff(x0, y0, x1, y1, born, died);
+        quad_tree.QueryRect(x0, y0, x1, y1, before);
+        int num_failed = same_cells(born, before) && died.empty() ? 0 : 1;
+        uint64_t num_born = 0;
+        uint64_t num_died = 0;
+        uint64_t diff_us = 0;
+        uint64_t query_us = 0;
+        for (int64_t generation = 0; generation < num_generations; ++generation) {
+            quad_tree.MarkGeneration();
+            // the last generation is one big jump, which the root compacts after
+            int64_t step = generation == num_generations - 1 ? 1000 : 1;
+            quad_tree.Step((uint64_t) step);
+            std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+            quad_tree.Diff(x0, y0, x1, y1, born, died);
+            std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+            quad_tree.QueryRect(x0, y0, x1, y1, after);
+            std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+            diff_us += (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+            query_us += (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
+            expected_changes(before, after, expected_born, expected_died);
+            if (!same_cells(born, expected_born) || !same_cells(died, expected_died)) {
+                ++num_failed;
+            }
+            num_born += born.size();
+            num_died += died.size();
+            // and a few rectangles of the same step
+            for (int query = 0; query < num_queries / num_generations; ++query) {
+                int64_t qx0 = gen_x(gen);
+                int64_t qy0 = gen_y(gen);
+                int64_t qx1 = qx0 + gen_size(gen);
+                int64_t qy1 = qy0 + gen_size(gen);
+                quad_tree.Diff(qx0, qy0, qx1, qy1, born, died);
+                CellList inside_before;
+                CellList inside_after;
+                for (const std::pair<int64_t, int64_t>& cell : before) {
+                    if (cell.first + x0 >= qx0 && cell.first + x0 <= qx1 && cell.second + y0 >= qy0 && cell.second + y0 <= qy1) {
+                        inside_before.push_back(std::make_pair(cell.first + x0 - qx0, cell.second + y0 - qy0));
+                    }
+                }
+                for (const std::pair<int64_t, int64_t>& cell : after) {
+                    if (cell.first + x0 >= qx0 && cell.first + x0 <= qx1 && cell.second + y0 >= qy0 && cell.second + y0 <= qy1) {
+                        inside_after.push_back(std::make_pair(cell.first + x0 - qx0, cell.second + y0 - qy0));
+                    }
+                }
+                expected_changes(inside_before, inside_after, expected_born, expected_died);
+                if (!same_cells(born, expected_born) || !same_cells(died, expected_died)) {
+                    ++num_failed;
+                }
+            }
+            before.swap(after);
+        }
+        std::cout << "\t" << num_generations << " generations, " << num_born << " cells born and " << num_died << " died. Diffs took "
+                  << diff_us / 1000 << " ms, querying every cell took " << query_us / 1000 << " ms. Failed: " << num_failed << std::endl;
+    }
+    {
+        // a glider flying away from a field of 256x256 blocks, so a step only changes a few of many cells
+        std::vector<std::pair<int64_t, int64_t>> cells;
+        for (int64_t x = 0; x < 1024; x += 4) {
+            for (int64_t y = 0; y < 1024; y += 4) {
+                cells.push_back(std::make_pair(x, y));
+                cells.push_back(std::make_pair(x + 1, y));
+                cells.push_back(std::make_pair(x, y + 1));
+                cells.push_back(std::make_pair(x + 1, y + 1));
+            }
+        }
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        for (const int64_t* cell : glider) {
+            cells.push_back(std::make_pair(1040 + cell[0], 1040 + cell[1]));
+        }
+        QuadTree quad_tree;
+        quad_tree.SetCellsAlive(cells);
+        quad_tree.MarkGeneration();
+        quad_tree.Step();
+        CellList born;
+        CellList died;
+        CellList after;
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        size_t num_changes = quad_tree.Diff(-1024, -1024, 2047, 2047, born, died);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        size_t num_cells = quad_tree.QueryRect(-1024, -1024, 2047, 2047, after);
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        std::cout << "\tA glider next to 65536 blocks: " << num_changes << " of " << num_cells << " cells changed. Diff: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() << " us, querying every cell: "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count() << " us" << std::endl;
+    }
+    {
+        // a 256x256 soup with gliders 2^62 away in every direction, so the tree is about 2^64 wide
+        int64_t far = INT64_C(1) << 62;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-128, 127, -128, 127, 0.375, seed);
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        int64_t corners[4][2] = {{-far, -far}, {far, -far}, {-far, far}, {far - 8, far - 8}};
+        std::vector<std::pair<int64_t, int64_t>> gliders;
+        for (const int64_t* corner : corners) {
+            for (const int64_t* cell : glider) {
+                gliders.push_back(std::make_pair(corner[0] + cell[0], corner[1] + cell[1]));
+            }
+        }
+        quad_tree.SetCellsAlive(gliders);
+        int num_failed = 0;
+        CellList before;
+        CellList after;
+        CellList born;
+        CellList died;
+        CellList expected_born;
+        CellList expected_died;
+        // the glider in the southeast corner, and the soup
+        coordinate_type rects[2][2] = {{far - 64, far - 64}, {-256, -256}};
+        for (const coordinate_type* rect : rects) {
+            quad_tree.QueryRect(rect[0], rect[1], rect[0] + 512, rect[1] + 512, before);
+            quad_tree.MarkGeneration();
+            quad_tree.Step(4);
+            quad_tree.Diff(rect[0], rect[1], rect[0] + 512, rect[1] + 512, born, died);
+            quad_tree.QueryRect(rect[0], rect[1], rect[0] + 512, rect[1] + 512, after);
+            expected_changes(before, after, expected_born, expected_died);
+            if (!same_cells(born, expected_born) || !same_cells(died, expected_died) || born.empty()) {
+                ++num_failed;
+            }
+        }
+        std::cout << "\tGliders 2^62 apart: the last diff found " << born.size() << " cells born and " << died.size()
+                  << " died. Failed: " << num_failed << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Check the bounding box we find from the edges of the tree against the one from every cell, and every node's
+ * quadrants against its children, for an evolving soup and for a tree with cells 2^62 apart
+ */
+void QuadTreeTests::RunBoundingBoxTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running BoundingBoxTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations << std::endl;
+    std::cout << "======================================================================================\n";
+    // the bounding box of every cell, west, north, east and south, or false if there are none
+    auto scan_cells = [](const QuadTree& quad_tree, coordinate_type box[4]) {
+        std::vector<std::pair<coordinate_type, coordinate_type>> cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        for (size_t i = 0; i < cells.size(); ++i) {
+            if (i == 0 || cells[i].first < box[0]) {
+                box[0] = cells[i].first;
+            }
+            if (i == 0 || cells[i].second < box[1]) {
+                box[1] = cells[i].second;
+            }
+            if (i == 0 || cells[i].first > box[2]) {
+                box[2] = cells[i].first;
+            }
+            if (i == 0 || cells[i].second > box[3]) {
+                box[3] = cells[i].second;
+            }
+        }
+        return !cells.empty();
+    };
+    // every distinct node under the root whose quadrants don't match its cells or children
+    auto wrong_quadrants = [](const QuadTreeNode* root) {
+        static const uint64_t kLeafQuadrants[4] = {QuadTreeLeafKernel::kQuadrantNW, QuadTreeLeafKernel::kQuadrantNE,
+                                                   QuadTreeLeafKernel::kQuadrantSW, QuadTreeLeafKernel::kQuadrantSE};
+        std::unordered_set<const QuadTreeNode*> seen;
+        std::vector<const QuadTreeNode*> stack(1, root);
+        int num_wrong = 0;
+        while (!stack.empty()) {
+            const QuadTreeNode* node = stack.back();
+            stack.pop_back();
+            if (!seen.insert(node).second) {
+                continue;
+            }
+            uint8_t expected = 0;
+            for (int i = 0; i < 4; ++i) {
+                if (node->level == QuadTreeNode::kLeafLevel) {
+                    expected |= (node->bits & kLeafQuadrants[i]) != 0 ? (uint8_t) (1 << i) : 0;
+                } else {
+                    const QuadTreeNode* child = i == 0 ? node->nw : i == 1 ? node->ne : i == 2 ? (const QuadTreeNode*) node->sw : node->se;
+                    expected |= child->empty ? 0 : (uint8_t) (1 << i);
+                    stack.push_back(child);
+                }
+            }
+            if (node->quadrants != expected || node->empty != (expected == 0)) {
+                ++num_wrong;
+            }
+        }
+        return num_wrong;
+    };
+    {
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        int num_failed = 0;
+        uint64_t box_us = 0;
+        uint64_t scan_us = 0;
+        coordinate_type box[4];
+        coordinate_type expected[4];
+        for (int64_t generation = 0; generation <= num_generations; ++generation) {
+            if (generation != 0) {
+                quad_tree.Step();
+            }
+            std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+            bool found = quad_tree.BoundingBox(box[0], box[1], box[2], box[3]);
+            std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+            bool expected_found = scan_cells(quad_tree, expected);
+            std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+            box_us += (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count();
+            scan_us += (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(t3 - t2).count();
+            if (found != expected_found || !std::equal(box, box + 4, expected) || wrong_quadrants(quad_tree.root) != 0) {
+                ++num_failed;
+            }
+        }
+        std::cout << "\t" << num_generations << " generations, last bounding box (" << box[0] << ", " << box[1] << ") to (" << box[2]
+                  << ", " << box[3] << "). Bounding boxes took " << box_us << " us, looking at every cell took " << scan_us / 1000
+                  << " ms. Failed: " << num_failed << std::endl;
+    }
+    {
+        // a 256x256 soup with gliders 2^62 away in every direction, so the tree is about 2^64 wide
+        int64_t far = INT64_C(1) << 62;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-128, 127, -128, 127, 0.375, seed);
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        int64_t corners[4][2] = {{-far, -far}, {far, -far}, {-far, far}, {far - 8, far - 8}};
+        std::vector<std::pair<int64_t, int64_t>> gliders;
+        for (const int64_t* corner : corners) {
+            for (const int64_t* cell : glider) {
+                gliders.push_back(std::make_pair(corner[0] + cell[0], corner[1] + cell[1]));
+            }
+        }
+        quad_tree.SetCellsAlive(gliders);
+        int num_failed = 0;
+        coordinate_type box[4];
+        coordinate_type expected[4];
+        for (int i = 0; i < 4; ++i) {
+            bool found = quad_tree.BoundingBox(box[0], box[1], box[2], box[3]);
+            if (!found || !scan_cells(quad_tree, expected) || !std::equal(box, box + 4, expected) || wrong_quadrants(quad_tree.root) != 0) {
+                ++num_failed;
+            }
+            quad_tree.Step(4);
+        }
+        std::cout << "\tGliders 2^62 apart: bounding box (" << box[0] << ", " << box[1] << ") to (" << box[2] << ", " << box[3]
+                  << "). Failed: " << num_failed << std::endl;
+    }
+    {
+        // a lone cell dies, and an empty tree has no bounding box
+        QuadTree quad_tree;
+        quad_tree.SetCellAlive(5, 5);
+        coordinate_type box[4] = {1, 2, 3, 4};
+        bool found_before = quad_tree.BoundingBox(box[0], box[1], box[2], box[3]);
+        bool right = found_before && box[0] == 5 && box[1] == 5 && box[2] == 5 && box[3] == 5;
+        quad_tree.Step();
+        right = right && !quad_tree.BoundingBox(box[0], box[1], box[2], box[3]) && box[0] == 5;
+        std::cout << "\tA lone cell and then no cells. Failed: " << (right ? 0 : 1) << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Checkpoint an evolving soup and resume a second tree from the last checkpoint, save and load a tree with cells 2^62
+ * apart, time a universe of over a million nodes, and turn down files that aren't whole snapshots
+ */
+void QuadTreeTests::RunSnapshotTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, uint64_t interval) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running SnapshotTest -> Density: " << density << " Seed: " << seed << " Generations: " << num_generations
+              << " Checkpoint interval: " << interval << std::endl;
+    std::cout << "======================================================================================\n";
+    // do two trees have the same cells, origin and generation?
+    auto same_trees = [](const QuadTree& a, const QuadTree& b) {
+        std::vector<std::pair<coordinate_type, coordinate_type>> a_cells;
+        std::vector<std::pair<coordinate_type, coordinate_type>> b_cells;
+        a.root->BuildDisplayList(a.origin_x, a.origin_y, a_cells);
+        b.root->BuildDisplayList(b.origin_x, b.origin_y, b_cells);
+        return a_cells == b_cells && a.origin_x == b.origin_x && a.origin_y == b.origin_y && a.num_generations == b.num_generations;
+    };
+    auto file_size = [](const char* path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return file ? (uint64_t) file.tellg() : 0;
+    };
+    const char* checkpoint = "snapshot_test_checkpoint.gol";
+    {
+        // the run we checkpoint, and a second tree we resume from its last checkpoint
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        quad_tree.SetCheckpoint(checkpoint, interval);
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        for (int64_t generation = 0; generation < num_generations; ++generation) {
+            quad_tree.Step();
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        uint64_t num_checkpoints = quad_tree.num_checkpoints;
+        uint64_t checkpoint_bytes = file_size(checkpoint);
+        QuadTree resumed;
+        bool loaded = resumed.LoadSnapshot(checkpoint);
+        int64_t last_checkpoint = num_generations / (int64_t) interval * (int64_t) interval;
+        int num_failed = loaded && resumed.num_generations == last_checkpoint ? 0 : 1;
+        resumed.Step((uint64_t) (num_generations - last_checkpoint));
+        if (!same_trees(quad_tree, resumed)) {
+            ++num_failed;
+        }
+        // and both keep going the same way
+        quad_tree.Step(1000);
+        resumed.Step(1000);
+        if (!same_trees(quad_tree, resumed)) {
+            ++num_failed;
+        }
+        std::cout << "\t" << num_generations << " generations with " << num_checkpoints << " checkpoints took "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms, the last one is "
+                  << checkpoint_bytes / 1024 << " KB. Resumed from generation " << last_checkpoint << ". Failed: " << num_failed << std::endl;
+    }
+    {
+        // a 256x256 soup with gliders 2^62 away in every direction, so the tree is about 2^64 wide
+        int64_t far = INT64_C(1) << 62;
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-128, 127, -128, 127, 0.375, seed);
+        int64_t glider[5][2] = {{1, 0}, {2, 1}, {0, 2}, {1, 2}, {2, 2}};
+        int64_t corners[4][2] = {{-far, -far}, {far, -far}, {-far, far}, {far - 8, far - 8}};
+        std::vector<std::pair<int64_t, int64_t>> gliders;
+        for (const int64_t* corner : corners) {
+            for (const int64_t* cell : glider) {
+                gliders.push_back(std::make_pair(corner[0] + cell[0], corner[1] + cell[1]));
+            }
+        }
+        quad_tree.SetCellsAlive(gliders);
+        quad_tree.Step(100);
+        QuadTree loaded;
+        int num_failed = quad_tree.SaveSnapshot(checkpoint) && loaded.LoadSnapshot(checkpoint) && same_trees(quad_tree, loaded) ? 0 : 1;
+        quad_tree.Step(100);
+        loaded.Step(100);
+        if (!same_trees(quad_tree, loaded)) {
+            ++num_failed;
+        }
+        std::cout << "\tGliders 2^62 apart: a level " << (level_type) loaded.root->level << " root in " << file_size(checkpoint)
+                  << " bytes. Failed: " << num_failed << std::endl;
+    }
+    {
+        // a 8192x8192 soup, whose leaves are almost all different
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(-4096, 4095, -4096, 4095, 0.375, seed);
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        bool saved = quad_tree.SaveSnapshot(checkpoint);
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        QuadTree loaded;
+        bool loaded_fine = loaded.LoadSnapshot(checkpoint);
+        std::chrono::high_resolution_clock::time_point t3 = std::chrono::high_resolution_clock::now();
+        // loading into the store the tree lives in finds every node already there, so it has to give us the same root
+        QuadTree shared(quad_tree.store);
+        int num_failed = saved && loaded_fine && shared.LoadSnapshot(checkpoint) && shared.root == quad_tree.root
+                         && loaded.root->ExactPopulation() == quad_tree.root->ExactPopulation() ? 0 : 1;
+        std::cout << "\tAn 8192x8192 soup: " << loaded.store.NumNodes() << " nodes in " << file_size(checkpoint) / 1024 << " KB. Saving took "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count() << " ms, loading took "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count() << " ms. Failed: " << num_failed << std::endl;
+    }
+    {
+        // a snapshot cut short, a file that isn't one and a file that isn't there leave the tree as it was
+        QuadTree quad_tree;
+        quad_tree.SetRandomCellsAlive(min_x, max_x, min_y, max_y, density, seed);
+        quad_tree.SaveSnapshot(checkpoint);
+        std::string contents;
+        {
+            std::ifstream file(checkpoint, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        const char* broken = "snapshot_test_broken.gol";
+        QuadTreeNode* root = quad_tree.root;
+        int num_failed = 0;
+        std::string broken_contents[2] = {contents.substr(0, contents.size() / 2), "x = 3, y = 3\nbo$2bo$3o!\n"};
+        for (const std::string& text : broken_contents) {
+            {
+                std::ofstream file(broken, std::ios::binary);
+                file << text;
+            }
+            if (quad_tree.LoadSnapshot(broken) || quad_tree.root != root || quad_tree.num_generations != 0) {
+                ++num_failed;
+            }
+        }
+        std::remove(broken);
+        if (quad_tree.LoadSnapshot("snapshot_test_missing.gol") || quad_tree.root != root) {
+            ++num_failed;
+        }
+        std::cout << "\tBroken and missing files. Failed: " << num_failed << std::endl;
+    }
+    std::remove(checkpoint);
+    std::cout << "DONE." << std::endl << std::endl;
+}
+
+/**
+ * Run a pattern one generation at a time and again in steps of a number with several bits set, which evolves the
+ * same nodes by several powers of 2 in a row, and compare the time, nodes created, evolves and memo hits, and check
+ * that the cells match
+ * @param step_size generations per step, like 7 for 4 + 2 + 1
+ */
+void QuadTreeTests::RunExactStepTest(const char* pattern_file_name, uint64_t num_generations, uint64_t step_size) {
+    std::cout << "======================================================================================\n";
+    std::cout << "Running ExactStepTest: " << pattern_file_name << " Generations: " << num_generations << " Step: " << step_size << std::endl;
+    std::cout << "======================================================================================\n";
+    std::vector<std::pair<int64_t, int64_t>> pattern_coords = ReadRLEPattern(pattern_file_name);
+    if (pattern_coords.size() == 0) {
+        std::cout << "Unable to load pattern: " << pattern_file_name << std::endl << std::endl;
+        return;
+    }
+    std::vector<std::pair<coordinate_type, coordinate_type>> expected;
+    uint64_t single_misses = 0;
+    for (int exact = 0; exact < 2; ++exact) {
+        QuadTreeNodeStore store;
+        QuadTree quad_tree(store);
+        quad_tree.SetCellsAlive(pattern_coords);
+        uint64_t step = exact ? step_size : 1;
+        std::chrono::high_resolution_clock::time_point t1 = std::chrono::high_resolution_clock::now();
+        for (uint64_t generation = 0; generation < num_generations; generation += step) {
+            quad_tree.Step(std::min(step, num_generations - generation));
+        }
+        std::chrono::high_resolution_clock::time_point t2 = std::chrono::high_resolution_clock::now();
+        std::vector<std::pair<coordinate_type, coordinate_type>> cells;
+        quad_tree.root->BuildDisplayList(quad_tree.origin_x, quad_tree.origin_y, cells);
+        // every node that isn't a memo hit is evolved from scratch, so that's what the steps cost
+        uint64_t misses = store.NumEvolves() - store.NumMemoHits();
+        std::cout << "\t" << (exact ? "Step(" : "Step() x ") << (exact ? std::to_string(step) + ") x " : "")
+                  << (num_generations + step - 1) / step << ": " << std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()
+                  << " milliseconds, " << store.NumNodesCreated() << " nodes created, " << store.NumEvolves() << " evolves, "
+                  << store.NumMemoHits() << " memo hits (" << (store.NumEvolves() != 0 ? 100 * store.NumMemoHits() / store.NumEvolves() : 0)
+                  << "%), " << misses << " misses";
+        if (!exact) {
+            expected.swap(cells);
+            single_misses = misses;
+        } else {
+            // skipping generations should never take more work than stepping through all of them
+            std::cout << ". Matches: " << (cells == expected ? "yes" : "NO") << ". Regressed: " << (misses > single_misses ? "YES" : "no");
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "DONE." << std::endl << std::endl;
+}
@@ -2,6 +2,8 @@
 // Created by Jenny Spurlock on 5/8/17.
 //
 #include <iostream>
+#include <vector>
+#include <chrono>
 #ifndef GOL_QUAD_TREE_TESTS_H
 #define GOL_QUAD_TREE_TESTS_H
 
@@ -35,7 +37,231 @@ class QuadTreeTests {
          */
         static void RunRLEPatternTest(const char* pattern_file_name, int num_generations, int64_t origin_x = 0, int64_t origin_y = 0, bool draw_result = true);
 
+        /**
+         * Read in an RLE pattern and jump straight to the specified generation with HashLife power of 2 steps
+         * @param pattern_file_name
+         * @param num_generations
+         * @param origin_x
+         * @param origin_y
+         */
+        static void RunRLEPatternJumpTest(const char* pattern_file_name, uint64_t num_generations, int64_t origin_x = 0, int64_t origin_y = 0, bool draw_result = true);
+
+        /**
+         * Benchmark the canonical node table against the std::unordered_map we used to use.
+         * This runs RunMegaRandomMaxBoundariesTest, then replays a Canonical() lookup for every node that is
+         * left in the table into a fresh node table and a fresh unordered_map, and times both
+         * @param num_nodes
+         * @param num_generations
+         */
+        static void RunNodeTableBenchmark(int64_t num_nodes, int64_t num_generations, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y);
+
+        /**
+         * Benchmark evolving the same random soup with 1, 2, 4... up to max_threads threads, and check that every
+         * run ends up with exactly the same cells as the single threaded run
+         * @param num_nodes
+         * @param num_generations
+         * @param max_threads most threads to try, 0 for one per hardware thread
+         */
+        static void RunThreadScalingBenchmark(int64_t num_nodes, int64_t num_generations, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, int max_threads = 0);
+
+        /**
+         * Run a pattern in a tree with its own store, in two trees that share a store, and in two trees with their own stores
+         * on separate threads, and check that every tree ends up with the same cells
+         * @param pattern_file_name
+         * @param num_generations
+         */
+        static void RunNodeStoreTest(const char* pattern_file_name, int num_generations);
+
+        /**
+         * Benchmark building a tree from a random soup with the bulk loader against setting the cells one at a time,
+         * and check that both give us the same canonical root
+         * @param num_nodes
+         */
+        static void RunBulkLoadBenchmark(int64_t num_nodes, int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y);
+
+        /**
+         * Fill a rectangle with a random soup straight into the tree, check that the same seed gives the same tree
+         * and that adding a full rectangle on top fills it, then evolve it
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         */
+        static void RunRandomSoupTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations);
+
+        /**
+         * Evolve the same random soup with garbage collection stopping the world, running incrementally and sweeping
+         * concurrently, compare the slowest step of each, and check that they all end up with the same cells
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         */
+        static void RunCollectionLatencyTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations);
+
+        /**
+         * Evolve a random soup in one big jump with and without a limit on nodes, which makes the store collect
+         * garbage in the middle of the step, then compare the memory they end up with and check that the cells match
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param exponent jump 2^exponent generations
+         * @param max_nodes pressure limit on the number of nodes
+         */
+        static void RunMemoryPressureTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int exponent, size_t max_nodes);
+
+        /**
+         * Evolve a pattern 2^exponent generations at a time with and without a memo budget, compare the time, peak
+         * memory and nodes created, and check that the cells match. Without a budget, every collection throws away the
+         * results of nodes that aren't reachable any more, even the ones the next step needs again
+         * @param pattern_file_name
+         * @param num_generations
+         * @param exponent step 2^exponent generations at a time
+         * @param max_bytes memo budget
+         */
+        static void RunMemoBudgetTest(const char* pattern_file_name, uint64_t num_generations, int exponent, size_t max_bytes);
+
+        /**
+         * Evolve the same random soup with and without compacting after every collection, compare the time it takes
+         * to step and to build a display list, and the memory left at the end, and check that the cells match
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         */
+        static void RunCompactionTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations);
+
+        /**
+         * Export the cells of a random soup into flat x and y arrays with a QuadTreeCellIterator and compare that with
+         * building a display list, then check that four blocks 2^63 apart, in a tree too tall
+         * for 64 bit offsets, come out right when we read them a few cells at a time
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         */
+        static void RunCellIteratorTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations);
+
+        /**
+         * Query random rectangles of an evolved soup, as cells and as bitmaps, and check them against filtering its
+         * display list, then time a small viewport into a tree with cells 2^62 apart against building the display list
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         * @param num_queries number of random rectangles
+         */
+        static void RunRectQueryTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_queries);
+
+        /**
+         * Render random viewports of an evolved soup at zooms 0 through 7, as density and occupancy, and check them
+         * against counting its display list cell by cell, then time rendering a tree with cells 2^62 apart whole
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         * @param num_viewports number of random viewports at each zoom
+         */
+        static void RunRenderTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_viewports);
+
+        /**
+         * Evolve a soup with a frame writer attached in each format, and check every file it wrote against rendering the
+         * same generations ourselves, then time stepping with and without a writer, and with one whose queue is too short
+         * to keep up, which drops frames instead of slowing the steps down. Then collect and compact after every step
+         * while frames are still being rendered, and check those frames too
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         * @param interval generations between frames
+         */
+        static void RunFrameWriterTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, uint64_t interval);
+
+        /**
+         * Diff an evolving soup against the generation before, whole and in random rectangles, and check it against
+         * comparing the cells before and after, then time a step of a glider next to a field of blocks, where only a few
+         * cells change, against querying all of them. Last, diff parts of a tree with cells 2^62 apart
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         * @param num_queries number of random rectangles
+         */
+        static void RunDiffTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, int num_queries);
+
+        /**
+         * Check the bounding box we find from the edges of the tree against the one from every cell, and every node's
+         * quadrants against its children, for an evolving soup and for a tree with cells 2^62 apart, and time the
+         * bounding box against looking at every cell
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         */
+        static void RunBoundingBoxTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations);
+
+        /**
+         * Checkpoint an evolving soup, resume a second tree from the last checkpoint, and check that both trees end up
+         * with the same cells. Then save and load a tree with cells 2^62 apart, time saving and loading a universe of
+         * over a million nodes, and check that files that aren't whole snapshots are turned down
+         * @param min_x
+         * @param max_x
+         * @param min_y
+         * @param max_y
+         * @param density chance of each cell being alive
+         * @param seed
+         * @param num_generations
+         * @param interval generations between checkpoints
+         */
+        static void RunSnapshotTest(int64_t min_x, int64_t max_x, int64_t min_y, int64_t max_y, double density, uint64_t seed, int64_t num_generations, uint64_t interval);
+
+        /**
+         * Run a pattern one generation at a time and again in steps of a number with several bits set, and compare the
+         * time, nodes created, evolves and memo hits, and check that the cells match. A step like that evolves the same
+         * nodes by several powers of 2 in a row, and each one needs its own memoized result to be found again next step
+         * @param pattern_file_name
+         * @param num_generations
+         * @param step_size generations per step, like 7 for 4 + 2 + 1
+         */
+        static void RunExactStepTest(const char* pattern_file_name, uint64_t num_generations, uint64_t step_size);
+
     private:
+        /**
+         * Shared implementation of RunRLEPatternTest and RunRLEPatternJumpTest
+         * @param jump step all of the generations at once instead of one at a time
+         */
+        static void RunRLEPattern(const char* pattern_file_name, uint64_t num_generations, int64_t origin_x, int64_t origin_y, bool draw_result, bool jump);
+
         /**
          * Read an RLE pattern from a file and output a vector of coordinate pairs
          * Read more about the file format here:
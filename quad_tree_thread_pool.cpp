@@ -0,0 +1,187 @@
+//
+// Created by agent on 10/15/26.
+//
+#include "quad_tree_thread_pool.h"
+
+// worker index of the current thread
+thread_local int QuadTreeThreadPool::worker_index = 0;
+
+/**
+ * Constructs a pool and starts its threads
+ * @param num_threads number of threads that run tasks, including the calling thread, from 1 to kMaxThreads
+ */
+QuadTreeThreadPool::QuadTreeThreadPool(int num_threads) : num_queued(0), num_sleeping(0), stopping(false), num_busy(0), paused(false) {
+    if (num_threads < 1) {
+        num_threads = 1;
+    } else if (num_threads > kMaxThreads) {
+        num_threads = kMaxThreads;
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        workers.push_back(new Worker());
+    }
+    // worker 0 is us, so we only start the rest
+    for (int i = 1; i < num_threads; ++i) {
+        workers[i]->thread = std::thread(&QuadTreeThreadPool::WorkerLoop, this, i);
+    }
+}
+
+/**
+ * Destructor, stops and joins every thread. No tasks may be running
+ */
+QuadTreeThreadPool::~QuadTreeThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_condition.notify_all();
+    for (size_t i = 1; i < workers.size(); ++i) {
+        workers[i]->thread.join();
+    }
+    for (Worker* worker : workers) {
+        delete worker;
+    }
+}
+
+/**
+ * Queue a task on the calling thread's deque
+ * @param group group to add the task to
+ * @param task function to run
+ */
+void QuadTreeThreadPool::Spawn(TaskGroup &group, std::function<void()> task) {
+    Task* queued = new Task();
+    queued->function = std::move(task);
+    queued->group = &group;
+    group.pending.fetch_add(1, std::memory_order_relaxed);
+
+    Worker* worker = workers[worker_index];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->tasks.push_back(queued);
+    }
+    num_queued.fetch_add(1);
+    // only touch the sleep mutex if somebody is actually asleep
+    if (num_sleeping.load() > 0) {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        sleep_condition.notify_one();
+    }
+}
+
+/**
+ * Run tasks until every task in the group has finished
+ * @param group
+ */
+void QuadTreeThreadPool::Wait(TaskGroup &group) {
+    int index = worker_index;
+    // we're not busy while we wait, other than with the tasks we run
+    Leave();
+    while (group.pending.load(std::memory_order_acquire) > 0) {
+        if (!RunTask(index)) {
+            // the rest of our group is running on other threads
+            std::this_thread::yield();
+        }
+    }
+    Enter();
+}
+
+/**
+ * Count the calling thread as busy, which waits if the pool is paused. Worker 0 calls this before it starts
+ * work that spawns tasks from outside of a task
+ */
+void QuadTreeThreadPool::Enter() {
+    while (true) {
+        while (paused.load()) {
+            std::this_thread::yield();
+        }
+        // TryPause() sets paused before it counts the busy threads, so either it sees us or we see it
+        num_busy.fetch_add(1);
+        if (!paused.load()) {
+            return;
+        }
+        num_busy.fetch_sub(1);
+    }
+}
+
+/**
+ * Pause the pool and wait until the calling thread, which has to be busy, is the only busy thread
+ * @return false if another thread paused the pool first, in which case the caller should Park()
+ */
+bool QuadTreeThreadPool::TryPause() {
+    bool expected = false;
+    if (!paused.compare_exchange_strong(expected, true)) {
+        return false;
+    }
+    while (num_busy.load() > 1) {
+        std::this_thread::yield();
+    }
+    return true;
+}
+
+/**
+ * Main loop of the pool's own threads
+ * @param index worker index of this thread
+ */
+void QuadTreeThreadPool::WorkerLoop(int index) {
+    worker_index = index;
+    int spins = 0;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (RunTask(index)) {
+            spins = 0;
+            continue;
+        }
+        if (++spins < kSpinsBeforeSleep) {
+            std::this_thread::yield();
+            continue;
+        }
+        // nothing to do for a while, so sleep until a task gets queued
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        num_sleeping.fetch_add(1);
+        sleep_condition.wait(lock, [this]() {
+            return stopping.load() || num_queued.load() > 0;
+        });
+        num_sleeping.fetch_sub(1);
+        spins = 0;
+    }
+}
+
+/**
+ * Pop a task from our own deque, or steal one from another thread, and run it
+ * @param index worker index of the calling thread
+ * @return true if a task was run
+ */
+bool QuadTreeThreadPool::RunTask(int index) {
+    Task* task = 0;
+    if (num_queued.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    // newest task from our own deque
+    {
+        Worker* worker = workers[index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->tasks.empty()) {
+            task = worker->tasks.back();
+            worker->tasks.pop_back();
+        }
+    }
+    // oldest task from somebody else's
+    int num_workers = (int) workers.size();
+    for (int i = 1; task == 0 && i < num_workers; ++i) {
+        Worker* victim = workers[(index + i) % num_workers];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (!victim->tasks.empty()) {
+            task = victim->tasks.front();
+            victim->tasks.pop_front();
+        }
+    }
+    if (task == 0) {
+        return false;
+    }
+    num_queued.fetch_sub(1, std::memory_order_relaxed);
+
+    Enter();
+    task->function();
+    Leave();
+    // release so whoever waits on the group sees everything the task wrote
+    task->group->pending.fetch_sub(1, std::memory_order_release);
+    delete task;
+    return true;
+}
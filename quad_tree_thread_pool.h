@@ -0,0 +1,183 @@
+//
+// Created by agent on 10/15/26.
+//
+
+#ifndef GOL_QUADTREETHREADPOOL_H
+#define GOL_QUADTREETHREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Work stealing thread pool for evolving quad tree nodes in parallel
+ *
+ * Every thread, including the one that created the pool, has its own deque of tasks. A thread pushes and pops
+ * tasks at the back of its own deque, so it works depth first on the tasks it just spawned while they are still
+ * in cache, and idle threads steal from the front of other deques, which is where the oldest and biggest tasks are.
+ *
+ * Tasks are spawned into a TaskGroup, and Wait() on a group doesn't block: the waiting thread keeps running tasks
+ * until the whole group is done. That way a task can spawn and wait on its own subtasks without tying up a thread.
+ *
+ * Only the thread that created the pool (worker 0) may spawn tasks from outside of a task.
+ *
+ * The pool can be paused so that one thread can have the nodes to itself in the middle of a step, to collect garbage.
+ * Threads count as busy while they run a task, or between Enter() and Leave(), except while they wait on a group.
+ * TryPause() stops busy threads from starting anything new and waits until the caller is the only one left busy.
+ * The others get there by finishing what they're doing, or by calling Park() when they see IsPaused().
+ */
+class QuadTreeThreadPool {
+
+    public:
+
+        // most threads we support, which also sizes per thread tables elsewhere
+        static const int kMaxThreads = 64;
+
+        /**
+         * A set of tasks to wait on
+         */
+        class TaskGroup {
+            public:
+                TaskGroup() : pending(0) {}
+
+            private:
+                friend class QuadTreeThreadPool;
+
+                // number of tasks spawned into this group that haven't finished
+                std::atomic<int> pending;
+        };
+
+        /**
+         * Constructs a pool and starts its threads
+         * @param num_threads number of threads that run tasks, including the calling thread, from 1 to kMaxThreads
+         */
+        explicit QuadTreeThreadPool(int num_threads);
+
+        /**
+         * Destructor, stops and joins every thread. No tasks may be running
+         */
+        ~QuadTreeThreadPool();
+
+        /**
+         * Queue a task on the calling thread's deque
+         * @param group group to add the task to
+         * @param task function to run
+         */
+        void Spawn(TaskGroup &group, std::function<void()> task);
+
+        /**
+         * Run tasks until every task in the group has finished
+         * @param group
+         */
+        void Wait(TaskGroup &group);
+
+        /**
+         * Count the calling thread as busy, which waits if the pool is paused. Worker 0 calls this before it starts
+         * work that spawns tasks from outside of a task
+         */
+        void Enter();
+
+        /**
+         * Stop counting the calling thread as busy
+         */
+        void Leave() { num_busy.fetch_sub(1); }
+
+        /**
+         * Pause the pool and wait until the calling thread, which has to be busy, is the only busy thread
+         * @return false if another thread paused the pool first, in which case the caller should Park()
+         */
+        bool TryPause();
+
+        /**
+         * Let paused threads carry on
+         */
+        void Resume() { paused.store(false); }
+
+        /**
+         * @return true if the pool is paused, so busy threads should Park()
+         */
+        bool IsPaused() const { return paused.load(std::memory_order_relaxed); }
+
+        /**
+         * Wait out a pause without counting as busy
+         */
+        void Park() {
+            Leave();
+            Enter();
+        }
+
+        /**
+         * @return number of threads that run tasks, including the one that created the pool
+         */
+        int NumThreads() const { return (int) workers.size(); }
+
+        /**
+         * @return index of the calling thread, 0 for the thread that created the pool (or any thread outside a pool)
+         * and 1 to NumThreads()-1 for the pool's own threads
+         */
+        static int WorkerIndex() { return worker_index; }
+
+    private:
+
+        /**
+         * A queued function and the group it belongs to
+         */
+        struct Task {
+            std::function<void()> function;
+            TaskGroup* group;
+        };
+
+        /**
+         * A thread's deque of tasks
+         */
+        struct Worker {
+            std::mutex mutex;
+            std::deque<Task*> tasks;
+            std::thread thread;
+        };
+
+        /**
+         * Main loop of the pool's own threads
+         * @param index worker index of this thread
+         */
+        void WorkerLoop(int index);
+
+        /**
+         * Pop a task from our own deque, or steal one from another thread, and run it
+         * @param index worker index of the calling thread
+         * @return true if a task was run
+         */
+        bool RunTask(int index);
+
+    private:
+
+        // one per thread, worker 0 is the thread that created the pool
+        std::vector<Worker*> workers;
+
+        // number of tasks sitting in deques, so idle threads know when to wake up
+        std::atomic<int> num_queued;
+
+        // idle threads sleep on this when there is nothing to steal
+        std::mutex sleep_mutex;
+        std::condition_variable sleep_condition;
+        std::atomic<int> num_sleeping;
+
+        // tells our threads to exit
+        std::atomic<bool> stopping;
+
+        // number of busy threads, and whether one of them has paused the rest
+        std::atomic<int> num_busy;
+        std::atomic<bool> paused;
+
+        // worker index of the current thread
+        static thread_local int worker_index;
+
+        // how many times an idle thread looks for work before it goes to sleep
+        static const int kSpinsBeforeSleep = 64;
+};
+
+#endif //GOL_QUADTREETHREADPOOL_H